@@ -0,0 +1,219 @@
+#include "AsyncPipeline.h"
+#include "ConnectionManager.h"
+
+#include <QRunnable>
+#include <QSqlError>
+
+namespace Database {
+
+class PipelineTaskPrivate : public QRunnable, public RejectableTask
+{
+public:
+	PipelineTaskPrivate(AsyncPipeline *instance, const QList<AsyncPipeline::Step> &steps,
+						bool transaction)
+		: _instance(instance)
+		, _steps(steps)
+		, _transaction(transaction)
+	{
+	}
+
+	void reject() override
+	{
+		AsyncQueryResult result;
+		result._error = AsyncQueryResult::rejectedError();
+		_instance->taskCallback(result);
+	}
+
+	void run() override
+	{
+		AsyncQueryResult result;
+		ConnectionManager* conmgr = ConnectionManager::instance();
+
+		// steps may write, run them on the file if reads are served from a memory replica
+		bool toReplicaSource = conmgr->memoryReplica()->isActive();
+		QString profile = toReplicaSource ? MemoryReplica::sourceProfile() : QString();
+		if (!conmgr->connectionExists(profile)) {
+			if (!conmgr->open(profile, &result._error)) {
+				_instance->taskCallback(result);
+				return;
+			}
+		}
+
+		QSqlDatabase db = conmgr->threadConnection(profile);
+		if (!db.isOpen() && !db.open()) {
+			result._error = db.lastError();
+			_instance->taskCallback(result);
+			return;
+		}
+
+		bool inTransaction = _transaction && db.transaction();
+		if (_transaction && !inTransaction) {
+			result._error = db.lastError();
+			_instance->taskCallback(result);
+			return;
+		}
+
+		QVector<AsyncQueryResult> sets;
+		AsyncQueryResult previous;
+		bool succ = true;
+		for (int i = 0; i < _steps.size() && succ; i++) {
+			QSqlQuery query(db);
+			succ = _steps[i](query, previous);
+
+			AsyncQueryResult cur = stepResult(query);
+			if (!succ && cur.isValid()) {
+				cur._error = QSqlError(QString(),
+						QString("Pipeline step %1 aborted").arg(i + 1),
+						QSqlError::StatementError);
+			}
+			sets.append(cur);
+			previous = cur;
+		}
+
+		if (inTransaction) {
+			if (succ && !db.commit()) {
+				succ = false;
+				previous._error = db.lastError();
+				if (!sets.isEmpty())
+					sets.last()._error = previous._error;
+			}
+			if (!succ)
+				db.rollback();
+		}
+
+		if (toReplicaSource)
+			conmgr->memoryReplica()->requestSync();
+
+		result = previous;
+		result._resultSets = sets;
+		_instance->taskCallback(result);
+	}
+
+private:
+	static AsyncQueryResult stepResult(QSqlQuery &query)
+	{
+		AsyncQueryResult result;
+		result._queryString = query.executedQuery();
+		result.setRecord(query.record());
+		result._error = query.lastError();
+		result._lastInsertId = query.lastInsertId();
+		result._numRowsAffected = query.numRowsAffected();
+
+		if (result.isValid() && query.isActive() && query.isSelect()) {
+			int cols = result._record.count();
+			while (query.next()) {
+				QVector<QVariant> currow(cols);
+				for (int ii = 0; ii < cols; ii++) {
+					if (!query.isNull(ii))
+						currow[ii] = query.value(ii);
+				}
+				result._data.append(currow);
+			}
+		}
+		return result;
+	}
+
+	AsyncPipeline *_instance;
+	QList<AsyncPipeline::Step> _steps;
+	bool _transaction;
+};
+
+/****************************************************************************************/
+/*                                       AsyncPipeline                                  */
+/****************************************************************************************/
+
+AsyncPipeline::AsyncPipeline(QObject *parent)
+	: QObject(parent), logger("Database.AsyncPipeline")
+	, _transaction(false)
+	, _taskCnt(0)
+{
+}
+
+AsyncPipeline::~AsyncPipeline()
+{
+	waitDone();
+}
+
+AsyncPipeline &AsyncPipeline::addStep(const Step &step)
+{
+	QMutexLocker locker(&_mutex);
+	_steps.append(step);
+	return *this;
+}
+
+AsyncPipeline &AsyncPipeline::addQuery(const QString &query)
+{
+	return addStep([query](QSqlQuery &q, const AsyncQueryResult &) {
+		return q.exec(query);
+	});
+}
+
+void AsyncPipeline::clear()
+{
+	QMutexLocker locker(&_mutex);
+	_steps.clear();
+}
+
+int AsyncPipeline::count() const
+{
+	QMutexLocker locker(&_mutex);
+	return _steps.size();
+}
+
+void AsyncPipeline::setTransaction(bool enabled)
+{
+	QMutexLocker locker(&_mutex);
+	_transaction = enabled;
+}
+
+bool AsyncPipeline::transaction() const
+{
+	QMutexLocker locker(&_mutex);
+	return _transaction;
+}
+
+bool AsyncPipeline::isRunning() const
+{
+	QMutexLocker locker(&_mutex);
+	return _taskCnt > 0;
+}
+
+bool AsyncPipeline::start()
+{
+	QMutexLocker locker(&_mutex);
+	if (_steps.isEmpty())
+		return false;
+
+	_taskCnt++;
+	PipelineTaskPrivate *task = new PipelineTaskPrivate(this, _steps, _transaction);
+	// the start may block, the running pipeline must still call back
+	locker.unlock();
+	ConnectionManager::instance()->startTask(task);
+	return true;
+}
+
+bool AsyncPipeline::waitDone(ulong msTimout)
+{
+	QMutexLocker lock(&_mutex);
+	if (_taskCnt > 0)
+		return _waitcondition.wait(&_mutex, msTimout);
+	else
+		return true;
+}
+
+void AsyncPipeline::taskCallback(const AsyncQueryResult &result)
+{
+	if (!result.isValid())
+		qCDebug(logger) << "AsyncPipeline: pipeline failed:" << result.error().text();
+
+	emit execDone(result);
+
+	// wake waitDone() last, the destructor may delete the object then
+	_mutex.lock();
+	_taskCnt--;
+	if (_taskCnt == 0)
+		_waitcondition.wakeAll();
+	_mutex.unlock();
+}
+
+}
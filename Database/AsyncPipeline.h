@@ -0,0 +1,135 @@
+#pragma once
+
+#include "AsyncQueryResult.h"
+
+#include <QList>
+#include <QLoggingCategory>
+#include <QMutex>
+#include <QObject>
+#include <QSqlQuery>
+#include <QWaitCondition>
+
+#include <functional>
+
+namespace Database {
+
+// class forward decl's
+class PipelineTaskPrivate;
+
+/**
+ * @brief Runs a chain of dependent queries back to back on one worker thread.
+ *
+ * @details Each step is a callable which runs on the worker thread. It gets an
+ * unused QSqlQuery on the thread connection of the ConnectionManager and the
+ * result of the previous step, executes its query and returns \c true on
+ * success. All steps share the same connection, there is no event loop hop
+ * between them and execDone() is emitted once when the chain is finished.
+ *
+ * Sample Usage:
+ * \code{.cpp}
+ * Database::AsyncPipeline *pipeline = new Database::AsyncPipeline(this);
+ * pipeline->setTransaction(true);
+ * pipeline->addStep([=](QSqlQuery &query, const Database::AsyncQueryResult &) {
+ *     query.prepare("INSERT INTO Invoice (CustomerId) VALUES (:cust)");
+ *     query.bindValue(":cust", customerId);
+ *     return query.exec();
+ * });
+ * pipeline->addStep([=](QSqlQuery &query, const Database::AsyncQueryResult &prev) {
+ *     query.prepare("INSERT INTO InvoiceLine (InvoiceId, TrackId) VALUES (:inv, :track)");
+ *     query.bindValue(":inv", prev.lastInsertId());
+ *     query.bindValue(":track", trackId);
+ *     return query.exec();
+ * });
+ * connect(pipeline, &Database::AsyncPipeline::execDone, ...);
+ * pipeline->start();
+ * \endcode
+ *
+ * @note Steps run on a worker thread, captured data must be thread safe.
+ */
+class AsyncPipeline : public QObject
+{
+	friend class PipelineTaskPrivate;
+	Q_OBJECT
+
+public:
+	/**
+	 * @brief A pipeline step.
+	 * @param query Unused query on the thread connection.
+	 * @param previous Result of the previous step, empty for the first step.
+	 * @returns \c false to abort the pipeline.
+	 */
+	typedef std::function<bool(QSqlQuery &query, const AsyncQueryResult &previous)> Step;
+
+	explicit AsyncPipeline(QObject *parent = nullptr);
+	virtual ~AsyncPipeline();
+
+	/**
+	 * @brief Append \p step to the pipeline.
+	 */
+	AsyncPipeline &addStep(const Step &step);
+
+	/**
+	 * @brief Append a step executing the plain sql \p query.
+	 */
+	AsyncPipeline &addQuery(const QString &query);
+
+	/**
+	 * @brief Remove all steps.
+	 */
+	void clear();
+
+	/**
+	 * @brief Number of steps.
+	 */
+	int count() const;
+
+	/**
+	 * @brief Run all steps in one transaction (default \c false).
+	 * @details If a step fails the transaction is rolled back.
+	 */
+	void setTransaction(bool enabled);
+	bool transaction() const;
+
+	/**
+	 * @brief Is a pipeline running.
+	 */
+	bool isRunning() const;
+
+	/**
+	 * @brief Run the current steps in the QThreadPool.
+	 * @details The steps are copied, the pipeline can be changed or started
+	 * again while it runs.
+	 * @returns \c false if there are no steps.
+	 */
+	bool start();
+
+	/**
+	 * @brief Wait for all started pipelines to finish.
+	 */
+	bool waitDone(ulong msTimout = ULONG_MAX);
+
+signals:
+	/**
+	 * @brief Is emitted when a started pipeline is finished.
+	 * @details \p result is the result of the last executed step,
+	 * AsyncQueryResult::resultSets() holds the results of all executed steps.
+	 * If a step failed, it is the last one and its error is the error of
+	 * \p result. If the commit fails, its error is set on \p result and on
+	 * the last result set.
+	 */
+	void execDone(const Database::AsyncQueryResult &result);
+
+private:
+	// attention lives in the context of QRunable
+	void taskCallback(const AsyncQueryResult &result);
+
+	QLoggingCategory logger;
+
+	mutable QMutex _mutex;
+	QWaitCondition _waitcondition;
+	QList<Step> _steps;
+	bool _transaction;
+	int _taskCnt;
+};
+
+}
@@ -1,296 +1,1481 @@
-#include "AsyncQuery.h"
-#include "ConnectionManager.h"
-
-#include <QRunnable>
-#include <QSqlQuery>
-#include <QThreadPool>
-#include <QQueue>
-
-
-namespace Database {
-
-class SqlTaskPrivate : public QRunnable
-{
-public:
-	SqlTaskPrivate(AsyncQuery *instance, AsyncQuery::QueuedQuery query,
-				   ulong delayMs = 0);
-
-	void run() override;
-
-private:
-	AsyncQuery* _instance;
-	AsyncQuery::QueuedQuery _query;
-	ulong _delayMs;
-
-};
-
-SqlTaskPrivate::SqlTaskPrivate(AsyncQuery *instance, AsyncQuery::QueuedQuery query,
-							   ulong delayMs)
-	: _instance(instance)
-	, _query(query)
-	, _delayMs(delayMs)
-{
-}
-
-void SqlTaskPrivate::run()
-{
-	Q_ASSERT(_instance);
-
-	AsyncQueryResult result;
-	ConnectionManager* conmgr = ConnectionManager::instance();
-	if (!conmgr->connectionExists()) {
-		if (!conmgr->open(&result._error))
-		{
-			result._queryString = _query.query;
-			_instance->taskCallback(result);
-			return;
-		}
-	}
-
-	QSqlDatabase db = conmgr->threadConnection();
-	if (!db.isOpen() && !db.open())
-	{
-		result._queryString = _query.query;
-		result._error = db.lastError();
-		_instance->taskCallback(result);
-		return;
-	}
-
-	//delay query
-	if (_delayMs > 0) {
-		QThread::currentThread()->msleep(_delayMs);
-	}
-
-	QSqlQuery query = QSqlQuery(db);
-	bool succ = true;
-	if (_query.isPrepared) {
-		succ = query.prepare(_query.query);
-		//bind values
-		QMapIterator<QString, QVariant> i(_query.boundValues);
-		while (i.hasNext()) {
-			i.next();
-			query.bindValue(i.key(), i.value());
-		}
-	}
-	if (succ) {
-		if (_query.isPrepared) {
-			if (_query.isBatch) {
-				query.execBatch();
-			}
-			else {
-				query.exec();
-			}
-		}
-		else {
-			query.exec(_query.query);
-		}
-	}
-
-	result._queryString = query.executedQuery();
-	result._record = query.record();
-	result._error = query.lastError();
-	result._lastInsertId = query.lastInsertId();
-	result._numRowsAffected = query.numRowsAffected();
-	int cols = result._record.count();
-
-	while (query.next()) {
-		QVector<QVariant> currow(cols);
-
-		for (int ii = 0; ii < cols; ii++) {
-			if (query.isNull(ii)) {
-				currow[ii] = QVariant();
-			}
-			else {
-				currow[ii] = query.value(ii);
-			}
-		}
-		result._data.append(currow);
-	}
-
-	//send result
-	_instance->taskCallback(result);
-}
-
-/****************************************************************************************/
-/*                                          AsyncQuery                                  */
-/****************************************************************************************/
-
-
-AsyncQuery::AsyncQuery(QObject* parent /* = nullptr */)
-	: QObject(parent), logger("Database.AsyncQuery")
-	, _deleteOnDone(false)
-	, _delayMs(0)
-	, _mode(Mode_Parallel)
-	, _taskCnt(0)
-	, _isBatch(false)
-{
-}
-
-AsyncQuery::~AsyncQuery()
-{
-}
-
-void AsyncQuery::setMode(AsyncQuery::Mode mode)
-{
-	QMutexLocker locker(&_mutex);
-	_mode = mode;
-}
-
-AsyncQuery::Mode AsyncQuery::mode()
-{
-	QMutexLocker locker(&_mutex);
-	return _mode;
-}
-
-bool AsyncQuery::isRunning() const
-{
-	QMutexLocker lock(&_mutex);
-	return (_taskCnt > 0);
-}
-
-QString AsyncQuery::query() const
-{
-	return _curQuery.query;
-}
-
-AsyncQueryResult AsyncQuery::result() const
-{
-	QMutexLocker lock(&_mutex);
-	return _result;
-}
-
-void AsyncQuery::prepare(const QString &query)
-{
-	_curQuery.query = query;
-}
-
-bool AsyncQuery::bindValue(const QString &placeholder, const QVariant &val)
-{
-	if (_isBatch)
-		return false;
-
-	_curQuery.boundValues[placeholder] = val;
-	return true;
-}
-
-bool AsyncQuery::bindBatchValue(const QString &placeholder, const QVariantList &values)
-{
-	if (values.isEmpty())
-		return false;
-
-	QVariant::Type type = values.first().type();
-	for (const auto &val : values)
-		if (val.type() != type)
-			return false;
-
-	bindValue(placeholder, values);
-	_isBatch = true;
-	return true;
-}
-
-void AsyncQuery::startExec()
-{
-	_curQuery.isPrepared = true;
-	_curQuery.isBatch = _isBatch;
-	startExecIntern();
-}
-
-void AsyncQuery::startExec(const QString &query)
-{
-	_curQuery.isPrepared = false;
-	_curQuery.query = query;
-	startExecIntern();
-
-}
-
-bool AsyncQuery::waitDone(ulong msTimout)
-{
-	QMutexLocker lock(&_mutex);
-	if (_taskCnt > 0)
-		return _waitcondition.wait(&_mutex, msTimout);
-	else
-		return true;
-}
-
-void AsyncQuery::startExecOnce(const QString &query, QObject *receiver, const char *member)
-{
-	AsyncQuery *q = new AsyncQuery();
-	q->_deleteOnDone = true;
-	connect(q, SIGNAL(execDone(Database::AsyncQueryResult)),
-			receiver, member);
-	q->startExec(query);
-}
-
-void AsyncQuery::setDelayMs(ulong ms)
-{
-	QMutexLocker locker(&_mutex);
-	_delayMs = ms;
-}
-
-void AsyncQuery::startExecIntern()
-{
-	QMutexLocker lock(&_mutex);
-	if (_mode == Mode_Parallel) {
-		QThreadPool* pool = QThreadPool::globalInstance();
-		SqlTaskPrivate* task = new SqlTaskPrivate(this, _curQuery, _delayMs);
-		incTaskCount();
-		pool->start(task);
-	} else {
-		if (_taskCnt == 0) {
-			QThreadPool* pool = QThreadPool::globalInstance();
-			SqlTaskPrivate* task = new SqlTaskPrivate(this, _curQuery, _delayMs);
-			incTaskCount();
-			pool->start(task);
-		} else {
-			if (_mode == Mode_Fifo) {
-				_ququ.enqueue(_curQuery);
-			} else {
-				_ququ.clear();
-				_ququ.enqueue(_curQuery);
-			}
-		}
-	}
-}
-
-void AsyncQuery::incTaskCount()
-{
-	bool busyChanged = _taskCnt == 0;
-	_taskCnt++;
-	if (busyChanged)
-		emit AsyncQuery::busyChanged(true);
-}
-
-void AsyncQuery::decTaskCount()
-{
-	bool busyChanged = _taskCnt == 1;
-	_taskCnt--;
-	if (busyChanged)
-		emit AsyncQuery::busyChanged(false);
-}
-
-void AsyncQuery::taskCallback(const AsyncQueryResult& result)
-{
-	_mutex.lock();
-	Q_ASSERT(_taskCnt > 0);
-	_result = result;
-	if (_mode != Mode_Parallel && !_ququ.isEmpty()) {
-		//start next query if queue not empty
-		QueuedQuery query = _ququ.dequeue();
-		QThreadPool* pool = QThreadPool::globalInstance();
-		SqlTaskPrivate* task = new SqlTaskPrivate(this, query, _delayMs);
-		pool->start(task);
-	} else {
-		decTaskCount();
-	}
-
-	_waitcondition.wakeAll();
-	_mutex.unlock();
-
-	emit execDone(result);
-
-	if (_deleteOnDone) {
-		// note delete later should be thread save
-		deleteLater();
-	}
-}
-}
+#include "AsyncQuery.h"
+#include "AsyncSession.h"
+#include "ConnectionManager.h"
+#include "DeliveryQueue.h"
+#include "MemoryReplica.h"
+#include "ResultWriter.h"
+
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QRegularExpression>
+#include <QRunnable>
+#include <QScopedPointer>
+#include <QSqlDriver>
+#include <QSqlQuery>
+#include <QQueue>
+
+#include <climits>
+
+#ifdef ASYNCSQL_SQLITE_API
+#include <sqlite3.h>
+#endif
+
+namespace Database {
+
+/**
+ * @brief Rewrites <tt>INSERT ... VALUES (:a, :b)</tt> to a multi-row
+ * <tt>INSERT ... VALUES (:a_r0, :b_r0), (:a_r1, :b_r1), ...</tt>
+ */
+class MultiRowInsert
+{
+public:
+	/** Bound parameters per statement, SQLite's default SQLITE_MAX_VARIABLE_NUMBER */
+	static const int maxParameters = 999;
+
+	/**
+	 * @brief Split \p sql into the statement head and the value tuple.
+	 * @returns \c false if \p sql is no single-tuple INSERT, has anything but
+	 * a semicolon after the tuple (e.g. an <tt>ON CONFLICT</tt> clause) or uses
+	 * other than the named \p placeholders.
+	 */
+	bool parse(const QString &sql, const QStringList &placeholders)
+	{
+		static const QRegularExpression re(
+			"^\\s*(INSERT\\s.*?\\bVALUES\\s*)\\(",
+			QRegularExpression::CaseInsensitiveOption
+				| QRegularExpression::DotMatchesEverythingOption);
+		static const QRegularExpression tail("^\\s*;?\\s*$");
+		QRegularExpressionMatch match = re.match(sql);
+		if (!match.hasMatch() || placeholders.isEmpty())
+			return false;
+
+		// the tuple ends at its balanced closing parenthesis
+		int begin = match.capturedEnd(0);
+		int end = begin;
+		for (int depth = 1; end < sql.size(); end++) {
+			if (sql.at(end) == QLatin1Char('('))
+				depth++;
+			else if (sql.at(end) == QLatin1Char(')') && --depth == 0)
+				break;
+		}
+		if (end >= sql.size() || !tail.match(sql.midRef(end + 1)).hasMatch())
+			return false;
+
+		_head = match.captured(1);
+		_segments.clear();
+		_placeholders.clear();
+
+		// split the tuple into literal text and placeholder references
+		QString tuple = sql.mid(begin, end - begin);
+		QString literal;
+		int found = 0;
+		for (int i = 0; i < tuple.size(); i++) {
+			QChar c = tuple.at(i);
+			if (c == QLatin1Char('?') || c == QLatin1Char('\'') || c == QLatin1Char('"'))
+				return false;
+			if (c == QLatin1Char(':') || c == QLatin1Char('@')) {
+				int end = i + 1;
+				while (end < tuple.size()
+					   && (tuple.at(end).isLetterOrNumber() || tuple.at(end) == QLatin1Char('_')))
+					end++;
+				QString name = tuple.mid(i, end - i);
+				if (placeholders.contains(name)) {
+					_segments << literal;
+					_placeholders << name;
+					literal.clear();
+					found++;
+					i = end - 1;
+					continue;
+				}
+			}
+			literal += c;
+		}
+		_segments << literal;
+		return found > 0;
+	}
+
+	QString statement(int rows) const
+	{
+		QString sql = _head;
+		for (int r = 0; r < rows; r++) {
+			if (r > 0)
+				sql += QLatin1String(", ");
+			sql += QLatin1Char('(');
+			for (int i = 0; i < _placeholders.size(); i++)
+				sql += _segments[i] + placeholder(_placeholders[i], r);
+			sql += _segments.last() + QLatin1Char(')');
+		}
+		return sql;
+	}
+
+	static QString placeholder(const QString &name, int row)
+	{
+		return name + QLatin1String("_r") + QString::number(row);
+	}
+
+private:
+	QString _head;
+	QStringList _segments;
+	QStringList _placeholders;
+};
+
+#ifdef ASYNCSQL_SQLITE_API
+static int sqliteProgressHandler(void *deadline)
+{
+	return QDateTime::currentMSecsSinceEpoch() >= *static_cast<qint64 *>(deadline);
+}
+#endif
+
+/**
+ * @brief Arms a driver level statement timeout for the remaining time until
+ * \p deadline while in scope.
+ *
+ * - QSQLITE: busy timeout, plus a progress handler interrupting the statement
+ *   if built with ASYNCSQL_SQLITE_API
+ * - QPSQL: statement_timeout
+ * - QMYSQL: max_execution_time (MySQL >= 5.7.8, SELECT only)
+ */
+class StatementTimeoutPrivate
+{
+public:
+	StatementTimeoutPrivate(QSqlDatabase &db, qint64 deadline)
+		: _db(db)
+		, _deadline(deadline)
+		, _armed(false)
+		, _busyTimeout(-1)
+	{
+		if (_deadline <= 0)
+			return;
+
+		qint64 remaining = qMax<qint64>(1, _deadline - QDateTime::currentMSecsSinceEpoch());
+		QString driver = _db.driverName();
+		QSqlQuery query(_db);
+		if (driver.startsWith("QSQLITE")) {
+			if (query.exec("PRAGMA busy_timeout") && query.next())
+				_busyTimeout = query.value(0).toInt();
+			query.exec(QString("PRAGMA busy_timeout = %1").arg(remaining));
+#ifdef ASYNCSQL_SQLITE_API
+			sqlite3 *handle = sqliteHandle();
+			if (handle)
+				sqlite3_progress_handler(handle, 1000, sqliteProgressHandler, &_deadline);
+#endif
+			_armed = true;
+		} else if (driver.startsWith("QPSQL")) {
+			_armed = query.exec(QString("SET statement_timeout = %1").arg(remaining));
+		} else if (driver.startsWith("QMYSQL")) {
+			_armed = query.exec(QString("SET SESSION max_execution_time = %1").arg(remaining));
+		}
+	}
+
+	~StatementTimeoutPrivate()
+	{
+		if (!_armed)
+			return;
+
+		QString driver = _db.driverName();
+		QSqlQuery query(_db);
+		if (driver.startsWith("QSQLITE")) {
+#ifdef ASYNCSQL_SQLITE_API
+			sqlite3 *handle = sqliteHandle();
+			if (handle)
+				sqlite3_progress_handler(handle, 0, nullptr, nullptr);
+#endif
+			if (_busyTimeout >= 0)
+				query.exec(QString("PRAGMA busy_timeout = %1").arg(_busyTimeout));
+		} else if (driver.startsWith("QPSQL")) {
+			query.exec("RESET statement_timeout");
+		} else if (driver.startsWith("QMYSQL")) {
+			query.exec("SET SESSION max_execution_time = DEFAULT");
+		}
+	}
+
+private:
+#ifdef ASYNCSQL_SQLITE_API
+	sqlite3 *sqliteHandle() const
+	{
+		QVariant v = _db.driver()->handle();
+		if (v.isValid() && qstrcmp(v.typeName(), "sqlite3*") == 0)
+			return *static_cast<sqlite3 **>(v.data());
+		return nullptr;
+	}
+#endif
+
+	QSqlDatabase &_db;
+	qint64 _deadline;
+	bool _armed;
+	int _busyTimeout;
+};
+
+class SqlTaskPrivate : public QRunnable, public RejectableTask
+{
+public:
+	SqlTaskPrivate(AsyncQuery *instance, AsyncQuery::QueuedQuery query,
+				   ulong delayMs = 0);
+
+	typedef std::function<void(const AsyncQueryResult &)> OnceCallback;
+
+	/**
+	 * @brief Get a task for AsyncQuery::startExecOnce() from the free list.
+	 * @details Once tasks have no AsyncQuery instance, they pass the result
+	 * to \p callback and return to the free list after run().
+	 */
+	static SqlTaskPrivate *acquireOnce(const AsyncQuery::QueuedQuery &query,
+									   OnceCallback callback);
+
+	void run() override;
+	void reject() override;
+
+private:
+	void finish(const AsyncQueryResult &result);
+
+	void execute(QSqlDatabase &db, const QString &sql, AsyncQueryResult &result);
+	void applyToReplica(const QString &sql, const AsyncQueryResult &result);
+	void execQuery(QSqlDatabase &db, const QString &sql, AsyncQueryResult &result);
+	void logSlowQuery(QSqlDatabase &db, const QString &sql, const AsyncQueryResult &result,
+					  qint64 queueMs, qint64 execMs);
+	void execScript(QSqlDatabase &db, const QString &script, AsyncQueryResult &result);
+	void fetchNextResults(QSqlQuery &query, AsyncQueryResult &result);
+	void execChunkedBatch(QSqlDatabase &db, const QString &sql, AsyncQueryResult &result);
+	void fetchRows(QSqlQuery &query, AsyncQueryResult &result);
+	void applyColumnHints(AsyncQueryResult &result);
+	void exportRows(QSqlQuery &query, AsyncQueryResult &result);
+
+	AsyncQuery* _instance;
+	AsyncQuery::QueuedQuery _query;
+	ulong _delayMs;
+	OnceCallback _callback;
+	/** rows streamed by exportRows(), the result holds none */
+	qint64 _exportedRows;
+
+};
+
+SqlTaskPrivate::SqlTaskPrivate(AsyncQuery *instance, AsyncQuery::QueuedQuery query,
+							   ulong delayMs)
+	: _instance(instance)
+	, _query(query)
+	, _delayMs(delayMs)
+	, _exportedRows(0)
+{
+}
+
+namespace {
+
+// free list of startExecOnce() tasks
+const int maxOnceTasks = 64;
+QMutex onceTasksMutex;
+QVector<SqlTaskPrivate*> onceTasks;
+
+}
+
+SqlTaskPrivate *SqlTaskPrivate::acquireOnce(const AsyncQuery::QueuedQuery &query,
+											OnceCallback callback)
+{
+	SqlTaskPrivate *task = nullptr;
+	onceTasksMutex.lock();
+	if (!onceTasks.isEmpty())
+		task = onceTasks.takeLast();
+	onceTasksMutex.unlock();
+
+	if (task) {
+		task->_query = query;
+	} else {
+		task = new SqlTaskPrivate(nullptr, query);
+		task->setAutoDelete(false);
+	}
+	task->_callback = std::move(callback);
+	return task;
+}
+
+void SqlTaskPrivate::reject()
+{
+	AsyncQueryResult result;
+	result._queryString = _query.query;
+	result._error = AsyncQueryResult::rejectedError();
+	finish(result);
+}
+
+void SqlTaskPrivate::finish(const AsyncQueryResult &result)
+{
+	if (_instance) {
+		_instance->taskCallback(result);
+		return;
+	}
+
+	OnceCallback callback;
+	callback.swap(_callback);
+	_query = AsyncQuery::QueuedQuery();
+	callback(result);
+
+	// nothing may touch the task after it is back in the free list
+	onceTasksMutex.lock();
+	bool pooled = onceTasks.size() < maxOnceTasks;
+	if (pooled)
+		onceTasks.append(this);
+	onceTasksMutex.unlock();
+	if (!pooled)
+		delete this;
+}
+
+/**
+ * @brief Value of column \p col of the current row, QVariant() for NULL.
+ * @details Drivers return an empty blob or text as a null QByteArray or
+ * QString; it is made non-null so it stays distinguishable from NULL.
+ */
+static QVariant cellValue(const QSqlQuery &query, int col)
+{
+	if (query.isNull(col))
+		return QVariant();
+	QVariant val = query.value(col);
+	if (val.isNull() && val.type() == QVariant::ByteArray)
+		return QByteArray("", 0);
+	if (val.isNull() && val.type() == QVariant::String)
+		return QString::fromUtf8("", 0);
+	return val;
+}
+
+/**
+ * @brief Wrap \p query to sort its rows by the 1-based column position.
+ * Statements which return no rows (INSERT, UPDATE, ...) are returned as is.
+ */
+static QString orderedQuery(const QString &query, int column, Qt::SortOrder order)
+{
+	if (!MemoryReplica::isQuery(query))
+		return query;
+
+	QString inner = query.trimmed();
+	while (inner.endsWith(QLatin1Char(';'))) {
+		inner.chop(1);
+		inner = inner.trimmed();
+	}
+	return QString("SELECT * FROM (%1) AS AsyncQueryOrdered ORDER BY %2 %3")
+		.arg(inner, QString::number(column + 1),
+			 order == Qt::AscendingOrder ? QString("ASC") : QString("DESC"));
+}
+
+/**
+ * @brief Split \p script into statements on ';' outside of quotes and comments.
+ * @details Comments are replaced by a space, a line comment keeps its line
+ * break. The BEGIN ... END body of a CREATE TRIGGER statement is not split.
+ */
+static QStringList splitStatements(const QString &script)
+{
+	QStringList statements;
+	QString cur;
+	QChar quote;
+	bool lineComment = false;
+	bool blockComment = false;
+
+	// keywords of the current statement, to find trigger bodies
+	QString word;
+	QStringList head;
+	bool trigger = false;
+	int depth = 0;
+	auto endWord = [&]() {
+		if (word.isEmpty())
+			return;
+		QString keyword = word.toUpper();
+		word.clear();
+		if (head.size() < 3) {
+			head << keyword;
+			trigger = trigger || (head.first() == QLatin1String("CREATE")
+					&& keyword == QLatin1String("TRIGGER"));
+		}
+		if (!trigger)
+			return;
+		if (keyword == QLatin1String("BEGIN") || keyword == QLatin1String("CASE"))
+			depth++;
+		else if (keyword == QLatin1String("END") && depth > 0)
+			depth--;
+	};
+
+	for (int i = 0; i < script.size(); i++) {
+		QChar c = script.at(i);
+		QChar next = i + 1 < script.size() ? script.at(i + 1) : QChar();
+
+		if (lineComment) {
+			if (c == QLatin1Char('\n')) {
+				lineComment = false;
+				cur += c;
+			}
+		} else if (blockComment) {
+			if (c == QLatin1Char('*') && next == QLatin1Char('/')) {
+				blockComment = false;
+				i++;
+			}
+		} else if (!quote.isNull()) {
+			cur += c;
+			if (c == quote)
+				quote = QChar();
+		} else if (c.isLetterOrNumber() || c == QLatin1Char('_')) {
+			cur += c;
+			word += c;
+		} else {
+			endWord();
+			if (c == QLatin1Char('\'') || c == QLatin1Char('"') || c == QLatin1Char('`')) {
+				cur += c;
+				quote = c;
+			} else if (c == QLatin1Char('-') && next == QLatin1Char('-')) {
+				cur += QLatin1Char(' ');
+				lineComment = true;
+				i++;
+			} else if (c == QLatin1Char('/') && next == QLatin1Char('*')) {
+				cur += QLatin1Char(' ');
+				blockComment = true;
+				i++;
+			} else if (c == QLatin1Char(';') && depth == 0) {
+				if (!cur.trimmed().isEmpty())
+					statements.append(cur.trimmed());
+				cur.clear();
+				head.clear();
+				trigger = false;
+			} else {
+				cur += c;
+			}
+		}
+	}
+	endWord();
+	if (!cur.trimmed().isEmpty())
+		statements.append(cur.trimmed());
+	return statements;
+}
+
+void SqlTaskPrivate::run()
+{
+	Q_ASSERT(_instance || _callback);
+
+	AsyncQueryResult result;
+	ConnectionManager* conmgr = ConnectionManager::instance();
+
+	QString sql = _query.query;
+	if (_query.orderByColumn >= 0 && !_query.isBatch && !_query.isScript) {
+		sql = orderedQuery(sql, _query.orderByColumn, _query.orderBy);
+	}
+
+	//the snapshot was served by startExecIntern(), store the fresh result
+	ResultCache *cache = conmgr->resultCache();
+	bool useCache = _query.useCache && cache->isEnabled();
+	QString cacheKey;
+	if (useCache) {
+		cacheKey = cache->key(sql, _query.boundValues, _query.profile);
+	}
+
+	//drop queries which waited past their deadline
+	if (_query.deadline > 0 && QDateTime::currentMSecsSinceEpoch() >= _query.deadline) {
+		result._queryString = _query.query;
+		result._error = AsyncQueryResult::timeoutError();
+		conmgr->metrics()->queryDropped();
+		finish(result);
+		return;
+	}
+
+	//writes bypass the in-memory replica, a session keeps all statements on one connection
+	QString profile = _query.profile;
+	bool replicaActive = profile.isEmpty() && conmgr->memoryReplica()->isActive();
+	bool replicaWrite = replicaActive && !_query.isExport
+			&& (_query.isScript || _query.isBatch || MemoryReplica::isWrite(sql));
+	if (replicaWrite || (replicaActive && _query.session)) {
+		profile = MemoryReplica::sourceProfile();
+	}
+
+	if (!conmgr->connectionExists(profile)) {
+		if (!conmgr->open(profile, &result._error))
+		{
+			result._queryString = _query.query;
+			finish(result);
+			return;
+		}
+	}
+
+	QSqlDatabase db = conmgr->threadConnection(profile);
+	if (!db.isOpen() && !db.open())
+	{
+		result._queryString = _query.query;
+		result._error = db.lastError();
+		finish(result);
+		return;
+	}
+
+	//delay query
+	if (_delayMs > 0) {
+		QThread::currentThread()->msleep(_delayMs);
+	}
+
+	qint64 queueMs = _query.startedAt > 0 ?
+		QDateTime::currentMSecsSinceEpoch() - _query.startedAt : 0;
+	//the copy must see the writes in the order of the file
+	QMutexLocker replicaLocker(replicaWrite && !_query.session ?
+		&conmgr->memoryReplica()->_writeMutex : nullptr);
+	QElapsedTimer execTimer;
+	execTimer.start();
+	{
+		StatementTimeoutPrivate timeout(db, _query.deadline);
+		execute(db, sql, result);
+	}
+	if (!result.isValid() && _query.deadline > 0
+			&& QDateTime::currentMSecsSinceEpoch() >= _query.deadline) {
+		result._error = AsyncQueryResult::timeoutError();
+	}
+
+	double execMs = execTimer.nsecsElapsed() / 1e6;
+	int rows = _query.isExport ? int(qMin<qint64>(_exportedRows, INT_MAX))
+			: qMax(0, result.count() > 0 ? result.count() : result.numRowsAffected());
+	conmgr->statementStats()->record(sql, execMs, rows, !result.isValid());
+	conmgr->metrics()->queryExecuted(queueMs, execMs, !result.isValid(), result.isTimeout());
+	logSlowQuery(db, sql, result, queueMs, qint64(execMs));
+
+	if (replicaWrite) {
+		if (!result.isValid() || _query.session) {
+			//a script or batch may have failed part way, a session transaction
+			//may be open: reload, for a session once COMMIT ran too
+			conmgr->memoryReplica()->requestSync();
+		} else {
+			applyToReplica(sql, result);
+		}
+	}
+	replicaLocker.unlock();
+
+	if (useCache && result.isValid()) {
+		cache->store(cacheKey, result);
+	}
+
+	//send result
+	finish(result);
+}
+
+void SqlTaskPrivate::execute(QSqlDatabase &db, const QString &sql, AsyncQueryResult &result)
+{
+	if (_query.isScript) {
+		execScript(db, sql, result);
+	} else if (_query.isBatch && _query.batchChunkSize > 0) {
+		execChunkedBatch(db, sql, result);
+	} else {
+		execQuery(db, sql, result);
+	}
+}
+
+void SqlTaskPrivate::applyToReplica(const QString &sql, const AsyncQueryResult &result)
+{
+	ConnectionManager *conmgr = ConnectionManager::instance();
+	MemoryReplica *replica = conmgr->memoryReplica();
+	// only a single statement gives the same result when repeated
+	bool repeat = replica->syncMode() == MemoryReplica::Sync_WriteThrough
+			&& !_query.isScript && !_query.isBatch && !_query.multiResult
+			&& MemoryReplica::isDeterministic(sql);
+	if (repeat && (conmgr->connectionExists() || conmgr->open())) {
+		QSqlQuery query(conmgr->threadConnection());
+		// triggers may do anything, their effects can not be compared
+		bool succ = query.exec("SELECT 1 FROM sqlite_master WHERE type = 'trigger' LIMIT 1")
+				&& !query.next();
+		query.finish();
+		// no signals and no result, the caller got them from the file
+		if (succ && _query.isPrepared) {
+			succ = query.prepare(sql);
+			for (auto it = _query.boundValues.constBegin(); it != _query.boundValues.constEnd(); ++it)
+				query.bindValue(it.key(), it.value());
+			succ = succ && query.exec();
+		} else if (succ) {
+			succ = query.exec(sql);
+		}
+		// the same rows and the same generated key, else the copy differs
+		succ = succ && query.numRowsAffected() == result.numRowsAffected();
+		if (succ && MemoryReplica::generatesKey(sql) && result.numRowsAffected() > 0)
+			succ = query.lastInsertId() == result.lastInsertId();
+		if (succ)
+			return;
+	}
+	// periodic mode, not repeatable or the copy missed or changed the write
+	replica->requestSync();
+}
+
+void SqlTaskPrivate::execQuery(QSqlDatabase &db, const QString &sql,
+							   AsyncQueryResult &result)
+{
+	QSqlQuery query = QSqlQuery(db);
+	if (_query.isExport) {
+		query.setForwardOnly(true);
+	}
+	bool succ = true;
+	if (_query.isPrepared) {
+		succ = query.prepare(sql);
+		//bind values
+		QMapIterator<QString, QVariant> i(_query.boundValues);
+		while (i.hasNext()) {
+			i.next();
+			query.bindValue(i.key(), i.value());
+		}
+	}
+	if (succ) {
+		if (_query.isPrepared) {
+			if (_query.isBatch) {
+				query.execBatch();
+			}
+			else {
+				query.exec();
+			}
+		}
+		else {
+			query.exec(sql);
+		}
+	}
+
+	result._queryString = query.executedQuery();
+	result.setRecord(query.record());
+	result._error = query.lastError();
+	result._lastInsertId = query.lastInsertId();
+	result._numRowsAffected = query.numRowsAffected();
+	if (result.isValid()) {
+		if (_query.isExport) {
+			exportRows(query, result);
+		} else {
+			fetchRows(query, result);
+			if (_query.multiResult) {
+				fetchNextResults(query, result);
+			}
+		}
+	}
+}
+
+void SqlTaskPrivate::logSlowQuery(QSqlDatabase &db, const QString &sql,
+								  const AsyncQueryResult &result, qint64 queueMs, qint64 execMs)
+{
+	SlowQueryLog *log = ConnectionManager::instance()->slowQueryLog();
+	if (!log->isEnabled() || execMs < log->thresholdMs())
+		return;
+
+	SlowQueryLog::Entry entry;
+	entry.timestamp = QDateTime::currentDateTime();
+	entry.query = sql;
+	entry.boundValues = _query.boundValues;
+	entry.queueMs = queueMs;
+	entry.execMs = execMs;
+	entry.rows = result.count() > 0 ? result.count() : qMax(0, result.numRowsAffected());
+	entry.connection = db.connectionName();
+	if (!result.isValid())
+		entry.error = result.error().text();
+	//plans of single statements only, a batch would be explained per row
+	if (log->capturePlan() && !_query.isBatch && !_query.isScript)
+		entry.plan = SlowQueryLog::explain(db, sql, _query.boundValues, _query.isPrepared);
+	log->record(entry);
+}
+
+void SqlTaskPrivate::fetchNextResults(QSqlQuery &query, AsyncQueryResult &result)
+{
+	AsyncQueryResult first = result;
+	result._resultSets.append(first);
+	while (query.nextResult()) {
+		AsyncQueryResult set;
+		set._queryString = result._queryString;
+		set.setRecord(query.record());
+		set._error = query.lastError();
+		set._numRowsAffected = query.numRowsAffected();
+		if (set.isValid()) {
+			fetchRows(query, set);
+		}
+		result._resultSets.append(set);
+		if (!set.isValid()) {
+			result._error = set._error;
+			break;
+		}
+	}
+}
+
+void SqlTaskPrivate::execScript(QSqlDatabase &db, const QString &script,
+								AsyncQueryResult &result)
+{
+	const QStringList statements = splitStatements(script);
+	for (const QString &statement : statements) {
+		QSqlQuery query(db);
+		query.exec(statement);
+
+		AsyncQueryResult set;
+		set._queryString = query.executedQuery();
+		set.setRecord(query.record());
+		set._error = query.lastError();
+		set._lastInsertId = query.lastInsertId();
+		set._numRowsAffected = query.numRowsAffected();
+		if (set.isValid()) {
+			fetchRows(query, set);
+		}
+
+		//the result itself mirrors the first result set
+		if (result._resultSets.isEmpty()) {
+			result = set;
+		}
+		result._resultSets.append(set);
+		if (!set.isValid()) {
+			result._error = set._error;
+			break;
+		}
+	}
+	if (statements.isEmpty()) {
+		result._queryString = script;
+	}
+}
+
+void SqlTaskPrivate::execChunkedBatch(QSqlDatabase &db, const QString &sql,
+									  AsyncQueryResult &result)
+{
+	QStringList names = _query.boundValues.keys();
+	QVector<QVariantList> lists;
+	int total = -1;
+	for (const QString &name : names) {
+		QVariantList values = _query.boundValues.value(name).toList();
+		if (total >= 0 && values.size() != total) {
+			result._queryString = sql;
+			result._error = QSqlError(QString(), "Batch value lists differ in size",
+									  QSqlError::StatementError);
+			return;
+		}
+		total = values.size();
+		lists << values;
+	}
+	total = qMax(total, 0);
+
+	MultiRowInsert multiRow;
+	bool useMultiRow = _query.batchMultiRow
+			&& !db.driver()->hasFeature(QSqlDriver::BatchOperations)
+			&& multiRow.parse(sql, names);
+
+	QSqlQuery query(db);
+	QSqlQuery fullQuery(db);
+	int fullRows = 0;
+	bool succ = true;
+	if (useMultiRow) {
+		fullRows = qMax(1, qMin(_query.batchChunkSize,
+								MultiRowInsert::maxParameters / qMax(1, names.size())));
+		succ = fullQuery.prepare(multiRow.statement(fullRows));
+		if (!succ)
+			result._error = fullQuery.lastError();
+	} else {
+		succ = query.prepare(sql);
+		if (!succ)
+			result._error = query.lastError();
+	}
+
+	int done = 0;
+	while (succ && done < total) {
+		int chunk = qMin(_query.batchChunkSize, total - done);
+		bool inTransaction = db.transaction();
+
+		if (useMultiRow) {
+			int row = done;
+			while (succ && row < done + chunk) {
+				int rows = qMin(fullRows, done + chunk - row);
+				QSqlQuery &stmt = rows == fullRows ? fullQuery : query;
+				if (rows != fullRows)
+					succ = stmt.prepare(multiRow.statement(rows));
+				for (int r = 0; succ && r < rows; r++) {
+					for (int i = 0; i < names.size(); i++)
+						stmt.bindValue(MultiRowInsert::placeholder(names[i], r),
+									   lists[i].at(row + r));
+				}
+				succ = succ && stmt.exec();
+				if (!succ)
+					result._error = stmt.lastError();
+				row += rows;
+			}
+		} else {
+			for (int i = 0; i < names.size(); i++)
+				query.bindValue(names[i], lists[i].mid(done, chunk));
+			succ = query.execBatch();
+			if (!succ)
+				result._error = query.lastError();
+		}
+
+		if (inTransaction) {
+			if (succ && !db.commit()) {
+				succ = false;
+				result._error = db.lastError();
+			}
+			if (!succ)
+				db.rollback();
+		}
+		if (succ) {
+			done += chunk;
+			emit _instance->batchProgress(done, total);
+		}
+	}
+
+	result._queryString = sql;
+	result._numRowsAffected = done;
+}
+
+void SqlTaskPrivate::fetchRows(QSqlQuery &query, AsyncQueryResult &result)
+{
+	int cols = result._record.count();
+
+	while (query.next()) {
+		QVector<QVariant> currow(cols);
+
+		for (int ii = 0; ii < cols; ii++) {
+			currow[ii] = cellValue(query, ii);
+		}
+		result._data.append(currow);
+	}
+
+	applyColumnHints(result);
+}
+
+void SqlTaskPrivate::applyColumnHints(AsyncQueryResult &result)
+{
+	int cols = result._record.count();
+	QVector<ColumnHint> hints(cols);
+	bool hinted = false;
+	for (auto it = _query.columnHints.constBegin(); it != _query.columnHints.constEnd(); ++it) {
+		if (it.key() >= 0 && it.key() < cols) {
+			hints[it.key()] = it.value();
+			hinted = true;
+		}
+	}
+	for (auto it = _query.namedColumnHints.constBegin();
+			it != _query.namedColumnHints.constEnd(); ++it) {
+		int col = result.columnIndex(it.key());
+		if (col >= 0) {
+			hints[col] = it.value();
+			hinted = true;
+		}
+	}
+	if (!hinted && !_query.displayStrings)
+		return;
+
+	QLocale locale;
+	int rows = result._data.size();
+	if (_query.displayStrings)
+		result._display = QVector<QVector<QString>>(rows);
+	for (int row = 0; row < rows; row++) {
+		QVector<QVariant> &cells = result._data[row];
+		QVector<QString> text(_query.displayStrings ? cols : 0);
+		for (int col = 0; col < cols && col < cells.size(); col++) {
+			const ColumnHint &hint = hints.at(col);
+			QVariant fetched = cells.at(col);
+			if (hint.type() != ColumnHint::Type_None)
+				cells[col] = hint.convert(fetched);
+			if (_query.displayStrings)
+				text[col] = hint.display(cells.at(col), locale, fetched);
+		}
+		if (_query.displayStrings)
+			result._display[row] = text;
+	}
+}
+
+void SqlTaskPrivate::exportRows(QSqlQuery &query, AsyncQueryResult &result)
+{
+	static const qint64 progressInterval = 1000;
+
+	QFile file;
+	QIODevice *device = _query.exportDevice;
+	if (!device) {
+		file.setFileName(_query.exportFileName);
+		if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+			result._error = QSqlError(QString(), file.errorString(),
+									  QSqlError::UnknownError);
+			return;
+		}
+		device = &file;
+	}
+
+	QScopedPointer<ResultWriter> writer(ResultWriter::create(_query.exportFormat, device));
+	int cols = result._record.count();
+	QVector<QVariant> currow(cols);
+	qint64 &rows = _exportedRows;
+	rows = 0;
+	bool succ = writer->writeHeader(result._record);
+
+	while (succ && query.next()) {
+		for (int ii = 0; ii < cols; ii++) {
+			currow[ii] = cellValue(query, ii);
+		}
+		succ = writer->writeRow(currow);
+		rows++;
+		if (rows % progressInterval == 0) {
+			emit _instance->exportProgress(rows);
+		}
+	}
+
+	if (succ) {
+		succ = writer->finish(rows);
+	}
+	if (!succ) {
+		result._error = QSqlError(QString(), writer->errorString(),
+								  QSqlError::UnknownError);
+	} else if (query.lastError().isValid()) {
+		result._error = query.lastError();
+	}
+	emit _instance->exportProgress(rows);
+}
+
+/****************************************************************************************/
+/*                                          AsyncQuery                                  */
+/****************************************************************************************/
+
+
+AsyncQuery::AsyncQuery(QObject* parent /* = nullptr */)
+	: QObject(parent), logger("Database.AsyncQuery")
+	, _delayMs(0)
+	, _mode(Mode_Parallel)
+	, _taskCnt(0)
+	, _isBatch(false)
+	, _persistentCache(false)
+	, _orderByColumn(-1)
+	, _orderBy(Qt::AscendingOrder)
+	, _hasLastQuery(false)
+	, _batchChunkSize(0)
+	, _batchMultiRow(false)
+	, _maxQueueDepth(0)
+	, _overflowPolicy(Overflow_Reject)
+	, _timeoutMs(0)
+	, _multiResult(false)
+	, _displayStrings(false)
+	, _session(nullptr)
+	, _delivery(Delivery_Immediate)
+	, _deliveryReceiver(this)
+	, _self(this)
+{
+}
+
+AsyncQuery::~AsyncQuery()
+{
+	ConnectionManager::instance()->metrics()->setQueueDepth(this, QString(), 0);
+}
+
+void AsyncQuery::setMode(AsyncQuery::Mode mode)
+{
+	QMutexLocker locker(&_mutex);
+	_mode = mode;
+}
+
+AsyncQuery::Mode AsyncQuery::mode()
+{
+	QMutexLocker locker(&_mutex);
+	return _mode;
+}
+
+bool AsyncQuery::isRunning() const
+{
+	QMutexLocker lock(&_mutex);
+	return (_taskCnt > 0);
+}
+
+QString AsyncQuery::query() const
+{
+	return _curQuery.query;
+}
+
+AsyncQueryResult AsyncQuery::result() const
+{
+	QMutexLocker lock(&_mutex);
+	return _result;
+}
+
+void AsyncQuery::prepare(const QString &query)
+{
+	_curQuery.query = query;
+}
+
+bool AsyncQuery::bindValue(const QString &placeholder, const QVariant &val)
+{
+	if (_isBatch)
+		return false;
+
+	_curQuery.boundValues[placeholder] = val;
+	return true;
+}
+
+void AsyncQuery::clearBoundValues()
+{
+	_curQuery.boundValues.clear();
+	_isBatch = false;
+}
+
+bool AsyncQuery::bindBatchValue(const QString &placeholder, const QVariantList &values)
+{
+	if (values.isEmpty())
+		return false;
+
+	QVariant::Type type = values.first().type();
+	for (const auto &val : values)
+		if (val.type() != type)
+			return false;
+
+	bindValue(placeholder, values);
+	_isBatch = true;
+	return true;
+}
+
+void AsyncQuery::setBatchChunkSize(int rows)
+{
+	QMutexLocker locker(&_mutex);
+	_batchChunkSize = qMax(rows, 0);
+}
+
+int AsyncQuery::batchChunkSize() const
+{
+	QMutexLocker locker(&_mutex);
+	return _batchChunkSize;
+}
+
+void AsyncQuery::setBatchMultiRowInsert(bool enabled)
+{
+	QMutexLocker locker(&_mutex);
+	_batchMultiRow = enabled;
+}
+
+bool AsyncQuery::batchMultiRowInsert() const
+{
+	QMutexLocker locker(&_mutex);
+	return _batchMultiRow;
+}
+
+bool AsyncQuery::startExec()
+{
+	_curQuery.isPrepared = true;
+	_curQuery.isBatch = _isBatch;
+	_curQuery.isExport = false;
+	_curQuery.isScript = false;
+	return startExecIntern(_curQuery);
+}
+
+bool AsyncQuery::startExec(const QString &query)
+{
+	_curQuery.isPrepared = false;
+	_curQuery.isExport = false;
+	_curQuery.isScript = false;
+	_curQuery.query = query;
+	return startExecIntern(_curQuery);
+}
+
+bool AsyncQuery::startExecScript(const QString &script)
+{
+	_curQuery.isPrepared = false;
+	_curQuery.isBatch = false;
+	_curQuery.isExport = false;
+	_curQuery.isScript = true;
+	_curQuery.query = script;
+	return startExecIntern(_curQuery);
+}
+
+void AsyncQuery::setConnectionProfile(const QString &profile)
+{
+	QMutexLocker locker(&_mutex);
+	_profile = profile;
+}
+
+QString AsyncQuery::connectionProfile() const
+{
+	QMutexLocker locker(&_mutex);
+	return _profile;
+}
+
+void AsyncQuery::setDelivery(AsyncQuery::Delivery delivery, QObject *receiver)
+{
+	QMutexLocker locker(&_mutex);
+	_delivery = delivery;
+	_deliveryReceiver = receiver ? receiver : this;
+}
+
+AsyncQuery::Delivery AsyncQuery::delivery() const
+{
+	QMutexLocker locker(&_mutex);
+	return _delivery;
+}
+
+void AsyncQuery::setSession(AsyncSession *session)
+{
+	QMutexLocker locker(&_mutex);
+	_session = session;
+}
+
+AsyncSession *AsyncQuery::session() const
+{
+	QMutexLocker locker(&_mutex);
+	return _session;
+}
+
+void AsyncQuery::setMultiResult(bool enabled)
+{
+	QMutexLocker locker(&_mutex);
+	_multiResult = enabled;
+}
+
+bool AsyncQuery::multiResult() const
+{
+	QMutexLocker locker(&_mutex);
+	return _multiResult;
+}
+
+void AsyncQuery::setColumnHint(int column, const ColumnHint &hint)
+{
+	QMutexLocker locker(&_mutex);
+	if (hint.type() == ColumnHint::Type_None)
+		_columnHints.remove(column);
+	else
+		_columnHints.insert(column, hint);
+}
+
+void AsyncQuery::setColumnHint(const QString &column, const ColumnHint &hint)
+{
+	QMutexLocker locker(&_mutex);
+	if (hint.type() == ColumnHint::Type_None)
+		_namedColumnHints.remove(column);
+	else
+		_namedColumnHints.insert(column, hint);
+}
+
+void AsyncQuery::clearColumnHints()
+{
+	QMutexLocker locker(&_mutex);
+	_columnHints.clear();
+	_namedColumnHints.clear();
+}
+
+void AsyncQuery::setDisplayStrings(bool enabled)
+{
+	QMutexLocker locker(&_mutex);
+	_displayStrings = enabled;
+}
+
+bool AsyncQuery::displayStrings() const
+{
+	QMutexLocker locker(&_mutex);
+	return _displayStrings;
+}
+
+bool AsyncQuery::startExport(QIODevice *device, ExportFormat format)
+{
+	_curQuery.isPrepared = true;
+	_curQuery.isBatch = false;
+	_curQuery.isExport = true;
+	_curQuery.isScript = false;
+	_curQuery.exportFormat = format;
+	_curQuery.exportDevice = device;
+	_curQuery.exportFileName.clear();
+	return startExecIntern(_curQuery);
+}
+
+bool AsyncQuery::startExport(const QString &fileName, ExportFormat format)
+{
+	_curQuery.isPrepared = true;
+	_curQuery.isBatch = false;
+	_curQuery.isExport = true;
+	_curQuery.isScript = false;
+	_curQuery.exportFormat = format;
+	_curQuery.exportDevice = nullptr;
+	_curQuery.exportFileName = fileName;
+	return startExecIntern(_curQuery);
+}
+
+bool AsyncQuery::waitDone(ulong msTimout)
+{
+	QMutexLocker lock(&_mutex);
+	if (_taskCnt > 0)
+		return _waitcondition.wait(&_mutex, msTimout);
+	else
+		return true;
+}
+
+void AsyncQuery::setMaxQueueDepth(int depth)
+{
+	QMutexLocker locker(&_mutex);
+	_maxQueueDepth = qMax(0, depth);
+}
+
+int AsyncQuery::maxQueueDepth() const
+{
+	QMutexLocker locker(&_mutex);
+	return _maxQueueDepth;
+}
+
+void AsyncQuery::setOverflowPolicy(AsyncQuery::OverflowPolicy policy)
+{
+	QMutexLocker locker(&_mutex);
+	_overflowPolicy = policy;
+}
+
+AsyncQuery::OverflowPolicy AsyncQuery::overflowPolicy() const
+{
+	QMutexLocker locker(&_mutex);
+	return _overflowPolicy;
+}
+
+int AsyncQuery::queueDepth() const
+{
+	QMutexLocker locker(&_mutex);
+	return _ququ.size();
+}
+
+void AsyncQuery::setTimeout(int ms)
+{
+	QMutexLocker locker(&_mutex);
+	_timeoutMs = qMax(0, ms);
+}
+
+int AsyncQuery::timeout() const
+{
+	QMutexLocker locker(&_mutex);
+	return _timeoutMs;
+}
+
+void AsyncQuery::startExecOnce(const QString &query, QObject *receiver, const char *member)
+{
+	// member is a SLOT() string: method code followed by the signature
+	QByteArray signature = QMetaObject::normalizedSignature(member + 1);
+	QByteArray method = signature.left(signature.indexOf('('));
+	bool hasArgument = !signature.endsWith("()");
+
+	startExecOnceIntern(query, receiver, [receiver, method, hasArgument](
+			const AsyncQueryResult &result) {
+		if (hasArgument) {
+			QMetaObject::invokeMethod(receiver, method.constData(), Qt::DirectConnection,
+				Q_ARG(Database::AsyncQueryResult, result));
+		} else {
+			QMetaObject::invokeMethod(receiver, method.constData(), Qt::DirectConnection);
+		}
+	});
+}
+
+void AsyncQuery::startExecOnceIntern(const QString &query, const QObject *context,
+		const std::function<void(const AsyncQueryResult &)> &handler)
+{
+	std::function<void(const AsyncQueryResult &)> callback = handler;
+	if (context) {
+		QPointer<QObject> guard(const_cast<QObject *>(context));
+		QThread *thread = context->thread();
+		callback = [guard, thread, handler](const AsyncQueryResult &result) {
+			DeliveryQueue::post(thread, guard, [handler, result]() {
+				handler(result);
+			});
+		};
+	}
+
+	QueuedQuery once;
+	once.isPrepared = false;
+	once.isBatch = false;
+	once.query = query;
+	ConnectionManager::instance()->startTask(SqlTaskPrivate::acquireOnce(once, std::move(callback)));
+}
+
+void AsyncQuery::setDelayMs(ulong ms)
+{
+	QMutexLocker locker(&_mutex);
+	_delayMs = ms;
+}
+
+void AsyncQuery::setPersistentCache(bool enabled)
+{
+	QMutexLocker locker(&_mutex);
+	_persistentCache = enabled;
+}
+
+bool AsyncQuery::persistentCache() const
+{
+	QMutexLocker locker(&_mutex);
+	return _persistentCache;
+}
+
+bool AsyncQuery::startExecAgain()
+{
+	_mutex.lock();
+	bool hasLastQuery = _hasLastQuery;
+	QueuedQuery query = _lastQuery;
+	_mutex.unlock();
+
+	if (!hasLastQuery)
+		return false;
+
+	return startExecIntern(query);
+}
+
+void AsyncQuery::setOrderBy(int column, Qt::SortOrder order)
+{
+	QMutexLocker locker(&_mutex);
+	_orderByColumn = column;
+	_orderBy = order;
+}
+
+int AsyncQuery::orderByColumn() const
+{
+	QMutexLocker locker(&_mutex);
+	return _orderByColumn;
+}
+
+bool AsyncQuery::startExecIntern(QueuedQuery query)
+{
+	QMutexLocker lock(&_mutex);
+	query.multiResult = _multiResult && !query.isBatch && !query.isScript;
+	query.useCache = _persistentCache && !query.isBatch && !query.isExport
+			&& !query.isScript && !query.multiResult;
+	query.profile = _profile;
+	query.session = _session;
+	query.orderByColumn = _orderByColumn;
+	query.orderBy = _orderBy;
+	query.batchChunkSize = _batchChunkSize;
+	query.batchMultiRow = _batchMultiRow;
+	query.columnHints = _columnHints;
+	query.namedColumnHints = _namedColumnHints;
+	query.displayStrings = _displayStrings;
+	query.startedAt = QDateTime::currentMSecsSinceEpoch();
+	query.deadline = _timeoutMs > 0 ? query.startedAt + _timeoutMs : 0;
+
+	bool overflow = _mode == Mode_Fifo && _maxQueueDepth > 0 && _taskCnt > 0
+			&& _ququ.size() >= _maxQueueDepth;
+	if (overflow) {
+		ConnectionManager::instance()->metrics()->queueOverflow();
+		if (_overflowPolicy == Overflow_Reject) {
+			lock.unlock();
+			emit queueOverflow();
+			return false;
+		} else if (_overflowPolicy == Overflow_DropOldest) {
+			_ququ.dequeue();
+		} else {
+			while (_taskCnt > 0 && _ququ.size() >= _maxQueueDepth)
+				_queueCondition.wait(&_mutex);
+		}
+	}
+
+	_lastQuery = query;
+	_hasLastQuery = true;
+
+	//serve the snapshot at once, before the refresh waits in a queue
+	if (query.useCache) {
+		lock.unlock();
+		serveCached(query);
+		lock.relock();
+	}
+
+	bool start = false;
+	if (_mode == Mode_Parallel) {
+		incTaskCount();
+		start = true;
+	} else {
+		if (_taskCnt == 0) {
+			incTaskCount();
+			start = true;
+		} else {
+			if (_mode == Mode_Fifo) {
+				_ququ.enqueue(query);
+			} else {
+				_ququ.clear();
+				_ququ.enqueue(query);
+			}
+			updateQueueMetrics();
+		}
+	}
+	ulong delayMs = _delayMs;
+	lock.unlock();
+
+	// the ConnectionManager may block the start, other tasks must still call back
+	if (start)
+		startTask(query, delayMs);
+
+	if (overflow)
+		emit queueOverflow();
+	return true;
+}
+
+void AsyncQuery::serveCached(const QueuedQuery &query)
+{
+	ConnectionManager *conmgr = ConnectionManager::instance();
+	ResultCache *cache = conmgr->resultCache();
+	if (!cache->isEnabled())
+		return;
+
+	QString sql = query.query;
+	if (query.orderByColumn >= 0) {
+		sql = orderedQuery(sql, query.orderByColumn, query.orderBy);
+	}
+
+	AsyncQueryResult cached;
+	if (cache->load(cache->key(sql, query.boundValues, query.profile), &cached)) {
+		conmgr->statementStats()->recordCacheHit(sql);
+		cacheCallback(cached);
+	}
+}
+
+void AsyncQuery::startTask(const QueuedQuery &query, ulong delayMs)
+{
+	SqlTaskPrivate* task = new SqlTaskPrivate(this, query, delayMs);
+	if (query.session) {
+		// a session has its own single thread, it is not admission controlled
+		query.session->start(task);
+	} else {
+		ConnectionManager::instance()->startTask(task);
+	}
+}
+
+void AsyncQuery::updateQueueMetrics()
+{
+	ConnectionManager::instance()->metrics()->setQueueDepth(this, objectName(), _ququ.size());
+}
+
+void AsyncQuery::incTaskCount()
+{
+	bool busyChanged = _taskCnt == 0;
+	_taskCnt++;
+	if (busyChanged)
+		emit AsyncQuery::busyChanged(true);
+}
+
+void AsyncQuery::decTaskCount()
+{
+	bool busyChanged = _taskCnt == 1;
+	_taskCnt--;
+	if (busyChanged)
+		emit AsyncQuery::busyChanged(false);
+}
+
+void AsyncQuery::taskCallback(const AsyncQueryResult& result)
+{
+	_mutex.lock();
+	Q_ASSERT(_taskCnt > 0);
+	_result = result;
+	if (_mode != Mode_Parallel && !_ququ.isEmpty()) {
+		//start next query if queue not empty
+		QueuedQuery query = _ququ.dequeue();
+		updateQueueMetrics();
+		startTask(query, _delayMs);
+	} else {
+		decTaskCount();
+	}
+
+	_queueCondition.wakeAll();
+	_waitcondition.wakeAll();
+	_mutex.unlock();
+
+	deliver(result);
+}
+
+void AsyncQuery::deliver(const AsyncQueryResult &result)
+{
+	_mutex.lock();
+	Delivery delivery = _delivery;
+	_mutex.unlock();
+
+	if (delivery == Delivery_Immediate) {
+		emit execDone(result);
+		return;
+	}
+	// both guards were created in the thread of their objects
+	_mutex.lock();
+	QPointer<QObject> receiver = _deliveryReceiver;
+	QPointer<AsyncQuery> self = _self;
+	_mutex.unlock();
+	if (!receiver)
+		return;
+
+	quintptr key = delivery == Delivery_Latest ? quintptr(this) : 0;
+	DeliveryQueue::post(receiver->thread(), receiver, [self, result]() {
+		if (self)
+			emit self->execDone(result);
+	}, key);
+}
+
+void AsyncQuery::cacheCallback(const AsyncQueryResult &result)
+{
+	_mutex.lock();
+	_result = result;
+	_mutex.unlock();
+
+	deliver(result);
+}
+}
@@ -1,252 +1,555 @@
-#pragma once
-
-#include "AsyncQueryResult.h"
-
-#include <QObject>
-#include <QString>
-#include <QSqlError>
-#include <QLoggingCategory>
-#include <QWaitCondition>
-#include <QMutex>
-#include <QQueue>
-
-namespace Database {
-
-// class forward decl's
-class SqlTaskPrivate;
-
-/**
- * @brief Class to run a asynchron sql query.
- *
- * @details This class provides functionalities to execute sql queries in a
- * asynchrounous way. The interface is similar to the Qt's synchronous QSqlQuery
- * http://doc.qt.io/qt-5/qsqlquery.html
- *
- * Create a AsyncQuery, connect a handler to the
- * execDone(const Database::AsyncQueryResult &result) signal and start the query
- * with startExec(const QString &query). The query is started in a proper thread and
- * the connected slot is called when finished. Queries are internally maintained in
- * a QThreadPool. By using the QThreadPool the execution of queries is optimized to
- * the available cores on the cpu and threads are not blindly generated.
- *
- * QSqlDatabase's can be only be used from within the thread that created it. This
- * class provides a solution to run queries also from  different threads
- * (http://doc.qt.io/qt-5/threads-modules.html#threads-and-the-sql-module).
- *
- */
-class AsyncQuery : public QObject
-{
-	friend class SqlTaskPrivate;
-	Q_OBJECT
-
-public:
-	/**
-	 * @brief The Mode defines how subsequent queries, triggered with
-	 * startExec() or startExec(const QString &query) are handled.
-	 */
-
-	enum Mode {
-		/** All queries for this object are started immediately and run in parallel.
-		 * The order in which subsequent queries are executed and finished can not
-		 * be guaranteed. Each query is started as soon as possible.
-		 */
-		Mode_Parallel,
-		/** Subsquent queries for this object are started in a Fifo fashion.
-		 * A Subsequent query waits until the last query is finished.
-		 * This guarantees the order of query sequences.
-		 */
-		Mode_Fifo,
-		/** Same as Mode_Fifo, but if a previous startExec call is not executed
-		 * yet it is skipped and overwritten by the current query. E.g. if a
-		 * graphical slider is bound to a sql query heavy database access can be
-		 * ommited by using this mode.
-		 */
-		Mode_SkipPrevious,
-	};
-
-	explicit AsyncQuery(QObject* parent = nullptr);
-	virtual ~AsyncQuery();
-
-	/**
-	 * @brief Set the mode how subsequent queries are executed.
-	 */
-	void setMode(AsyncQuery::Mode mode);
-	AsyncQuery::Mode mode();
-
-	/**
-	 * @brief Are there any queries running.
-	 */
-	bool isRunning() const;
-
-	QString query() const;
-
-	/**
-	 * @brief Retrieve the result of the last query
-	 */
-	AsyncQueryResult result() const;
-
-	/**
-	 * @brief Prepare a AsyncQuery
-	 */
-	void prepare(const QString &query);
-
-	/**
-	 * @brief BindValue for prepared query.
-	 *
-	 * @returns false if bindBatchValue() has been called, otherwise true
-	 */
-	bool bindValue(const QString &placeholder, const QVariant &val);
-
-	/**
-	 * @brief Bind list of values for prepared batch query
-	 *
-	 * The query will fail if
-	 * - a mix of bindValue() and bindBatchValue() is called
-	 * - \p values does not have the same size as \p values in other
-	 *   bindBatchValue() calls
-	 *
-	 * @returns false if \p values is empty, if it contains a mix of data
-	 * types, if its size is different from previous calls or if bindValue()
-	 * has been called, otherwise true
-	 */
-	bool bindBatchValue(const QString &placeholder, const QVariantList &values);
-
-	/**
-	 * @brief Start a prepared query execution set with prepare(const QString &query);
-	 */
-	void startExec(); //start
-
-	/**
-	 * @brief Start the execution of the query.
-	 */
-	void startExec(const QString & query);
-
-	/**
-	 * @brief Wait for query is finished
-	 * @details This function blocks the calling thread until query is finsihed. Using
-	 * this function provides same functionallity as Qt's synchron QSqlQuery.
-	 */
-	bool waitDone(ulong msTimout = ULONG_MAX);
-
-	/**
-	 * @brief Convinience function to start a AsyncQuery once with given slot as result
-	 * handler.
-	 * @details Sample Usage:
-	 * \code{.cpp}
-	 * Database::AsyncQuery::startExecOnce(
-	 *        "SELECT name FROM sqlite_master WHERE type='table'",
-	 *        this, SLOT(myExecDoneHandler(const Database::AsyncQueryResult &)));
-	 * \endcode
-	 */
-	static void startExecOnce(const QString& query, QObject* receiver,const char* member);
-
-	/**
-	 * @brief Convinience function to start a AsyncQuery once with given slot as result
-	 * handler.
-	 * @details Sample Usage:
-	 * \code{.cpp}
-	 * Database::AsyncQuery::startExecOnce(
-	 *        "SELECT name FROM sqlite_master WHERE type='table'",
-	 *        this, &MyObject::myExecDoneHandler);
-	 * \endcode
-	 */
-	template <typename Object>
-	static inline void startExecOnce(const QString &query, const Object *object,
-			void (Object::*slot)(const AsyncQueryResult &))
-	{
-		AsyncQuery * q = new AsyncQuery();
-		q->_deleteOnDone =true;
-		connect(q, &AsyncQuery::execDone, object, slot);
-		q->startExec(query);
-	}
-
-	/**
-	 * @brief Convinience function to start a AsyncQuery once with given lambda function
-	 * as result handler.
-	 * @details Sample Usage:
-	 * \code{.cpp}
-	 * Database::AsyncQuery::startExecOnce(
-	 *        "SELECT name FROM sqlite_master WHERE type='table'",
-	 *        [=](const Database::AsyncQueryResult& res) {
-	 *            //do handling here
-	 * });
-	 * \endcode
-	 */
-	template <typename Func>
-	static inline void startExecOnce(const QString& query, Func functor)
-	{
-		AsyncQuery * q = new AsyncQuery();
-		q->_deleteOnDone =true;
-		connect(q, &AsyncQuery::execDone, functor);
-		q->startExec(query);
-	}	
-
-	/**
-	 * @brief Convinience function to start a AsyncQuery once with given lambda function
-	 * as result handler.
-	 *
-	 * The connection is automatically destroyed if the sender or the context
-	 * is destroyed.
-	 */
-	template <typename Func>
-	static inline void startExecOnce(const QString& query, const QObject *context,
-			Func functor)
-	{
-		AsyncQuery * q = new AsyncQuery();
-		q->_deleteOnDone =true;
-		connect(q, &AsyncQuery::execDone, context, functor);
-		q->startExec(query);
-	}	
-
-	/**
-	 * @brief Set delay to execute query. Mainly used for testing.
-	 * @details The executing query thread sleeps ms before query is executed.
-	 */
-	void setDelayMs(ulong ms);
-
-signals:
-	/**
-	 * @brief Is emited when asynchronous query is done.
-	 */
-	void execDone(const Database::AsyncQueryResult& result);
-	/**
-	 * @brief Is emited if asynchronous query running status changes.
-	 */
-	void busyChanged(bool busy);
-
-private:
-	struct QueuedQuery {
-		bool isPrepared;
-		bool isBatch;
-		QString query;
-		QMap <QString, QVariant> boundValues;
-	};
-
-	void startExecIntern();
-	/* use only in locked area */
-	void incTaskCount();
-	void decTaskCount();
-
-	// asynchronous callbacks
-	// attention lives in the context of QRunable
-	void taskCallback(const AsyncQueryResult& result);
-
-
-private:
-	QLoggingCategory logger;
-
-	QWaitCondition _waitcondition;
-	mutable QMutex _mutex;
-	bool _deleteOnDone;
-	ulong _delayMs;
-	Mode _mode;
-	int _taskCnt;
-	bool _isBatch;
-
-	AsyncQueryResult _result;
-	QQueue <QueuedQuery> _ququ;
-	QueuedQuery _curQuery;
-
-};
-
-}
+#pragma once
+
+#include "AsyncQueryResult.h"
+#include "ColumnHint.h"
+
+#include <QObject>
+#include <QPointer>
+#include <QString>
+#include <QSqlError>
+#include <QLoggingCategory>
+#include <QWaitCondition>
+#include <QMutex>
+#include <QQueue>
+
+#include <functional>
+
+class QIODevice;
+
+namespace Database {
+
+// class forward decl's
+class SqlTaskPrivate;
+class AsyncSession;
+
+/**
+ * @brief Class to run a asynchron sql query.
+ *
+ * @details This class provides functionalities to execute sql queries in a
+ * asynchrounous way. The interface is similar to the Qt's synchronous QSqlQuery
+ * http://doc.qt.io/qt-5/qsqlquery.html
+ *
+ * Create a AsyncQuery, connect a handler to the
+ * execDone(const Database::AsyncQueryResult &result) signal and start the query
+ * with startExec(const QString &query). The query is started in a proper thread and
+ * the connected slot is called when finished. Queries are internally maintained in
+ * a QThreadPool. By using the QThreadPool the execution of queries is optimized to
+ * the available cores on the cpu and threads are not blindly generated.
+ *
+ * QSqlDatabase's can be only be used from within the thread that created it. This
+ * class provides a solution to run queries also from  different threads
+ * (http://doc.qt.io/qt-5/threads-modules.html#threads-and-the-sql-module).
+ *
+ */
+class AsyncQuery : public QObject
+{
+	friend class SqlTaskPrivate;
+	Q_OBJECT
+
+public:
+	/**
+	 * @brief The Mode defines how subsequent queries, triggered with
+	 * startExec() or startExec(const QString &query) are handled.
+	 */
+
+	enum Mode {
+		/** All queries for this object are started immediately and run in parallel.
+		 * The order in which subsequent queries are executed and finished can not
+		 * be guaranteed. Each query is started as soon as possible.
+		 */
+		Mode_Parallel,
+		/** Subsquent queries for this object are started in a Fifo fashion.
+		 * A Subsequent query waits until the last query is finished.
+		 * This guarantees the order of query sequences.
+		 */
+		Mode_Fifo,
+		/** Same as Mode_Fifo, but if a previous startExec call is not executed
+		 * yet it is skipped and overwritten by the current query. E.g. if a
+		 * graphical slider is bound to a sql query heavy database access can be
+		 * ommited by using this mode.
+		 */
+		Mode_SkipPrevious,
+	};
+
+	/**
+	 * @brief Defines how results are delivered with execDone().
+	 */
+	enum Delivery {
+		/** execDone() is emitted from the worker thread as soon as the query
+		 * is done. */
+		Delivery_Immediate,
+		/** Results are collected per thread of the receiver (see
+		 * setDelivery()) and delivered in one batch per event loop iteration
+		 * or frame (see DeliveryQueue::setFrameInterval()). execDone() is
+		 * emitted in the thread of the receiver. */
+		Delivery_Batched,
+		/** Same as Delivery_Batched, but only the newest result of this object
+		 * in a batch is delivered. */
+		Delivery_Latest,
+	};
+
+	/**
+	 * @brief Defines what happens if a query is started while the Mode_Fifo
+	 * queue holds maxQueueDepth() queries.
+	 */
+	enum OverflowPolicy {
+		/** The new query is not started, the start function returns \c false. */
+		Overflow_Reject,
+		/** The calling thread blocks until the queue has room. */
+		Overflow_Block,
+		/** The oldest queued query is dropped without execDone(). */
+		Overflow_DropOldest,
+	};
+
+	/**
+	 * @brief File formats supported by startExport().
+	 */
+	enum ExportFormat {
+		/** Comma separated values with a header line (RFC 4180 quoting). */
+		Export_Csv,
+		/** One JSON object per row and line, keyed by column name. */
+		Export_JsonLines,
+		/** Compact QDataStream row stream with column names and types. */
+		Export_Binary,
+	};
+
+	explicit AsyncQuery(QObject* parent = nullptr);
+	virtual ~AsyncQuery();
+
+	/**
+	 * @brief Set the mode how subsequent queries are executed.
+	 */
+	void setMode(AsyncQuery::Mode mode);
+	AsyncQuery::Mode mode();
+
+	/**
+	 * @brief Limit the number of queries waiting in the Mode_Fifo queue.
+	 * 0 (default) means unlimited.
+	 * @details If the limit is hit, overflowPolicy() applies and
+	 * queueOverflow() is emitted.
+	 */
+	void setMaxQueueDepth(int depth);
+	int maxQueueDepth() const;
+
+	void setOverflowPolicy(AsyncQuery::OverflowPolicy policy);
+	AsyncQuery::OverflowPolicy overflowPolicy() const;
+
+	/**
+	 * @brief Number of queries waiting in the queue (Mode_Fifo and
+	 * Mode_SkipPrevious).
+	 */
+	int queueDepth() const;
+
+	/**
+	 * @brief Are there any queries running.
+	 */
+	bool isRunning() const;
+
+	QString query() const;
+
+	/**
+	 * @brief Retrieve the result of the last query
+	 */
+	AsyncQueryResult result() const;
+
+	/**
+	 * @brief Prepare a AsyncQuery
+	 */
+	void prepare(const QString &query);
+
+	/**
+	 * @brief BindValue for prepared query.
+	 *
+	 * @returns false if bindBatchValue() has been called, otherwise true
+	 */
+	bool bindValue(const QString &placeholder, const QVariant &val);
+
+	/**
+	 * @brief Remove the values bound by bindValue() and bindBatchValue().
+	 * @details prepare() keeps them for the next start.
+	 */
+	void clearBoundValues();
+
+	/**
+	 * @brief Bind list of values for prepared batch query
+	 *
+	 * The query will fail if
+	 * - a mix of bindValue() and bindBatchValue() is called
+	 * - \p values does not have the same size as \p values in other
+	 *   bindBatchValue() calls
+	 *
+	 * @returns false if \p values is empty, if it contains a mix of data
+	 * types, if its size is different from previous calls or if bindValue()
+	 * has been called, otherwise true
+	 */
+	bool bindBatchValue(const QString &placeholder, const QVariantList &values);
+
+	/**
+	 * @brief Split batch queries into chunks of \p rows rows.
+	 * @details Each chunk is executed in its own transaction and
+	 * batchProgress() is emitted after each committed chunk. If a chunk fails
+	 * it is rolled back, the remaining chunks are skipped and
+	 * AsyncQueryResult::numRowsAffected() holds the number of committed rows.
+	 * A value of 0 (default) executes the whole batch with a single
+	 * QSqlQuery::execBatch().
+	 */
+	void setBatchChunkSize(int rows);
+	int batchChunkSize() const;
+
+	/**
+	 * @brief Rewrite chunked batch inserts to multi-row VALUES statements.
+	 * @details Only applies to drivers without native batch support (where
+	 * Qt emulates execBatch() row by row, e.g. QSQLITE) and to a single-tuple
+	 * <tt>INSERT ... VALUES (...)</tt> with named placeholders which ends
+	 * after the tuple. Other statements, e.g. with an <tt>ON CONFLICT</tt>
+	 * clause, are executed with QSqlQuery::execBatch().
+	 * Requires setBatchChunkSize().
+	 */
+	void setBatchMultiRowInsert(bool enabled);
+	bool batchMultiRowInsert() const;
+
+	/**
+	 * @brief Start a prepared query execution set with prepare(const QString &query);
+	 * @returns \c false if the query was rejected (see setMaxQueueDepth()).
+	 */
+	bool startExec(); //start
+
+	/**
+	 * @brief Start the execution of the query.
+	 * @returns \c false if the query was rejected (see setMaxQueueDepth()).
+	 */
+	bool startExec(const QString & query);
+
+	/**
+	 * @brief Execute the statements of \p script one after another on the same
+	 * connection and deliver all their results with a single execDone().
+	 * @details Statements are separated by ';' outside of quotes and comments.
+	 * Every statement adds an entry to AsyncQueryResult::resultSets(); the
+	 * first failing statement stops the script and its error becomes the error
+	 * of the result. No transaction is opened, add BEGIN/COMMIT to the script
+	 * if needed.
+	 * @note Statements containing ';' themselves (e.g. trigger bodies) are not
+	 * supported.
+	 * @returns \c false if the script was rejected (see setMaxQueueDepth()).
+	 */
+	bool startExecScript(const QString &script);
+
+	/**
+	 * @brief Run subsequent queries on the ConnectionManager connection
+	 * profile \p profile (see ConnectionManager::addProfile()).
+	 * The empty name (default) selects the default profile.
+	 */
+	void setConnectionProfile(const QString &profile);
+	QString connectionProfile() const;
+
+	/**
+	 * @brief How results are delivered, default Delivery_Immediate.
+	 * @param receiver Batched results are delivered in the thread of
+	 * \p receiver and dropped once it is deleted. \c nullptr (default) is
+	 * the AsyncQuery object. Call in the thread of \p receiver.
+	 */
+	void setDelivery(Delivery delivery, QObject *receiver = nullptr);
+	Delivery delivery() const;
+
+	/**
+	 * @brief Run subsequent queries in \p session, i.e. on its worker thread
+	 * and connection in start order. \c nullptr (default) runs them in the
+	 * global QThreadPool.
+	 * @note \p session has to outlive this query.
+	 */
+	void setSession(AsyncSession *session);
+	AsyncSession *session() const;
+
+	/**
+	 * @brief Fetch all result sets of subsequent queries, e.g. of stored
+	 * procedures returning several results.
+	 * @details The query is executed once and QSqlQuery::nextResult() is
+	 * walked; every result set is added to AsyncQueryResult::resultSets().
+	 * Requires a driver supporting QSqlDriver::MultipleResultSets, otherwise
+	 * only the first result set is returned.
+	 */
+	void setMultiResult(bool enabled);
+	bool multiResult() const;
+
+	/**
+	 * @brief Convert the cells of \p column in subsequent results with \p hint.
+	 * @details Hints are applied on the worker thread right after the rows
+	 * are fetched, a hint by column name wins over a hint by index. A hint of
+	 * ColumnHint::Type_None removes the hint.
+	 */
+	void setColumnHint(int column, const ColumnHint &hint);
+	void setColumnHint(const QString &column, const ColumnHint &hint);
+	void clearColumnHints();
+
+	/**
+	 * @brief Format the DisplayRole strings of subsequent results on the
+	 * worker thread (default \c false).
+	 * @details Hinted columns are formatted by their ColumnHint, all others
+	 * like QStyledItemDelegate does. The models then return
+	 * AsyncQueryResult::displayString() and never format while painting.
+	 */
+	void setDisplayStrings(bool enabled);
+	bool displayStrings() const;
+
+	/**
+	 * @brief Start the last started query again, e.g. to refresh a result.
+	 * @details The current setOrderBy() and setPersistentCache() settings
+	 * apply, prepare() and bindValue() calls since the last start are ignored.
+	 * @returns \c false if no query was started yet or if the query was
+	 * rejected.
+	 */
+	bool startExecAgain();
+
+	/**
+	 * @brief Sort the rows of subsequent queries in the database.
+	 * @details The query is wrapped as
+	 * <tt>SELECT * FROM (query) ORDER BY column+1 ASC|DESC</tt>. Only single
+	 * SELECT, VALUES and WITH queries are wrapped, other statements (INSERT,
+	 * UPDATE, ...) run unchanged. A \p column of -1 disables the sorting.
+	 */
+	void setOrderBy(int column, Qt::SortOrder order = Qt::AscendingOrder);
+	int orderByColumn() const;
+
+	/**
+	 * @brief Start a prepared query and write its rows to \p device.
+	 * @details Rows are serialized on the worker thread straight from the
+	 * database cursor, so memory usage does not grow with the result size.
+	 * Progress is reported with exportProgress(). The AsyncQueryResult passed
+	 * to execDone() carries the head record and error, but no rows.
+	 * @note \p device must be open for writing and must not be accessed until
+	 * execDone() is emitted.
+	 */
+	bool startExport(QIODevice *device, ExportFormat format);
+
+	/**
+	 * @brief Start a prepared query and write its rows to file \p fileName.
+	 * @details Same as startExport(QIODevice*, ExportFormat), but the file is
+	 * opened and closed on the worker thread.
+	 */
+	bool startExport(const QString &fileName, ExportFormat format);
+
+	/**
+	 * @brief Wait for query is finished
+	 * @details This function blocks the calling thread until query is finsihed. Using
+	 * this function provides same functionallity as Qt's synchron QSqlQuery.
+	 */
+	bool waitDone(ulong msTimout = ULONG_MAX);
+
+	/**
+	 * @name Fire-and-forget queries
+	 * @details The startExecOnce() functions do not create an AsyncQuery object.
+	 * The query runs in a pooled task with the default connection profile and
+	 * the handler is called directly with the result: in the thread of the
+	 * receiver/context (batched with DeliveryQueue, dropped if the receiver is
+	 * deleted before), or on the worker thread if no context is given.
+	 */
+	///@{
+
+	/**
+	 * @brief Convinience function to start a AsyncQuery once with given slot as result
+	 * handler.
+	 * @details Sample Usage:
+	 * \code{.cpp}
+	 * Database::AsyncQuery::startExecOnce(
+	 *        "SELECT name FROM sqlite_master WHERE type='table'",
+	 *        this, SLOT(myExecDoneHandler(const Database::AsyncQueryResult &)));
+	 * \endcode
+	 */
+	static void startExecOnce(const QString& query, QObject* receiver,const char* member);
+
+	/**
+	 * @brief Convinience function to start a AsyncQuery once with given slot as result
+	 * handler.
+	 * @details Sample Usage:
+	 * \code{.cpp}
+	 * Database::AsyncQuery::startExecOnce(
+	 *        "SELECT name FROM sqlite_master WHERE type='table'",
+	 *        this, &MyObject::myExecDoneHandler);
+	 * \endcode
+	 */
+	template <typename Object>
+	static inline void startExecOnce(const QString &query, const Object *object,
+			void (Object::*slot)(const AsyncQueryResult &))
+	{
+		Object *receiver = const_cast<Object *>(object);
+		startExecOnceIntern(query, receiver, [receiver, slot](const AsyncQueryResult &result) {
+			(receiver->*slot)(result);
+		});
+	}
+
+	/**
+	 * @brief Convinience function to start a AsyncQuery once with given lambda function
+	 * as result handler.
+	 * @details Sample Usage:
+	 * \code{.cpp}
+	 * Database::AsyncQuery::startExecOnce(
+	 *        "SELECT name FROM sqlite_master WHERE type='table'",
+	 *        [=](const Database::AsyncQueryResult& res) {
+	 *            //do handling here
+	 * });
+	 * \endcode
+	 */
+	template <typename Func>
+	static inline void startExecOnce(const QString& query, Func functor)
+	{
+		startExecOnceIntern(query, nullptr, functor);
+	}
+
+	/**
+	 * @brief Convinience function to start a AsyncQuery once with given lambda function
+	 * as result handler.
+	 *
+	 * The connection is automatically destroyed if the sender or the context
+	 * is destroyed.
+	 */
+	template <typename Func>
+	static inline void startExecOnce(const QString& query, const QObject *context,
+			Func functor)
+	{
+		startExecOnceIntern(query, context, functor);
+	}
+	///@}
+
+	/**
+	 * @brief Set delay to execute query. Mainly used for testing.
+	 * @details The executing query thread sleeps ms before query is executed.
+	 */
+	void setDelayMs(ulong ms);
+
+	/**
+	 * @brief Deadline for each started query in ms after its start call.
+	 * 0 (default) means no deadline.
+	 * @details A query still queued when its deadline passes is dropped
+	 * before it reaches a connection. A running query is interrupted by a
+	 * driver level statement timeout (SQLite busy timeout and, with
+	 * ASYNCSQL_SQLITE_API, a progress handler; PostgreSQL statement_timeout;
+	 * MySQL max_execution_time). In both cases the result has
+	 * AsyncQueryResult::isTimeout() set.
+	 */
+	void setTimeout(int ms);
+	int timeout() const;
+
+	/**
+	 * @brief Serve results from the persistent ResultCache
+	 * (ConnectionManager::resultCache()).
+	 * @details If enabled and a snapshot for the query and its bound values
+	 * exists, execDone() is first emitted with the snapshot
+	 * (AsyncQueryResult::isCached()) before the query is run. The snapshot is
+	 * loaded on the calling thread by startExec() before the query is queued,
+	 * so a Fifo queue or the task limit do not delay it; with
+	 * Delivery_Immediate execDone() is emitted before startExec() returns.
+	 * The fresh result is emitted as usual and replaces the snapshot on disk.
+	 * Batch queries, scripts, multi result queries and exports are never
+	 * cached.
+	 */
+	void setPersistentCache(bool enabled);
+	bool persistentCache() const;
+
+signals:
+	/**
+	 * @brief Is emited when asynchronous query is done.
+	 */
+	void execDone(const Database::AsyncQueryResult& result);
+	/**
+	 * @brief Is emited if asynchronous query running status changes.
+	 */
+	void busyChanged(bool busy);
+	/**
+	 * @brief Is emitted from the worker thread while startExport() runs.
+	 * @param rows Number of rows written so far.
+	 */
+	void exportProgress(qint64 rows);
+	/**
+	 * @brief Is emitted from the worker thread after each committed chunk of
+	 * a chunked batch query (see setBatchChunkSize()).
+	 */
+	void batchProgress(int rowsDone, int rowsTotal);
+	/**
+	 * @brief Is emitted if a query is started while the queue is full (see
+	 * setMaxQueueDepth()).
+	 */
+	void queueOverflow();
+
+private:
+	struct QueuedQuery {
+		bool isPrepared;
+		bool isBatch;
+		QString query;
+		QMap <QString, QVariant> boundValues;
+		bool isExport = false;
+		ExportFormat exportFormat = Export_Csv;
+		QIODevice *exportDevice = nullptr;
+		QString exportFileName;
+		bool useCache = false;
+		int orderByColumn = -1;
+		Qt::SortOrder orderBy = Qt::AscendingOrder;
+		int batchChunkSize = 0;
+		bool batchMultiRow = false;
+		qint64 deadline = 0;
+		bool isScript = false;
+		bool multiResult = false;
+		QMap<int, ColumnHint> columnHints;
+		QMap<QString, ColumnHint> namedColumnHints;
+		bool displayStrings = false;
+		QString profile;
+		AsyncSession *session = nullptr;
+		qint64 startedAt = 0;
+	};
+
+	bool startExecIntern(QueuedQuery query);
+	static void startExecOnceIntern(const QString &query, const QObject *context,
+			const std::function<void(const AsyncQueryResult &)> &handler);
+	void serveCached(const QueuedQuery &query);
+	/* may block on the caller's thread (ConnectionManager::setTaskOverflowPolicy()), do not hold the lock there */
+	void startTask(const QueuedQuery &query, ulong delayMs);
+	/* use only in locked area */
+	void incTaskCount();
+	void decTaskCount();
+	/* use only in locked area */
+	void updateQueueMetrics();
+
+	// asynchronous callbacks
+	// attention lives in the context of QRunable
+	void taskCallback(const AsyncQueryResult& result);
+	void cacheCallback(const AsyncQueryResult& result);
+	void deliver(const AsyncQueryResult& result);
+
+
+private:
+	QLoggingCategory logger;
+
+	QWaitCondition _waitcondition;
+	/** wakes starters blocked by Overflow_Block, apart from waitDone() */
+	QWaitCondition _queueCondition;
+	mutable QMutex _mutex;
+	ulong _delayMs;
+	Mode _mode;
+	int _taskCnt;
+	bool _isBatch;
+	bool _persistentCache;
+	int _orderByColumn;
+	Qt::SortOrder _orderBy;
+	bool _hasLastQuery;
+	int _batchChunkSize;
+	bool _batchMultiRow;
+	int _maxQueueDepth;
+	OverflowPolicy _overflowPolicy;
+	int _timeoutMs;
+	bool _multiResult;
+	QMap<int, ColumnHint> _columnHints;
+	QMap<QString, ColumnHint> _namedColumnHints;
+	bool _displayStrings;
+	QString _profile;
+	AsyncSession *_session;
+	Delivery _delivery;
+	QPointer<QObject> _deliveryReceiver;
+	QPointer<AsyncQuery> _self;
+
+	AsyncQueryResult _result;
+	QQueue <QueuedQuery> _ququ;
+	QueuedQuery _curQuery;
+	QueuedQuery _lastQuery;
+
+};
+
+}
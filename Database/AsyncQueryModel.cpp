@@ -9,10 +9,18 @@ namespace Database {
 AsyncQueryModel::AsyncQueryModel(QObject* parent)
 	: QAbstractTableModel(parent)
 	, logger("Database.AsyncQueryModel")
+	, _sortStrategy(AsyncSortFilter::SortOnWorker)
+	, _mapped(false)
 {
 	_aQuery = new AsyncQuery(this);
 	connect (_aQuery, SIGNAL(execDone(Database::AsyncQueryResult)),
 			 this, SLOT(onExecDone(Database::AsyncQueryResult)));
+
+	_sortFilter = new AsyncSortFilter(this);
+	connect (_sortFilter, SIGNAL(finished(Database::AsyncQueryResult,QVector<int>)),
+			 this, SLOT(onSortFilterDone(Database::AsyncQueryResult,QVector<int>)));
+
+	_liveQuery = new LiveQuery(_aQuery, this);
 }
 
 AsyncQueryModel::~AsyncQueryModel()
@@ -37,15 +45,51 @@ void AsyncQueryModel::startExec(const QString &query)
 
 void AsyncQueryModel::clear()
 {
-	beginResetModel();
-	_res = {};
-	endResetModel();
+	setResult({}, {}, false);
+}
+
+void AsyncQueryModel::setSortStrategy(AsyncSortFilter::SortStrategy strategy)
+{
+	_sortStrategy = strategy;
+}
+
+AsyncSortFilter::SortStrategy AsyncQueryModel::sortStrategy() const
+{
+	return _sortStrategy;
+}
+
+void AsyncQueryModel::setFilterFixedString(const QString &pattern)
+{
+	_sortFilter->setFilterFixedString(pattern);
+	_sortFilter->start(_res);
+}
+
+void AsyncQueryModel::setFilterKeyColumn(int column)
+{
+	_sortFilter->setFilterKeyColumn(column);
+	if (!_sortFilter->filterFixedString().isEmpty())
+		_sortFilter->start(_res);
+}
+
+void AsyncQueryModel::setLiveTables(const QStringList &tables)
+{
+	_liveQuery->setTables(tables);
+}
+
+QStringList AsyncQueryModel::liveTables() const
+{
+	return _liveQuery->tables();
+}
+
+void AsyncQueryModel::setLiveDebounceMs(int ms)
+{
+	_liveQuery->setDebounceMs(ms);
 }
 
 int AsyncQueryModel::rowCount(const QModelIndex &parent) const
 {
 	Q_UNUSED(parent);
-	return _res.count();
+	return _mapped ? _rows.size() : _res.count();
 
 }
 
@@ -59,7 +103,13 @@ QVariant AsyncQueryModel::data(const QModelIndex &index, int role) const
 {
 	if (role == Qt::DisplayRole)
 	{
-		return _res.value(index.row(), index.column());
+		if (_res.hasDisplayStrings())
+			return _res.displayString(sourceRow(index.row()), index.column());
+		return _res.value(sourceRow(index.row()), index.column());
+	}
+	if (role == Qt::EditRole)
+	{
+		return _res.value(sourceRow(index.row()), index.column());
 	}
 	return QVariant();
 
@@ -76,14 +126,53 @@ QVariant AsyncQueryModel::headerData(int section,
 	return QVariant();
 }
 
+void AsyncQueryModel::sort(int column, Qt::SortOrder order)
+{
+	if (_sortStrategy == AsyncSortFilter::SortInSql) {
+		_sortFilter->setSortColumn(-1);
+		_aQuery->setOrderBy(column, order);
+		_aQuery->startExecAgain();
+	} else {
+		_aQuery->setOrderBy(-1);
+		_sortFilter->setSortColumn(column, order);
+		_sortFilter->start(_res);
+	}
+}
+
 void AsyncQueryModel::onExecDone(const Database::AsyncQueryResult &result)
 {
 	if (!result.isValid()) {
 		qCDebug(logger) << "SqlError" << result.error().text();
 	}
 
+	if (_sortFilter->isActive()) {
+		// keep showing the current rows until the new order is computed
+		_sortFilter->start(result);
+	} else {
+		setResult(result, {}, false);
+	}
+}
+
+void AsyncQueryModel::onSortFilterDone(const Database::AsyncQueryResult &result,
+		const QVector<int> &rows)
+{
+	setResult(result, rows, _sortFilter->isActive());
+}
+
+int AsyncQueryModel::sourceRow(int row) const
+{
+	if (!_mapped)
+		return row;
+	return (row >= 0 && row < _rows.size()) ? _rows.at(row) : -1;
+}
+
+void AsyncQueryModel::setResult(const AsyncQueryResult &result, const QVector<int> &rows,
+		bool mapped)
+{
 	beginResetModel();
 	_res = result;
+	_rows = rows;
+	_mapped = mapped;
 	endResetModel();
 }
 
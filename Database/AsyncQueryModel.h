@@ -4,6 +4,8 @@
 #include <QAbstractTableModel>
 
 #include "AsyncQueryResult.h"
+#include "AsyncSortFilter.h"
+#include "LiveQuery.h"
 
 namespace Database {
 
@@ -39,6 +41,41 @@ public:
 	void startExec(const QString &query);
 	void clear();
 
+	/**
+	 * @brief Where sort() sorts the rows, default is
+	 * AsyncSortFilter::SortOnWorker.
+	 * @details With AsyncSortFilter::SortInSql the last query is run again
+	 * with an ORDER BY clause, otherwise the loaded rows are sorted in the
+	 * QThreadPool. In both cases the model is reset once the new order is
+	 * available.
+	 */
+	void setSortStrategy(AsyncSortFilter::SortStrategy strategy);
+	AsyncSortFilter::SortStrategy sortStrategy() const;
+
+	/**
+	 * @brief Show only rows containing \p pattern (case insensitive).
+	 * @details Filtering is done in the QThreadPool. An empty pattern shows
+	 * all rows.
+	 */
+	void setFilterFixedString(const QString &pattern);
+
+	/**
+	 * @brief Column the filter is applied to, -1 (default) matches any column.
+	 */
+	void setFilterKeyColumn(int column);
+
+	/**
+	 * @brief Run the query again when one of \p tables is changed.
+	 * @details See LiveQuery. An empty list (default) disables live updates.
+	 */
+	void setLiveTables(const QStringList &tables);
+	QStringList liveTables() const;
+
+	/**
+	 * @brief Debounce interval of live updates in ms, default 100.
+	 */
+	void setLiveDebounceMs(int ms);
+
 	/** @name QAbstractItemModel interface */
 	///@{
 	int rowCount(const QModelIndex &parent = QModelIndex()) const override;
@@ -46,15 +83,27 @@ public:
 	QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
 	QVariant headerData(int section, Qt::Orientation orientation, int role = 
 			Qt::DisplayRole) const override;
+	void sort(int column, Qt::SortOrder order = Qt::AscendingOrder) override;
 	///@}
 
 protected slots:
 	void onExecDone(const Database::AsyncQueryResult &result);
+	void onSortFilterDone(const Database::AsyncQueryResult &result,
+			const QVector<int> &rows);
 
 private:
+	int sourceRow(int row) const;
+	void setResult(const AsyncQueryResult &result, const QVector<int> &rows,
+			bool mapped);
+
 	QLoggingCategory logger;
 	AsyncQueryResult _res;
 	AsyncQuery *_aQuery;
+	AsyncSortFilter *_sortFilter;
+	LiveQuery *_liveQuery;
+	AsyncSortFilter::SortStrategy _sortStrategy;
+	QVector<int> _rows;
+	bool _mapped;
 };
 
 }
@@ -10,11 +10,17 @@ static const int firstRole = Qt::UserRole + 1;
 AsyncQueryQMLModel::AsyncQueryQMLModel(QObject *parent)
 	: QAbstractTableModel(parent)
 	, _aQuery(new AsyncQuery(this))
+	, _sortFilter(new AsyncSortFilter(this))
+	, _liveQuery(new LiveQuery(_aQuery, this))
+	, _sortStrategy(AsyncSortFilter::SortOnWorker)
+	, _mapped(false)
 #if SUPPORTS_QSQLQUERY_TABLENAME
 	, _prefixMode(PrefixTableNameOnDuplicate)
 #endif
 {
 	connect(_aQuery, &AsyncQuery::execDone, this, &AsyncQueryQMLModel::onExecDone);
+	connect(_sortFilter, &AsyncSortFilter::finished, this,
+			&AsyncQueryQMLModel::onSortFilterDone);
 }
 
 AsyncQuery *AsyncQueryQMLModel::asyncQuery() const
@@ -49,6 +55,24 @@ AsyncQueryQMLModel::PrefixMode AsyncQueryQMLModel::prefixMode() const
 }
 #endif
 
+void AsyncQueryQMLModel::setLiveTables(const QStringList &tables)
+{
+	if (tables == _liveQuery->tables())
+		return;
+	_liveQuery->setTables(tables);
+	emit liveTablesChanged(tables);
+}
+
+QStringList AsyncQueryQMLModel::liveTables() const
+{
+	return _liveQuery->tables();
+}
+
+void AsyncQueryQMLModel::setLiveDebounceMs(int ms)
+{
+	_liveQuery->setDebounceMs(ms);
+}
+
 void AsyncQueryQMLModel::startExec(const QString &query)
 {
 	_aQuery->startExec(query);
@@ -58,16 +82,28 @@ void AsyncQueryQMLModel::clear()
 {
 	beginResetModel();
 	_res = {};
+	_rows.clear();
+	_mapped = false;
 	_roleNames.clear();
 	_roleIDs.clear();
 	setColumnNames({});
 	endResetModel();
 }
 
+void AsyncQueryQMLModel::setSortStrategy(AsyncSortFilter::SortStrategy strategy)
+{
+	_sortStrategy = strategy;
+}
+
+AsyncSortFilter::SortStrategy AsyncQueryQMLModel::sortStrategy() const
+{
+	return _sortStrategy;
+}
+
 int AsyncQueryQMLModel::rowCount(const QModelIndex &parent) const
 {
 	Q_UNUSED(parent);
-	return _res.count();
+	return _mapped ? _rows.size() : _res.count();
 }
 
 int AsyncQueryQMLModel::columnCount(const QModelIndex &parent) const
@@ -78,16 +114,15 @@ int AsyncQueryQMLModel::columnCount(const QModelIndex &parent) const
 
 QVariant AsyncQueryQMLModel::data(const QModelIndex &index, int role) const
 {
-	if (role >= firstRole && role < firstRole + columnCount())
-		return _res.value(index.row(), role - firstRole);
-
-	return {};
+	if (role == Qt::DisplayRole)
+		return displayData(sourceRow(index.row()), index.column());
+	return roleData(sourceRow(index.row()), role);
 }
 
 QVariant AsyncQueryQMLModel::data(int row, const QString &role) const
 {
 	if (row >= 0 && row < rowCount() && _roleIDs.contains(role))
-		return _res.value(row, _roleIDs.value(role) - firstRole);
+		return roleData(sourceRow(row), _roleIDs.value(role));
 
 	return {};
 }
@@ -97,6 +132,19 @@ QHash<int, QByteArray> AsyncQueryQMLModel::roleNames() const
 	return _roleNames;
 }
 
+void AsyncQueryQMLModel::sort(int column, Qt::SortOrder order)
+{
+	if (_sortStrategy == AsyncSortFilter::SortInSql) {
+		_sortFilter->setSortColumn(-1);
+		_aQuery->setOrderBy(column, order);
+		_aQuery->startExecAgain();
+	} else {
+		_aQuery->setOrderBy(-1);
+		_sortFilter->setSortColumn(column, order);
+		_sortFilter->start(_res);
+	}
+}
+
 void AsyncQueryQMLModel::setQueryString(const QString &query)
 {
 	if (query == asyncQuery()->query())
@@ -128,12 +176,27 @@ void AsyncQueryQMLModel::exec()
 	asyncQuery()->startExec();
 }
 
+void AsyncQueryQMLModel::setFilterFixedString(const QString &pattern)
+{
+	_sortFilter->setFilterFixedString(pattern);
+	_sortFilter->start(_res);
+}
+
+void AsyncQueryQMLModel::setFilterKeyColumn(int column)
+{
+	_sortFilter->setFilterKeyColumn(column);
+	if (!_sortFilter->filterFixedString().isEmpty())
+		_sortFilter->start(_res);
+}
+
 void AsyncQueryQMLModel::onExecDone(const Database::AsyncQueryResult &result)
 {
-	beginResetModel();
-	_res = result;
-	updateRoles();
-	endResetModel();
+	if (_sortFilter->isActive()) {
+		// keep showing the current rows until the new order is computed
+		_sortFilter->start(result);
+	} else {
+		setResult(result, {}, false);
+	}
 
 	if (result.isValid())
 		emit querySucceeded(result);
@@ -141,6 +204,49 @@ void AsyncQueryQMLModel::onExecDone(const Database::AsyncQueryResult &result)
 		emit queryFailed(result.error().text());
 }
 
+void AsyncQueryQMLModel::onSortFilterDone(const Database::AsyncQueryResult &result,
+		const QVector<int> &rows)
+{
+	setResult(result, rows, _sortFilter->isActive());
+}
+
+void AsyncQueryQMLModel::setResult(const AsyncQueryResult &result, const QVector<int> &rows,
+		bool mapped)
+{
+	beginResetModel();
+	_res = result;
+	_rows = rows;
+	_mapped = mapped;
+	updateRoles();
+	endResetModel();
+}
+
+QVariant AsyncQueryQMLModel::roleData(int row, int role) const
+{
+	// a column role keeps the typed value, its display role the formatted text
+	int columns = columnCount();
+	if (role >= firstRole && role < firstRole + columns)
+		return _res.value(row, role - firstRole);
+	if (role >= firstRole + columns && role < firstRole + 2 * columns)
+		return displayData(row, role - firstRole - columns);
+
+	return {};
+}
+
+QVariant AsyncQueryQMLModel::displayData(int row, int column) const
+{
+	if (_res.hasDisplayStrings())
+		return _res.displayString(row, column);
+	return _res.value(row, column);
+}
+
+int AsyncQueryQMLModel::sourceRow(int row) const
+{
+	if (!_mapped)
+		return row;
+	return (row >= 0 && row < _rows.size()) ? _rows.at(row) : -1;
+}
+
 void AsyncQueryQMLModel::updateRoles()
 {
 	_roleNames.clear();
@@ -159,6 +265,17 @@ void AsyncQueryQMLModel::updateRoles()
 		_roleIDs[name] = id;
 		columnNames << name;
 	}
+	// "<column>Display" roles after all column roles, a taken name (e.g. by a
+	// column "TotalDisplay") gets underscores appended: "TotalDisplay_"
+	for (int i = 0; i < record.count(); ++i)
+	{
+		QString name = columnNames.at(i) + QLatin1String("Display");
+		while (_roleIDs.contains(name))
+			name += QLatin1Char('_');
+		auto id = firstRole + record.count() + i;
+		_roleNames[id] = name.toUtf8();
+		_roleIDs[name] = id;
+	}
 
 	setColumnNames(columnNames);
 }
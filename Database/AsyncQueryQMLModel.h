@@ -1,6 +1,8 @@
 #pragma once
 #include <QAbstractTableModel>
 #include "AsyncQueryResult.h"
+#include "AsyncSortFilter.h"
+#include "LiveQuery.h"
 
 #define SUPPORTS_QSQLQUERY_TABLENAME (QT_VERSION >= QT_VERSION_CHECK(5,10,0))
 
@@ -14,10 +16,13 @@ class AsyncQueryQMLModel : public QAbstractTableModel
 	Q_PROPERTY(QString query READ queryString WRITE setQueryString NOTIFY
 			queryStringChanged)
 	Q_PROPERTY(QStringList columnNames READ columnNames NOTIFY columnNamesChanged)
+	Q_PROPERTY(QStringList liveTables READ liveTables WRITE setLiveTables NOTIFY
+			liveTablesChanged)
 
 signals:
 	void queryStringChanged(const QString &queryString);
 	void columnNamesChanged(const QStringList &columnNames);
+	void liveTablesChanged(const QStringList &liveTables);
 	void querySucceeded(const AsyncQueryResult &result);
 	void queryFailed(const QString &errorMessage);
 
@@ -46,11 +51,19 @@ public:
 	void startExec(const QString &query);
 	void clear();
 
+	void setSortStrategy(AsyncSortFilter::SortStrategy strategy);
+	AsyncSortFilter::SortStrategy sortStrategy() const;
+
+	void setLiveTables(const QStringList &tables);
+	QStringList liveTables() const;
+	void setLiveDebounceMs(int ms);
+
 	int rowCount(const QModelIndex &parent = QModelIndex()) const override;
 	int columnCount(const QModelIndex &parent = QModelIndex()) const override;
 	QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
 	Q_INVOKABLE QVariant data(int row, const QString &role) const;
 	QHash<int, QByteArray> roleNames() const override;
+	Q_INVOKABLE void sort(int column, Qt::SortOrder order = Qt::AscendingOrder) override;
 
 	void setQueryString(const QString &query);
 #if SUPPORTS_QSQLQUERY_TABLENAME
@@ -60,9 +73,18 @@ public:
 public slots:
 	void bindValue(const QString &name, const QVariant &value);
 	void exec();
+	void setFilterFixedString(const QString &pattern);
+	void setFilterKeyColumn(int column);
 
 private:
 	void onExecDone(const Database::AsyncQueryResult &result);
+	void onSortFilterDone(const Database::AsyncQueryResult &result,
+			const QVector<int> &rows);
+	void setResult(const AsyncQueryResult &result, const QVector<int> &rows,
+			bool mapped);
+	int sourceRow(int row) const;
+	QVariant roleData(int row, int role) const;
+	QVariant displayData(int row, int column) const;
 	void updateRoles();
 	void setColumnNames(const QStringList &columnNames);
 #if SUPPORTS_QSQLQUERY_TABLENAME
@@ -75,6 +97,11 @@ private:
 	QStringList _columnNames;
 	AsyncQueryResult _res;
 	AsyncQuery *_aQuery;
+	AsyncSortFilter *_sortFilter;
+	LiveQuery *_liveQuery;
+	AsyncSortFilter::SortStrategy _sortStrategy;
+	QVector<int> _rows;
+	bool _mapped;
 #if SUPPORTS_QSQLQUERY_TABLENAME
 	PrefixMode _prefixMode;
 #endif
@@ -1,58 +1,612 @@
-#include "AsyncQueryResult.h"
-
-#include <QVariant>
-#include <QSqlError>
-
-namespace Database {
-
-AsyncQueryResult::AsyncQueryResult()
-{
-	qRegisterMetaType<AsyncQueryResult>();
-}
-
-QSqlError AsyncQueryResult::error() const
-{
-	return _error;
-}
-
-QSqlRecord AsyncQueryResult::headRecord() const
-{
-	return _record;
-}
-
-int AsyncQueryResult::count() const
-{
-	return _data.size();
-}
-
-QSqlRecord AsyncQueryResult::record(int row) const
-{
-	QSqlRecord rec = _record;
-	if (row >= 0 && row < _data.size()) {
-		for (int i = 0; i < _record.count(); i++) {
-			rec.setValue(i, _data[row][i]);
-		}
-	}
-	return rec;
-}
-
-QVariant AsyncQueryResult::value(int row, int col) const
-{
-	if (row >= 0 && row < _data.size()) {
-		if (col >= 0 && col < _record.count())
-			return _data[row][col];
-	}
-	return QVariant();
-}
-
-QVariant AsyncQueryResult::value(int row, const QString &col) const
-{
-	int colid = _record.indexOf(col);
-	return value(row, colid);
-}
-
-bool AsyncQueryResult::isValid() const
-{
-	return !_error.isValid();
-}
-}	//	namespace
+#include "AsyncQueryResult.h"
+
+#include <QVariant>
+#include <QSqlError>
+#include <QSqlField>
+#include <QtEndian>
+
+#include <cstring>
+
+namespace Database {
+
+namespace {
+
+const quint32 binaryMagic = 0x41515253; // "AQRS"
+/** Version 2 adds the result sets and the display strings. */
+const quint32 binaryVersion = 2;
+
+const char *timeoutErrorCode = "AsyncQueryTimeout";
+const char *rejectedErrorCode = "AsyncQueryRejected";
+
+/** Storage of one column in the binary format. */
+enum ColumnEncoding {
+	Encoding_Null,		///< every cell is NULL, no payload
+	Encoding_Int64,		///< little endian qint64 block
+	Encoding_Double,	///< little endian IEEE 754 block
+	Encoding_String,	///< quint32 offset block + UTF-8 data block
+	Encoding_Bytes,		///< quint32 offset block + raw data block
+	Encoding_Variant,	///< one QVariant per non NULL cell
+};
+
+ColumnEncoding encodingFor(QVariant::Type type)
+{
+	switch (type) {
+	case QVariant::Bool:
+	case QVariant::Int:
+	case QVariant::UInt:
+	case QVariant::LongLong:
+	case QVariant::ULongLong:
+		return Encoding_Int64;
+	case QVariant::Double:
+		return Encoding_Double;
+	case QVariant::String:
+		return Encoding_String;
+	case QVariant::ByteArray:
+		return Encoding_Bytes;
+	default:
+		return Encoding_Variant;
+	}
+}
+
+QVariant int64Variant(qint64 val, QVariant::Type type)
+{
+	switch (type) {
+	case QVariant::Bool:
+		return QVariant(val != 0);
+	case QVariant::Int:
+		return QVariant(int(val));
+	case QVariant::UInt:
+		return QVariant(uint(val));
+	case QVariant::ULongLong:
+		return QVariant(qulonglong(val));
+	default:
+		return QVariant(val);
+	}
+}
+
+inline bool isNullBit(const QByteArray &nulls, int row)
+{
+	return nulls.at(row / 8) & (1 << (row % 8));
+}
+
+inline uchar *blockAt(QByteArray &block, int offset)
+{
+	return reinterpret_cast<uchar *>(block.data() + offset);
+}
+
+inline const uchar *blockAt(const QByteArray &block, int offset)
+{
+	return reinterpret_cast<const uchar *>(block.constData() + offset);
+}
+
+/** Bytes left in \p in, used to reject sizes a corrupt stream can not hold. */
+qint64 bytesLeft(QDataStream &in)
+{
+	return in.device() ? in.device()->bytesAvailable() : 0;
+}
+
+QString fieldTableName(const QSqlField &field)
+{
+#if QT_VERSION >= QT_VERSION_CHECK(5,10,0)
+	return field.tableName();
+#else
+	Q_UNUSED(field);
+	return QString();
+#endif
+}
+
+}
+
+AsyncQueryResult::AsyncQueryResult()
+{
+	qRegisterMetaType<AsyncQueryResult>();
+}
+
+QSqlError AsyncQueryResult::error() const
+{
+	return _error;
+}
+
+bool AsyncQueryResult::isTimeout() const
+{
+	return _error.nativeErrorCode() == QLatin1String(timeoutErrorCode);
+}
+
+QSqlError AsyncQueryResult::timeoutError()
+{
+	return QSqlError(QString(), "Query deadline exceeded", QSqlError::StatementError,
+					 QLatin1String(timeoutErrorCode));
+}
+
+bool AsyncQueryResult::isRejected() const
+{
+	return _error.nativeErrorCode() == QLatin1String(rejectedErrorCode);
+}
+
+QSqlError AsyncQueryResult::rejectedError()
+{
+	return QSqlError(QString(), "Too many pending database tasks", QSqlError::ConnectionError,
+					 QLatin1String(rejectedErrorCode));
+}
+
+bool AsyncQueryResult::isIntegral(const QVariant &val)
+{
+	switch (val.type()) {
+	case QVariant::Bool:
+	case QVariant::Int:
+	case QVariant::UInt:
+	case QVariant::LongLong:
+	case QVariant::ULongLong:
+		return true;
+	default:
+		return false;
+	}
+}
+
+QSqlRecord AsyncQueryResult::headRecord() const
+{
+	return _record;
+}
+
+int AsyncQueryResult::count() const
+{
+	return _data.size();
+}
+
+QSqlRecord AsyncQueryResult::record(int row) const
+{
+	QSqlRecord rec = _record;
+	if (row >= 0 && row < _data.size()) {
+		for (int i = 0; i < _record.count(); i++) {
+			rec.setValue(i, _data[row][i]);
+		}
+	}
+	return rec;
+}
+
+QVariant AsyncQueryResult::value(int row, int col) const
+{
+	if (row >= 0 && row < _data.size()) {
+		if (col >= 0 && col < _record.count())
+			return _data[row][col];
+	}
+	return QVariant();
+}
+
+QVariant AsyncQueryResult::value(int row, const QString &col) const
+{
+	return value(row, columnIndex(col));
+}
+
+QVariant AsyncQueryResult::value(int row, Column col) const
+{
+	return value(row, col.index());
+}
+
+QString AsyncQueryResult::displayString(int row, int col) const
+{
+	if (row >= 0 && row < _display.size()) {
+		if (col >= 0 && col < _display[row].size())
+			return _display[row][col];
+		return QString();
+	}
+	return value(row, col).toString();
+}
+
+int AsyncQueryResult::columnIndex(const QString &name) const
+{
+	auto it = _columns.constFind(name);
+	if (it != _columns.constEnd())
+		return it.value();
+	it = _columns.constFind(name.toLower());
+	if (it != _columns.constEnd())
+		return it.value();
+	// qualified names like "table.field"
+	return _record.indexOf(name);
+}
+
+AsyncQueryResult::Column AsyncQueryResult::column(const QString &name) const
+{
+	return Column(columnIndex(name));
+}
+
+AsyncQueryRow AsyncQueryResult::row(int row) const
+{
+	return AsyncQueryRow(this, row);
+}
+
+AsyncQueryRow AsyncQueryResult::rows() const
+{
+	return AsyncQueryRow(this, -1);
+}
+
+void AsyncQueryResult::setRecord(const QSqlRecord &record)
+{
+	_record = record;
+	_columns.clear();
+	_columns.reserve(2 * record.count());
+	// first match wins like QSqlRecord::indexOf()
+	for (int i = 0; i < record.count(); i++) {
+		QString name = record.fieldName(i);
+		if (!_columns.contains(name))
+			_columns.insert(name, i);
+		QString lower = name.toLower();
+		if (!_columns.contains(lower))
+			_columns.insert(lower, i);
+	}
+}
+
+bool AsyncQueryResult::isValid() const
+{
+	return !_error.isValid();
+}
+
+QByteArray AsyncQueryResult::toBinary() const
+{
+	QByteArray data;
+	QDataStream out(&data, QIODevice::WriteOnly);
+	out.setVersion(QDataStream::Qt_5_5);
+	out << *this;
+	return data;
+}
+
+AsyncQueryResult AsyncQueryResult::fromBinary(const QByteArray &data, bool *ok)
+{
+	AsyncQueryResult result;
+	QDataStream in(data);
+	in.setVersion(QDataStream::Qt_5_5);
+	in >> result;
+	if (ok)
+		*ok = in.status() == QDataStream::Ok;
+	return result;
+}
+
+QDataStream &operator<<(QDataStream &out, const AsyncQueryResult &result)
+{
+	const QSqlRecord &rec = result._record;
+	const int rows = result._data.size();
+	const int cols = rec.count();
+
+	out << binaryMagic << binaryVersion;
+
+	out << qint32(cols);
+	for (int c = 0; c < cols; c++) {
+		QSqlField field = rec.field(c);
+		out << field.name() << fieldTableName(field) << qint32(field.type())
+			<< qint32(field.requiredStatus()) << qint32(field.length())
+			<< qint32(field.precision()) << field.defaultValue()
+			<< field.isAutoValue() << field.isReadOnly() << field.isGenerated();
+	}
+
+	out << result._error.driverText() << result._error.databaseText()
+		<< qint32(result._error.type()) << result._error.nativeErrorCode();
+	out << result._lastInsertId << result._queryString
+		<< qint32(result._numRowsAffected);
+
+	out << qint32(rows);
+	for (int c = 0; c < cols; c++) {
+		QByteArray nulls((rows + 7) / 8, '\0');
+		QVariant::Type type = QVariant::Invalid;
+		bool mixed = false;
+		for (int r = 0; r < rows; r++) {
+			const QVariant &val = result._data[r][c];
+			// a typed null (e.g. QVariant(QVariant::String)) is NULL as well
+			if (!val.isValid() || val.isNull()) {
+				nulls[r / 8] = char(nulls.at(r / 8) | (1 << (r % 8)));
+			} else if (type == QVariant::Invalid) {
+				type = val.type();
+			} else if (val.type() != type) {
+				mixed = true;
+			}
+		}
+
+		ColumnEncoding enc = Encoding_Null;
+		if (mixed)
+			enc = Encoding_Variant;
+		else if (type != QVariant::Invalid)
+			enc = encodingFor(type);
+
+		out << quint8(enc) << qint32(type) << nulls;
+
+		switch (enc) {
+		case Encoding_Null:
+			break;
+		case Encoding_Int64: {
+			QByteArray block(rows * 8, '\0');
+			for (int r = 0; r < rows; r++) {
+				if (!isNullBit(nulls, r))
+					qToLittleEndian<qint64>(result._data[r][c].toLongLong(),
+											blockAt(block, r * 8));
+			}
+			out << block;
+			break;
+		}
+		case Encoding_Double: {
+			QByteArray block(rows * 8, '\0');
+			for (int r = 0; r < rows; r++) {
+				if (!isNullBit(nulls, r)) {
+					double val = result._data[r][c].toDouble();
+					quint64 bits;
+					std::memcpy(&bits, &val, sizeof(bits));
+					qToLittleEndian<quint64>(bits, blockAt(block, r * 8));
+				}
+			}
+			out << block;
+			break;
+		}
+		case Encoding_String:
+		case Encoding_Bytes: {
+			QByteArray offsets((rows + 1) * 4, '\0');
+			QByteArray block;
+			for (int r = 0; r < rows; r++) {
+				qToLittleEndian<quint32>(quint32(block.size()), blockAt(offsets, r * 4));
+				if (isNullBit(nulls, r))
+					continue;
+				const QVariant &val = result._data[r][c];
+				block += enc == Encoding_String ? val.toString().toUtf8()
+												: val.toByteArray();
+			}
+			qToLittleEndian<quint32>(quint32(block.size()), blockAt(offsets, rows * 4));
+			out << offsets << block;
+			break;
+		}
+		case Encoding_Variant:
+			for (int r = 0; r < rows; r++) {
+				if (!isNullBit(nulls, r))
+					out << result._data[r][c];
+			}
+			break;
+		}
+	}
+
+	out << qint32(result._resultSets.size());
+	for (const AsyncQueryResult &set : result._resultSets)
+		out << set;
+
+	bool display = result.hasDisplayStrings() && result._display.size() == rows;
+	out << display;
+	if (display) {
+		for (int r = 0; r < rows; r++) {
+			for (int c = 0; c < cols; c++)
+				out << result._display[r].value(c);
+		}
+	}
+	return out;
+}
+
+QDataStream &operator>>(QDataStream &in, AsyncQueryResult &result)
+{
+	quint32 magic = 0;
+	quint32 version = 0;
+	in >> magic >> version;
+	if (magic != binaryMagic || version == 0 || version > binaryVersion) {
+		in.setStatus(QDataStream::ReadCorruptData);
+		return in;
+	}
+
+	AsyncQueryResult res;
+	qint32 cols = 0;
+	in >> cols;
+	// every field takes more than one byte
+	if (cols < 0 || cols > bytesLeft(in) || in.status() != QDataStream::Ok) {
+		in.setStatus(QDataStream::ReadCorruptData);
+		return in;
+	}
+
+	QSqlRecord rec;
+	for (int c = 0; c < cols && in.status() == QDataStream::Ok; c++) {
+		QString name, table;
+		qint32 type, required, length, precision;
+		QVariant defaultValue;
+		bool autoValue, readOnly, generated;
+		in >> name >> table >> type >> required >> length >> precision
+			>> defaultValue >> autoValue >> readOnly >> generated;
+
+		QSqlField field(name, QVariant::Type(type));
+		field.setRequiredStatus(QSqlField::RequiredStatus(required));
+		field.setLength(length);
+		field.setPrecision(precision);
+		field.setDefaultValue(defaultValue);
+		field.setAutoValue(autoValue);
+		field.setReadOnly(readOnly);
+		field.setGenerated(generated);
+#if QT_VERSION >= QT_VERSION_CHECK(5,10,0)
+		field.setTableName(table);
+#endif
+		rec.append(field);
+	}
+	res.setRecord(rec);
+
+	QString driverText, databaseText, nativeCode;
+	qint32 errorType;
+	in >> driverText >> databaseText >> errorType >> nativeCode;
+	res._error = QSqlError(driverText, databaseText,
+						   QSqlError::ErrorType(errorType), nativeCode);
+
+	qint32 numRowsAffected;
+	in >> res._lastInsertId >> res._queryString >> numRowsAffected;
+	res._numRowsAffected = numRowsAffected;
+
+	qint32 rows = 0;
+	in >> rows;
+	// every cell takes at least one bit of its null bitmap, check before allocating
+	if (rows < 0 || in.status() != QDataStream::Ok
+			|| qint64(rows) * qMax(1, int(cols)) > bytesLeft(in) * 8) {
+		in.setStatus(QDataStream::ReadCorruptData);
+		return in;
+	}
+
+	res._data = QVector<QVector<QVariant>>(rows, QVector<QVariant>(cols));
+	for (int c = 0; c < cols && in.status() == QDataStream::Ok; c++) {
+		quint8 enc;
+		qint32 type;
+		QByteArray nulls;
+		in >> enc >> type >> nulls;
+		if (nulls.size() != (rows + 7) / 8) {
+			in.setStatus(QDataStream::ReadCorruptData);
+			return in;
+		}
+
+		switch (enc) {
+		case Encoding_Null:
+			break;
+		case Encoding_Int64:
+		case Encoding_Double: {
+			QByteArray block;
+			in >> block;
+			if (block.size() != rows * 8) {
+				in.setStatus(QDataStream::ReadCorruptData);
+				return in;
+			}
+			for (int r = 0; r < rows; r++) {
+				if (isNullBit(nulls, r))
+					continue;
+				if (enc == Encoding_Int64) {
+					qint64 val = qFromLittleEndian<qint64>(blockAt(block, r * 8));
+					res._data[r][c] = int64Variant(val, QVariant::Type(type));
+				} else {
+					quint64 bits = qFromLittleEndian<quint64>(blockAt(block, r * 8));
+					double val;
+					std::memcpy(&val, &bits, sizeof(val));
+					res._data[r][c] = val;
+				}
+			}
+			break;
+		}
+		case Encoding_String:
+		case Encoding_Bytes: {
+			QByteArray offsets, block;
+			in >> offsets >> block;
+			if (offsets.size() != (rows + 1) * 4) {
+				in.setStatus(QDataStream::ReadCorruptData);
+				return in;
+			}
+			for (int r = 0; r < rows; r++) {
+				if (isNullBit(nulls, r))
+					continue;
+				quint32 begin = qFromLittleEndian<quint32>(blockAt(offsets, r * 4));
+				quint32 end = qFromLittleEndian<quint32>(blockAt(offsets, r * 4 + 4));
+				if (begin > end || end > quint32(block.size())) {
+					in.setStatus(QDataStream::ReadCorruptData);
+					return in;
+				}
+				// an empty cell is not NULL, keep its value non-null
+				int size = int(end - begin);
+				const char *ptr = size > 0 ? block.constData() + begin : "";
+				if (enc == Encoding_String)
+					res._data[r][c] = QString::fromUtf8(ptr, size);
+				else
+					res._data[r][c] = QByteArray(ptr, size);
+			}
+			break;
+		}
+		case Encoding_Variant:
+			for (int r = 0; r < rows; r++) {
+				if (!isNullBit(nulls, r))
+					in >> res._data[r][c];
+			}
+			break;
+		default:
+			in.setStatus(QDataStream::ReadCorruptData);
+			return in;
+		}
+	}
+
+	if (version >= 2 && in.status() == QDataStream::Ok) {
+		qint32 sets = 0;
+		in >> sets;
+		// a result set starts with magic and version
+		if (sets < 0 || qint64(sets) * 8 > bytesLeft(in)) {
+			in.setStatus(QDataStream::ReadCorruptData);
+			return in;
+		}
+		for (int i = 0; i < sets && in.status() == QDataStream::Ok; i++) {
+			AsyncQueryResult set;
+			in >> set;
+			res._resultSets.append(set);
+		}
+
+		bool display = false;
+		in >> display;
+		if (display && in.status() == QDataStream::Ok) {
+			// a string takes at least its length
+			if (qint64(rows) * cols * 4 > bytesLeft(in)) {
+				in.setStatus(QDataStream::ReadCorruptData);
+				return in;
+			}
+			res._display = QVector<QVector<QString>>(rows);
+			for (int r = 0; r < rows && in.status() == QDataStream::Ok; r++) {
+				QVector<QString> text(cols);
+				for (int c = 0; c < cols; c++)
+					in >> text[c];
+				res._display[r] = text;
+			}
+		}
+	}
+
+	if (in.status() == QDataStream::Ok)
+		result = res;
+	return in;
+}
+/****************************************************************************************/
+/*                                       AsyncQueryRow                                  */
+/****************************************************************************************/
+
+AsyncQueryRow::AsyncQueryRow()
+	: _result(nullptr)
+	, _row(-1)
+	, _cells(nullptr)
+	, _count(0)
+{
+}
+
+AsyncQueryRow::AsyncQueryRow(const AsyncQueryResult *result, int row)
+	: _result(result)
+	, _row(row)
+	, _cells(nullptr)
+	, _count(0)
+{
+	if (row >= 0 && row < result->_data.size()) {
+		_cells = result->_data[row].constData();
+		_count = result->_data[row].size();
+	}
+}
+
+bool AsyncQueryRow::next()
+{
+	if (!_result || _row + 1 >= _result->_data.size()) {
+		_row = _result ? _result->_data.size() : -1;
+		_cells = nullptr;
+		_count = 0;
+		return false;
+	}
+	_row++;
+	_cells = _result->_data[_row].constData();
+	_count = _result->_data[_row].size();
+	return true;
+}
+
+const QVariant &AsyncQueryRow::value(int col) const
+{
+	static const QVariant null;
+	if (col < 0 || col >= _count)
+		return null;
+	return _cells[col];
+}
+
+const QVariant &AsyncQueryRow::value(const QString &col) const
+{
+	return value(_result ? _result->columnIndex(col) : -1);
+}
+
+#if QT_VERSION >= QT_VERSION_CHECK(5,10,0)
+QStringView AsyncQueryRow::toStringView(int col) const
+{
+	const QVariant &val = value(col);
+	if (val.type() != QVariant::String)
+		return QStringView();
+	return QStringView(*static_cast<const QString *>(val.constData()));
+}
+#endif
+
+}	//	namespace
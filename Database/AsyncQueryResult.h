@@ -1,102 +1,339 @@
-#pragma once
-
-#include <QMetaType>
-#include <QSqlRecord>
-#include <QVector>
-#include <QVariant>
-#include <QSqlError>
-
-
-namespace Database {
-
-// class forward decls's
-class SqlTaskPrivate;
-
-/**
-* @brief Represent a AsyncQuery result.
-* @details The query result is retreived via the getter functions. If an sql error
-* occured AsyncQueryResult is not isValid() and the error can retrieved with
-* error().
-*
-*/
-class AsyncQueryResult
-{
-friend class SqlTaskPrivate;
-
-public:
-	AsyncQueryResult();
-	virtual ~AsyncQueryResult() = default;
-
-	/**
-	 * @brief Returns \c true if no error occured in the query.
-	 */
-	bool isValid() const;
-
-	/**
-	 * @brief Retrieve the sql error of the query.
-	 */
-	QSqlError error() const;
-
-	/**
-	 * @brief Returns the head record to retrieve column names of the table.
-	 */
-	QSqlRecord headRecord() const;
-
-	/**
-	 * @brief Returns the number of rows in the result.
-	 */
-	int  count() const;
-
-	/**
-	 * @brief Returns the QSqlRecord of given row.
-	 */
-	QSqlRecord record(int row) const;
-
-	/**
-	 * @brief Returns the value of given row and columns.
-	 * @details If row or col is invalid a empty QVariatn is returned.
-	 */
-	QVariant value(int row, int col) const;
-
-	/**
-	 * @brief Returns the value of given row and column name.
-	 * @details If row or col is invalid a empty QVariant is returned.
-	 */
-	QVariant value(int row, const QString &col) const;
-
-	/**
-	 * @brief Returns internal raw data structure of result.
-	 */
-	QVector<QVector<QVariant>> data() const { return _data; }
-
-	/**
-	 * @brief Returns the object ID of the most recent inserted row
-	 *
-	 * @see QSqlQuery::lastInsertId()
-	 */
-	QVariant lastInsertId() const { return _lastInsertId; }
-	/**
-	 * @brief Returns the query string
-	 * @note A prepared query may not always have its value placeholder
-	 * replaced if the query fails.
-	 */
-	QString queryString() const { return _queryString; }
-	/**
-	 * @brief Returns the number of rows affected by the SQL statement
-	 *
-	 * @see QSqlQuery::numRowsAffected()
-	 */
-	int numRowsAffected() const { return _numRowsAffected; }
-
-private:
-	QVector<QVector<QVariant>> _data;
-	QSqlRecord _record;
-	QSqlError _error;
-	QVariant _lastInsertId;
-	QString _queryString;
-	int _numRowsAffected = -1;
-};
-
-}	//	namespace
-
-Q_DECLARE_METATYPE(Database::AsyncQueryResult)
+#pragma once
+
+#include <QDataStream>
+#include <QHash>
+#include <QMetaType>
+#include <QSqlRecord>
+#include <QVector>
+#include <QVariant>
+#include <QSqlError>
+
+
+namespace Database {
+
+// class forward decls's
+class SqlTaskPrivate;
+class ResultCache;
+class PipelineTaskPrivate;
+class ShardedQuery;
+class AsyncQueryRow;
+
+/**
+* @brief Represent a AsyncQuery result.
+* @details The query result is retreived via the getter functions. If an sql error
+* occured AsyncQueryResult is not isValid() and the error can retrieved with
+* error().
+*
+*/
+class AsyncQueryResult
+{
+friend class SqlTaskPrivate;
+friend class ResultCache;
+friend class PipelineTaskPrivate;
+friend class ShardedQuery;
+friend class ParallelScan;
+friend class ScanTaskPrivate;
+friend class ResultOperations;
+friend QDataStream &operator<<(QDataStream &out, const AsyncQueryResult &result);
+friend QDataStream &operator>>(QDataStream &in, AsyncQueryResult &result);
+
+public:
+	/**
+	 * @brief A column resolved once with column(), cheap to use for every row.
+	 */
+	class Column
+	{
+	public:
+		Column() : _index(-1) {}
+		bool isValid() const { return _index >= 0; }
+		int index() const { return _index; }
+
+	private:
+		friend class AsyncQueryResult;
+		explicit Column(int index) : _index(index) {}
+		int _index;
+	};
+
+	AsyncQueryResult();
+	virtual ~AsyncQueryResult() = default;
+
+	/**
+	 * @brief Returns \c true if no error occured in the query.
+	 */
+	bool isValid() const;
+
+	/**
+	 * @brief Retrieve the sql error of the query.
+	 */
+	QSqlError error() const;
+
+	/**
+	 * @brief Returns \c true if the query was dropped or interrupted because
+	 * its deadline passed (see AsyncQuery::setTimeout()).
+	 */
+	bool isTimeout() const;
+
+	/**
+	 * @brief Returns \c true if the query was rejected by the admission
+	 * control (see ConnectionManager::setMaxTasksPending()).
+	 */
+	bool isRejected() const;
+
+	/**
+	 * @brief Returns the head record to retrieve column names of the table.
+	 */
+	QSqlRecord headRecord() const;
+
+	/**
+	 * @brief Returns the number of rows in the result.
+	 */
+	int  count() const;
+
+	/**
+	 * @brief Returns the QSqlRecord of given row.
+	 */
+	QSqlRecord record(int row) const;
+
+	/**
+	 * @brief Returns the value of given row and columns.
+	 * @details If row or col is invalid a empty QVariatn is returned.
+	 */
+	QVariant value(int row, int col) const;
+
+	/**
+	 * @brief Returns the value of given row and column name.
+	 * @details If row or col is invalid a empty QVariant is returned.
+	 */
+	QVariant value(int row, const QString &col) const;
+
+	/**
+	 * @brief Returns the value of given row and resolved column.
+	 */
+	QVariant value(int row, Column col) const;
+
+	/**
+	 * @brief Returns \c true if the DisplayRole strings of the rows were
+	 * formatted on the worker thread (see AsyncQuery::setDisplayStrings()).
+	 */
+	bool hasDisplayStrings() const { return !_display.isEmpty(); }
+
+	/**
+	 * @brief Returns the preformatted DisplayRole string of given row and
+	 * column.
+	 * @details Falls back to value().toString() without display strings.
+	 */
+	QString displayString(int row, int col) const;
+
+	/**
+	 * @brief Index of the column \p name, -1 if there is none.
+	 * @details Matches like QSqlRecord::indexOf() (case insensitive) but
+	 * uses a hash built with the head record.
+	 */
+	int columnIndex(const QString &name) const;
+
+	/**
+	 * @brief Resolve the column \p name once for repeated access.
+	 */
+	Column column(const QString &name) const;
+
+	/**
+	 * @brief A view of \p row reading the cells in place.
+	 * @note The view must not outlive the result.
+	 */
+	AsyncQueryRow row(int row) const;
+
+	/**
+	 * @brief A cursor positioned before the first row, see AsyncQueryRow::next().
+	 * @note The cursor must not outlive the result.
+	 */
+	AsyncQueryRow rows() const;
+
+	/**
+	 * @brief Returns internal raw data structure of result.
+	 */
+	QVector<QVector<QVariant>> data() const { return _data; }
+
+	/**
+	 * @brief Returns the object ID of the most recent inserted row
+	 *
+	 * @see QSqlQuery::lastInsertId()
+	 */
+	QVariant lastInsertId() const { return _lastInsertId; }
+	/**
+	 * @brief Returns the query string
+	 * @note A prepared query may not always have its value placeholder
+	 * replaced if the query fails.
+	 */
+	QString queryString() const { return _queryString; }
+	/**
+	 * @brief Returns the number of rows affected by the SQL statement
+	 *
+	 * @see QSqlQuery::numRowsAffected()
+	 */
+	int numRowsAffected() const { return _numRowsAffected; }
+
+	/**
+	 * @brief Returns all result sets of a script (AsyncQuery::startExecScript()),
+	 * multi result query (AsyncQuery::setMultiResult()) or AsyncPipeline in
+	 * execution order.
+	 * @details For scripts and multi result queries the result itself holds
+	 * the first result set, for pipelines the last one. If a statement failed,
+	 * its entry carries the error and is the last one. Empty for single result
+	 * queries.
+	 */
+	QVector<AsyncQueryResult> resultSets() const { return _resultSets; }
+
+	/**
+	 * @brief Returns \c true if the result is a snapshot from the persistent
+	 * ResultCache and not a fresh result from the database.
+	 *
+	 * @see AsyncQuery::setPersistentCache()
+	 */
+	bool isCached() const { return _isCached; }
+
+	/**
+	 * @brief Serialize the result into the binary format of operator<<().
+	 */
+	QByteArray toBinary() const;
+
+	/**
+	 * @brief Restore a result serialized with toBinary() or operator<<().
+	 * @details \p data may wrap a memory mapped file (QByteArray::fromRawData()
+	 * over QFile::map()), which saves reading the file into memory first.
+	 * Decoding still copies: every column block is read out of \p data and
+	 * its cells are converted to QVariants. Sizes are checked against the
+	 * remaining bytes before anything is allocated.
+	 * @param ok [optional] set to \c false if \p data is corrupt or has an
+	 * unsupported version.
+	 */
+	static AsyncQueryResult fromBinary(const QByteArray &data, bool *ok = nullptr);
+
+	/**
+	 * @brief Returns \c true if \p val holds an integer type (bool, int, uint,
+	 * qlonglong or qulonglong), \c false for doubles, text and invalid values.
+	 */
+	static bool isIntegral(const QVariant &val);
+
+private:
+	friend class AsyncQueryRow;
+
+	static QSqlError timeoutError();
+	static QSqlError rejectedError();
+	void setRecord(const QSqlRecord &record);
+
+	QVector<QVector<QVariant>> _data;
+	QSqlRecord _record;
+	QHash<QString, int> _columns;
+	QVector<QVector<QString>> _display;
+	QSqlError _error;
+	QVariant _lastInsertId;
+	QString _queryString;
+	int _numRowsAffected = -1;
+	bool _isCached = false;
+	QVector<AsyncQueryResult> _resultSets;
+};
+
+/**
+ * @brief Lightweight view of one row of an AsyncQueryResult, or a cursor over
+ * its rows.
+ *
+ * @details The typed accessors read the cells in place, without copying the
+ * row or building a QSqlRecord. Invalid columns read as NULL.
+ *
+ * Sample Usage:
+ * \code{.cpp}
+ * Database::AsyncQueryResult::Column name = result.column("Name");
+ * Database::AsyncQueryRow row = result.rows();
+ * while (row.next())
+ *     names << row.toString(name);
+ * \endcode
+ */
+class AsyncQueryRow
+{
+public:
+	AsyncQueryRow();
+
+	/**
+	 * @brief Returns \c true if the view is positioned on a row.
+	 */
+	bool isValid() const { return _cells != nullptr; }
+	int row() const { return _row; }
+	int count() const { return _count; }
+
+	/**
+	 * @brief Move to the next row.
+	 * @returns \c false after the last row.
+	 */
+	bool next();
+
+	const QVariant &value(int col) const;
+	const QVariant &value(AsyncQueryResult::Column col) const { return value(col.index()); }
+	const QVariant &value(const QString &col) const;
+
+	bool isNull(int col) const { return value(col).isNull(); }
+	bool isNull(AsyncQueryResult::Column col) const { return isNull(col.index()); }
+
+	int toInt(int col, bool *ok = nullptr) const { return value(col).toInt(ok); }
+	int toInt(AsyncQueryResult::Column col, bool *ok = nullptr) const
+	{ return toInt(col.index(), ok); }
+
+	qlonglong toLongLong(int col, bool *ok = nullptr) const { return value(col).toLongLong(ok); }
+	qlonglong toLongLong(AsyncQueryResult::Column col, bool *ok = nullptr) const
+	{ return toLongLong(col.index(), ok); }
+
+	double toDouble(int col, bool *ok = nullptr) const { return value(col).toDouble(ok); }
+	double toDouble(AsyncQueryResult::Column col, bool *ok = nullptr) const
+	{ return toDouble(col.index(), ok); }
+
+	bool toBool(int col) const { return value(col).toBool(); }
+	bool toBool(AsyncQueryResult::Column col) const { return toBool(col.index()); }
+
+	QString toString(int col) const { return value(col).toString(); }
+	QString toString(AsyncQueryResult::Column col) const { return toString(col.index()); }
+
+#if QT_VERSION >= QT_VERSION_CHECK(5,10,0)
+	/**
+	 * @brief View of a text cell without copying it.
+	 * @details Cells which do not hold a QString (numbers, NULL, ...) return
+	 * an empty view, use toString() for them.
+	 */
+	QStringView toStringView(int col) const;
+	QStringView toStringView(AsyncQueryResult::Column col) const
+	{ return toStringView(col.index()); }
+#endif
+
+private:
+	friend class AsyncQueryResult;
+	AsyncQueryRow(const AsyncQueryResult *result, int row);
+
+	const AsyncQueryResult *_result;
+	int _row;
+	const QVariant *_cells;
+	int _count;
+};
+
+/**
+ * @brief Write \p result in the versioned binary result format.
+ * @details The head record, error and meta data are followed by the rows in
+ * column-major order. Each column starts with a null bitmap and stores integer,
+ * floating point, string and blob columns as contiguous typed blocks. Columns
+ * with mixed types fall back to per-cell QVariant streaming. The result sets
+ * (resultSets()) and the display strings follow the rows.
+ * Invalid and typed null QVariants are both written as NULL.
+ * @note The column blocks make the format compact, they are not read in
+ * place: operator>>() copies each block out of the stream and converts its
+ * cells to the QVariant rows of the result.
+ */
+QDataStream &operator<<(QDataStream &out, const AsyncQueryResult &result);
+
+/**
+ * @brief Read a result written with operator<<().
+ * @details Sets QDataStream::ReadCorruptData on a bad header, an unknown
+ * version or sizes which exceed the remaining bytes of the stream. Version 1
+ * data has no result sets and no display strings.
+ */
+QDataStream &operator>>(QDataStream &in, AsyncQueryResult &result);
+
+}	//	namespace
+
+Q_DECLARE_METATYPE(Database::AsyncQueryResult)
@@ -0,0 +1,84 @@
+#include "AsyncSession.h"
+#include "ConnectionManager.h"
+
+#include <QRunnable>
+
+namespace Database {
+
+/**
+ * @brief Closes the connections of the session thread.
+ */
+class SessionCloseTaskPrivate : public QRunnable
+{
+public:
+	void run() override
+	{
+		// the session queries may use any connection profile
+		ConnectionManager *conmgr = ConnectionManager::instance();
+		QStringList profiles = conmgr->profileNames();
+		profiles.prepend(QString());
+		for (const QString &profile : profiles) {
+			if (conmgr->connectionExists(profile)) {
+				conmgr->closeOne(QThread::currentThread());
+				return;
+			}
+		}
+	}
+};
+
+/**
+ * @brief Runs a query task of the session.
+ */
+class SessionTaskPrivate : public QRunnable
+{
+public:
+	explicit SessionTaskPrivate(QRunnable *task)
+		: _task(task)
+	{
+	}
+
+	void run() override
+	{
+		bool deleteTask = _task->autoDelete();
+		_task->run();
+		if (deleteTask)
+			delete _task;
+		ConnectionManager::instance()->sendTableNotifications();
+	}
+
+private:
+	QRunnable *_task;
+};
+
+AsyncSession::AsyncSession(QObject *parent)
+	: QObject(parent), logger("Database.AsyncSession")
+{
+	// one thread which never expires, so its connection stays open
+	_pool.setMaxThreadCount(1);
+	_pool.setExpiryTimeout(-1);
+}
+
+AsyncSession::~AsyncSession()
+{
+	close();
+}
+
+bool AsyncSession::waitDone(int msTimout)
+{
+	return _pool.waitForDone(msTimout);
+}
+
+void AsyncSession::close()
+{
+	_pool.waitForDone();
+	_pool.start(new SessionCloseTaskPrivate());
+	_pool.waitForDone();
+	qCDebug(logger) << "AsyncSession::close: session closed";
+}
+
+void AsyncSession::start(QRunnable *task)
+{
+	_pool.start(new SessionTaskPrivate(task));
+}
+
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <QLoggingCategory>
+#include <QObject>
+#include <QThreadPool>
+
+namespace Database {
+
+// class forward decl's
+class AsyncQuery;
+
+/**
+ * @brief Pins a sequence of queries to one worker thread and its connection.
+ *
+ * @details Connections of the ConnectionManager belong to the pool thread
+ * which picks up a task, so session state (temporary tables, ATTACHed
+ * databases, SET variables, open transactions) is lost between queries.
+ * An AsyncSession reserves a private worker thread for its lifetime. All
+ * queries of AsyncQuery objects bound with AsyncQuery::setSession() run on
+ * this thread, on the same connection and in the order they were started.
+ *
+ * Sample Usage:
+ * \code{.cpp}
+ * Database::AsyncSession *session = new Database::AsyncSession(this);
+ * Database::AsyncQuery *query = new Database::AsyncQuery(this);
+ * query->setSession(session);
+ * query->startExec("CREATE TEMP TABLE Report AS SELECT ...");
+ * query->startExec("SELECT * FROM Report WHERE ...");
+ * \endcode
+ *
+ * Session queries do not count against
+ * ConnectionManager::setMaxTasksInFlight(), the session thread is not part of
+ * the global QThreadPool.
+ *
+ * @note The session has to outlive the queries bound to it.
+ */
+class AsyncSession : public QObject
+{
+	friend class AsyncQuery;
+	Q_OBJECT
+
+public:
+	explicit AsyncSession(QObject *parent = nullptr);
+
+	/**
+	 * @brief Waits for the queued queries and closes the connection.
+	 */
+	virtual ~AsyncSession();
+
+	/**
+	 * @brief Wait until all queries started in the session are executed.
+	 */
+	bool waitDone(int msTimout = -1);
+
+	/**
+	 * @brief Wait for the queued queries and close the session connections.
+	 * @details Session state is discarded, a subsequent query opens a new
+	 * connection.
+	 */
+	void close();
+
+private:
+	/** Runs \p task on the session thread and reports its table changes. */
+	void start(QRunnable *task);
+
+	QLoggingCategory logger;
+	QThreadPool _pool;
+};
+
+}
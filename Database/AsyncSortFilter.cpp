@@ -0,0 +1,181 @@
+#include "AsyncSortFilter.h"
+#include "ConnectionManager.h"
+#include "ResultOperations.h"
+
+#include <QRunnable>
+
+namespace Database {
+
+namespace {
+
+bool acceptsRow(const QVector<QVariant> &row, const QString &filter, int filterColumn)
+{
+	if (filterColumn >= 0)
+		return row.value(filterColumn).toString().contains(filter, Qt::CaseInsensitive);
+
+	for (const QVariant &val : row) {
+		if (val.toString().contains(filter, Qt::CaseInsensitive))
+			return true;
+	}
+	return false;
+}
+
+}
+
+/**
+ * @brief Shared by an AsyncSortFilter and its tasks, so tasks outliving the
+ * object do not call into freed memory.
+ */
+struct SortFilterStatePrivate
+{
+	QMutex mutex;
+	AsyncSortFilter *instance;
+};
+
+class SortFilterTaskPrivate : public QRunnable
+{
+public:
+	SortFilterTaskPrivate(const QSharedPointer<SortFilterStatePrivate> &state, quint64 generation,
+			const AsyncQueryResult &result, int sortColumn, Qt::SortOrder sortOrder,
+			const QString &filter, int filterColumn)
+		: _state(state)
+		, _generation(generation)
+		, _result(result)
+		, _sortColumn(sortColumn)
+		, _sortOrder(sortOrder)
+		, _filter(filter)
+		, _filterColumn(filterColumn)
+	{
+	}
+
+	void run() override
+	{
+		QVector<int> rows;
+		if (_filter.isEmpty()) {
+			rows.resize(_result.count());
+			for (int row = 0; row < rows.size(); row++)
+				rows[row] = row;
+		} else {
+			QString filter = _filter;
+			int filterColumn = _filterColumn;
+			rows = ResultOperations::filterRows(_result,
+				[filter, filterColumn](const QVector<QVariant> &row) {
+					return acceptsRow(row, filter, filterColumn);
+				});
+		}
+
+		if (_sortColumn >= 0) {
+			ResultOperations::SortColumn column = { _sortColumn, _sortOrder };
+			rows = ResultOperations::sortRows(_result,
+				QVector<ResultOperations::SortColumn>() << column, rows);
+		}
+
+		// the instance is not deleted while the state is locked
+		QMutexLocker locker(&_state->mutex);
+		if (_state->instance)
+			_state->instance->taskCallback(_generation, _result, rows);
+	}
+
+private:
+	QSharedPointer<SortFilterStatePrivate> _state;
+	quint64 _generation;
+	AsyncQueryResult _result;
+	int _sortColumn;
+	Qt::SortOrder _sortOrder;
+	QString _filter;
+	int _filterColumn;
+};
+
+/****************************************************************************************/
+/*                                       AsyncSortFilter                                */
+/****************************************************************************************/
+
+AsyncSortFilter::AsyncSortFilter(QObject *parent)
+	: QObject(parent)
+	, _state(new SortFilterStatePrivate)
+	, _generation(0)
+	, _sortColumn(-1)
+	, _sortOrder(Qt::AscendingOrder)
+	, _filterColumn(-1)
+{
+	_state->instance = this;
+	qRegisterMetaType<QVector<int>>("QVector<int>");
+}
+
+AsyncSortFilter::~AsyncSortFilter()
+{
+	// running tasks drop their result, a callback in progress finishes first
+	QMutexLocker locker(&_state->mutex);
+	_state->instance = nullptr;
+}
+
+void AsyncSortFilter::setSortColumn(int column, Qt::SortOrder order)
+{
+	QMutexLocker locker(&_mutex);
+	_sortColumn = column;
+	_sortOrder = order;
+}
+
+int AsyncSortFilter::sortColumn() const
+{
+	QMutexLocker locker(&_mutex);
+	return _sortColumn;
+}
+
+Qt::SortOrder AsyncSortFilter::sortOrder() const
+{
+	QMutexLocker locker(&_mutex);
+	return _sortOrder;
+}
+
+void AsyncSortFilter::setFilterFixedString(const QString &pattern)
+{
+	QMutexLocker locker(&_mutex);
+	_filter = pattern;
+}
+
+QString AsyncSortFilter::filterFixedString() const
+{
+	QMutexLocker locker(&_mutex);
+	return _filter;
+}
+
+void AsyncSortFilter::setFilterKeyColumn(int column)
+{
+	QMutexLocker locker(&_mutex);
+	_filterColumn = column;
+}
+
+int AsyncSortFilter::filterKeyColumn() const
+{
+	QMutexLocker locker(&_mutex);
+	return _filterColumn;
+}
+
+bool AsyncSortFilter::isActive() const
+{
+	QMutexLocker locker(&_mutex);
+	return _sortColumn >= 0 || !_filter.isEmpty();
+}
+
+void AsyncSortFilter::start(const AsyncQueryResult &result)
+{
+	QMutexLocker locker(&_mutex);
+	_generation++;
+	SortFilterTaskPrivate *task = new SortFilterTaskPrivate(_state, _generation, result,
+			_sortColumn, _sortOrder, _filter, _filterColumn);
+	ConnectionManager::instance()->startTask(task);
+}
+
+void AsyncSortFilter::taskCallback(quint64 generation, const AsyncQueryResult &result,
+		const QVector<int> &rows)
+{
+	_mutex.lock();
+	bool current = generation == _generation;
+	_mutex.unlock();
+
+	if (current)
+		emit finished(result, rows);
+}
+
+}
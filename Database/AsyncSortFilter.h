@@ -0,0 +1,101 @@
+#pragma once
+
+#include "AsyncQueryResult.h"
+
+#include <QMutex>
+#include <QObject>
+#include <QSharedPointer>
+#include <QVector>
+
+namespace Database {
+
+// class forward decl's
+class SortFilterTaskPrivate;
+struct SortFilterStatePrivate;
+
+/**
+ * @brief Sorts and filters an AsyncQueryResult off the calling thread.
+ *
+ * @details Used by AsyncQueryModel and AsyncQueryQMLModel. start() computes
+ * the visible row order of a result in the QThreadPool and emits finished()
+ * with the result and the source row indexes in display order. The filter
+ * and the sort are parallel (ResultOperations::filterRows() and
+ * ResultOperations::sortRows()): the rows are split into chunks which are
+ * processed by several pool threads, the sorted chunks are merged. A newer
+ * start() supersedes a still running one, whose result is silently dropped.
+ *
+ * The object may be deleted while tasks are running, they detach from it and
+ * drop their result.
+ */
+class AsyncSortFilter : public QObject
+{
+	friend class SortFilterTaskPrivate;
+	Q_OBJECT
+
+public:
+	/**
+	 * @brief Where the models sort their rows.
+	 */
+	enum SortStrategy {
+		/** The query is re-run with an ORDER BY clause (AsyncQuery::setOrderBy()). */
+		SortInSql,
+		/** The loaded result is sorted in the QThreadPool. */
+		SortOnWorker,
+	};
+	Q_ENUM(SortStrategy)
+
+	explicit AsyncSortFilter(QObject *parent = nullptr);
+	virtual ~AsyncSortFilter();
+
+	/**
+	 * @brief Column to sort by, -1 keeps the order of the result.
+	 */
+	void setSortColumn(int column, Qt::SortOrder order = Qt::AscendingOrder);
+	int sortColumn() const;
+	Qt::SortOrder sortOrder() const;
+
+	/**
+	 * @brief Only rows containing \p pattern (case insensitive) are accepted.
+	 * An empty pattern accepts all rows.
+	 */
+	void setFilterFixedString(const QString &pattern);
+	QString filterFixedString() const;
+
+	/**
+	 * @brief Column the filter is applied to, -1 matches any column.
+	 */
+	void setFilterKeyColumn(int column);
+	int filterKeyColumn() const;
+
+	/**
+	 * @brief Returns \c true if a sort column or a filter is set.
+	 */
+	bool isActive() const;
+
+	/**
+	 * @brief Start sorting and filtering \p result.
+	 */
+	void start(const AsyncQueryResult &result);
+
+signals:
+	/**
+	 * @brief Is emitted when the row order for \p result is computed.
+	 * @param rows Source rows of \p result in display order.
+	 */
+	void finished(const Database::AsyncQueryResult &result, const QVector<int> &rows);
+
+private:
+	// attention lives in the context of QRunable
+	void taskCallback(quint64 generation, const AsyncQueryResult &result,
+			const QVector<int> &rows);
+
+	mutable QMutex _mutex;
+	QSharedPointer<SortFilterStatePrivate> _state;
+	quint64 _generation;
+	int _sortColumn;
+	Qt::SortOrder _sortOrder;
+	QString _filter;
+	int _filterColumn;
+};
+
+}
@@ -0,0 +1,572 @@
+#include "BulkImport.h"
+#include "ConnectionManager.h"
+
+#include <QFile>
+#include <QQueue>
+#include <QRunnable>
+#include <QSharedPointer>
+#include <QSqlDriver>
+#include <QSqlError>
+#include <QSqlQuery>
+#include <QThread>
+#include <QVariant>
+#include <QVector>
+
+namespace Database {
+
+namespace {
+
+/** Converted rows of one parser chunk, stored column-wise for execBatch(). */
+struct ParsedChunk {
+	QVector<QVariantList> columns;
+	int rows = 0;
+};
+
+/**
+ * State shared between the parsers and the writer. The queue is bounded, so
+ * parsers block while the writer is behind and memory usage stays constant.
+ */
+struct ImportState {
+	QMutex mutex;
+	QWaitCondition notEmpty;
+	QWaitCondition notFull;
+	QQueue<ParsedChunk> queue;
+	int maxQueued = 4;
+	int parsersRunning = 0;
+	bool cancel = false;
+	qint64 errors = 0;
+
+	void push(const ParsedChunk &chunk)
+	{
+		QMutexLocker locker(&mutex);
+		while (!cancel && queue.size() >= maxQueued)
+			notFull.wait(&mutex);
+		if (!cancel)
+			queue.enqueue(chunk);
+		notEmpty.wakeAll();
+	}
+
+	/** @returns \c false if all parsers are done and the queue is empty */
+	bool pop(ParsedChunk *chunk)
+	{
+		QMutexLocker locker(&mutex);
+		while (queue.isEmpty() && parsersRunning > 0)
+			notEmpty.wait(&mutex);
+		if (queue.isEmpty())
+			return false;
+		*chunk = queue.dequeue();
+		notFull.wakeAll();
+		return true;
+	}
+
+	void parserDone(qint64 parseErrors)
+	{
+		QMutexLocker locker(&mutex);
+		parsersRunning--;
+		errors += parseErrors;
+		notEmpty.wakeAll();
+	}
+
+	void abort()
+	{
+		QMutexLocker locker(&mutex);
+		cancel = true;
+		queue.clear();
+		notFull.wakeAll();
+	}
+
+	bool isCanceled()
+	{
+		QMutexLocker locker(&mutex);
+		return cancel;
+	}
+
+	qint64 errorCount()
+	{
+		QMutexLocker locker(&mutex);
+		return errors;
+	}
+};
+
+/**
+ * Reads one record starting at \p p and advances \p p behind its line break.
+ * Unquoted empty fields are null byte arrays, quoted empty fields are empty.
+ */
+void parseRecord(const char *&p, const char *end, char delimiter,
+		QVector<QByteArray> &fields)
+{
+	fields.clear();
+	QByteArray field;
+	bool inQuotes = false;
+
+	while (p < end) {
+		char c = *p;
+		if (inQuotes) {
+			if (c == '"') {
+				if (p + 1 < end && p[1] == '"') {
+					field += '"';
+					p += 2;
+					continue;
+				}
+				inQuotes = false;
+			} else {
+				field += c;
+			}
+			p++;
+			continue;
+		}
+
+		if (c == '"') {
+			inQuotes = true;
+			if (field.isNull())
+				field = QByteArray("");
+		} else if (c == delimiter) {
+			fields << field;
+			field = QByteArray();
+		} else if (c == '\r' || c == '\n') {
+			break;
+		} else {
+			field += c;
+		}
+		p++;
+	}
+	fields << field;
+
+	if (p < end && *p == '\r')
+		p++;
+	if (p < end && *p == '\n')
+		p++;
+}
+
+/**
+ * Checks for a plain decimal number: an optional minus sign, digits without
+ * leading zeros, an optional fraction and exponent. Codes like "007" or
+ * "+49 30", "nan" and "inf" are no numbers and stay text.
+ */
+bool isNumber(const QByteArray &field, bool *integral)
+{
+	const char *p = field.constData();
+	const char *end = p + field.size();
+	auto digits = [&p, end]() {
+		const char *begin = p;
+		while (p < end && *p >= '0' && *p <= '9')
+			p++;
+		return int(p - begin);
+	};
+
+	if (p < end && *p == '-')
+		p++;
+	const char *first = p;
+	int count = digits();
+	if (count == 0 || (count > 1 && *first == '0'))
+		return false;
+
+	*integral = true;
+	if (p < end && *p == '.') {
+		p++;
+		if (digits() == 0)
+			return false;
+		*integral = false;
+	}
+	if (p < end && (*p == 'e' || *p == 'E')) {
+		p++;
+		if (p < end && (*p == '+' || *p == '-'))
+			p++;
+		if (digits() == 0)
+			return false;
+		*integral = false;
+	}
+	return p == end;
+}
+
+QVariant convertField(const QByteArray &field, bool convertTypes)
+{
+	if (field.isNull())
+		return QVariant();
+
+	bool integral;
+	if (convertTypes && isNumber(field, &integral)) {
+		bool ok;
+		if (integral) {
+			// integers beyond 64 bit keep their digits as text
+			qlonglong ival = field.toLongLong(&ok);
+			if (ok)
+				return ival;
+		} else {
+			double dval = field.toDouble(&ok);
+			if (ok)
+				return dval;
+		}
+	}
+	return QString::fromUtf8(field);
+}
+
+/**
+ * Splits [begin, end) into \p parts ranges, each starting at a record.
+ * Line breaks inside quoted fields are skipped.
+ */
+QVector<const char *> recordBoundaries(const char *begin, const char *end, int parts)
+{
+	QVector<const char *> bounds;
+	bounds << begin;
+
+	const qint64 size = end - begin;
+	const char *p = begin;
+	bool inQuotes = false;
+	for (int i = 1; i < parts; i++) {
+		const char *target = begin + size * i / parts;
+		while (p < end && p < target) {
+			if (*p == '"')
+				inQuotes = !inQuotes;
+			p++;
+		}
+		while (p < end) {
+			char c = *p++;
+			if (c == '"')
+				inQuotes = !inQuotes;
+			else if (c == '\n' && !inQuotes)
+				break;
+		}
+		bounds << p;
+	}
+	bounds << end;
+	return bounds;
+}
+
+}
+
+class CsvParseTaskPrivate : public QRunnable
+{
+public:
+	CsvParseTaskPrivate(QSharedPointer<ImportState> state, const char *begin,
+			const char *end, int columns, char delimiter, int chunkRows,
+			bool convertTypes)
+		: _state(state)
+		, _begin(begin)
+		, _end(end)
+		, _columns(columns)
+		, _delimiter(delimiter)
+		, _chunkRows(chunkRows)
+		, _convertTypes(convertTypes)
+	{
+	}
+
+	void run() override
+	{
+		qint64 errors = 0;
+		QVector<QByteArray> fields;
+		ParsedChunk chunk;
+		chunk.columns.resize(_columns);
+
+		const char *p = _begin;
+		while (p < _end && !_state->isCanceled()) {
+			parseRecord(p, _end, _delimiter, fields);
+			if (_columns > 1 && fields.size() == 1 && fields.first().isNull())
+				continue; // empty line, in a single column file it is a NULL field
+			if (fields.size() != _columns) {
+				errors++;
+				continue;
+			}
+
+			for (int i = 0; i < _columns; i++)
+				chunk.columns[i] << convertField(fields[i], _convertTypes);
+			chunk.rows++;
+
+			if (chunk.rows >= _chunkRows) {
+				_state->push(chunk);
+				chunk = ParsedChunk();
+				chunk.columns.resize(_columns);
+			}
+		}
+		if (chunk.rows > 0)
+			_state->push(chunk);
+
+		_state->parserDone(errors);
+	}
+
+private:
+	QSharedPointer<ImportState> _state;
+	const char *_begin;
+	const char *_end;
+	int _columns;
+	char _delimiter;
+	int _chunkRows;
+	bool _convertTypes;
+};
+
+class ImportTaskPrivate : public QRunnable
+{
+public:
+	ImportTaskPrivate(BulkImport *instance, const QString &fileName, const QString &table)
+		: _instance(instance)
+		, _fileName(fileName)
+		, _table(table)
+	{
+		QMutexLocker locker(&instance->_mutex);
+		_delimiter = instance->_delimiter;
+		_hasHeader = instance->_hasHeader;
+		_columns = instance->_columns;
+		_convertTypes = instance->_convertTypes;
+		_parserThreads = instance->_parserThreads;
+		_chunkRows = instance->_chunkRows;
+	}
+
+	void run() override
+	{
+		qint64 rows = 0;
+		QString errorText;
+		QSharedPointer<ImportState> state(new ImportState);
+
+		QFile file(_fileName);
+		if (!file.open(QIODevice::ReadOnly)) {
+			_instance->taskCallback(0, 0, file.errorString());
+			return;
+		}
+
+		qint64 size = file.size();
+		uchar *mapped = size > 0 ? file.map(0, size) : nullptr;
+		if (size > 0 && !mapped) {
+			_instance->taskCallback(0, 0, file.errorString());
+			return;
+		}
+		const char *begin = reinterpret_cast<const char *>(mapped);
+		const char *end = begin + size;
+
+		// skip UTF-8 BOM
+		if (size >= 3 && begin[0] == '\xEF' && begin[1] == '\xBB' && begin[2] == '\xBF')
+			begin += 3;
+
+		QStringList columns = _columns;
+		if (_hasHeader && begin < end) {
+			QVector<QByteArray> fields;
+			parseRecord(begin, end, _delimiter, fields);
+			if (columns.isEmpty()) {
+				for (const QByteArray &field : fields)
+					columns << QString::fromUtf8(field).trimmed();
+			}
+		}
+		if (columns.isEmpty()) {
+			if (mapped)
+				file.unmap(mapped);
+			_instance->taskCallback(0, 0, "No columns to import");
+			return;
+		}
+
+		// start parsers
+		QVector<const char *> bounds = recordBoundaries(begin, end, _parserThreads);
+		state->maxQueued = 2 * _parserThreads;
+		state->parsersRunning = bounds.size() - 1;
+		for (int i = 0; i + 1 < bounds.size(); i++) {
+			_instance->_parserPool.start(new CsvParseTaskPrivate(state, bounds[i],
+					bounds[i + 1], columns.size(), _delimiter, _chunkRows, _convertTypes));
+		}
+
+		// write chunks, to the file if reads are served from a memory replica
+		QSqlError error;
+		ConnectionManager* conmgr = ConnectionManager::instance();
+		bool toReplicaSource = conmgr->memoryReplica()->isActive();
+		QString profile = toReplicaSource ? MemoryReplica::sourceProfile() : QString();
+		bool succ = conmgr->connectionExists(profile) || conmgr->open(profile, &error);
+		QSqlDatabase db = conmgr->threadConnection(profile);
+		QSqlQuery query(db);
+
+		if (succ) {
+			QSqlDriver *driver = db.driver();
+			QStringList names, placeholders;
+			for (const QString &col : columns) {
+				names << driver->escapeIdentifier(col, QSqlDriver::FieldName);
+				placeholders << "?";
+			}
+			succ = query.prepare(QString("INSERT INTO %1 (%2) VALUES (%3)").arg(
+					driver->escapeIdentifier(_table, QSqlDriver::TableName),
+					names.join(", "), placeholders.join(", ")));
+			if (!succ)
+				error = query.lastError();
+		}
+
+		ParsedChunk chunk;
+		while (succ && state->pop(&chunk)) {
+			bool inTransaction = db.transaction();
+			for (int i = 0; i < chunk.columns.size(); i++)
+				query.bindValue(i, chunk.columns[i]);
+			succ = query.execBatch();
+			if (!succ)
+				error = query.lastError();
+
+			if (inTransaction) {
+				if (succ && !db.commit()) {
+					succ = false;
+					error = db.lastError();
+				}
+				if (!succ)
+					db.rollback();
+			}
+			if (succ) {
+				rows += chunk.rows;
+				emit _instance->progress(rows, state->errorCount());
+			}
+		}
+
+		if (!succ) {
+			errorText = error.text();
+			state->abort();
+		}
+		_instance->_parserPool.waitForDone();
+		if (mapped)
+			file.unmap(mapped);
+		if (toReplicaSource && rows > 0)
+			conmgr->memoryReplica()->requestSync();
+
+		_instance->taskCallback(rows, state->errorCount(), errorText);
+	}
+
+private:
+	BulkImport *_instance;
+	QString _fileName;
+	QString _table;
+	char _delimiter;
+	bool _hasHeader;
+	QStringList _columns;
+	bool _convertTypes;
+	int _parserThreads;
+	int _chunkRows;
+};
+
+/****************************************************************************************/
+/*                                          BulkImport                                  */
+/****************************************************************************************/
+
+BulkImport::BulkImport(QObject *parent)
+	: QObject(parent), logger("Database.BulkImport")
+	, _running(false)
+	, _delimiter(',')
+	, _hasHeader(true)
+	, _convertTypes(true)
+	, _parserThreads(qMax(1, QThread::idealThreadCount()))
+	, _chunkRows(10000)
+{
+}
+
+BulkImport::~BulkImport()
+{
+	waitDone();
+}
+
+void BulkImport::setDelimiter(char delimiter)
+{
+	QMutexLocker locker(&_mutex);
+	_delimiter = delimiter;
+}
+
+char BulkImport::delimiter() const
+{
+	QMutexLocker locker(&_mutex);
+	return _delimiter;
+}
+
+void BulkImport::setHasHeader(bool hasHeader)
+{
+	QMutexLocker locker(&_mutex);
+	_hasHeader = hasHeader;
+}
+
+bool BulkImport::hasHeader() const
+{
+	QMutexLocker locker(&_mutex);
+	return _hasHeader;
+}
+
+void BulkImport::setColumns(const QStringList &columns)
+{
+	QMutexLocker locker(&_mutex);
+	_columns = columns;
+}
+
+QStringList BulkImport::columns() const
+{
+	QMutexLocker locker(&_mutex);
+	return _columns;
+}
+
+void BulkImport::setConvertTypes(bool convert)
+{
+	QMutexLocker locker(&_mutex);
+	_convertTypes = convert;
+}
+
+bool BulkImport::convertTypes() const
+{
+	QMutexLocker locker(&_mutex);
+	return _convertTypes;
+}
+
+void BulkImport::setParserThreads(int threads)
+{
+	QMutexLocker locker(&_mutex);
+	_parserThreads = qMax(1, threads);
+}
+
+int BulkImport::parserThreads() const
+{
+	QMutexLocker locker(&_mutex);
+	return _parserThreads;
+}
+
+void BulkImport::setChunkRows(int rows)
+{
+	QMutexLocker locker(&_mutex);
+	_chunkRows = qMax(1, rows);
+}
+
+int BulkImport::chunkRows() const
+{
+	QMutexLocker locker(&_mutex);
+	return _chunkRows;
+}
+
+bool BulkImport::isRunning() const
+{
+	QMutexLocker locker(&_mutex);
+	return _running;
+}
+
+bool BulkImport::startImport(const QString &fileName, const QString &table)
+{
+	_mutex.lock();
+	if (_running) {
+		_mutex.unlock();
+		qCWarning(logger) << "BulkImport::startImport: import already running";
+		return false;
+	}
+	_running = true;
+	_parserPool.setMaxThreadCount(_parserThreads);
+	_mutex.unlock();
+
+	ConnectionManager::instance()->startTask(new ImportTaskPrivate(this, fileName, table));
+	return true;
+}
+
+bool BulkImport::waitDone(ulong msTimout)
+{
+	QMutexLocker lock(&_mutex);
+	if (_running)
+		return _waitcondition.wait(&_mutex, msTimout);
+	else
+		return true;
+}
+
+void BulkImport::taskCallback(qint64 rows, qint64 errors, const QString &errorText)
+{
+	if (!errorText.isEmpty())
+		qCWarning(logger) << "BulkImport: import failed:" << errorText;
+
+	emit importDone(rows, errors, errorText);
+
+	// wake waitDone() last, the destructor may delete the object then
+	_mutex.lock();
+	_running = false;
+	_waitcondition.wakeAll();
+	_mutex.unlock();
+}
+
+}
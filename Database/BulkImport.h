@@ -0,0 +1,138 @@
+#pragma once
+
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QThreadPool>
+#include <QWaitCondition>
+#include <QMutex>
+#include <QLoggingCategory>
+
+namespace Database {
+
+// class forward decl's
+class ImportTaskPrivate;
+
+/**
+ * @brief Imports a CSV file into a database table.
+ *
+ * @details The file is memory mapped and split on record boundaries into one
+ * range per parser thread. The parsers run in a private QThreadPool, convert
+ * the fields and hand chunks of rows to a single writer task in the global
+ * QThreadPool. The writer uses the thread connection of the ConnectionManager
+ * and inserts each chunk with a prepared batch query in its own transaction.
+ *
+ * Sample Usage:
+ * \code{.cpp}
+ * Database::BulkImport *import = new Database::BulkImport(this);
+ * connect(import, &Database::BulkImport::progress, ...);
+ * connect(import, &Database::BulkImport::importDone, ...);
+ * import->startImport("/data/orders.csv", "Orders");
+ * \endcode
+ *
+ * Field conversion: an unquoted empty field is NULL, integers and decimal
+ * numbers are bound as qlonglong and double (see setConvertTypes()), all
+ * other fields as QString. Numbers with leading zeros or a plus sign
+ * ("007", "+49"), "nan" and "inf" stay text. Records with a different
+ * number of fields than the header are skipped and counted as errors.
+ * Empty lines are skipped, except in a file with a single column, where
+ * they are records with a NULL field.
+ *
+ * @note Rows are not inserted in file order.
+ */
+class BulkImport : public QObject
+{
+	friend class ImportTaskPrivate;
+	Q_OBJECT
+
+public:
+	explicit BulkImport(QObject *parent = nullptr);
+	virtual ~BulkImport();
+
+	/**
+	 * @brief Field delimiter, default ','.
+	 */
+	void setDelimiter(char delimiter);
+	char delimiter() const;
+
+	/**
+	 * @brief Does the first record contain the column names (default \c true).
+	 */
+	void setHasHeader(bool hasHeader);
+	bool hasHeader() const;
+
+	/**
+	 * @brief Target columns in field order. Default are the header names.
+	 * @note Required if the file has no header.
+	 */
+	void setColumns(const QStringList &columns);
+	QStringList columns() const;
+
+	/**
+	 * @brief Convert numeric fields to qlonglong/double (default \c true).
+	 */
+	void setConvertTypes(bool convert);
+	bool convertTypes() const;
+
+	/**
+	 * @brief Number of parser threads, default QThread::idealThreadCount().
+	 */
+	void setParserThreads(int threads);
+	int parserThreads() const;
+
+	/**
+	 * @brief Rows per batch and transaction, default 10000.
+	 */
+	void setChunkRows(int rows);
+	int chunkRows() const;
+
+	/**
+	 * @brief Is an import running.
+	 */
+	bool isRunning() const;
+
+	/**
+	 * @brief Start importing \p fileName into \p table.
+	 * @returns \c false if an import is already running.
+	 */
+	bool startImport(const QString &fileName, const QString &table);
+
+	/**
+	 * @brief Wait for the import to finish.
+	 */
+	bool waitDone(ulong msTimout = ULONG_MAX);
+
+signals:
+	/**
+	 * @brief Is emitted from the writer after each committed chunk.
+	 * @param rows Number of rows inserted so far.
+	 * @param errors Number of records skipped so far.
+	 */
+	void progress(qint64 rows, qint64 errors);
+
+	/**
+	 * @brief Is emitted when the import is finished.
+	 * @param errorText Empty on success, otherwise the file or database error
+	 * which aborted the import. Already committed chunks stay in the table.
+	 */
+	void importDone(qint64 rows, qint64 errors, const QString &errorText);
+
+private:
+	// attention lives in the context of QRunable
+	void taskCallback(qint64 rows, qint64 errors, const QString &errorText);
+
+	QLoggingCategory logger;
+
+	mutable QMutex _mutex;
+	QWaitCondition _waitcondition;
+	QThreadPool _parserPool;
+	bool _running;
+	char _delimiter;
+	bool _hasHeader;
+	QStringList _columns;
+	bool _convertTypes;
+	int _parserThreads;
+	int _chunkRows;
+};
+
+}
@@ -0,0 +1,240 @@
+#include "ColumnHint.h"
+#include "AsyncQueryResult.h"
+
+#include <QDateTime>
+#include <QRegularExpression>
+
+#include <cmath>
+
+namespace Database {
+
+namespace {
+
+/**
+ * Formats the decimal number \p text (sign, digits, fraction, exponent) with
+ * \p scale fraction digits, rounded half away from zero, without going
+ * through double. Returns a null string if \p text is no such number.
+ */
+QString formatDecimal(const QString &text, int scale, const QLocale &locale)
+{
+	static const QRegularExpression number(
+		"^\\s*([+-]?)(\\d*)(?:\\.(\\d*))?(?:[eE]([+-]?\\d{1,3}))?\\s*$");
+	QRegularExpressionMatch match = number.match(text);
+	if (!match.hasMatch() || match.capturedLength(2) + match.capturedLength(3) == 0)
+		return QString();
+
+	// all digits and the position of the decimal point in them
+	QString digits = match.captured(2) + match.captured(3);
+	int point = match.capturedLength(2) + match.captured(4).toInt();
+	if (point < 1) {
+		digits.prepend(QString(1 - point, QLatin1Char('0')));
+		point = 1;
+	}
+	if (point > digits.size())
+		digits.append(QString(point - digits.size(), QLatin1Char('0')));
+
+	if (scale >= 0 && digits.size() - point > scale) {
+		bool up = digits.at(point + scale) >= QLatin1Char('5');
+		digits.truncate(point + scale);
+		for (int i = digits.size() - 1; up && i >= 0; i--) {
+			up = digits.at(i) == QLatin1Char('9');
+			digits[i] = up ? QChar(QLatin1Char('0')) : QChar(digits.at(i).unicode() + 1);
+		}
+		if (up) {
+			digits.prepend(QLatin1Char('1'));
+			point++;
+		}
+	} else if (scale >= 0) {
+		digits.append(QString(point + scale - digits.size(), QLatin1Char('0')));
+	}
+
+	int lead = 0;
+	while (lead < point - 1 && digits.at(lead) == QLatin1Char('0'))
+		lead++;
+	QString integer = digits.mid(lead, point - lead);
+	QString fraction = digits.mid(point);
+	bool negative = match.captured(1) == QLatin1String("-")
+			&& digits.count(QLatin1Char('0')) != digits.size();
+
+	if (!locale.numberOptions().testFlag(QLocale::OmitGroupSeparator)) {
+		for (int pos = integer.size() - 3; pos > 0; pos -= 3)
+			integer.insert(pos, locale.groupSeparator());
+	}
+	QString result = integer;
+	if (!fraction.isEmpty())
+		result += locale.decimalPoint() + fraction;
+	if (locale.zeroDigit() != QLatin1Char('0')) {
+		for (int i = 0; i < result.size(); i++) {
+			if (result.at(i).isDigit() && result.at(i).unicode() < 128)
+				result[i] = QChar(locale.zeroDigit().unicode() + result.at(i).digitValue());
+		}
+	}
+	if (negative)
+		result.prepend(locale.negativeSign());
+	return result;
+}
+
+}
+
+ColumnHint::ColumnHint()
+	: _type(Type_None)
+	, _scale(-1)
+{
+}
+
+ColumnHint ColumnHint::date(const QString &format, const QString &displayFormat)
+{
+	ColumnHint hint;
+	hint._type = Type_Date;
+	hint._format = format;
+	hint._displayFormat = displayFormat;
+	return hint;
+}
+
+ColumnHint ColumnHint::time(const QString &format, const QString &displayFormat)
+{
+	ColumnHint hint;
+	hint._type = Type_Time;
+	hint._format = format;
+	hint._displayFormat = displayFormat;
+	return hint;
+}
+
+ColumnHint ColumnHint::dateTime(const QString &format, const QString &displayFormat)
+{
+	ColumnHint hint;
+	hint._type = Type_DateTime;
+	hint._format = format;
+	hint._displayFormat = displayFormat;
+	return hint;
+}
+
+ColumnHint ColumnHint::decimal(int scale)
+{
+	ColumnHint hint;
+	hint._type = Type_Decimal;
+	hint._scale = scale;
+	return hint;
+}
+
+ColumnHint ColumnHint::enumeration(const QHash<QString, QString> &labels)
+{
+	ColumnHint hint;
+	hint._type = Type_Enum;
+	hint._labels = labels;
+	return hint;
+}
+
+QVariant ColumnHint::convert(const QVariant &val) const
+{
+	if (val.isNull() || (val.type() != QVariant::String && _type != Type_Decimal))
+		return val;
+
+	switch (_type) {
+	case Type_Date: {
+		QDate date = _format.isEmpty() ? QDate::fromString(val.toString(), Qt::ISODate)
+									   : QDate::fromString(val.toString(), _format);
+		return date.isValid() ? QVariant(date) : val;
+	}
+	case Type_Time: {
+		QTime time = _format.isEmpty() ? QTime::fromString(val.toString(), Qt::ISODate)
+									   : QTime::fromString(val.toString(), _format);
+		return time.isValid() ? QVariant(time) : val;
+	}
+	case Type_DateTime: {
+		QString text = val.toString();
+		QDateTime dateTime;
+		if (_format.isEmpty()) {
+			dateTime = QDateTime::fromString(text, QStringLiteral("yyyy-MM-dd HH:mm:ss"));
+			if (!dateTime.isValid())
+				dateTime = QDateTime::fromString(text, Qt::ISODate);
+		} else {
+			dateTime = QDateTime::fromString(text, _format);
+		}
+		return dateTime.isValid() ? QVariant(dateTime) : val;
+	}
+	case Type_Decimal: {
+		// integers are exact already, a double has no fraction digits to round
+		if (AsyncQueryResult::isIntegral(val))
+			return val;
+		bool ok;
+		double num = val.toDouble(&ok);
+		if (!ok)
+			return val;
+		if (_scale >= 0) {
+			double factor = std::pow(10.0, _scale);
+			num = std::round(num * factor) / factor;
+		}
+		return QVariant(num);
+	}
+	default:
+		return val;
+	}
+}
+
+QString ColumnHint::display(const QVariant &val, const QLocale &locale,
+							const QVariant &fetched) const
+{
+	if (val.isNull())
+		return QString();
+
+	switch (_type) {
+	case Type_Date:
+		if (val.type() == QVariant::Date && !_displayFormat.isEmpty())
+			return val.toDate().toString(_displayFormat);
+		break;
+	case Type_Time:
+		if (val.type() == QVariant::Time && !_displayFormat.isEmpty())
+			return val.toTime().toString(_displayFormat);
+		break;
+	case Type_DateTime:
+		if (val.type() == QVariant::DateTime && !_displayFormat.isEmpty())
+			return val.toDateTime().toString(_displayFormat);
+		break;
+	case Type_Decimal: {
+		// text and integers are formatted exactly, a double can only be rounded
+		QVariant exact = fetched.isValid() ? fetched : val;
+		if (exact.type() == QVariant::String || AsyncQueryResult::isIntegral(exact)) {
+			QString text = formatDecimal(exact.toString(), _scale, locale);
+			if (!text.isNull())
+				return text;
+		}
+		if (val.type() == QVariant::Double && _scale >= 0)
+			return locale.toString(val.toDouble(), 'f', _scale);
+		break;
+	}
+	case Type_Enum: {
+		QString key = val.toString();
+		return _labels.value(key, key);
+	}
+	default:
+		break;
+	}
+	return defaultDisplay(val, locale);
+}
+
+QString ColumnHint::defaultDisplay(const QVariant &val, const QLocale &locale)
+{
+	switch (val.type()) {
+	case QVariant::Invalid:
+		return QString();
+	case QVariant::Int:
+	case QVariant::LongLong:
+		return locale.toString(val.toLongLong());
+	case QVariant::UInt:
+	case QVariant::ULongLong:
+		return locale.toString(val.toULongLong());
+	case QVariant::Double:
+		return locale.toString(val.toDouble());
+	case QVariant::Date:
+		return locale.toString(val.toDate(), QLocale::ShortFormat);
+	case QVariant::Time:
+		return locale.toString(val.toTime(), QLocale::ShortFormat);
+	case QVariant::DateTime:
+		return locale.toString(val.toDateTime(), QLocale::ShortFormat);
+	default:
+		return val.isNull() ? QString() : val.toString();
+	}
+}
+
+}
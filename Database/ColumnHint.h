@@ -0,0 +1,110 @@
+#pragma once
+
+#include <QHash>
+#include <QLocale>
+#include <QString>
+#include <QVariant>
+
+namespace Database {
+
+/**
+ * @brief Type hint of a result column, applied on the worker thread while the
+ * rows are fetched (see AsyncQuery::setColumnHint()).
+ *
+ * @details Drivers like QSQLITE return dates and decimals as text. A hint
+ * converts the cells of a column into the proper type once, so neither sorting
+ * nor painting has to parse them again. With AsyncQuery::setDisplayStrings()
+ * the hint also formats the DisplayRole text of the column.
+ *
+ * Sample Usage:
+ * \code{.cpp}
+ * query->setColumnHint("InvoiceDate", Database::ColumnHint::dateTime());
+ * query->setColumnHint("Total", Database::ColumnHint::decimal(2));
+ * query->setColumnHint("Status", Database::ColumnHint::enumeration({{"0", "open"}, {"1", "paid"}}));
+ * \endcode
+ */
+class ColumnHint
+{
+public:
+	enum Type {
+		/** No conversion, only the default display format. */
+		Type_None,
+		/** Text parsed to QDate. */
+		Type_Date,
+		/** Text parsed to QTime. */
+		Type_Time,
+		/** Text parsed to QDateTime. */
+		Type_DateTime,
+		/**
+		 * Text or double converted to double, rounded to scale(), integers
+		 * are kept. The display text is formatted from the fetched value.
+		 */
+		Type_Decimal,
+		/** Value kept, displayed with the label of labels(). */
+		Type_Enum,
+	};
+
+	ColumnHint();
+
+	/**
+	 * @brief Parse dates with \p format, ISO 8601 if empty. Displayed with
+	 * \p displayFormat or the short locale format if empty.
+	 */
+	static ColumnHint date(const QString &format = QString(),
+						   const QString &displayFormat = QString());
+	static ColumnHint time(const QString &format = QString(),
+						   const QString &displayFormat = QString());
+	/**
+	 * @details The empty \p format accepts SQLite's <tt>yyyy-MM-dd HH:mm:ss</tt>
+	 * and ISO 8601.
+	 */
+	static ColumnHint dateTime(const QString &format = QString(),
+							   const QString &displayFormat = QString());
+
+	/**
+	 * @brief Decimal with \p scale fraction digits, -1 keeps all digits.
+	 */
+	static ColumnHint decimal(int scale = -1);
+
+	/**
+	 * @brief Display the label of a value, keyed by the value as string.
+	 * @details Values without a label are displayed as they are.
+	 */
+	static ColumnHint enumeration(const QHash<QString, QString> &labels);
+
+	Type type() const { return _type; }
+	QString format() const { return _format; }
+	QString displayFormat() const { return _displayFormat; }
+	int scale() const { return _scale; }
+	QHash<QString, QString> labels() const { return _labels; }
+
+	/**
+	 * @brief Convert the cell value \p val, NULL stays NULL.
+	 * @details Values which can not be converted are returned unchanged.
+	 */
+	QVariant convert(const QVariant &val) const;
+
+	/**
+	 * @brief DisplayRole text of the converted cell value \p val.
+	 * @details Decimals are formatted from \p fetched, the value before
+	 * convert(), if it is text or an integer. Its digits are rounded as they
+	 * are, a double would lose precision beyond 15 digits.
+	 */
+	QString display(const QVariant &val, const QLocale &locale,
+					const QVariant &fetched = QVariant()) const;
+
+	/**
+	 * @brief DisplayRole text of an unhinted cell, formatted like
+	 * QStyledItemDelegate::displayText().
+	 */
+	static QString defaultDisplay(const QVariant &val, const QLocale &locale);
+
+private:
+	Type _type;
+	QString _format;
+	QString _displayFormat;
+	int _scale;
+	QHash<QString, QString> _labels;
+};
+
+}
@@ -1,233 +1,1116 @@
-#include "ConnectionManager.h"
-#include <QSqlError>
-
-
-namespace Database {
-
-ConnectionManager *ConnectionManager::_instance = nullptr;
-QMutex ConnectionManager::_instanceMutex;
-
-ConnectionManager::ConnectionManager(QObject* parent /*= nullptr */)
-	: QObject(parent), logger("Database.ConnectionManager")
-{
-	_port = -1;
-	_precisionPolicy = QSql::LowPrecisionDouble;
-	_type = "QMYSQL";
-}
-
-ConnectionManager::~ConnectionManager()
-{
-	closeAll();
-}
-
-ConnectionManager *ConnectionManager::createInstance()
-{
-	return instance();
-}
-
-ConnectionManager *ConnectionManager::instance()
-{
-	QMutexLocker locker(&_instanceMutex);
-	if (_instance == nullptr) {
-		_instance = new ConnectionManager();
-	}
-	return _instance;
-}
-
-void ConnectionManager::destroyInstance()
-{
-	QMutexLocker locker(&_instanceMutex);
-	if (_instance != nullptr) {
-		delete _instance; _instance = nullptr;
-	}
-}
-
-void ConnectionManager::setType(QString type)
-{
-	QMutexLocker locker(&_mutex);
-	_type = type;
-}
-
-QString ConnectionManager::type()
-{
-	QMutexLocker locker(&_mutex);
-	return _type;
-}
-
-void ConnectionManager::setHostName(const QString & host)
-{
-	QMutexLocker locker(&_mutex);
-	_hostName = host;
-}
-
-QString	ConnectionManager::hostName() const
-{
-	QMutexLocker locker(&_mutex);
-	return _hostName;
-}
-
-void ConnectionManager::setPort(int port)
-{
-	QMutexLocker locker(&_mutex);
-	_port = port;
-}
-
-int	ConnectionManager::port() const
-{
-	QMutexLocker locker(&_mutex);
-	return _port;
-}
-
-void ConnectionManager::setDatabaseName(const QString& name)
-{
-	QMutexLocker locker(&_mutex);
-	_databaseName = name;
-}
-
-QString ConnectionManager::databaseName() const
-{
-	QMutexLocker locker(&_mutex);
-	return _databaseName;
-}
-
-
-void ConnectionManager::setUserName(const QString & name)
-{
-	QMutexLocker locker(&_mutex);
-	_userName = name;
-}
-
-QString	ConnectionManager::userName() const
-{
-	QMutexLocker locker(&_mutex);
-	return _userName;
-}
-
-void ConnectionManager::setNumericalPrecisionPolicy(
-	QSql::NumericalPrecisionPolicy precisionPolicy)
-{
-	QMutexLocker locker(&_mutex);
-	_precisionPolicy = precisionPolicy;
-}
-
-QSql::NumericalPrecisionPolicy
-	ConnectionManager::numericalPrecisionPolicy() const
-{
-	QMutexLocker locker(&_mutex);
-	return _precisionPolicy;
-}
-
-void ConnectionManager::setPassword(const QString & password)
-{
-	QMutexLocker locker(&_mutex);
-	_password = password;
-}
-
-QString	ConnectionManager::password() const
-{
-	QMutexLocker locker(&_mutex);
-	return _password;
-}
-
-int ConnectionManager::connectionCount() const
-{
-	QMutexLocker locker(&_mutex);
-	return _conns.count();
-}
-
-bool ConnectionManager::connectionExists(QThread* t /*= QThread::currentThread()*/) const
-{
-	QMutexLocker locker(&_mutex);
-	return _conns.contains(t);
-}
-
-bool ConnectionManager::open(QSqlError *error)
-{
-	QMutexLocker locker(&_mutex);
-
-	QThread* curThread = QThread::currentThread();
-
-	if (_conns.contains(curThread)) {
-		qCWarning(logger) << "ConnectionManager::open: "
-			"there is a open connection";
-		return true;
-	}
-
-	QString conname = QString("CNM0x%1").arg((qlonglong)curThread, 0, 16);
-	QSqlDatabase dbconn = QSqlDatabase::contains(conname) ?
-		QSqlDatabase::database(conname, false) : QSqlDatabase::addDatabase(_type, conname);
-	if (!dbconn.isValid()) {
-		if (error)
-			*error = dbconn.lastError();
-
-		dbconn = {};
-		QSqlDatabase::removeDatabase(conname);
-		_conns.remove(curThread);
-		return false;
-	}
-	dbconn.setHostName(_hostName);
-	dbconn.setDatabaseName(_databaseName);
-	dbconn.setUserName(_userName);
-	dbconn.setPassword(_password);
-	dbconn.setPort(_port);
-	dbconn.setNumericalPrecisionPolicy(_precisionPolicy);
-
-	bool ok = dbconn.open();
-
-	if (ok != true) {
-		qCCritical(logger) << "ConnectionManager::open: con= " << conname
-			<< ": Connection error=" << dbconn.lastError().text();
-		if (error)
-			*error = dbconn.lastError();
-
-		dbconn = {};
-		QSqlDatabase::removeDatabase(conname);
-		_conns.remove(curThread);
-		return false;
-	}
-
-	_conns.insert(curThread, dbconn);
-
-	return true;
-}
-
-QSqlDatabase ConnectionManager::threadConnection() const
-{
-	QMutexLocker locker(&_mutex);
-	QThread* curThread = QThread::currentThread();
-	QSqlDatabase ret = _conns.value(curThread, QSqlDatabase());
-	return ret;
-}
-
-void ConnectionManager::dump()
-{
-	qCInfo(logger) << "Database connections:" << _conns;
-}
-
-void ConnectionManager::closeAll()
-{
-	QMutexLocker locker(&_mutex);
-	/// @attention es koennte sein, dass das nicht geht, weil falscher thread
-
-	while (_conns.count()) {
-		QThread* t = _conns.firstKey();
-		QSqlDatabase db = _conns.take(t);
-		db.close();
-	}
-}
-
-void ConnectionManager::closeOne(QThread* t)
-{
-	QMutexLocker locker(&_mutex);
-	/// @attention es koennte sein, dass das nicht geht, wenn falscher thread
-
-	if (!_conns.contains(t)) {
-		qCWarning(logger) << "closeOne no Connection open for thread " << t;
-		return;
-	}
-
-	QSqlDatabase db = _conns.take(t);
-	db.close();
-}
-
-}	//	namespace
+#include "ConnectionManager.h"
+#include <QCoreApplication>
+#include <QEvent>
+#include <QRunnable>
+#include <QSet>
+#include <QSqlDriver>
+#include <QSqlError>
+#include <QSqlQuery>
+#include <QThreadPool>
+#include <QThreadStorage>
+#include <QVector>
+
+#ifdef ASYNCSQL_SQLITE_API
+#include <sqlite3.h>
+#endif
+
+
+namespace Database {
+
+namespace {
+
+// set on threads running admitted or rejected tasks, they must never block
+QThreadStorage<bool> workerThread;
+
+}
+
+/**
+ * @brief Runs a task and reports its end to the ConnectionManager admission
+ * control.
+ * @details Wrappers are kept in a free list, like the startExecOnce() tasks.
+ */
+class AdmittedTaskPrivate : public QRunnable
+{
+public:
+	static AdmittedTaskPrivate *acquire(ConnectionManager *manager, QRunnable *task)
+	{
+		AdmittedTaskPrivate *wrapper = nullptr;
+		freeMutex.lock();
+		if (!freeList.isEmpty())
+			wrapper = freeList.takeLast();
+		freeMutex.unlock();
+
+		if (!wrapper) {
+			wrapper = new AdmittedTaskPrivate();
+			wrapper->setAutoDelete(false);
+		}
+		wrapper->_manager = manager;
+		wrapper->_task = task;
+		return wrapper;
+	}
+
+	void run() override
+	{
+		workerThread.setLocalData(true);
+		bool deleteTask = _task->autoDelete();
+		_manager->_metrics.taskStarted();
+		_task->run();
+		if (deleteTask)
+			delete _task;
+		_manager->sendTableNotifications();
+		_manager->taskFinished();
+		_task = nullptr;
+
+		// nothing may touch the wrapper after it is back in the free list
+		freeMutex.lock();
+		bool pooled = freeList.size() < maxFree;
+		if (pooled)
+			freeList.append(this);
+		freeMutex.unlock();
+		if (!pooled)
+			delete this;
+	}
+
+private:
+	AdmittedTaskPrivate()
+		: _manager(nullptr)
+		, _task(nullptr)
+	{
+	}
+
+	static const int maxFree = 64;
+	static QMutex freeMutex;
+	static QVector<AdmittedTaskPrivate*> freeList;
+
+	ConnectionManager *_manager;
+	QRunnable *_task;
+};
+
+QMutex AdmittedTaskPrivate::freeMutex;
+QVector<AdmittedTaskPrivate*> AdmittedTaskPrivate::freeList;
+
+/**
+ * @brief Runs RejectableTask::reject() of a task refused by the admission
+ * control.
+ */
+class RejectedTaskPrivate : public QRunnable
+{
+public:
+	explicit RejectedTaskPrivate(QRunnable *task)
+		: _task(task)
+	{
+	}
+
+	void run() override
+	{
+		workerThread.setLocalData(true);
+		bool deleteTask = _task->autoDelete();
+		dynamic_cast<RejectableTask*>(_task)->reject();
+		if (deleteTask)
+			delete _task;
+	}
+
+private:
+	QRunnable *_task;
+};
+
+/**
+ * @brief Tables changed by one SQLite connection, only used in its thread.
+ */
+struct SqliteHookStatePrivate
+{
+	bool isSubscribed() const
+	{
+		return manager->_subscriptionCount.load() != 0;
+	}
+
+	ConnectionManager *manager;
+	/** changed by the open transaction */
+	QSet<QString> changed;
+	/** changed by the transaction passing the commit hook */
+	QSet<QString> committing;
+	/** committed, not yet reported */
+	QSet<QString> committed;
+	QByteArray lastTable;
+};
+
+#ifdef ASYNCSQL_SQLITE_API
+namespace {
+
+sqlite3 *sqliteHandle(const QSqlDatabase &db)
+{
+	QVariant v = db.driver()->handle();
+	if (v.isValid() && qstrcmp(v.typeName(), "sqlite3*") == 0)
+		return *static_cast<sqlite3 **>(v.data());
+	return nullptr;
+}
+
+void sqliteUpdateHook(void *arg, int, const char *, const char *table, sqlite3_int64)
+{
+	SqliteHookStatePrivate *state = static_cast<SqliteHookStatePrivate *>(arg);
+	if (!state->isSubscribed())
+		return;
+	// a new change, so the last commit is done
+	if (!state->committing.isEmpty()) {
+		state->committed += state->committing;
+		state->committing.clear();
+	}
+	// called per row, avoid a conversion for runs on the same table
+	if (state->lastTable == table)
+		return;
+	state->lastTable = table;
+	state->changed.insert(QString::fromUtf8(table));
+}
+
+int sqliteCommitHook(void *arg)
+{
+	// the commit is not done yet, the tables are reported after the task
+	SqliteHookStatePrivate *state = static_cast<SqliteHookStatePrivate *>(arg);
+	state->lastTable.clear();
+	state->committing += state->changed;
+	state->changed.clear();
+	return 0;
+}
+
+void sqliteRollbackHook(void *arg)
+{
+	// also called if the commit fails after the commit hook
+	SqliteHookStatePrivate *state = static_cast<SqliteHookStatePrivate *>(arg);
+	state->lastTable.clear();
+	state->changed.clear();
+	state->committing.clear();
+}
+
+}
+#endif
+
+/**
+ * @brief Receives driver notifications (e.g. PostgreSQL LISTEN/NOTIFY) on an
+ * own connection in the listener thread.
+ */
+class NotificationListenerPrivate : public QObject
+{
+public:
+	class SubscriptionEvent : public QEvent
+	{
+	public:
+		SubscriptionEvent(const QStringList &subscribe, const QStringList &unsubscribe)
+			: QEvent(eventType())
+			, subscribe(subscribe)
+			, unsubscribe(unsubscribe)
+		{
+		}
+
+		static QEvent::Type eventType()
+		{
+			static int type = QEvent::registerEventType();
+			return QEvent::Type(type);
+		}
+
+		QStringList subscribe;
+		QStringList unsubscribe;
+	};
+
+	NotificationListenerPrivate(ConnectionManager *manager, const QString &profile)
+		: _manager(manager)
+		, _profile(profile)
+	{
+	}
+
+	~NotificationListenerPrivate()
+	{
+		if (_db.isValid()) {
+			_db.close();
+			_db = QSqlDatabase();
+			QSqlDatabase::removeDatabase(connectionName());
+		}
+	}
+
+	bool event(QEvent *e) override
+	{
+		if (e->type() != SubscriptionEvent::eventType())
+			return QObject::event(e);
+
+		SubscriptionEvent *ev = static_cast<SubscriptionEvent *>(e);
+		if (open()) {
+			for (const QString &name : ev->subscribe)
+				_db.driver()->subscribeToNotification(name);
+			for (const QString &name : ev->unsubscribe)
+				_db.driver()->unsubscribeFromNotification(name);
+		}
+		return true;
+	}
+
+private:
+	QString connectionName() const
+	{
+		if (_profile.isEmpty())
+			return QStringLiteral("CNM_listener");
+		return QStringLiteral("CNM_listener_") + _profile;
+	}
+
+	bool open()
+	{
+		if (_db.isOpen())
+			return true;
+
+		ConnectionProfile prof = _manager->profile(_profile);
+		_db = QSqlDatabase::contains(connectionName()) ?
+			QSqlDatabase::database(connectionName(), false) :
+			QSqlDatabase::addDatabase(prof.type, connectionName());
+		_db.setHostName(prof.hostName);
+		_db.setDatabaseName(prof.databaseName);
+		_db.setUserName(prof.userName);
+		_db.setPassword(prof.password);
+		_db.setPort(prof.port);
+		_db.setConnectOptions(prof.connectOptions);
+		if (!_db.open()) {
+			qCCritical(_manager->logger) << "ConnectionManager: notification listener:"
+				<< _db.lastError().text();
+			return false;
+		}
+		if (!_db.driver()->hasFeature(QSqlDriver::EventNotifications)) {
+			qCWarning(_manager->logger) << "ConnectionManager: driver" << prof.type
+				<< "does not support notifications";
+			_db.close();
+			return false;
+		}
+
+		typedef void (QSqlDriver::*NotificationSignal)(const QString &,
+			QSqlDriver::NotificationSource, const QVariant &);
+		ConnectionManager *manager = _manager;
+		connect(_db.driver(), static_cast<NotificationSignal>(&QSqlDriver::notification),
+			this, [manager](const QString &name) {
+				emit manager->tablesChanged(QStringList() << name);
+			});
+		return true;
+	}
+
+	ConnectionManager *_manager;
+	QString _profile;
+	QSqlDatabase _db;
+};
+
+ConnectionProfile ConnectionProfile::sqlite(const QString &databaseName,
+	ConnectionProfile::SqlitePreset preset)
+{
+	ConnectionProfile profile;
+	profile.type = "QSQLITE";
+	profile.databaseName = databaseName;
+
+	switch (preset) {
+	case Sqlite_ReadHeavy:
+		profile.connectOptions = "QSQLITE_BUSY_TIMEOUT=5000";
+		profile.initStatements
+			<< "PRAGMA journal_mode=WAL"
+			<< "PRAGMA synchronous=NORMAL"
+			<< "PRAGMA cache_size=-65536"
+			<< "PRAGMA mmap_size=268435456"
+			<< "PRAGMA temp_store=MEMORY";
+		break;
+	case Sqlite_WriteHeavy:
+		profile.connectOptions = "QSQLITE_BUSY_TIMEOUT=30000";
+		profile.initStatements
+			<< "PRAGMA journal_mode=WAL"
+			<< "PRAGMA synchronous=NORMAL"
+			<< "PRAGMA cache_size=-16384"
+			<< "PRAGMA wal_autocheckpoint=10000"
+			<< "PRAGMA temp_store=MEMORY";
+		break;
+	case Sqlite_InMemory:
+#if defined(ASYNCSQL_SQLITE_API) && SQLITE_VERSION_NUMBER >= 3036000
+		// memdb uses normal locking, so the busy timeout covers concurrent writers
+		profile.databaseName = QString("file:/%1?vfs=memdb").arg(databaseName);
+#else
+		profile.databaseName = QString("file:%1?mode=memory&cache=shared").arg(databaseName);
+#endif
+		profile.connectOptions = "QSQLITE_OPEN_URI;QSQLITE_BUSY_TIMEOUT=5000";
+		profile.initStatements
+			<< "PRAGMA synchronous=OFF"
+			<< "PRAGMA temp_store=MEMORY";
+		break;
+	}
+	return profile;
+}
+
+ConnectionManager *ConnectionManager::_instance = nullptr;
+QMutex ConnectionManager::_instanceMutex;
+
+ConnectionManager::ConnectionManager(QObject* parent /*= nullptr */)
+	: QObject(parent), logger("Database.ConnectionManager")
+	, _listenerThread(nullptr)
+	, _maxTasksInFlight(0)
+	, _tasksInFlight(0)
+	, _maxTasksPending(0)
+	, _taskOverflowPolicy(AsyncQuery::Overflow_Reject)
+	, _metrics(this)
+	, _memoryReplica(this)
+	, _rejectPool(new QThreadPool(this))
+{
+	// rejected tasks only deliver an error, one thread keeps their order
+	_rejectPool->setMaxThreadCount(1);
+	_port = -1;
+	_precisionPolicy = QSql::LowPrecisionDouble;
+	_type = "QMYSQL";
+}
+
+ConnectionManager::~ConnectionManager()
+{
+	if (_listenerThread) {
+		_listenerThread->quit();
+		_listenerThread->wait();
+		delete _listenerThread;
+	}
+	_rejectPool->waitForDone();
+	closeAll();
+}
+
+ConnectionManager *ConnectionManager::createInstance()
+{
+	return instance();
+}
+
+ConnectionManager *ConnectionManager::instance()
+{
+	QMutexLocker locker(&_instanceMutex);
+	if (_instance == nullptr) {
+		_instance = new ConnectionManager();
+	}
+	return _instance;
+}
+
+void ConnectionManager::destroyInstance()
+{
+	QMutexLocker locker(&_instanceMutex);
+	if (_instance != nullptr) {
+		delete _instance; _instance = nullptr;
+	}
+}
+
+void ConnectionManager::setType(QString type)
+{
+	QMutexLocker locker(&_mutex);
+	_type = type;
+}
+
+QString ConnectionManager::type()
+{
+	QMutexLocker locker(&_mutex);
+	return _type;
+}
+
+void ConnectionManager::setHostName(const QString & host)
+{
+	QMutexLocker locker(&_mutex);
+	_hostName = host;
+}
+
+QString	ConnectionManager::hostName() const
+{
+	QMutexLocker locker(&_mutex);
+	return _hostName;
+}
+
+void ConnectionManager::setPort(int port)
+{
+	QMutexLocker locker(&_mutex);
+	_port = port;
+}
+
+int	ConnectionManager::port() const
+{
+	QMutexLocker locker(&_mutex);
+	return _port;
+}
+
+void ConnectionManager::setDatabaseName(const QString& name)
+{
+	QMutexLocker locker(&_mutex);
+	_databaseName = name;
+}
+
+QString ConnectionManager::databaseName() const
+{
+	QMutexLocker locker(&_mutex);
+	return _databaseName;
+}
+
+
+void ConnectionManager::setUserName(const QString & name)
+{
+	QMutexLocker locker(&_mutex);
+	_userName = name;
+}
+
+QString	ConnectionManager::userName() const
+{
+	QMutexLocker locker(&_mutex);
+	return _userName;
+}
+
+void ConnectionManager::setNumericalPrecisionPolicy(
+	QSql::NumericalPrecisionPolicy precisionPolicy)
+{
+	QMutexLocker locker(&_mutex);
+	_precisionPolicy = precisionPolicy;
+}
+
+QSql::NumericalPrecisionPolicy
+	ConnectionManager::numericalPrecisionPolicy() const
+{
+	QMutexLocker locker(&_mutex);
+	return _precisionPolicy;
+}
+
+void ConnectionManager::setPassword(const QString & password)
+{
+	QMutexLocker locker(&_mutex);
+	_password = password;
+}
+
+QString	ConnectionManager::password() const
+{
+	QMutexLocker locker(&_mutex);
+	return _password;
+}
+
+void ConnectionManager::setConnectOptions(const QString &options)
+{
+	QMutexLocker locker(&_mutex);
+	_connectOptions = options;
+}
+
+QString ConnectionManager::connectOptions() const
+{
+	QMutexLocker locker(&_mutex);
+	return _connectOptions;
+}
+
+void ConnectionManager::setInitStatements(const QStringList &statements)
+{
+	QMutexLocker locker(&_mutex);
+	_initStatements = statements;
+}
+
+QStringList ConnectionManager::initStatements() const
+{
+	QMutexLocker locker(&_mutex);
+	return _initStatements;
+}
+
+void ConnectionManager::setInitCallback(const ConnectionProfile::InitCallback &callback)
+{
+	QMutexLocker locker(&_mutex);
+	_initCallback = callback;
+}
+
+ConnectionProfile::InitCallback ConnectionManager::initCallback() const
+{
+	QMutexLocker locker(&_mutex);
+	return _initCallback;
+}
+
+void ConnectionManager::setDefaultProfile(const ConnectionProfile &profile)
+{
+	QMutexLocker locker(&_mutex);
+	_type = profile.type;
+	_hostName = profile.hostName;
+	_port = profile.port;
+	_databaseName = profile.databaseName;
+	_userName = profile.userName;
+	_password = profile.password;
+	_precisionPolicy = profile.precisionPolicy;
+	_connectOptions = profile.connectOptions;
+	_initStatements = profile.initStatements;
+	_initCallback = profile.initCallback;
+}
+
+void ConnectionManager::addProfile(const QString &name, const ConnectionProfile &profile)
+{
+	QMutexLocker locker(&_mutex);
+	if (name.isEmpty()) {
+		qCWarning(logger) << "ConnectionManager::addProfile: empty profile name";
+		return;
+	}
+	_profiles.insert(name, profile);
+}
+
+void ConnectionManager::removeProfile(const QString &name)
+{
+	QMutexLocker locker(&_mutex);
+	_profiles.remove(name);
+}
+
+bool ConnectionManager::hasProfile(const QString &name) const
+{
+	QMutexLocker locker(&_mutex);
+	return name.isEmpty() || _profiles.contains(name);
+}
+
+ConnectionProfile ConnectionManager::profile(const QString &name) const
+{
+	QMutexLocker locker(&_mutex);
+	if (name.isEmpty())
+		return defaultProfile();
+	return _profiles.value(name);
+}
+
+QStringList ConnectionManager::profileNames() const
+{
+	QMutexLocker locker(&_mutex);
+	return _profiles.keys();
+}
+
+ConnectionProfile ConnectionManager::defaultProfile() const
+{
+	ConnectionProfile profile;
+	profile.type = _type;
+	profile.hostName = _hostName;
+	profile.port = _port;
+	profile.databaseName = _databaseName;
+	profile.userName = _userName;
+	profile.password = _password;
+	profile.precisionPolicy = _precisionPolicy;
+	profile.connectOptions = _connectOptions;
+	profile.initStatements = _initStatements;
+	profile.initCallback = _initCallback;
+	return profile;
+}
+
+bool ConnectionManager::initConnection(QSqlDatabase &db, const ConnectionProfile &profile,
+	QSqlError *error) const
+{
+	for (const QString &statement : profile.initStatements) {
+		QSqlQuery query(db);
+		if (!query.exec(statement)) {
+			qCCritical(logger) << "ConnectionManager::open: init statement" << statement
+				<< "failed:" << query.lastError().text();
+			if (error)
+				*error = query.lastError();
+			return false;
+		}
+	}
+
+	if (profile.initCallback && !profile.initCallback(db)) {
+		qCCritical(logger) << "ConnectionManager::open: init callback failed";
+		if (error) {
+			*error = db.lastError().isValid() ? db.lastError() :
+				QSqlError(QString(), "Connection init callback failed",
+						  QSqlError::ConnectionError);
+		}
+		return false;
+	}
+	return true;
+}
+
+int ConnectionManager::connectionCount() const
+{
+	QMutexLocker locker(&_mutex);
+	return _conns.count();
+}
+
+bool ConnectionManager::connectionExists(QThread* t /*= QThread::currentThread()*/) const
+{
+	return connectionExists(QString(), t);
+}
+
+bool ConnectionManager::connectionExists(const QString &profile,
+	QThread* t /*= QThread::currentThread()*/) const
+{
+	QMutexLocker locker(&_mutex);
+	ConnectionKey key(t, profile);
+	return _conns.contains(key) && !_staleConns.contains(key);
+}
+
+bool ConnectionManager::open(QSqlError *error)
+{
+	return open(QString(), error);
+}
+
+bool ConnectionManager::open(const QString &profileName, QSqlError *error)
+{
+	QMutexLocker locker(&_mutex);
+
+	QThread* curThread = QThread::currentThread();
+	ConnectionKey key(curThread, profileName);
+
+	// marked by reopenAll(), this is the owning thread
+	if (_staleConns.contains(key)) {
+		closeConnection(key);
+	}
+
+	if (_conns.contains(key)) {
+		qCWarning(logger) << "ConnectionManager::open: "
+			"there is a open connection";
+		return true;
+	}
+
+	if (!profileName.isEmpty() && !_profiles.contains(profileName)) {
+		qCCritical(logger) << "ConnectionManager::open: unknown profile" << profileName;
+		if (error)
+			*error = QSqlError(QString(), QString("Unknown connection profile %1")
+				.arg(profileName), QSqlError::ConnectionError);
+		_metrics.connectionOpened(false);
+		return false;
+	}
+	ConnectionProfile prof = profileName.isEmpty() ?
+		defaultProfile() : _profiles.value(profileName);
+
+	// connecting and the init statements may take long, other threads must not
+	// wait for them; the connection is published when it is ready
+	locker.unlock();
+
+	QString conname = QString("CNM0x%1").arg((qlonglong)curThread, 0, 16);
+	if (!profileName.isEmpty())
+		conname += "_" + profileName;
+	QSqlDatabase dbconn = QSqlDatabase::contains(conname) ?
+		QSqlDatabase::database(conname, false) : QSqlDatabase::addDatabase(prof.type, conname);
+	if (!dbconn.isValid()) {
+		if (error)
+			*error = dbconn.lastError();
+
+		dbconn = {};
+		QSqlDatabase::removeDatabase(conname);
+		_metrics.connectionOpened(false);
+		return false;
+	}
+	dbconn.setHostName(prof.hostName);
+	dbconn.setDatabaseName(prof.databaseName);
+	dbconn.setUserName(prof.userName);
+	dbconn.setPassword(prof.password);
+	dbconn.setPort(prof.port);
+	dbconn.setNumericalPrecisionPolicy(prof.precisionPolicy);
+	dbconn.setConnectOptions(prof.connectOptions);
+
+	bool ok = dbconn.open();
+	if (ok && !initConnection(dbconn, prof, error)) {
+		dbconn.close();
+		dbconn = {};
+		QSqlDatabase::removeDatabase(conname);
+		_metrics.connectionOpened(false);
+		return false;
+	}
+
+	if (ok != true) {
+		qCCritical(logger) << "ConnectionManager::open: con= " << conname
+			<< ": Connection error=" << dbconn.lastError().text();
+		if (error)
+			*error = dbconn.lastError();
+
+		dbconn = {};
+		QSqlDatabase::removeDatabase(conname);
+		_metrics.connectionOpened(false);
+		return false;
+	}
+
+	locker.relock();
+	_conns.insert(key, dbconn);
+
+#ifdef ASYNCSQL_SQLITE_API
+	// report committed changes for live queries
+	if (sqlite3 *handle = sqliteHandle(dbconn)) {
+		SqliteHookStatePrivate *state = new SqliteHookStatePrivate;
+		state->manager = this;
+		sqlite3_update_hook(handle, sqliteUpdateHook, state);
+		sqlite3_commit_hook(handle, sqliteCommitHook, state);
+		sqlite3_rollback_hook(handle, sqliteRollbackHook, state);
+		_sqliteHooks.insert(key, state);
+	}
+#endif
+
+	_metrics.connectionOpened(true);
+	int count = _conns.count();
+	locker.unlock();
+	emit connectionCountChanged(count);
+	return true;
+}
+
+QSqlDatabase ConnectionManager::threadConnection() const
+{
+	return threadConnection(QString());
+}
+
+QSqlDatabase ConnectionManager::threadConnection(const QString &profile) const
+{
+	QMutexLocker locker(&_mutex);
+	QThread* curThread = QThread::currentThread();
+	QSqlDatabase ret = _conns.value(ConnectionKey(curThread, profile), QSqlDatabase());
+	return ret;
+}
+
+void ConnectionManager::dump()
+{
+	qCInfo(logger) << "Database connections:" << _conns;
+}
+
+void ConnectionManager::closeAll()
+{
+	QMutexLocker locker(&_mutex);
+	/// @attention es koennte sein, dass das nicht geht, weil falscher thread
+
+	if (_conns.isEmpty())
+		return;
+
+	while (_conns.count()) {
+		closeConnection(_conns.firstKey());
+	}
+	locker.unlock();
+	emit connectionCountChanged(0);
+}
+
+void ConnectionManager::closeOne(QThread* t)
+{
+	QMutexLocker locker(&_mutex);
+	/// @attention es koennte sein, dass das nicht geht, wenn falscher thread
+
+	bool found = false;
+	for (const ConnectionKey &key : _conns.keys()) {
+		if (key.first == t) {
+			closeConnection(key);
+			found = true;
+		}
+	}
+
+	if (!found) {
+		qCWarning(logger) << "closeOne no Connection open for thread " << t;
+		return;
+	}
+	int count = _conns.count();
+	locker.unlock();
+	emit connectionCountChanged(count);
+}
+
+void ConnectionManager::reopenAll()
+{
+	QMutexLocker locker(&_mutex);
+	QThread *curThread = QThread::currentThread();
+
+	bool closed = false;
+	for (const ConnectionKey &key : _conns.keys()) {
+		if (key.first == curThread) {
+			closeConnection(key);
+			closed = true;
+		} else {
+			// a connection must only be closed by its own thread
+			_staleConns.insert(key);
+		}
+	}
+
+	if (!closed)
+		return;
+	int count = _conns.count();
+	locker.unlock();
+	emit connectionCountChanged(count);
+}
+
+void ConnectionManager::closeConnection(const ConnectionKey &key)
+{
+	QSqlDatabase db = _conns.take(key);
+	_staleConns.remove(key);
+#ifdef ASYNCSQL_SQLITE_API
+	// the handle may outlive the state if the connection is still in use
+	if (sqlite3 *handle = sqliteHandle(db)) {
+		sqlite3_update_hook(handle, nullptr, nullptr);
+		sqlite3_commit_hook(handle, nullptr, nullptr);
+		sqlite3_rollback_hook(handle, nullptr, nullptr);
+	}
+#endif
+	db.close();
+	delete _sqliteHooks.take(key);
+}
+
+void ConnectionManager::subscribeTables(const QStringList &tables, const QString &profile)
+{
+	QMutexLocker locker(&_mutex);
+	QMap<QString, int> &subscribed = _subscribedTables[profile];
+	QStringList added;
+	for (const QString &table : tables) {
+		if (subscribed[table]++ == 0)
+			added << table;
+		_subscriptionCount.ref();
+	}
+
+	// SQLite connections report changes through their hooks
+	QString type = profile.isEmpty() ? _type : _profiles.value(profile).type;
+	if (added.isEmpty() || type.startsWith("QSQLITE"))
+		return;
+
+	if (!_listenerThread) {
+		_listenerThread = new QThread();
+		_listenerThread->start();
+	}
+	NotificationListenerPrivate *listener = _listeners.value(profile);
+	if (!listener) {
+		listener = new NotificationListenerPrivate(this, profile);
+		listener->moveToThread(_listenerThread);
+		connect(_listenerThread, &QThread::finished, [listener]() {
+			delete listener;
+		});
+		_listeners.insert(profile, listener);
+	}
+	QCoreApplication::postEvent(listener,
+		new NotificationListenerPrivate::SubscriptionEvent(added, QStringList()));
+}
+
+void ConnectionManager::unsubscribeTables(const QStringList &tables, const QString &profile)
+{
+	QMutexLocker locker(&_mutex);
+	if (!_subscribedTables.contains(profile))
+		return;
+	QMap<QString, int> &subscribed = _subscribedTables[profile];
+	QStringList removed;
+	for (const QString &table : tables) {
+		if (!subscribed.contains(table))
+			continue;
+		if (--subscribed[table] == 0) {
+			subscribed.remove(table);
+			removed << table;
+		}
+		_subscriptionCount.deref();
+	}
+	if (subscribed.isEmpty())
+		_subscribedTables.remove(profile);
+
+	NotificationListenerPrivate *listener = _listeners.value(profile);
+	if (!removed.isEmpty() && listener) {
+		QCoreApplication::postEvent(listener,
+			new NotificationListenerPrivate::SubscriptionEvent(QStringList(), removed));
+	}
+}
+
+void ConnectionManager::sendTableNotifications()
+{
+	QSet<QString> changed;
+	QMutexLocker locker(&_mutex);
+	QThread *curThread = QThread::currentThread();
+	for (auto it = _sqliteHooks.constBegin(); it != _sqliteHooks.constEnd(); ++it) {
+		if (it.key().first != curThread)
+			continue;
+		// the hooks run in this thread as well
+		SqliteHookStatePrivate *state = it.value();
+		changed += state->committed;
+		changed += state->committing;
+		state->committed.clear();
+		state->committing.clear();
+	}
+	locker.unlock();
+
+	if (changed.isEmpty())
+		return;
+#if QT_VERSION >= QT_VERSION_CHECK(5,14,0)
+	emit tablesChanged(QStringList(changed.begin(), changed.end()));
+#else
+	emit tablesChanged(changed.toList());
+#endif
+}
+
+ResultCache *ConnectionManager::resultCache()
+{
+	return &_resultCache;
+}
+
+SlowQueryLog *ConnectionManager::slowQueryLog()
+{
+	return &_slowQueryLog;
+}
+
+StatementStats *ConnectionManager::statementStats()
+{
+	return &_statementStats;
+}
+
+PoolMetrics *ConnectionManager::metrics()
+{
+	return &_metrics;
+}
+
+MemoryReplica *ConnectionManager::memoryReplica()
+{
+	return &_memoryReplica;
+}
+
+QString ConnectionManager::metricsText(bool prometheus)
+{
+	if (prometheus)
+		return _metrics.toPrometheus();
+	return QString::fromUtf8(_metrics.toJson());
+}
+
+QVariantList ConnectionManager::statementStatistics(int limit)
+{
+	QVariantList list;
+	const QVector<StatementStats::Statement> statements =
+		_statementStats.snapshot(StatementStats::Sort_TotalTime, limit);
+	for (const StatementStats::Statement &s : statements) {
+		QVariantMap map;
+		map.insert("fingerprint", s.fingerprint);
+		map.insert("example", s.example);
+		map.insert("calls", s.calls);
+		map.insert("errors", s.errors);
+		map.insert("rows", s.rows);
+		map.insert("cacheHits", s.cacheHits);
+		map.insert("totalMs", s.totalMs);
+		map.insert("meanMs", s.meanMs);
+		map.insert("maxMs", s.maxMs);
+		map.insert("p50Ms", s.p50Ms);
+		map.insert("p95Ms", s.p95Ms);
+		map.insert("p99Ms", s.p99Ms);
+		list.append(map);
+	}
+	return list;
+}
+
+void ConnectionManager::setMaxTasksInFlight(int max)
+{
+	QList<QPair<QRunnable*, QThreadPool*>> admitted;
+
+	_taskMutex.lock();
+	_maxTasksInFlight = qMax(0, max);
+	while (!_pendingTasks.isEmpty()
+			&& (_maxTasksInFlight == 0 || _tasksInFlight < _maxTasksInFlight)) {
+		admitted << _pendingTasks.dequeue();
+		_tasksInFlight++;
+	}
+	_pendingCondition.wakeAll();
+	_taskMutex.unlock();
+
+	for (const auto &next : admitted)
+		next.second->start(AdmittedTaskPrivate::acquire(this, next.first));
+}
+
+int ConnectionManager::maxTasksInFlight() const
+{
+	QMutexLocker locker(&_taskMutex);
+	return _maxTasksInFlight;
+}
+
+int ConnectionManager::tasksInFlight() const
+{
+	QMutexLocker locker(&_taskMutex);
+	return _tasksInFlight;
+}
+
+int ConnectionManager::tasksPending() const
+{
+	QMutexLocker locker(&_taskMutex);
+	return _pendingTasks.size();
+}
+
+void ConnectionManager::setMaxTasksPending(int max)
+{
+	QMutexLocker locker(&_taskMutex);
+	_maxTasksPending = qMax(0, max);
+	_pendingCondition.wakeAll();
+}
+
+int ConnectionManager::maxTasksPending() const
+{
+	QMutexLocker locker(&_taskMutex);
+	return _maxTasksPending;
+}
+
+void ConnectionManager::setTaskOverflowPolicy(AsyncQuery::OverflowPolicy policy)
+{
+	QMutexLocker locker(&_taskMutex);
+	_taskOverflowPolicy = policy;
+	_pendingCondition.wakeAll();
+}
+
+AsyncQuery::OverflowPolicy ConnectionManager::taskOverflowPolicy() const
+{
+	QMutexLocker locker(&_taskMutex);
+	return _taskOverflowPolicy;
+}
+
+bool ConnectionManager::tasksLimited() const
+{
+	return _maxTasksInFlight > 0 && _tasksInFlight >= _maxTasksInFlight;
+}
+
+bool ConnectionManager::pendingFull() const
+{
+	return _maxTasksPending > 0 && _pendingTasks.size() >= _maxTasksPending;
+}
+
+void ConnectionManager::startTask(QRunnable *task, QThreadPool *pool)
+{
+	if (!pool)
+		pool = QThreadPool::globalInstance();
+
+	_taskMutex.lock();
+	// a blocked worker could hold the slot the pending tasks wait for
+	if (_taskOverflowPolicy == AsyncQuery::Overflow_Block && !workerThread.hasLocalData()) {
+		while (tasksLimited() && pendingFull())
+			_pendingCondition.wait(&_taskMutex);
+	}
+	if (tasksLimited()) {
+		QRunnable *rejected = nullptr;
+		if (pendingFull()) {
+			if (_taskOverflowPolicy == AsyncQuery::Overflow_Reject) {
+				if (dynamic_cast<RejectableTask*>(task))
+					rejected = task;
+			} else if (_taskOverflowPolicy == AsyncQuery::Overflow_DropOldest) {
+				for (int i = 0; i < _pendingTasks.size(); i++) {
+					if (dynamic_cast<RejectableTask*>(_pendingTasks.at(i).first)) {
+						rejected = _pendingTasks.takeAt(i).first;
+						break;
+					}
+				}
+			}
+		}
+		if (rejected != task)
+			_pendingTasks.enqueue(qMakePair(task, pool));
+		int pending = _pendingTasks.size();
+		_taskMutex.unlock();
+
+		if (rejected) {
+			_metrics.queueOverflow();
+			_rejectPool->start(new RejectedTaskPrivate(rejected));
+		}
+		if (rejected != task) {
+			_metrics.taskHeldBack();
+			emit taskLimitReached(pending);
+		}
+		return;
+	}
+	_tasksInFlight++;
+	_taskMutex.unlock();
+
+	pool->start(AdmittedTaskPrivate::acquire(this, task));
+}
+
+bool ConnectionManager::tryStartTask(QRunnable *task, QThreadPool *pool)
+{
+	if (!pool)
+		pool = QThreadPool::globalInstance();
+
+	_taskMutex.lock();
+	if (tasksLimited()) {
+		_taskMutex.unlock();
+		return false;
+	}
+	_tasksInFlight++;
+	_taskMutex.unlock();
+
+	pool->start(AdmittedTaskPrivate::acquire(this, task));
+	return true;
+}
+
+void ConnectionManager::taskFinished()
+{
+	_taskMutex.lock();
+	_tasksInFlight--;
+	if (_pendingTasks.isEmpty()
+			|| (_maxTasksInFlight > 0 && _tasksInFlight >= _maxTasksInFlight)) {
+		_taskMutex.unlock();
+		return;
+	}
+	QPair<QRunnable*, QThreadPool*> next = _pendingTasks.dequeue();
+	_tasksInFlight++;
+	_pendingCondition.wakeAll();
+	_taskMutex.unlock();
+
+	next.second->start(AdmittedTaskPrivate::acquire(this, next.first));
+}
+
+}	//	namespace
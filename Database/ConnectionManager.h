@@ -1,166 +1,550 @@
-#pragma once
-
-#include <QObject>
-#include <QString>
-#include <QMap>
-#include <QThread>
-#include <QMutex>
-#include <QSql>
-#include <QSqlDatabase>
-
-#include <QLoggingCategory>
-
-
-namespace Database {
-
-/**
- * @brief Maintains the database connection for asynchrone queries.
- *
- * @details Set up the ConnectionManager (database type, name, etc...) at programm
- * startup with createInstance() and setting the appropriate values to the instance. The
- * ConnectionManager instance provides the same interface as QSqlDatabase for initializing
- * the connection. A asynchrone query AsyncQuery inernally uses the configured instance
- * and opens a connection for each thread.
- *
- * Before application shutdown the instance have to be destroyed with destroyInstance().
- *
- * @note All functions are thread save and reentrant
- */
-class ConnectionManager : public QObject
-{
-	Q_OBJECT
-
-	/** Number if open connections. */
-	Q_PROPERTY(int connectionCount READ connectionCount NOTIFY connectionCountChanged)
-	Q_PROPERTY(QString type READ type WRITE setType)
-	Q_PROPERTY(QString hostName READ hostName WRITE setHostName)
-	Q_PROPERTY(int port READ port WRITE setPort)
-	Q_PROPERTY(QString databaseName READ databaseName WRITE setDatabaseName)
-	Q_PROPERTY(QString userName READ userName WRITE setUserName)
-	Q_PROPERTY(QString password READ password WRITE setPassword)
-
-public:
-	/**
-	 * @brief Call createInstance for initialization.
-	 * @return The ConnectionManager instance.
-	 */
-	static ConnectionManager *createInstance();
-
-	/**
-	 * @brief Get the instance.
-	 * @details If the instance is not created it will be created.
-	 * @return The ConnectionManager instance.
-	 */
-	static ConnectionManager *instance();
-
-	/**
-	 * @brief Delete the ConnectionManager instance.
-	 */
-	static void destroyInstance();
-
-	/**
-	 * @name Wrapper methods around QSqlDatabase
-	 * @note Each connection which was already opened (e.g. by the AsyncQuery) are not
-	 * reopened on change.
-	 */
-	///@{
-
-	/**
-	 * @brief Set the database driver. Valid values are e.g. "QMYSQL", "QSQLITE", ...
-	 * @see http://doc.qt.io/qt-5/sql-driver.html
-	 */
-	void setType(QString type);
-	QString type();
-
-	void setHostName(const QString & host);
-	QString	hostName() const;
-
-	void setPort(int port);
-	int	port() const;
-
-	void setDatabaseName(const QString& name);
-	QString databaseName() const;
-
-	void setUserName(const QString & name);
-	QString	userName() const;
-
-	void setNumericalPrecisionPolicy(QSql::NumericalPrecisionPolicy precisionPolicy);
-	QSql::NumericalPrecisionPolicy	numericalPrecisionPolicy() const;
-
-	void setPassword(const QString & password);
-	QString	password() const;
-	///@}
-
-	///@{
-	/**
-	  * @name Connection maintainance. Basically for AsyncQuery internal usage.
-	  */
-
-	/**
-	 * @brief Number of open connections.
-	 */
-	int connectionCount() const;
-
-	/**
-	 * @brief Returns \c true, if a database connection for thread t exists.
-	 * @param t [optional] thread Object.
-	 */
-	bool connectionExists(QThread* t = QThread::currentThread()) const;
-
-	/**
-	 * @brief Opens a database connection for current thread.
-	 * @returns \c true on success
-	 */
-	bool open(QSqlError *error = nullptr);
-
-	/**
-	 * @brief Check if a connection exists for current thread.
-	 * @note If no connection exists QSqlDatabase::isValid() is \c false
-	 */
-	QSqlDatabase threadConnection() const;
-
-	/** @brief Dump all connections to tracelog */
-	void dump();
-
-	/**
-	 * @brief Close all open connections.
-	 */
-	Q_INVOKABLE void closeAll();
-
-	/**
-	 * @brief Close connection for thread t.
-	 * @note If connection does not exists nothing happens.
-	 */
-	void closeOne(QThread* t);
-	///@}
-
-signals:
-	/**
-	 * @brief Is emitted if the number of connections is changed.
-	 */
-	void connectionCountChanged(int);
-
-private:
-	ConnectionManager(QObject* parent = nullptr);
-	virtual ~ConnectionManager();
-
-	//the static instance
-	static ConnectionManager *_instance;
-	static QMutex _instanceMutex;
-
-	mutable QMutex _mutex;
-	QMap<QThread*, QSqlDatabase> _conns;
-
-	QString	_hostName;
-	int	_port;
-	QString	_userName;
-	QString _databaseName;
-	QSql::NumericalPrecisionPolicy	_precisionPolicy;
-	QString	_password;
-	QString _type;
-
-	QLoggingCategory logger;
-};
-
-} // namespace
-
+#pragma once
+
+#include <QObject>
+#include <QString>
+#include <QMap>
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QAtomicInt>
+#include <QQueue>
+#include <QPair>
+#include <QSet>
+#include <QSql>
+#include <QSqlDatabase>
+#include <QVariantList>
+#include <QStringList>
+
+#include <QLoggingCategory>
+
+#include <functional>
+
+#include "AsyncQuery.h"
+#include "ResultCache.h"
+#include "SlowQueryLog.h"
+#include "StatementStats.h"
+#include "PoolMetrics.h"
+#include "MemoryReplica.h"
+
+class QRunnable;
+class QThreadPool;
+
+
+namespace Database {
+
+// class forward decl's
+class NotificationListenerPrivate;
+struct SqliteHookStatePrivate;
+
+/**
+ * @brief Task which the admission control may reject instead of holding it
+ * back (see ConnectionManager::setMaxTasksPending()).
+ */
+class RejectableTask
+{
+public:
+	virtual ~RejectableTask() = default;
+
+	/**
+	 * @brief Is called instead of QRunnable::run() if the task is rejected,
+	 * on a helper thread of the ConnectionManager.
+	 */
+	virtual void reject() = 0;
+};
+
+/**
+ * @brief Settings of a database connection registered with
+ * ConnectionManager::addProfile().
+ */
+struct ConnectionProfile
+{
+	/**
+	 * @brief Called on the worker thread for every new connection after
+	 * initStatements were executed. Return \c false to fail the open.
+	 * @note Must not call the ConnectionManager.
+	 */
+	typedef std::function<bool(QSqlDatabase &db)> InitCallback;
+
+	/**
+	 * @brief Ready-made settings for SQLite, see sqlite().
+	 */
+	enum SqlitePreset {
+		/** WAL, 64 MB page cache, 256 MB mmap, temp tables in memory. */
+		Sqlite_ReadHeavy,
+		/** WAL, synchronous=NORMAL, larger autocheckpoint, longer busy timeout. */
+		Sqlite_WriteHeavy,
+		/** Shared in-memory database named by databaseName, visible to all thread
+		 * connections of the profile while at least one of them is open.
+		 * With ASYNCSQL_SQLITE_API and SQLite 3.36 or later it uses the memdb
+		 * VFS, where writers and readers wait for each other with the busy
+		 * timeout. Otherwise it is a shared-cache database: table locks
+		 * (SQLITE_LOCKED) are not retried, concurrent writes fail with
+		 * "database table is locked". */
+		Sqlite_InMemory,
+	};
+
+	QString type = "QMYSQL";
+	QString hostName;
+	int port = -1;
+	QString databaseName;
+	QString userName;
+	QString password;
+	QSql::NumericalPrecisionPolicy precisionPolicy = QSql::LowPrecisionDouble;
+	/** Driver specific options, see QSqlDatabase::setConnectOptions(). */
+	QString connectOptions;
+	/** Statements executed in order on every new connection. */
+	QStringList initStatements;
+	InitCallback initCallback;
+
+	/**
+	 * @brief A "QSQLITE" profile for \p databaseName tuned by \p preset.
+	 * @details The settings are plain connectOptions and initStatements
+	 * (PRAGMAs) and can be adjusted afterwards.
+	 */
+	static ConnectionProfile sqlite(const QString &databaseName, SqlitePreset preset);
+};
+
+/**
+ * @brief Maintains the database connection for asynchrone queries.
+ *
+ * @details Set up the ConnectionManager (database type, name, etc...) at programm
+ * startup with createInstance() and setting the appropriate values to the instance. The
+ * ConnectionManager instance provides the same interface as QSqlDatabase for initializing
+ * the connection. A asynchrone query AsyncQuery inernally uses the configured instance
+ * and opens a connection for each thread.
+ *
+ * Additional databases (e.g. shards with the same schema) are registered as named
+ * connection profiles with addProfile(). Each thread opens one connection per
+ * profile it uses. The settings above form the default profile with the empty
+ * name.
+ *
+ * Before application shutdown the instance have to be destroyed with destroyInstance().
+ *
+ * @note All functions are thread save and reentrant
+ */
+class ConnectionManager : public QObject
+{
+	Q_OBJECT
+
+	/** Number if open connections. */
+	Q_PROPERTY(int connectionCount READ connectionCount NOTIFY connectionCountChanged)
+	Q_PROPERTY(QString type READ type WRITE setType)
+	Q_PROPERTY(QString hostName READ hostName WRITE setHostName)
+	Q_PROPERTY(int port READ port WRITE setPort)
+	Q_PROPERTY(QString databaseName READ databaseName WRITE setDatabaseName)
+	Q_PROPERTY(QString userName READ userName WRITE setUserName)
+	Q_PROPERTY(QString password READ password WRITE setPassword)
+	Q_PROPERTY(QString connectOptions READ connectOptions WRITE setConnectOptions)
+	Q_PROPERTY(QStringList initStatements READ initStatements WRITE setInitStatements)
+
+public:
+	/**
+	 * @brief Call createInstance for initialization.
+	 * @return The ConnectionManager instance.
+	 */
+	static ConnectionManager *createInstance();
+
+	/**
+	 * @brief Get the instance.
+	 * @details If the instance is not created it will be created.
+	 * @return The ConnectionManager instance.
+	 */
+	static ConnectionManager *instance();
+
+	/**
+	 * @brief Delete the ConnectionManager instance.
+	 */
+	static void destroyInstance();
+
+	/**
+	 * @name Wrapper methods around QSqlDatabase
+	 * @note Each connection which was already opened (e.g. by the AsyncQuery) are not
+	 * reopened on change.
+	 */
+	///@{
+
+	/**
+	 * @brief Set the database driver. Valid values are e.g. "QMYSQL", "QSQLITE", ...
+	 * @see http://doc.qt.io/qt-5/sql-driver.html
+	 */
+	void setType(QString type);
+	QString type();
+
+	void setHostName(const QString & host);
+	QString	hostName() const;
+
+	void setPort(int port);
+	int	port() const;
+
+	void setDatabaseName(const QString& name);
+	QString databaseName() const;
+
+	void setUserName(const QString & name);
+	QString	userName() const;
+
+	void setNumericalPrecisionPolicy(QSql::NumericalPrecisionPolicy precisionPolicy);
+	QSql::NumericalPrecisionPolicy	numericalPrecisionPolicy() const;
+
+	void setPassword(const QString & password);
+	QString	password() const;
+
+	void setConnectOptions(const QString &options);
+	QString connectOptions() const;
+	///@}
+
+	/**
+	 * @brief Statements executed in order on every new connection of the
+	 * default profile, e.g. PRAGMAs or SET commands.
+	 * @details If a statement fails the connection is closed and open() fails.
+	 */
+	void setInitStatements(const QStringList &statements);
+	QStringList initStatements() const;
+
+	/**
+	 * @brief Called on the worker thread for every new connection of the default
+	 * profile, after the init statements.
+	 */
+	void setInitCallback(const ConnectionProfile::InitCallback &callback);
+	ConnectionProfile::InitCallback initCallback() const;
+
+	/**
+	 * @brief Replace all settings of the default profile with \p profile, e.g.
+	 * with one of the ConnectionProfile::sqlite() presets.
+	 */
+	void setDefaultProfile(const ConnectionProfile &profile);
+
+	///@{
+	/**
+	  * @name Named connection profiles.
+	  */
+
+	/**
+	 * @brief Register or replace the connection profile \p name.
+	 * @note Connections already opened for \p name are not reopened.
+	 */
+	void addProfile(const QString &name, const ConnectionProfile &profile);
+
+	/**
+	 * @brief Remove the connection profile \p name.
+	 */
+	void removeProfile(const QString &name);
+
+	/**
+	 * @brief Returns \c true if \p name is the default profile (empty name)
+	 * or a registered profile.
+	 */
+	bool hasProfile(const QString &name) const;
+
+	/**
+	 * @brief Returns the settings of profile \p name, the empty name returns
+	 * the default profile.
+	 */
+	ConnectionProfile profile(const QString &name) const;
+
+	/**
+	 * @brief Names of the registered profiles (without the default profile).
+	 */
+	QStringList profileNames() const;
+	///@}
+
+	///@{
+	/**
+	  * @name Connection maintainance. Basically for AsyncQuery internal usage.
+	  */
+
+	/**
+	 * @brief Number of open connections.
+	 */
+	int connectionCount() const;
+
+	/**
+	 * @brief Returns \c true, if a database connection for thread t exists.
+	 * @param t [optional] thread Object.
+	 */
+	bool connectionExists(QThread* t = QThread::currentThread()) const;
+
+	/**
+	 * @brief Returns \c true, if a connection of \p profile for thread t exists.
+	 * @note Connections marked by reopenAll() are reported as missing.
+	 */
+	bool connectionExists(const QString &profile, QThread* t = QThread::currentThread()) const;
+
+	/**
+	 * @brief Opens a database connection for current thread.
+	 * @returns \c true on success
+	 */
+	bool open(QSqlError *error = nullptr);
+
+	/**
+	 * @brief Opens a connection of \p profile for current thread.
+	 * @details Connecting, the init statements and the init callback run
+	 * without locking the ConnectionManager. The connection is visible to
+	 * threadConnection() and connectionExists() once it is initialized.
+	 * @returns \c true on success
+	 */
+	bool open(const QString &profile, QSqlError *error = nullptr);
+
+	/**
+	 * @brief Check if a connection exists for current thread.
+	 * @note If no connection exists QSqlDatabase::isValid() is \c false
+	 */
+	QSqlDatabase threadConnection() const;
+
+	/**
+	 * @brief The connection of \p profile for current thread.
+	 * @note If no connection exists QSqlDatabase::isValid() is \c false
+	 */
+	QSqlDatabase threadConnection(const QString &profile) const;
+
+	/** @brief Dump all connections to tracelog */
+	void dump();
+
+	/**
+	 * @brief Close all open connections.
+	 */
+	Q_INVOKABLE void closeAll();
+
+	/**
+	 * @brief Close all connections (of all profiles) for thread t.
+	 * @note If connection does not exists nothing happens.
+	 */
+	void closeOne(QThread* t);
+
+	/**
+	 * @brief Reopen all connections, e.g. after the default profile changed.
+	 * @details The connections of the current thread are closed now. Connections
+	 * of other threads are only marked: connectionExists() reports them as
+	 * missing and open() closes and reopens them on their own thread.
+	 */
+	void reopenAll();
+	///@}
+
+	///@{
+	/**
+	  * @name Change notifications for live queries.
+	  */
+
+	/**
+	 * @brief Register interest in changes of \p tables of connection profile
+	 * \p profile (reference counted).
+	 * @details SQLite connections report committed changes of all tables
+	 * through sqlite3_update_hook()/sqlite3_commit_hook() if the library is
+	 * built with ASYNCSQL_SQLITE_API. The tables are collected per connection
+	 * and reported when the commit is done, at the end of each task (see
+	 * sendTableNotifications()). For drivers supporting
+	 * QSqlDriver::EventNotifications (e.g. QPSQL) a listener thread subscribes
+	 * to a notification named like each table on a connection of \p profile;
+	 * the database has to send it, e.g. with a trigger running
+	 * <tt>NOTIFY tablename</tt>.
+	 * @note Changes made by other processes are only seen through driver
+	 * notifications.
+	 */
+	void subscribeTables(const QStringList &tables, const QString &profile = QString());
+	void unsubscribeTables(const QStringList &tables, const QString &profile = QString());
+
+	/**
+	 * @brief Emit tablesChanged() for the changes committed on the SQLite
+	 * connections of the calling thread since the last call.
+	 * @details Called after every task started with startTask() and every
+	 * AsyncSession task. Call it after committing on a connection of an own
+	 * thread, e.g. the main thread.
+	 */
+	void sendTableNotifications();
+	///@}
+
+	/**
+	 * @brief The persistent result cache used by AsyncQuery::setPersistentCache().
+	 * @details The cache is disabled until ResultCache::setDirectory() is called.
+	 */
+	ResultCache *resultCache();
+
+	/**
+	 * @brief The log of slow queries run by AsyncQuery.
+	 * @details The log is disabled until SlowQueryLog::setThresholdMs() is
+	 * called.
+	 */
+	SlowQueryLog *slowQueryLog();
+
+	/**
+	 * @brief Aggregated statistics per normalized statement.
+	 * @details Disabled until StatementStats::setEnabled() is called.
+	 */
+	StatementStats *statementStats();
+
+	/**
+	 * @brief The \p limit statements with the highest total time, e.g. for
+	 * QML. Each entry is a map with the fields of StatementStats::Statement.
+	 */
+	Q_INVOKABLE QVariantList statementStatistics(int limit = 20);
+
+	/**
+	 * @brief Counters, gauges and latency histograms of the pool, the query
+	 * queues and the connections.
+	 */
+	PoolMetrics *metrics();
+
+	/**
+	 * @brief Serves reads of the default SQLite profile from an in-memory copy.
+	 * @details Inactive until MemoryReplica::enable() is called.
+	 */
+	MemoryReplica *memoryReplica();
+
+	/**
+	 * @brief PoolMetrics::toJson() or, if \p prometheus is \c true,
+	 * PoolMetrics::toPrometheus() for QML and scripting.
+	 */
+	Q_INVOKABLE QString metricsText(bool prometheus = true);
+
+	///@{
+	/**
+	  * @name Admission control for database tasks.
+	  */
+
+	/**
+	 * @brief Limit the number of database tasks running or waiting in the
+	 * QThreadPool. 0 (default) means unlimited.
+	 * @details Tasks above the limit are kept in a FIFO by the
+	 * ConnectionManager and handed to the pool when a running task finishes.
+	 */
+	void setMaxTasksInFlight(int max);
+	int maxTasksInFlight() const;
+
+	/**
+	 * @brief Number of tasks handed to a pool and not yet finished.
+	 */
+	int tasksInFlight() const;
+
+	/**
+	 * @brief Number of tasks held back by setMaxTasksInFlight().
+	 */
+	int tasksPending() const;
+
+	/**
+	 * @brief Limit the number of tasks held back by setMaxTasksInFlight().
+	 * 0 (default) means unlimited.
+	 * @details If the limit is reached, taskOverflowPolicy() decides about
+	 * tasks implementing RejectableTask (queries and pipelines):
+	 * AsyncQuery::Overflow_Reject rejects the new task,
+	 * AsyncQuery::Overflow_DropOldest the oldest held back one and
+	 * AsyncQuery::Overflow_Block blocks the starting thread until there is
+	 * room. A rejected query finishes with an AsyncQueryResult::isRejected()
+	 * error. Tasks started from a worker thread are never blocked and tasks
+	 * which can not be rejected are always held back.
+	 */
+	void setMaxTasksPending(int max);
+	int maxTasksPending() const;
+
+	/**
+	 * @brief What to do when maxTasksPending() is reached, default
+	 * AsyncQuery::Overflow_Reject.
+	 */
+	void setTaskOverflowPolicy(AsyncQuery::OverflowPolicy policy);
+	AsyncQuery::OverflowPolicy taskOverflowPolicy() const;
+
+	/**
+	 * @brief Start \p task in \p pool, subject to setMaxTasksInFlight().
+	 * @details Used by AsyncQuery and the other task based classes. The task
+	 * is deleted after it has run if QRunnable::autoDelete() is set.
+	 * @param pool [optional] defaults to QThreadPool::globalInstance().
+	 */
+	void startTask(QRunnable *task, QThreadPool *pool = nullptr);
+
+	/**
+	 * @brief Start \p task only if setMaxTasksInFlight() admits it right away.
+	 * @details Never blocks and never holds the task back, for optional work
+	 * such as the helper tasks of ResultOperations.
+	 * @returns \c false if the task was not started, it is not deleted then.
+	 */
+	bool tryStartTask(QRunnable *task, QThreadPool *pool = nullptr);
+	///@}
+
+signals:
+	/**
+	 * @brief Is emitted if the number of connections is changed.
+	 */
+	void connectionCountChanged(int);
+
+	/**
+	 * @brief Is emitted when a task is held back because
+	 * maxTasksInFlight() is reached.
+	 */
+	void taskLimitReached(int pendingTasks);
+
+	/**
+	 * @brief Is emitted when changes of \p tables were committed (see
+	 * subscribeTables()).
+	 * @note Is emitted from the thread of the connection, after the commit.
+	 */
+	void tablesChanged(const QStringList &tables);
+
+private:
+	typedef QPair<QThread*, QString> ConnectionKey;
+
+	friend class AdmittedTaskPrivate;
+	friend class RejectedTaskPrivate;
+	friend class NotificationListenerPrivate;
+	friend struct SqliteHookStatePrivate;
+	/* use only in locked area */
+	void closeConnection(const ConnectionKey &key);
+	void taskFinished();
+	/* use only in locked area */
+	bool tasksLimited() const;
+	/* use only in locked area */
+	bool pendingFull() const;
+
+	ConnectionManager(QObject* parent = nullptr);
+	virtual ~ConnectionManager();
+
+	//the static instance
+	static ConnectionManager *_instance;
+	static QMutex _instanceMutex;
+
+	/* use only in locked area */
+	ConnectionProfile defaultProfile() const;
+	/* use only in locked area */
+	bool initConnection(QSqlDatabase &db, const ConnectionProfile &profile,
+						QSqlError *error) const;
+
+	mutable QMutex _mutex;
+	QMap<ConnectionKey, QSqlDatabase> _conns;
+	QSet<ConnectionKey> _staleConns;
+	QMap<QString, ConnectionProfile> _profiles;
+	QMap<ConnectionKey, SqliteHookStatePrivate*> _sqliteHooks;
+	QMap<QString, QMap<QString, int>> _subscribedTables;
+	QAtomicInt _subscriptionCount;
+	QThread *_listenerThread;
+	QMap<QString, NotificationListenerPrivate*> _listeners;
+
+	QString	_hostName;
+	int	_port;
+	QString	_userName;
+	QString _databaseName;
+	QSql::NumericalPrecisionPolicy	_precisionPolicy;
+	QString	_password;
+	QString _type;
+	QString _connectOptions;
+	QStringList _initStatements;
+	ConnectionProfile::InitCallback _initCallback;
+
+	ResultCache _resultCache;
+	SlowQueryLog _slowQueryLog;
+	StatementStats _statementStats;
+	PoolMetrics _metrics;
+	MemoryReplica _memoryReplica;
+
+	mutable QMutex _taskMutex;
+	int _maxTasksInFlight;
+	int _tasksInFlight;
+	QQueue<QPair<QRunnable*, QThreadPool*>> _pendingTasks;
+	int _maxTasksPending;
+	AsyncQuery::OverflowPolicy _taskOverflowPolicy;
+	/** wakes starters blocked by Overflow_Block */
+	QWaitCondition _pendingCondition;
+	/** runs RejectableTask::reject() of rejected tasks */
+	QThreadPool *_rejectPool;
+
+	QLoggingCategory logger;
+};
+
+} // namespace
+
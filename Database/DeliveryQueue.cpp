@@ -0,0 +1,121 @@
+#include "DeliveryQueue.h"
+
+#include <QAtomicInt>
+#include <QMap>
+#include <QTimer>
+
+namespace Database {
+
+namespace {
+
+QMutex queuesMutex;
+QMap<QThread*, DeliveryQueue*> queues;
+QAtomicInt frameIntervalMs(0);
+
+}
+
+DeliveryQueue::DeliveryQueue(QObject *parent)
+	: QObject(parent)
+	, _scheduled(false)
+{
+}
+
+void DeliveryQueue::setFrameInterval(int ms)
+{
+	frameIntervalMs.store(qMax(0, ms));
+}
+
+int DeliveryQueue::frameInterval()
+{
+	return frameIntervalMs.load();
+}
+
+void DeliveryQueue::post(QThread *thread, const QPointer<QObject> &guard,
+						 const std::function<void()> &callback, quintptr coalesceKey)
+{
+	// appended under queuesMutex, a finishing thread cannot delete the queue meanwhile
+	QMutexLocker locker(&queuesMutex);
+	DeliveryQueue *queue = queues.value(thread);
+	if (!queue) {
+		queue = new DeliveryQueue();
+		queue->moveToThread(thread);
+		queues.insert(thread, queue);
+		// finished is emitted in the thread itself, before its event loop is gone
+		connect(thread, &QThread::finished, queue, [thread, queue]() {
+			queuesMutex.lock();
+			queues.remove(thread);
+			queuesMutex.unlock();
+			queue->runEntries();
+			delete queue;
+		}, Qt::DirectConnection);
+	}
+	queue->append(guard, callback, coalesceKey);
+}
+
+int DeliveryQueue::pending(QThread *thread)
+{
+	QMutexLocker locker(&queuesMutex);
+	DeliveryQueue *queue = queues.value(thread);
+	if (!queue)
+		return 0;
+	QMutexLocker queueLocker(&queue->_mutex);
+	return queue->_entries.size();
+}
+
+void DeliveryQueue::append(const QPointer<QObject> &guard,
+						   const std::function<void()> &callback, quintptr coalesceKey)
+{
+	QMutexLocker locker(&_mutex);
+	if (coalesceKey != 0) {
+		auto it = _coalesced.constFind(coalesceKey);
+		if (it != _coalesced.constEnd()) {
+			_entries[it.value()].callback = callback;
+			return;
+		}
+		_coalesced.insert(coalesceKey, _entries.size());
+	}
+
+	Entry entry;
+	entry.guard = guard;
+	entry.callback = callback;
+	entry.coalesceKey = coalesceKey;
+	_entries.append(entry);
+
+	if (!_scheduled) {
+		_scheduled = true;
+		QMetaObject::invokeMethod(this, "flush", Qt::QueuedConnection);
+	}
+}
+
+void DeliveryQueue::flush()
+{
+	_mutex.lock();
+	int interval = frameIntervalMs.load();
+	if (interval > 0 && _lastFlush.isValid() && _lastFlush.elapsed() < interval) {
+		int wait = int(interval - _lastFlush.elapsed());
+		_mutex.unlock();
+		QTimer::singleShot(wait, this, SLOT(flush()));
+		return;
+	}
+	_lastFlush.start();
+	_mutex.unlock();
+
+	runEntries();
+}
+
+void DeliveryQueue::runEntries()
+{
+	_mutex.lock();
+	QVector<Entry> entries;
+	entries.swap(_entries);
+	_coalesced.clear();
+	_scheduled = false;
+	_mutex.unlock();
+
+	for (const Entry &entry : entries) {
+		if (entry.guard)
+			entry.callback();
+	}
+}
+
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QMutex>
+#include <QObject>
+#include <QPointer>
+#include <QThread>
+#include <QVector>
+
+#include <functional>
+
+namespace Database {
+
+/**
+ * @brief Collects callbacks posted from worker threads and runs them in one
+ * batch in the thread of the queue.
+ *
+ * @details There is one queue per receiving thread. The first post() into an
+ * empty queue schedules a single flush for the next event loop iteration, or
+ * for the next frame if setFrameInterval() is set, and all callbacks posted
+ * until then run in that flush. Callbacks posted with the same coalesce key
+ * replace each other, only the newest one runs.
+ *
+ * When the receiving thread finishes, its queue runs the pending callbacks
+ * and is deleted in that thread, before the thread exits.
+ *
+ * Used by AsyncQuery::setDelivery() to deliver results in batches.
+ *
+ * @note post() is thread save. The receiving thread needs an event loop.
+ */
+class DeliveryQueue : public QObject
+{
+	Q_OBJECT
+
+public:
+	/**
+	 * @brief Minimum time between two flushes of a queue in ms, e.g. 16 for
+	 * one batch per frame. 0 (default) flushes once per event loop iteration.
+	 */
+	static void setFrameInterval(int ms);
+	static int frameInterval();
+
+	/**
+	 * @brief Run \p callback in \p thread with the next batch.
+	 * @param guard The callback is dropped if \p guard is deleted before,
+	 * must not be \c nullptr. Create it in the thread which owns the object.
+	 * @param coalesceKey If not 0 a pending callback with the same key is
+	 * replaced by \p callback.
+	 */
+	static void post(QThread *thread, const QPointer<QObject> &guard,
+					 const std::function<void()> &callback, quintptr coalesceKey = 0);
+
+	/**
+	 * @brief Number of callbacks waiting for the next flush in \p thread.
+	 */
+	static int pending(QThread *thread);
+
+private slots:
+	void flush();
+
+private:
+	explicit DeliveryQueue(QObject *parent = nullptr);
+
+	void append(const QPointer<QObject> &guard, const std::function<void()> &callback,
+				quintptr coalesceKey);
+	void runEntries();
+
+	struct Entry {
+		QPointer<QObject> guard;
+		std::function<void()> callback;
+		quintptr coalesceKey;
+	};
+
+	mutable QMutex _mutex;
+	QVector<Entry> _entries;
+	QHash<quintptr, int> _coalesced;
+	bool _scheduled;
+	QElapsedTimer _lastFlush;
+};
+
+}
@@ -0,0 +1,69 @@
+#include "LiveQuery.h"
+#include "AsyncQuery.h"
+#include "ConnectionManager.h"
+
+namespace Database {
+
+LiveQuery::LiveQuery(AsyncQuery *query, QObject *parent)
+	: QObject(parent)
+	, _query(query)
+{
+	_debounce.setSingleShot(true);
+	_debounce.setInterval(100);
+	connect(&_debounce, SIGNAL(timeout()), this, SLOT(onDebounced()));
+	connect(ConnectionManager::instance(), SIGNAL(tablesChanged(QStringList)),
+			this, SLOT(onTablesChanged(QStringList)), Qt::QueuedConnection);
+}
+
+LiveQuery::~LiveQuery()
+{
+	setTables(QStringList());
+}
+
+void LiveQuery::setTables(const QStringList &tables)
+{
+	ConnectionManager *conmgr = ConnectionManager::instance();
+	if (!_tables.isEmpty())
+		conmgr->unsubscribeTables(_tables, _profile);
+	_tables = tables;
+	if (!_tables.isEmpty()) {
+		_profile = _query->connectionProfile();
+		conmgr->subscribeTables(_tables, _profile);
+	} else {
+		_debounce.stop();
+	}
+}
+
+QStringList LiveQuery::tables() const
+{
+	return _tables;
+}
+
+void LiveQuery::setDebounceMs(int ms)
+{
+	_debounce.setInterval(qMax(0, ms));
+}
+
+int LiveQuery::debounceMs() const
+{
+	return _debounce.interval();
+}
+
+void LiveQuery::onTablesChanged(const QStringList &tables)
+{
+	for (const QString &table : tables) {
+		if (_tables.contains(table, Qt::CaseInsensitive)) {
+			// not restarted, continuous changes must not starve the query
+			if (!_debounce.isActive())
+				_debounce.start();
+			return;
+		}
+	}
+}
+
+void LiveQuery::onDebounced()
+{
+	_query->startExecAgain();
+}
+
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <QObject>
+#include <QStringList>
+#include <QTimer>
+
+namespace Database {
+
+// class forward decl's
+class AsyncQuery;
+
+/**
+ * @brief Runs the last query of an AsyncQuery again when tables it reads are
+ * changed.
+ *
+ * @details The tables are subscribed at the ConnectionManager
+ * (ConnectionManager::subscribeTables()). When a change of one of them is
+ * reported with ConnectionManager::tablesChanged(), AsyncQuery::startExecAgain()
+ * is called after a debounce interval, so a burst of changes re-runs the
+ * query once and continuous changes at most once per interval. Used by
+ * AsyncQueryModel and AsyncQueryQMLModel.
+ */
+class LiveQuery : public QObject
+{
+	Q_OBJECT
+
+public:
+	explicit LiveQuery(AsyncQuery *query, QObject *parent = nullptr);
+	virtual ~LiveQuery();
+
+	/**
+	 * @brief Tables read by the query, compared case insensitive. An empty
+	 * list disables the live updates.
+	 * @details The tables are subscribed for the current connection profile
+	 * of the query (AsyncQuery::connectionProfile()).
+	 */
+	void setTables(const QStringList &tables);
+	QStringList tables() const;
+
+	/**
+	 * @brief Time in ms to collect changes before the query is run again,
+	 * default 100.
+	 */
+	void setDebounceMs(int ms);
+	int debounceMs() const;
+
+private slots:
+	void onTablesChanged(const QStringList &tables);
+	void onDebounced();
+
+private:
+	AsyncQuery *_query;
+	QStringList _tables;
+	QString _profile;
+	QTimer _debounce;
+};
+
+}
@@ -0,0 +1,359 @@
+#include "MemoryReplica.h"
+#include "ConnectionManager.h"
+
+#include <QRegularExpression>
+#include <QRunnable>
+
+#ifdef ASYNCSQL_SQLITE_API
+#include <sqlite3.h>
+#endif
+
+namespace Database {
+
+/**
+ * @brief Reloads the copy in the QThreadPool.
+ */
+class ReplicaSyncTaskPrivate : public QRunnable
+{
+public:
+	explicit ReplicaSyncTaskPrivate(MemoryReplica *replica)
+		: _replica(replica)
+	{
+	}
+
+	void run() override
+	{
+		_replica->sync();
+	}
+
+private:
+	MemoryReplica *_replica;
+};
+
+MemoryReplica::MemoryReplica(ConnectionManager *manager)
+	: QObject(nullptr)
+	, _manager(manager)
+	, _active(false)
+	, _syncMode(Sync_WriteThrough)
+	, _syncIntervalMs(1000)
+	, _keeper(nullptr)
+	, logger("Database.MemoryReplica")
+{
+	_syncTimer.setSingleShot(true);
+	connect(&_syncTimer, &QTimer::timeout, this, &MemoryReplica::syncTimeout);
+}
+
+MemoryReplica::~MemoryReplica()
+{
+#ifdef ASYNCSQL_SQLITE_API
+	if (_keeper)
+		sqlite3_close(_keeper);
+#endif
+}
+
+QString MemoryReplica::replicaName()
+{
+#if defined(ASYNCSQL_SQLITE_API) && SQLITE_VERSION_NUMBER >= 3036000
+	// memdb uses normal locking, readers wait with their busy timeout during a reload
+	return QStringLiteral("file:/asyncsql_replica?vfs=memdb");
+#else
+	return QStringLiteral("file:asyncsql_replica?mode=memory&cache=shared");
+#endif
+}
+
+QString MemoryReplica::sourceProfile()
+{
+	return QStringLiteral("asyncsql_replica_source");
+}
+
+bool MemoryReplica::enable(QSqlError *error)
+{
+#ifdef ASYNCSQL_SQLITE_API
+	QMutexLocker syncLocker(&_syncMutex);
+	QMutexLocker writeLocker(&_writeMutex);
+	QMutexLocker locker(&_mutex);
+	if (_active)
+		return true;
+
+	ConnectionProfile source = _manager->profile(QString());
+	if (!source.type.startsWith("QSQLITE")) {
+		qCWarning(logger) << "MemoryReplica::enable: default profile is" << source.type;
+		if (error)
+			*error = QSqlError(QString(), "Memory replica requires a SQLite database",
+							   QSqlError::ConnectionError);
+		return false;
+	}
+
+	// the keeper connection keeps the in-memory database alive
+	int rc = sqlite3_open_v2(replicaName().toUtf8().constData(), &_keeper,
+		SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE | SQLITE_OPEN_URI, nullptr);
+	if (rc != SQLITE_OK || !load(source.databaseName, _keeper, error)) {
+		if (rc != SQLITE_OK && error)
+			*error = QSqlError(QString(), sqlite3_errmsg(_keeper),
+							   QSqlError::ConnectionError, QString::number(rc));
+		sqlite3_close(_keeper);
+		_keeper = nullptr;
+		return false;
+	}
+	_lastSync = QDateTime::currentDateTime();
+
+	_sourceFile = source.databaseName;
+	_sourceOptions = source.connectOptions;
+	_manager->addProfile(sourceProfile(), source);
+
+	ConnectionProfile replica = source;
+	replica.databaseName = replicaName();
+	QStringList options = source.connectOptions.split(';');
+	options.removeAll(QString());
+	if (!options.contains("QSQLITE_OPEN_URI"))
+		options << "QSQLITE_OPEN_URI";
+	if (!source.connectOptions.contains("QSQLITE_BUSY_TIMEOUT"))
+		options << "QSQLITE_BUSY_TIMEOUT=10000";
+	replica.connectOptions = options.join(';');
+	_manager->setDefaultProfile(replica);
+	_active = true;
+	locker.unlock();
+
+	// reopen all connections on the copy, each on its own thread
+	_manager->reopenAll();
+	qCInfo(logger) << "MemoryReplica: serving" << _sourceFile << "from memory";
+	return true;
+#else
+	qCWarning(logger) << "MemoryReplica::enable: requires CONFIG += asyncsql_sqlite";
+	if (error)
+		*error = QSqlError(QString(), "Memory replica requires the SQLite API",
+						   QSqlError::ConnectionError);
+	return false;
+#endif
+}
+
+void MemoryReplica::disable()
+{
+	QMutexLocker syncLocker(&_syncMutex);
+	QMutexLocker writeLocker(&_writeMutex);
+	QMutexLocker locker(&_mutex);
+	if (!_active)
+		return;
+
+	ConnectionProfile source = _manager->profile(QString());
+	source.databaseName = _sourceFile;
+	source.connectOptions = _sourceOptions;
+	_manager->setDefaultProfile(source);
+	_manager->removeProfile(sourceProfile());
+	_active = false;
+	locker.unlock();
+
+	_manager->reopenAll();
+#ifdef ASYNCSQL_SQLITE_API
+	sqlite3_close(_keeper);
+#endif
+	_keeper = nullptr;
+}
+
+bool MemoryReplica::isActive() const
+{
+	QMutexLocker locker(&_mutex);
+	return _active;
+}
+
+void MemoryReplica::setSyncMode(MemoryReplica::SyncMode mode)
+{
+	QMutexLocker locker(&_mutex);
+	_syncMode = mode;
+}
+
+MemoryReplica::SyncMode MemoryReplica::syncMode() const
+{
+	QMutexLocker locker(&_mutex);
+	return _syncMode;
+}
+
+void MemoryReplica::setSyncIntervalMs(int ms)
+{
+	QMutexLocker locker(&_mutex);
+	_syncIntervalMs = qMax(0, ms);
+}
+
+int MemoryReplica::syncIntervalMs() const
+{
+	QMutexLocker locker(&_mutex);
+	return _syncIntervalMs;
+}
+
+bool MemoryReplica::sync(QSqlError *error)
+{
+	QMutexLocker syncLocker(&_syncMutex);
+	_mutex.lock();
+	bool active = _active;
+	QString fileName = _sourceFile;
+	_mutex.unlock();
+
+	// no write must be between the file and its repetition on the copy,
+	// it would be applied twice
+	QMutexLocker writeLocker(&_writeMutex);
+	bool succ = active && load(fileName, _keeper, error);
+	writeLocker.unlock();
+	if (succ) {
+		QMutexLocker locker(&_mutex);
+		_lastSync = QDateTime::currentDateTime();
+	}
+	syncLocker.unlock();
+
+	if (active)
+		emit synced(succ);
+	return succ;
+}
+
+void MemoryReplica::requestSync()
+{
+	QMetaObject::invokeMethod(this, "startSyncTimer", Qt::QueuedConnection);
+}
+
+QDateTime MemoryReplica::lastSync() const
+{
+	QMutexLocker locker(&_mutex);
+	return _lastSync;
+}
+
+/**
+ * @brief First keyword of \p sql after white space, '(' and comments, upper
+ * case. Empty if \p sql ends in a comment.
+ */
+static QString firstKeyword(const QString &sql)
+{
+	int i = 0;
+	while (i < sql.size()) {
+		if (sql[i].isSpace() || sql[i] == QLatin1Char('(')) {
+			i++;
+		} else if (sql.midRef(i, 2) == QLatin1String("--")) {
+			i = sql.indexOf(QLatin1Char('\n'), i);
+			if (i < 0)
+				return QString();
+		} else if (sql.midRef(i, 2) == QLatin1String("/*")) {
+			i = sql.indexOf(QLatin1String("*/"), i + 2);
+			if (i < 0)
+				return QString();
+			i += 2;
+		} else {
+			break;
+		}
+	}
+	int end = i;
+	while (end < sql.size() && sql[end].isLetter())
+		end++;
+	return sql.mid(i, end - i).toUpper();
+}
+
+/**
+ * @brief Does a WITH statement modify data.
+ */
+static bool withModifies(const QString &sql)
+{
+	static const QRegularExpression modifies("\\b(INSERT|UPDATE|DELETE|REPLACE)\\b",
+		QRegularExpression::CaseInsensitiveOption);
+	return sql.contains(modifies);
+}
+
+bool MemoryReplica::isWrite(const QString &sql)
+{
+	QString keyword = firstKeyword(sql);
+	if (keyword.isEmpty())
+		return true;
+	if (keyword == "SELECT" || keyword == "VALUES" || keyword == "EXPLAIN")
+		return false;
+	if (keyword == "PRAGMA")
+		return sql.contains(QLatin1Char('='));
+	if (keyword == "WITH")
+		return withModifies(sql);
+	return true;
+}
+
+bool MemoryReplica::isQuery(const QString &sql)
+{
+	QString keyword = firstKeyword(sql);
+	if (keyword == "SELECT" || keyword == "VALUES")
+		return true;
+	if (keyword == "WITH")
+		return !withModifies(sql);
+	return false;
+}
+
+bool MemoryReplica::isDeterministic(const QString &sql)
+{
+	static const QRegularExpression volatileTerms(
+		"\\b(random|randomblob|changes|total_changes|last_insert_rowid|"
+		"current_timestamp|current_date|current_time)\\b|'now'",
+		QRegularExpression::CaseInsensitiveOption);
+	return !sql.contains(volatileTerms);
+}
+
+bool MemoryReplica::generatesKey(const QString &sql)
+{
+	static const QRegularExpression inserts("\\b(INSERT|REPLACE)\\b",
+		QRegularExpression::CaseInsensitiveOption);
+	QString keyword = firstKeyword(sql);
+	if (keyword == "WITH")
+		return sql.contains(inserts);
+	return keyword == "INSERT" || keyword == "REPLACE";
+}
+
+void MemoryReplica::startSyncTimer()
+{
+	QMutexLocker locker(&_mutex);
+	if (!_active || _syncTimer.isActive())
+		return;
+	// at most one reload per interval
+	qint64 sinceLast = _lastSync.msecsTo(QDateTime::currentDateTime());
+	_syncTimer.start(int(qBound<qint64>(0, _syncIntervalMs - sinceLast, _syncIntervalMs)));
+}
+
+void MemoryReplica::syncTimeout()
+{
+	_manager->startTask(new ReplicaSyncTaskPrivate(this));
+}
+
+bool MemoryReplica::load(const QString &fileName, sqlite3 *keeper, QSqlError *error)
+{
+#ifdef ASYNCSQL_SQLITE_API
+	sqlite3 *source = nullptr;
+	int rc = sqlite3_open_v2(fileName.toUtf8().constData(), &source,
+		SQLITE_OPEN_READONLY | SQLITE_OPEN_URI, nullptr);
+	if (rc == SQLITE_OK) {
+		sqlite3_busy_timeout(source, 10000);
+		sqlite3_backup *backup = sqlite3_backup_init(keeper, "main", source, "main");
+		if (backup) {
+			// the copy is locked while readers are active, retry for up to 10 s
+			int retries = 0;
+			do {
+				rc = sqlite3_backup_step(backup, -1);
+				if ((rc == SQLITE_BUSY || rc == SQLITE_LOCKED) && retries++ < 1000)
+					sqlite3_sleep(10);
+				else
+					break;
+			} while (true);
+			sqlite3_backup_finish(backup);
+			rc = rc == SQLITE_DONE ? SQLITE_OK : rc;
+		} else {
+			rc = sqlite3_errcode(keeper);
+		}
+	}
+
+	if (rc != SQLITE_OK) {
+		QString message = QString("Loading %1 into memory failed: %2").arg(fileName,
+			QString::fromUtf8(sqlite3_errstr(rc)));
+		qCCritical(logger) << "MemoryReplica:" << message;
+		if (error)
+			*error = QSqlError(QString(), message, QSqlError::ConnectionError,
+							   QString::number(rc));
+	}
+	sqlite3_close(source);
+	return rc == SQLITE_OK;
+#else
+	Q_UNUSED(fileName);
+	Q_UNUSED(keeper);
+	Q_UNUSED(error);
+	return false;
+#endif
+}
+
+}
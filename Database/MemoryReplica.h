@@ -0,0 +1,175 @@
+#pragma once
+
+#include <QDateTime>
+#include <QMutex>
+#include <QObject>
+#include <QSqlError>
+#include <QString>
+#include <QTimer>
+
+#include <QLoggingCategory>
+
+struct sqlite3;
+
+namespace Database {
+
+// class forward decl's
+class ConnectionManager;
+
+/**
+ * @brief Serves the reads of the default SQLite profile from an in-memory copy
+ * of the database file.
+ *
+ * @details enable() loads the database file of the default profile once into a
+ * named in-memory database with the SQLite backup API. The default profile is
+ * then redirected to that copy, so every thread connection reads from memory
+ * instead of its own small page cache of the file. Statements which modify
+ * data (see isWrite()), scripts and batches are sent to the file through an
+ * internal profile and then brought to the copy:
+ * - Sync_WriteThrough executes the same statement on the copy right after it
+ *   succeeded on the file. Writes and their repetition are serialized, so the
+ *   copy sees them in commit order. Scripts, batches, failed writes, statements
+ *   which are not deterministic (see isDeterministic()), databases with
+ *   triggers and repetitions which changed other rows or generated another
+ *   key than on the file reload the copy.
+ * - Sync_Periodic reloads the whole copy at most once per syncIntervalMs()
+ *   after writes.
+ *
+ * Sample Usage:
+ * \code{.cpp}
+ * Database::ConnectionManager *conmgr = Database::ConnectionManager::instance();
+ * conmgr->setType("QSQLITE");
+ * conmgr->setDatabaseName("chinook.db");
+ * conmgr->memoryReplica()->enable();
+ * \endcode
+ *
+ * @note Requires the library built with <tt>CONFIG += asyncsql_sqlite</tt>.
+ * Periodic syncs and requestSync() need an event loop in the thread of the
+ * ConnectionManager.
+ * @note All functions are thread save.
+ */
+class MemoryReplica : public QObject
+{
+	Q_OBJECT
+
+public:
+	enum SyncMode {
+		/** Repeat each write on the copy (default). */
+		Sync_WriteThrough,
+		/** Reload the copy from the file after writes, see setSyncIntervalMs(). */
+		Sync_Periodic,
+	};
+	Q_ENUM(SyncMode)
+
+	explicit MemoryReplica(ConnectionManager *manager);
+	virtual ~MemoryReplica();
+
+	/**
+	 * @brief Load the database of the default profile into memory and serve
+	 * reads from it.
+	 * @details The connections of the calling thread are closed, those of other
+	 * threads are reopened on the copy when they are used next (see
+	 * ConnectionManager::reopenAll()). Call it at startup before queries are
+	 * started.
+	 * @returns \c false if the default profile is not SQLite or loading failed.
+	 */
+	bool enable(QSqlError *error = nullptr);
+
+	/**
+	 * @brief Restore the default profile to the database file and drop the copy.
+	 * @details Connections are reopened as in enable().
+	 */
+	void disable();
+
+	bool isActive() const;
+
+	void setSyncMode(SyncMode mode);
+	SyncMode syncMode() const;
+
+	/**
+	 * @brief Minimum time between periodic reloads, default 1000 ms.
+	 */
+	void setSyncIntervalMs(int ms);
+	int syncIntervalMs() const;
+
+	/**
+	 * @brief Reload the copy from the file now, blocks until it is done.
+	 * @details Readers of the copy wait (busy timeout) while it is replaced.
+	 */
+	bool sync(QSqlError *error = nullptr);
+
+	/**
+	 * @brief Schedule a reload within syncIntervalMs(), e.g. after the file was
+	 * changed by another process.
+	 */
+	void requestSync();
+
+	/**
+	 * @brief Time of the last successful load.
+	 */
+	QDateTime lastSync() const;
+
+	/**
+	 * @brief Returns \c false for statements which only read (SELECT, VALUES,
+	 * EXPLAIN, PRAGMA queries and WITH without data modification).
+	 */
+	static bool isWrite(const QString &sql);
+
+	/**
+	 * @brief Returns \c true for statements which can be used as a sub-query,
+	 * i.e. SELECT, VALUES and WITH without data modification.
+	 */
+	static bool isQuery(const QString &sql);
+
+	/**
+	 * @brief Returns \c false if repeating \p sql can give a different
+	 * result, e.g. with random(), the current time or the last insert id.
+	 */
+	static bool isDeterministic(const QString &sql);
+
+	/**
+	 * @brief Returns \c true for INSERT and REPLACE statements, which may
+	 * generate a key (rowid, AUTOINCREMENT).
+	 */
+	static bool generatesKey(const QString &sql);
+
+	/**
+	 * @brief Name of the internal profile writing to the database file.
+	 */
+	static QString sourceProfile();
+
+signals:
+	/**
+	 * @brief Is emitted after each reload of the copy.
+	 */
+	void synced(bool success);
+
+private slots:
+	void startSyncTimer();
+	void syncTimeout();
+
+private:
+	friend class SqlTaskPrivate;
+
+	static QString replicaName();
+	bool load(const QString &fileName, sqlite3 *keeper, QSqlError *error);
+
+	ConnectionManager *_manager;
+
+	mutable QMutex _mutex;
+	QMutex _syncMutex;
+	// held from a write on the file until it was repeated on the copy, and by reloads
+	QMutex _writeMutex;
+	bool _active;
+	SyncMode _syncMode;
+	int _syncIntervalMs;
+	QDateTime _lastSync;
+	QString _sourceFile;
+	QString _sourceOptions;
+	sqlite3 *_keeper;
+	QTimer _syncTimer;
+
+	QLoggingCategory logger;
+};
+
+}
@@ -0,0 +1,400 @@
+#include "ParallelScan.h"
+#include "ConnectionManager.h"
+
+#include <QRunnable>
+#include <QSqlQuery>
+#include <QStringList>
+#include <QThread>
+
+namespace Database {
+
+/**
+ * @brief Reads the key range (partition < 0) or one partition of a scan.
+ */
+class ScanTaskPrivate : public QRunnable
+{
+public:
+	enum Keys {
+		Keys_All,	///< every row, the scan is not partitioned
+		Keys_Null,	///< rows with a NULL key
+		Keys_Range,	///< keys from _from to _to
+	};
+
+	ScanTaskPrivate(ParallelScan *instance, const ParallelScan::Scan &scan)
+		: _instance(instance)
+		, _scan(scan)
+		, _partition(-1)
+		, _keys(Keys_All)
+		, _from(0)
+		, _to(0)
+		, _last(false)
+	{
+	}
+
+	ScanTaskPrivate(ParallelScan *instance, const ParallelScan::Scan &scan, int partition,
+					Keys keys, qint64 from, qint64 to, bool last)
+		: _instance(instance)
+		, _scan(scan)
+		, _partition(partition)
+		, _keys(keys)
+		, _from(from)
+		, _to(to)
+		, _last(last)
+	{
+	}
+
+	void run() override
+	{
+		AsyncQueryResult result;
+		ConnectionManager* conmgr = ConnectionManager::instance();
+
+		if (conmgr->connectionExists(_scan.profile)
+				|| conmgr->open(_scan.profile, &result._error)) {
+			QSqlDatabase db = conmgr->threadConnection(_scan.profile);
+			QMap<QString, QVariant> boundValues = _scan.boundValues;
+			QString sql = _partition < 0 ? rangeQuery() : partitionQuery(boundValues);
+
+			QSqlQuery query(db);
+			query.setForwardOnly(true);
+			bool succ = query.prepare(sql);
+			if (succ) {
+				for (auto it = boundValues.constBegin(); it != boundValues.constEnd(); ++it)
+					query.bindValue(it.key(), it.value());
+				succ = query.exec();
+			}
+
+			result._queryString = sql;
+			result.setRecord(query.record());
+			result._error = query.lastError();
+			if (succ) {
+				int cols = result._record.count();
+				while (query.next()) {
+					QVector<QVariant> currow(cols);
+					for (int ii = 0; ii < cols; ii++) {
+						if (!query.isNull(ii))
+							currow[ii] = query.value(ii);
+					}
+					result._data.append(currow);
+				}
+			}
+		}
+
+		if (_partition < 0)
+			_instance->rangeDone(_scan, result);
+		else
+			_instance->partitionDone(_partition, result);
+	}
+
+private:
+	QString filter() const
+	{
+		return _scan.where.isEmpty() ? QString() :
+			QString(" WHERE (%1)").arg(_scan.where);
+	}
+
+	QString rangeQuery() const
+	{
+		return QString("SELECT MIN(%1), MAX(%1) FROM %2%3")
+			.arg(_scan.keyColumn, _scan.table, filter());
+	}
+
+	QString partitionQuery(QMap<QString, QVariant> &boundValues) const
+	{
+		QString sql = QString("SELECT %1 FROM %2%3").arg(_scan.columns, _scan.table, filter());
+		if (_keys == Keys_Null) {
+			sql += _scan.where.isEmpty() ? " WHERE " : " AND ";
+			return sql + QString("%1 IS NULL").arg(_scan.keyColumn);
+		}
+		if (_keys == Keys_Range) {
+			sql += _scan.where.isEmpty() ? " WHERE " : " AND ";
+			sql += QString("%1 >= :asyncsql_from AND %1 %2 :asyncsql_to")
+				.arg(_scan.keyColumn, _last ? "<=" : "<");
+			boundValues.insert(":asyncsql_from", _from);
+			boundValues.insert(":asyncsql_to", _to);
+		}
+		return sql + QString(" ORDER BY %1").arg(_scan.keyColumn);
+	}
+
+	ParallelScan *_instance;
+	ParallelScan::Scan _scan;
+	int _partition;
+	Keys _keys;
+	qint64 _from;
+	qint64 _to;
+	bool _last;
+};
+
+/****************************************************************************************/
+/*                                       ParallelScan                                   */
+/****************************************************************************************/
+
+ParallelScan::ParallelScan(QObject *parent)
+	: QObject(parent), logger("Database.ParallelScan")
+	, _streaming(false)
+	, _running(false)
+	, _pending(0)
+	, _nextStream(0)
+	, _streamedRows(0)
+{
+	_scan.keyColumn = "rowid";
+	_scan.columns = "*";
+	_scan.partitions = QThread::idealThreadCount();
+}
+
+ParallelScan::~ParallelScan()
+{
+	waitDone();
+}
+
+void ParallelScan::setTable(const QString &table)
+{
+	QMutexLocker locker(&_mutex);
+	_scan.table = table;
+}
+
+QString ParallelScan::table() const
+{
+	QMutexLocker locker(&_mutex);
+	return _scan.table;
+}
+
+void ParallelScan::setKeyColumn(const QString &column)
+{
+	QMutexLocker locker(&_mutex);
+	_scan.keyColumn = column;
+}
+
+QString ParallelScan::keyColumn() const
+{
+	QMutexLocker locker(&_mutex);
+	return _scan.keyColumn;
+}
+
+void ParallelScan::setColumns(const QString &columns)
+{
+	QMutexLocker locker(&_mutex);
+	_scan.columns = columns;
+}
+
+QString ParallelScan::columns() const
+{
+	QMutexLocker locker(&_mutex);
+	return _scan.columns;
+}
+
+void ParallelScan::setWhere(const QString &condition)
+{
+	QMutexLocker locker(&_mutex);
+	_scan.where = condition;
+}
+
+QString ParallelScan::where() const
+{
+	QMutexLocker locker(&_mutex);
+	return _scan.where;
+}
+
+void ParallelScan::bindValue(const QString &placeholder, const QVariant &val)
+{
+	QMutexLocker locker(&_mutex);
+	_scan.boundValues.insert(placeholder, val);
+}
+
+void ParallelScan::clearBoundValues()
+{
+	QMutexLocker locker(&_mutex);
+	_scan.boundValues.clear();
+}
+
+void ParallelScan::setPartitions(int partitions)
+{
+	QMutexLocker locker(&_mutex);
+	_scan.partitions = qMax(1, partitions);
+}
+
+int ParallelScan::partitions() const
+{
+	QMutexLocker locker(&_mutex);
+	return _scan.partitions;
+}
+
+void ParallelScan::setConnectionProfile(const QString &profile)
+{
+	QMutexLocker locker(&_mutex);
+	_scan.profile = profile;
+}
+
+QString ParallelScan::connectionProfile() const
+{
+	QMutexLocker locker(&_mutex);
+	return _scan.profile;
+}
+
+void ParallelScan::setStreaming(bool enabled)
+{
+	QMutexLocker locker(&_mutex);
+	_streaming = enabled;
+}
+
+bool ParallelScan::streaming() const
+{
+	QMutexLocker locker(&_mutex);
+	return _streaming;
+}
+
+bool ParallelScan::isRunning() const
+{
+	QMutexLocker locker(&_mutex);
+	return _running;
+}
+
+bool ParallelScan::startExec()
+{
+	QMutexLocker locker(&_mutex);
+	if (_running || _scan.table.isEmpty())
+		return false;
+
+	_running = true;
+	ConnectionManager::instance()->startTask(new ScanTaskPrivate(this, _scan));
+	return true;
+}
+
+bool ParallelScan::waitDone(ulong msTimout)
+{
+	QMutexLocker lock(&_mutex);
+	if (_running)
+		return _waitcondition.wait(&_mutex, msTimout);
+	else
+		return true;
+}
+
+void ParallelScan::rangeDone(const ParallelScan::Scan &scan, const AsyncQueryResult &result)
+{
+	if (!result.isValid()) {
+		qCWarning(logger) << "ParallelScan: key range failed:" << result.error().text();
+		finish(result);
+		return;
+	}
+
+	// other key types (text, real) can not be split, read them in one partition
+	QVariant min = result._data.value(0).value(0);
+	QVariant max = result._data.value(0).value(1);
+	bool bounded = AsyncQueryResult::isIntegral(min) && AsyncQueryResult::isIntegral(max);
+	if (!min.isNull() && !bounded)
+		qCWarning(logger) << "ParallelScan: key is not an integer, reading one partition";
+	qint64 from = bounded ? min.toLongLong() : 0;
+	qint64 to = bounded ? max.toLongLong() : 0;
+
+	// equally wide key ranges, trailing ones may be empty for small ranges
+	int count = 1;
+	quint64 step = 0;
+	if (bounded) {
+		quint64 span = quint64(to) - quint64(from);
+		count = span < quint64(scan.partitions) ? int(span) + 1 : scan.partitions;
+		step = span / quint64(count) + 1;
+	}
+	// NULL keys are outside of every range, they sort first; a rowid is never NULL
+	static const QStringList rowids = { "rowid", "oid", "_rowid_" };
+	bool nullKeys = bounded && !rowids.contains(scan.keyColumn, Qt::CaseInsensitive);
+	int first = nullKeys ? 1 : 0;
+
+	_mutex.lock();
+	_results = QVector<AsyncQueryResult>(first + count);
+	_done = QVector<bool>(first + count, false);
+	_pending = first + count;
+	_nextStream = 0;
+	_streamedRows = 0;
+	_mutex.unlock();
+
+	if (nullKeys) {
+		ConnectionManager::instance()->startTask(
+			new ScanTaskPrivate(this, scan, 0, ScanTaskPrivate::Keys_Null, 0, 0, false));
+	}
+	for (int i = 0; i < count; i++) {
+		qint64 begin = qint64(quint64(from) + step * quint64(i));
+		bool last = i == count - 1;
+		qint64 end = last ? to : qint64(quint64(begin) + step);
+		ConnectionManager::instance()->startTask(new ScanTaskPrivate(this, scan, first + i,
+			bounded ? ScanTaskPrivate::Keys_Range : ScanTaskPrivate::Keys_All, begin, end, last));
+	}
+}
+
+void ParallelScan::partitionDone(int partition, const AsyncQueryResult &result)
+{
+	_mutex.lock();
+	_results[partition] = result;
+	_done[partition] = true;
+	bool streaming = _streaming;
+	bool lastDone = --_pending == 0;
+	_mutex.unlock();
+
+	if (streaming) {
+		// emit in key order, the thread finishing the next partition emits it
+		QMutexLocker streamLocker(&_streamMutex);
+		forever {
+			_mutex.lock();
+			if (_nextStream >= _done.size() || !_done[_nextStream]) {
+				_mutex.unlock();
+				break;
+			}
+			int index = _nextStream++;
+			AsyncQueryResult part = _results[index];
+			_results[index]._data.clear();
+			_streamedRows += part.count();
+			_mutex.unlock();
+
+			if (part.isValid())
+				emit partitionReady(index, part);
+		}
+	}
+
+	if (!lastDone)
+		return;
+
+	_mutex.lock();
+	QVector<AsyncQueryResult> results = _results;
+	_results.clear();
+	_done.clear();
+	int streamedRows = _streamedRows;
+	_mutex.unlock();
+
+	AsyncQueryResult merged;
+	merged._record = results.first()._record;
+	merged._columns = results.first()._columns;
+	merged._queryString = results.first()._queryString;
+
+	int total = 0;
+	for (const AsyncQueryResult &res : results) {
+		if (!res.isValid()) {
+			qCWarning(logger) << "ParallelScan: partition failed:" << res.error().text();
+			merged._error = res._error;
+			finish(merged);
+			return;
+		}
+		total += res.count();
+	}
+
+	if (streaming) {
+		total = streamedRows;
+	} else {
+		// partitions are ordered by the key and cover ascending key ranges
+		merged._data.reserve(total);
+		for (const AsyncQueryResult &res : results)
+			merged._data += res._data;
+	}
+	merged._numRowsAffected = total;
+	finish(merged);
+}
+
+void ParallelScan::finish(const AsyncQueryResult &result)
+{
+	emit execDone(result);
+
+	// wake waitDone() last, the destructor may delete the object then
+	_mutex.lock();
+	_running = false;
+	_waitcondition.wakeAll();
+	_mutex.unlock();
+}
+
+}
@@ -0,0 +1,161 @@
+#pragma once
+
+#include "AsyncQueryResult.h"
+
+#include <QLoggingCategory>
+#include <QMap>
+#include <QMutex>
+#include <QObject>
+#include <QVector>
+#include <QWaitCondition>
+
+namespace Database {
+
+// class forward decl's
+class ScanTaskPrivate;
+
+/**
+ * @brief Reads a large table in parallel, split into ranges of an integer key.
+ *
+ * @details A first task determines MIN and MAX of keyColumn() for the rows
+ * matching where(). The range is split into partitions() equally wide key
+ * ranges which are read in parallel, each by its own task on its own thread
+ * connection, ordered by the key. The partial results are combined in key
+ * order into one result, or with setStreaming() delivered partition by
+ * partition. Unless the key is the rowid, rows with a NULL key are read by an
+ * additional first partition, they come first as in SQLite's ascending order.
+ * If MIN or MAX is not an integer the scan is read unpartitioned.
+ *
+ * Sample Usage:
+ * \code{.cpp}
+ * Database::ParallelScan *scan = new Database::ParallelScan(this);
+ * scan->setTable("Track");
+ * scan->setColumns("TrackId, Name, Milliseconds");
+ * scan->setWhere("Milliseconds > :min");
+ * scan->bindValue(":min", 60000);
+ * connect(scan, &Database::ParallelScan::execDone, ...);
+ * scan->startExec();
+ * \endcode
+ *
+ * @note Partitions read from different connections, without a common
+ * transaction they may see different states of the table while it is
+ * written.
+ */
+class ParallelScan : public QObject
+{
+	friend class ScanTaskPrivate;
+	Q_OBJECT
+
+public:
+	explicit ParallelScan(QObject *parent = nullptr);
+	virtual ~ParallelScan();
+
+	/**
+	 * @brief Table (or view) to read.
+	 */
+	void setTable(const QString &table);
+	QString table() const;
+
+	/**
+	 * @brief Integer column to partition and order by, default "rowid".
+	 */
+	void setKeyColumn(const QString &column);
+	QString keyColumn() const;
+
+	/**
+	 * @brief Select list, default "*".
+	 */
+	void setColumns(const QString &columns);
+	QString columns() const;
+
+	/**
+	 * @brief Optional filter condition, use named placeholders with bindValue().
+	 */
+	void setWhere(const QString &condition);
+	QString where() const;
+	void bindValue(const QString &placeholder, const QVariant &val);
+	void clearBoundValues();
+
+	/**
+	 * @brief Number of key ranges read in parallel, default
+	 * QThread::idealThreadCount().
+	 */
+	void setPartitions(int partitions);
+	int partitions() const;
+
+	/**
+	 * @brief Connection profile to read from (see ConnectionManager::addProfile()).
+	 */
+	void setConnectionProfile(const QString &profile);
+	QString connectionProfile() const;
+
+	/**
+	 * @brief Deliver the rows with partitionReady() instead of execDone().
+	 * @details Partitions are emitted in key order as soon as they and all
+	 * partitions before them are read. execDone() then carries no rows.
+	 */
+	void setStreaming(bool enabled);
+	bool streaming() const;
+
+	/**
+	 * @brief Is a scan running.
+	 */
+	bool isRunning() const;
+
+	/**
+	 * @brief Start the scan in the QThreadPool.
+	 * @returns \c false if no table is set or a scan is already running.
+	 */
+	bool startExec();
+
+	/**
+	 * @brief Wait for the running scan to finish.
+	 */
+	bool waitDone(ulong msTimout = ULONG_MAX);
+
+signals:
+	/**
+	 * @brief Is emitted in streaming mode with the rows of one partition.
+	 * @note Is emitted from a worker thread, partitions arrive in key order.
+	 */
+	void partitionReady(int partition, const Database::AsyncQueryResult &result);
+
+	/**
+	 * @brief Is emitted when all partitions are read.
+	 * @details AsyncQueryResult::numRowsAffected() is the total number of
+	 * rows. If a partition failed, the result carries its error and no rows.
+	 */
+	void execDone(const Database::AsyncQueryResult &result);
+
+private:
+	struct Scan {
+		QString table;
+		QString keyColumn;
+		QString columns;
+		QString where;
+		QMap<QString, QVariant> boundValues;
+		QString profile;
+		int partitions;
+	};
+
+	// attention lives in the context of QRunable
+	void rangeDone(const Scan &scan, const AsyncQueryResult &result);
+	void partitionDone(int partition, const AsyncQueryResult &result);
+	void finish(const AsyncQueryResult &result);
+
+	QLoggingCategory logger;
+
+	mutable QMutex _mutex;
+	QMutex _streamMutex;
+	QWaitCondition _waitcondition;
+	Scan _scan;
+	bool _streaming;
+	bool _running;
+	int _pending;
+	int _nextStream;
+	int _streamedRows;
+	QVector<AsyncQueryResult> _results;
+	QVector<bool> _done;
+};
+
+}
@@ -0,0 +1,236 @@
+#include "PoolMetrics.h"
+#include "ConnectionManager.h"
+
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QThreadPool>
+
+namespace Database {
+
+namespace {
+
+void addMetric(QString &out, const char *name, const char *type, const char *help,
+			   qint64 value)
+{
+	out += QString("# HELP asyncsql_%1 %2\n# TYPE asyncsql_%1 %3\nasyncsql_%1 %4\n")
+		.arg(QLatin1String(name), QLatin1String(help), QLatin1String(type))
+		.arg(value);
+}
+
+void addHistogram(QString &out, const char *name, const char *help,
+				  const PoolMetrics::Histogram &histogram)
+{
+	out += QString("# HELP asyncsql_%1 %2\n# TYPE asyncsql_%1 histogram\n")
+		.arg(QLatin1String(name), QLatin1String(help));
+	qint64 cumulative = 0;
+	for (int i = 0; i < histogram.counts.size(); i++) {
+		cumulative += histogram.counts[i];
+		QString le = i < histogram.bounds.size() ?
+			QString::number(histogram.bounds[i]) : QStringLiteral("+Inf");
+		out += QString("asyncsql_%1_bucket{le=\"%2\"} %3\n")
+			.arg(QLatin1String(name), le).arg(cumulative);
+	}
+	out += QString("asyncsql_%1_sum %2\nasyncsql_%1_count %3\n")
+		.arg(QLatin1String(name), QString::number(histogram.sum, 'f', 3))
+		.arg(histogram.count);
+}
+
+QJsonObject histogramJson(const PoolMetrics::Histogram &histogram)
+{
+	QJsonArray buckets;
+	for (int i = 0; i < histogram.counts.size(); i++) {
+		QJsonObject bucket;
+		bucket.insert("le", i < histogram.bounds.size() ?
+			QJsonValue(histogram.bounds[i]) : QJsonValue(QStringLiteral("+Inf")));
+		bucket.insert("count", double(histogram.counts[i]));
+		buckets.append(bucket);
+	}
+	QJsonObject obj;
+	obj.insert("buckets", buckets);
+	obj.insert("sum", histogram.sum);
+	obj.insert("count", double(histogram.count));
+	return obj;
+}
+
+}
+
+PoolMetrics::PoolMetrics(ConnectionManager *manager)
+	: _manager(manager)
+{
+	_values.queueWaitMs = latencyHistogram();
+	_values.execMs = latencyHistogram();
+}
+
+PoolMetrics::Histogram PoolMetrics::latencyHistogram()
+{
+	Histogram histogram;
+	histogram.bounds << 1 << 5 << 10 << 25 << 50 << 100 << 250 << 500 << 1000
+					 << 2500 << 5000 << 10000;
+	histogram.counts = QVector<qint64>(histogram.bounds.size() + 1, 0);
+	return histogram;
+}
+
+void PoolMetrics::observe(Histogram &histogram, double value)
+{
+	int bucket = 0;
+	while (bucket < histogram.bounds.size() && value > histogram.bounds[bucket])
+		bucket++;
+	histogram.counts[bucket]++;
+	histogram.sum += value;
+	histogram.count++;
+}
+
+PoolMetrics::Snapshot PoolMetrics::snapshot() const
+{
+	_mutex.lock();
+	Snapshot snap = _values;
+	for (const Queue &queue : _queues) {
+		snap.queuedQueries += queue.depth;
+		if (!queue.name.isEmpty())
+			snap.queueDepths[queue.name] += queue.depth;
+	}
+	_mutex.unlock();
+
+	snap.connections = _manager->connectionCount();
+	snap.tasksInFlight = _manager->tasksInFlight();
+	snap.tasksPending = _manager->tasksPending();
+	snap.poolActiveThreads = QThreadPool::globalInstance()->activeThreadCount();
+	snap.poolMaxThreads = QThreadPool::globalInstance()->maxThreadCount();
+	return snap;
+}
+
+QString PoolMetrics::toPrometheus() const
+{
+	Snapshot snap = snapshot();
+	QString out;
+	addMetric(out, "tasks_started_total", "counter", "Database tasks started.",
+			  snap.tasksStarted);
+	addMetric(out, "tasks_held_back_total", "counter",
+			  "Tasks held back by the in-flight limit.", snap.tasksHeldBack);
+	addMetric(out, "queries_total", "counter", "Queries executed.", snap.queriesExecuted);
+	addMetric(out, "query_errors_total", "counter", "Queries failed.", snap.queryErrors);
+	addMetric(out, "query_timeouts_total", "counter", "Queries past their deadline.",
+			  snap.queryTimeouts);
+	addMetric(out, "queue_overflows_total", "counter", "Queries hitting a full queue.",
+			  snap.queueOverflows);
+	addMetric(out, "connections_opened_total", "counter", "Connections opened.",
+			  snap.connectionsOpened);
+	addMetric(out, "connection_failures_total", "counter", "Connections failed to open.",
+			  snap.connectionFailures);
+	addMetric(out, "connections", "gauge", "Open connections.", snap.connections);
+	addMetric(out, "tasks_in_flight", "gauge", "Tasks handed to a pool.",
+			  snap.tasksInFlight);
+	addMetric(out, "tasks_pending", "gauge", "Tasks waiting for admission.",
+			  snap.tasksPending);
+	addMetric(out, "pool_active_threads", "gauge", "Active threads of the global pool.",
+			  snap.poolActiveThreads);
+	addMetric(out, "pool_max_threads", "gauge", "Maximum threads of the global pool.",
+			  snap.poolMaxThreads);
+	addMetric(out, "queued_queries", "gauge", "Queries waiting in AsyncQuery queues.",
+			  snap.queuedQueries);
+	if (!snap.queueDepths.isEmpty()) {
+		out += "# HELP asyncsql_query_queue_depth Queue depth of named AsyncQuery objects.\n"
+			   "# TYPE asyncsql_query_queue_depth gauge\n";
+		for (auto it = snap.queueDepths.constBegin(); it != snap.queueDepths.constEnd(); ++it) {
+			QString name = it.key();
+			name.replace(QLatin1Char('\\'), QLatin1String("\\\\"))
+				.replace(QLatin1Char('"'), QLatin1String("\\\""));
+			out += QString("asyncsql_query_queue_depth{query=\"%1\"} %2\n")
+				.arg(name, QString::number(it.value()));
+		}
+	}
+	addHistogram(out, "queue_wait_ms", "Time queries waited before execution.",
+				 snap.queueWaitMs);
+	addHistogram(out, "exec_ms", "Query execution time.", snap.execMs);
+	return out;
+}
+
+QByteArray PoolMetrics::toJson() const
+{
+	Snapshot snap = snapshot();
+
+	QJsonObject depths;
+	for (auto it = snap.queueDepths.constBegin(); it != snap.queueDepths.constEnd(); ++it)
+		depths.insert(it.key(), it.value());
+
+	QJsonObject obj;
+	obj.insert("tasksStarted", double(snap.tasksStarted));
+	obj.insert("tasksHeldBack", double(snap.tasksHeldBack));
+	obj.insert("queriesExecuted", double(snap.queriesExecuted));
+	obj.insert("queryErrors", double(snap.queryErrors));
+	obj.insert("queryTimeouts", double(snap.queryTimeouts));
+	obj.insert("queueOverflows", double(snap.queueOverflows));
+	obj.insert("connectionsOpened", double(snap.connectionsOpened));
+	obj.insert("connectionFailures", double(snap.connectionFailures));
+	obj.insert("connections", snap.connections);
+	obj.insert("tasksInFlight", snap.tasksInFlight);
+	obj.insert("tasksPending", snap.tasksPending);
+	obj.insert("poolActiveThreads", snap.poolActiveThreads);
+	obj.insert("poolMaxThreads", snap.poolMaxThreads);
+	obj.insert("queuedQueries", snap.queuedQueries);
+	obj.insert("queueDepths", depths);
+	obj.insert("queueWaitMs", histogramJson(snap.queueWaitMs));
+	obj.insert("execMs", histogramJson(snap.execMs));
+	return QJsonDocument(obj).toJson(QJsonDocument::Compact);
+}
+
+void PoolMetrics::taskStarted()
+{
+	QMutexLocker locker(&_mutex);
+	_values.tasksStarted++;
+}
+
+void PoolMetrics::taskHeldBack()
+{
+	QMutexLocker locker(&_mutex);
+	_values.tasksHeldBack++;
+}
+
+void PoolMetrics::queryExecuted(qint64 queueWaitMs, double execMs, bool error, bool timeout)
+{
+	QMutexLocker locker(&_mutex);
+	_values.queriesExecuted++;
+	if (error)
+		_values.queryErrors++;
+	if (timeout)
+		_values.queryTimeouts++;
+	observe(_values.queueWaitMs, queueWaitMs);
+	observe(_values.execMs, execMs);
+}
+
+void PoolMetrics::queueOverflow()
+{
+	QMutexLocker locker(&_mutex);
+	_values.queueOverflows++;
+}
+
+void PoolMetrics::queryDropped()
+{
+	QMutexLocker locker(&_mutex);
+	_values.queryErrors++;
+	_values.queryTimeouts++;
+}
+
+void PoolMetrics::connectionOpened(bool success)
+{
+	QMutexLocker locker(&_mutex);
+	if (success)
+		_values.connectionsOpened++;
+	else
+		_values.connectionFailures++;
+}
+
+void PoolMetrics::setQueueDepth(const void *query, const QString &name, int depth)
+{
+	QMutexLocker locker(&_mutex);
+	if (depth <= 0) {
+		_queues.remove(query);
+	} else {
+		Queue &queue = _queues[query];
+		queue.name = name;
+		queue.depth = depth;
+	}
+}
+
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <QMap>
+#include <QMutex>
+#include <QString>
+#include <QVector>
+
+namespace Database {
+
+// class forward decl's
+class ConnectionManager;
+
+/**
+ * @brief Counters, gauges and histograms of the database thread pool, the
+ * query queues and the connections.
+ *
+ * @details Owned by the ConnectionManager (ConnectionManager::metrics()) and
+ * always collected. snapshot() returns the current values; toPrometheus() and
+ * toJson() export them for monitoring, e.g. to alert on saturation when
+ * tasksPending or queue wait times grow.
+ *
+ * @note All functions are thread save.
+ */
+class PoolMetrics
+{
+public:
+	/**
+	 * @brief Latency histogram with fixed bucket bounds in ms.
+	 */
+	struct Histogram {
+		/** Upper bounds of the buckets, the last bucket is +Inf. */
+		QVector<double> bounds;
+		/** Non cumulative count per bucket, bounds.size() + 1 entries. */
+		QVector<qint64> counts;
+		double sum = 0;
+		qint64 count = 0;
+	};
+
+	struct Snapshot {
+		// counters
+		qint64 tasksStarted = 0;
+		qint64 tasksHeldBack = 0;
+		qint64 queriesExecuted = 0;
+		qint64 queryErrors = 0;
+		qint64 queryTimeouts = 0;
+		qint64 queueOverflows = 0;
+		qint64 connectionsOpened = 0;
+		qint64 connectionFailures = 0;
+		// gauges
+		int connections = 0;
+		int tasksInFlight = 0;
+		int tasksPending = 0;
+		int poolActiveThreads = 0;
+		int poolMaxThreads = 0;
+		int queuedQueries = 0;
+		/** Queue depth of AsyncQuery objects with an objectName(). */
+		QMap<QString, int> queueDepths;
+		// histograms
+		Histogram queueWaitMs;
+		Histogram execMs;
+	};
+
+	explicit PoolMetrics(ConnectionManager *manager);
+
+	/**
+	 * @brief Returns the current values.
+	 */
+	Snapshot snapshot() const;
+
+	/**
+	 * @brief Returns snapshot() in the Prometheus text exposition format.
+	 * All metric names start with "asyncsql_".
+	 */
+	QString toPrometheus() const;
+
+	/**
+	 * @brief Returns snapshot() as JSON object.
+	 */
+	QByteArray toJson() const;
+
+	/** @name Recording, used by the database classes */
+	///@{
+	void taskStarted();
+	void taskHeldBack();
+	void queryExecuted(qint64 queueWaitMs, double execMs, bool error, bool timeout);
+	void queueOverflow();
+	/**
+	 * @brief Count a query dropped before execution because its deadline passed.
+	 */
+	void queryDropped();
+	void connectionOpened(bool success);
+	/**
+	 * @brief Set the queue depth of the AsyncQuery \p query, 0 removes it.
+	 */
+	void setQueueDepth(const void *query, const QString &name, int depth);
+	///@}
+
+private:
+	static Histogram latencyHistogram();
+	static void observe(Histogram &histogram, double value);
+
+	ConnectionManager *_manager;
+
+	mutable QMutex _mutex;
+	Snapshot _values;
+	struct Queue {
+		QString name;
+		int depth;
+	};
+	QMap<const void*, Queue> _queues;
+};
+
+}
@@ -0,0 +1,123 @@
+#include "ResultCache.h"
+
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDir>
+#include <QFile>
+#include <QSaveFile>
+
+namespace Database {
+
+static const char *snapshotSuffix = ".aqr";
+
+ResultCache::ResultCache()
+{
+}
+
+void ResultCache::setDirectory(const QString &directory)
+{
+	QMutexLocker locker(&_mutex);
+	_directory = directory;
+	if (!_directory.isEmpty())
+		QDir().mkpath(_directory);
+}
+
+QString ResultCache::directory() const
+{
+	QMutexLocker locker(&_mutex);
+	return _directory;
+}
+
+void ResultCache::setVersion(const QString &version)
+{
+	QMutexLocker locker(&_mutex);
+	_version = version;
+}
+
+QString ResultCache::version() const
+{
+	QMutexLocker locker(&_mutex);
+	return _version;
+}
+
+bool ResultCache::isEnabled() const
+{
+	QMutexLocker locker(&_mutex);
+	return !_directory.isEmpty();
+}
+
+QString ResultCache::key(const QString &query,
+						 const QMap<QString, QVariant> &boundValues,
+						 const QString &profile) const
+{
+	QByteArray data;
+	QDataStream out(&data, QIODevice::WriteOnly);
+	out.setVersion(QDataStream::Qt_5_5);
+	out << version() << query << boundValues;
+	// keep the keys of the default profile stable
+	if (!profile.isEmpty())
+		out << profile;
+	return QString::fromLatin1(
+		QCryptographicHash::hash(data, QCryptographicHash::Sha1).toHex());
+}
+
+bool ResultCache::load(const QString &key, AsyncQueryResult *result) const
+{
+	QFile file(fileName(key));
+	if (file.fileName().isEmpty() || !file.open(QIODevice::ReadOnly))
+		return false;
+
+	bool ok = false;
+	qint64 size = file.size();
+	uchar *mapped = size > 0 ? file.map(0, size) : nullptr;
+	if (mapped) {
+		QByteArray data = QByteArray::fromRawData(
+			reinterpret_cast<const char *>(mapped), int(size));
+		*result = AsyncQueryResult::fromBinary(data, &ok);
+		file.unmap(mapped);
+	} else {
+		*result = AsyncQueryResult::fromBinary(file.readAll(), &ok);
+	}
+	if (ok)
+		result->_isCached = true;
+	return ok;
+}
+
+bool ResultCache::store(const QString &key, const AsyncQueryResult &result)
+{
+	QSaveFile file(fileName(key));
+	if (file.fileName().isEmpty() || !file.open(QIODevice::WriteOnly))
+		return false;
+
+	QDataStream out(&file);
+	out.setVersion(QDataStream::Qt_5_5);
+	out << result;
+	if (out.status() != QDataStream::Ok) {
+		file.cancelWriting();
+		return false;
+	}
+	return file.commit();
+}
+
+void ResultCache::clear()
+{
+	QString path = directory();
+	if (path.isEmpty())
+		return;
+
+	QDir dir(path);
+	const QStringList files = dir.entryList(
+		QStringList() << QStringLiteral("*") + QLatin1String(snapshotSuffix), QDir::Files);
+	for (const QString &name : files)
+		dir.remove(name);
+}
+
+QString ResultCache::fileName(const QString &key) const
+{
+	QMutexLocker locker(&_mutex);
+	if (_directory.isEmpty())
+		return QString();
+	return QDir(_directory).filePath(key + QLatin1String(snapshotSuffix));
+}
+
+}
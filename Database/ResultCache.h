@@ -0,0 +1,80 @@
+#pragma once
+
+#include "AsyncQueryResult.h"
+
+#include <QMap>
+#include <QMutex>
+#include <QString>
+#include <QVariant>
+
+namespace Database {
+
+/**
+ * @brief Persistent on-disk cache of AsyncQueryResult snapshots.
+ *
+ * @details The cache is owned by the ConnectionManager and disabled until a
+ * directory is set. Queries opt in with AsyncQuery::setPersistentCache(). Such
+ * a query first delivers the stored snapshot (AsyncQueryResult::isCached()) and
+ * then runs against the database as usual, delivering and storing the fresh
+ * result (stale-while-revalidate).
+ *
+ * Snapshots are keyed by the query string, the bound values, the connection
+ * profile and version().
+ * Bump the version whenever the schema or the cached data changes in a way
+ * that invalidates old snapshots.
+ *
+ * @note All functions are thread save.
+ */
+class ResultCache
+{
+public:
+	ResultCache();
+
+	/**
+	 * @brief Directory for the snapshot files. An empty directory disables
+	 * the cache.
+	 */
+	void setDirectory(const QString &directory);
+	QString directory() const;
+
+	/**
+	 * @brief Schema/data version which is part of each key.
+	 */
+	void setVersion(const QString &version);
+	QString version() const;
+
+	bool isEnabled() const;
+
+	/**
+	 * @brief Build the cache key for \p query with \p boundValues on the
+	 * connection profile \p profile.
+	 */
+	QString key(const QString &query, const QMap<QString, QVariant> &boundValues,
+				const QString &profile = QString()) const;
+
+	/**
+	 * @brief Load the snapshot stored for \p key.
+	 * @returns \c false if there is no (readable) snapshot.
+	 */
+	bool load(const QString &key, AsyncQueryResult *result) const;
+
+	/**
+	 * @brief Store \p result as snapshot for \p key.
+	 * @details The file is replaced atomically.
+	 */
+	bool store(const QString &key, const AsyncQueryResult &result);
+
+	/**
+	 * @brief Remove all snapshots from the cache directory.
+	 */
+	void clear();
+
+private:
+	QString fileName(const QString &key) const;
+
+	mutable QMutex _mutex;
+	QString _directory;
+	QString _version;
+};
+
+}
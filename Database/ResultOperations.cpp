@@ -0,0 +1,635 @@
+#include "ResultOperations.h"
+#include "ConnectionManager.h"
+#include "DeliveryQueue.h"
+
+#include <QDateTime>
+#include <QHash>
+#include <QMutex>
+#include <QPointer>
+#include <QRunnable>
+#include <QSharedPointer>
+#include <QSqlField>
+#include <QThread>
+#include <QThreadPool>
+#include <QWaitCondition>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace Database {
+
+namespace {
+
+QAtomicInt minChunk(4096);
+
+/**
+ * Precomputed key of one value, compared like SQLite: NULL < numbers < text.
+ * Integers stay qint64, a double would lose precision above 2^53.
+ */
+struct SortKey {
+	enum Kind { Null, Integer, Real, Text };
+
+	Kind kind;
+	qint64 integer;
+	double real;
+	QString text;
+
+	bool isNumber() const { return kind == Integer || kind == Real; }
+};
+
+SortKey makeSortKey(const QVariant &val)
+{
+	SortKey key;
+	key.kind = SortKey::Text;
+	key.integer = 0;
+	key.real = 0;
+
+	if (!val.isValid() || val.isNull()) {
+		key.kind = SortKey::Null;
+		return key;
+	}
+
+	switch (val.type()) {
+	case QVariant::Bool:
+	case QVariant::Int:
+	case QVariant::UInt:
+	case QVariant::LongLong:
+		key.kind = SortKey::Integer;
+		key.integer = val.toLongLong();
+		break;
+	case QVariant::ULongLong:
+		if (val.toULongLong() <= quint64(std::numeric_limits<qint64>::max())) {
+			key.kind = SortKey::Integer;
+			key.integer = val.toLongLong();
+		} else {
+			key.kind = SortKey::Real;
+			key.real = val.toDouble();
+		}
+		break;
+	case QVariant::Double:
+		key.kind = SortKey::Real;
+		key.real = val.toDouble();
+		break;
+	case QVariant::Date:
+		key.kind = SortKey::Integer;
+		key.integer = val.toDate().toJulianDay();
+		break;
+	case QVariant::Time:
+		key.kind = SortKey::Integer;
+		key.integer = val.toTime().msecsSinceStartOfDay();
+		break;
+	case QVariant::DateTime:
+		key.kind = SortKey::Integer;
+		key.integer = val.toDateTime().toMSecsSinceEpoch();
+		break;
+	default:
+		key.text = val.toString();
+		break;
+	}
+	return key;
+}
+
+/** Compares an integer with a double exactly, NaN sorts after all numbers. */
+int compareMixed(qint64 integer, double real)
+{
+	if (std::isnan(real))
+		return -1;
+	// 2^63 is exact as double, qint64 covers [-2^63, 2^63)
+	if (real < -9223372036854775808.0)
+		return 1;
+	if (real >= 9223372036854775808.0)
+		return -1;
+	qint64 truncated = qint64(real);
+	if (integer != truncated)
+		return integer < truncated ? -1 : 1;
+	double fraction = real - double(truncated);
+	return fraction > 0 ? -1 : (fraction < 0 ? 1 : 0);
+}
+
+int compareKeys(const SortKey &a, const SortKey &b)
+{
+	if (a.isNumber() && b.isNumber()) {
+		if (a.kind == SortKey::Integer && b.kind == SortKey::Integer)
+			return a.integer < b.integer ? -1 : (b.integer < a.integer ? 1 : 0);
+		if (a.kind == SortKey::Real && b.kind == SortKey::Real) {
+			// NaN is unordered, it is equal to NaN and sorts after all numbers
+			bool nanA = std::isnan(a.real), nanB = std::isnan(b.real);
+			if (nanA || nanB)
+				return nanA == nanB ? 0 : (nanA ? 1 : -1);
+			return a.real < b.real ? -1 : (b.real < a.real ? 1 : 0);
+		}
+		if (a.kind == SortKey::Integer)
+			return compareMixed(a.integer, b.real);
+		return -compareMixed(b.integer, a.real);
+	}
+	if (a.kind != b.kind)
+		return a.kind < b.kind ? -1 : 1;
+	if (a.kind == SortKey::Text)
+		return QString::compare(a.text, b.text);
+	return 0;
+}
+
+int compareValues(const QVariant &a, const QVariant &b)
+{
+	return compareKeys(makeSortKey(a), makeSortKey(b));
+}
+
+/** Appends \p val to a hash key, equal values like compareValues() give equal bytes. */
+void appendKey(QByteArray &key, const QVariant &val)
+{
+	SortKey k = makeSortKey(val);
+	// a double equal to an integer gets the bytes of the integer
+	if (k.kind == SortKey::Real && k.real >= -9223372036854775808.0
+			&& k.real < 9223372036854775808.0 && k.real == std::trunc(k.real)) {
+		k.kind = SortKey::Integer;
+		k.integer = qint64(k.real);
+	}
+	switch (k.kind) {
+	case SortKey::Null:
+		key += 'z';
+		break;
+	case SortKey::Integer:
+		key += 'i';
+		key.append(reinterpret_cast<const char *>(&k.integer), sizeof(k.integer));
+		break;
+	case SortKey::Real:
+		// every NaN (any payload or sign) is one value
+		if (std::isnan(k.real))
+			k.real = std::numeric_limits<double>::quiet_NaN();
+		key += 'n';
+		key.append(reinterpret_cast<const char *>(&k.real), sizeof(k.real));
+		break;
+	case SortKey::Text: {
+		QByteArray utf8 = k.text.toUtf8();
+		int len = utf8.size();
+		key += 't';
+		key.append(reinterpret_cast<const char *>(&len), sizeof(len));
+		key += utf8;
+		break;
+	}
+	}
+}
+
+QVariant accumulate(ResultOperations::Function function, const QVariant &acc,
+					const QVariant &val)
+{
+	if (!val.isValid() || val.isNull())
+		return acc;
+
+	switch (function) {
+	case ResultOperations::Count:
+		return QVariant(acc.toLongLong() + 1);
+	case ResultOperations::Sum:
+		if (!acc.isValid() || acc.isNull())
+			return AsyncQueryResult::isIntegral(val) ? QVariant(val.toLongLong())
+													 : QVariant(val.toDouble());
+		if (AsyncQueryResult::isIntegral(acc) && AsyncQueryResult::isIntegral(val))
+			return QVariant(acc.toLongLong() + val.toLongLong());
+		return QVariant(acc.toDouble() + val.toDouble());
+	case ResultOperations::Min:
+		return !acc.isValid() || acc.isNull() || compareValues(val, acc) < 0 ? val : acc;
+	case ResultOperations::Max:
+		return !acc.isValid() || acc.isNull() || compareValues(val, acc) > 0 ? val : acc;
+	}
+	return acc;
+}
+
+/** Combines two partial aggregates of the same group. */
+QVariant combine(ResultOperations::Function function, const QVariant &acc,
+				 const QVariant &other)
+{
+	if (function == ResultOperations::Count)
+		return QVariant(acc.toLongLong() + other.toLongLong());
+	return accumulate(function, acc, other);
+}
+
+/**
+ * @brief Chunks of one parallel operation, claimed by the caller and by
+ * helper tasks in the QThreadPool.
+ */
+struct ChunkState {
+	std::function<void(int)> body;
+	int chunks;
+	QAtomicInt next;
+	QAtomicInt done;
+	QMutex mutex;
+	QWaitCondition finished;
+
+	void work()
+	{
+		int chunk;
+		while ((chunk = next.fetchAndAddOrdered(1)) < chunks) {
+			body(chunk);
+			if (done.fetchAndAddOrdered(1) + 1 == chunks) {
+				QMutexLocker locker(&mutex);
+				finished.wakeAll();
+			}
+		}
+	}
+};
+
+class ChunkTaskPrivate : public QRunnable
+{
+public:
+	explicit ChunkTaskPrivate(const QSharedPointer<ChunkState> &state)
+		: _state(state)
+	{
+	}
+
+	void run() override
+	{
+		_state->work();
+	}
+
+private:
+	QSharedPointer<ChunkState> _state;
+};
+
+/**
+ * @brief Runs \p body for each chunk in [0, chunks) and returns when all are done.
+ * @details The caller works on the chunks itself, helper tasks which start
+ * late find no chunk left. So the caller never waits for a pool thread and it
+ * is save to call from a task in the QThreadPool.
+ */
+void parallelChunks(int chunks, const std::function<void(int)> &body)
+{
+	if (chunks <= 1) {
+		if (chunks == 1)
+			body(0);
+		return;
+	}
+
+	QSharedPointer<ChunkState> state(new ChunkState);
+	state->body = body;
+	state->chunks = chunks;
+
+	// helpers are optional: without room in the admission control the caller
+	// does the chunks alone instead of blocking or holding them back
+	ConnectionManager *conmgr = ConnectionManager::instance();
+	int helpers = qMin(chunks, QThreadPool::globalInstance()->maxThreadCount()) - 1;
+	for (int i = 0; i < helpers; i++) {
+		ChunkTaskPrivate *helper = new ChunkTaskPrivate(state);
+		if (!conmgr->tryStartTask(helper)) {
+			delete helper;
+			break;
+		}
+	}
+
+	state->work();
+
+	QMutexLocker locker(&state->mutex);
+	while (state->done.loadAcquire() < chunks)
+		state->finished.wait(&state->mutex);
+}
+
+int chunkCount(int rows)
+{
+	int min = qMax(1, minChunk.loadAcquire());
+	int chunks = (rows + min - 1) / min;
+	return qBound(1, chunks, qMax(1, QThread::idealThreadCount()));
+}
+
+int chunkBegin(int rows, int chunks, int chunk)
+{
+	return int(qint64(rows) * chunk / chunks);
+}
+
+/**
+ * @brief Partial result of groupBy() for one chunk.
+ */
+struct Groups {
+	QHash<QByteArray, int> index;
+	QVector<QByteArray> keys;
+	QVector<QVector<QVariant>> rows;
+};
+
+class OperationTaskPrivate : public QRunnable
+{
+public:
+	OperationTaskPrivate(const std::function<AsyncQueryResult()> &operation,
+						 const std::function<void(const AsyncQueryResult &)> &callback)
+		: _operation(operation)
+		, _callback(callback)
+	{
+	}
+
+	void run() override
+	{
+		AsyncQueryResult result = _operation();
+		if (_callback)
+			_callback(result);
+	}
+
+private:
+	std::function<AsyncQueryResult()> _operation;
+	std::function<void(const AsyncQueryResult &)> _callback;
+};
+
+}
+
+QVector<int> ResultOperations::filterRows(const AsyncQueryResult &result,
+										  const ResultOperations::Predicate &predicate)
+{
+	const QVector<QVector<QVariant>> data = result.data();
+	int count = data.size();
+	int chunks = chunkCount(count);
+
+	QVector<QVector<int>> parts(chunks);
+	QVector<int> *partData = parts.data();
+	parallelChunks(chunks, [&](int chunk) {
+		int end = chunkBegin(count, chunks, chunk + 1);
+		QVector<int> &part = partData[chunk];
+		for (int row = chunkBegin(count, chunks, chunk); row < end; row++) {
+			if (predicate(data[row]))
+				part.append(row);
+		}
+	});
+
+	QVector<int> rows;
+	for (const QVector<int> &part : parts)
+		rows += part;
+	return rows;
+}
+
+QVector<int> ResultOperations::sortRows(const AsyncQueryResult &result,
+										const QVector<ResultOperations::SortColumn> &columns)
+{
+	QVector<int> rows(result.count());
+	for (int row = 0; row < rows.size(); row++)
+		rows[row] = row;
+	return sortRows(result, columns, rows);
+}
+
+QVector<int> ResultOperations::sortRows(const AsyncQueryResult &result,
+										const QVector<ResultOperations::SortColumn> &columns,
+										const QVector<int> &rows)
+{
+	if (columns.isEmpty() || rows.size() < 2)
+		return rows;
+
+	const QVector<QVector<QVariant>> data = result.data();
+	int count = rows.size();
+	int chunks = chunkCount(count);
+
+	// keys per sort column, indexed by position in rows; the chunks write
+	// through raw pointers, the vectors are not shared
+	QVector<QVector<SortKey>> keys(columns.size());
+	QVector<SortKey*> keyData(columns.size());
+	for (int c = 0; c < columns.size(); c++) {
+		keys[c].resize(count);
+		keyData[c] = keys[c].data();
+	}
+	QVector<int> order(count);
+	int *orderData = order.data();
+	parallelChunks(chunks, [&](int chunk) {
+		int end = chunkBegin(count, chunks, chunk + 1);
+		for (int pos = chunkBegin(count, chunks, chunk); pos < end; pos++) {
+			const QVector<QVariant> &row = data[rows[pos]];
+			for (int c = 0; c < columns.size(); c++)
+				keyData[c][pos] = makeSortKey(row.value(columns[c].column));
+			orderData[pos] = pos;
+		}
+	});
+
+	auto lessThan = [&](int a, int b) {
+		for (int c = 0; c < columns.size(); c++) {
+			int cmp = compareKeys(keyData[c][a], keyData[c][b]);
+			if (cmp != 0)
+				return columns[c].order == Qt::AscendingOrder ? cmp < 0 : cmp > 0;
+		}
+		return false;
+	};
+
+	// sort the chunks in parallel, then merge pairs of runs until one is left
+	QVector<int> runs;
+	for (int chunk = 0; chunk <= chunks; chunk++)
+		runs.append(chunkBegin(count, chunks, chunk));
+	parallelChunks(chunks, [&](int chunk) {
+		std::stable_sort(orderData + runs[chunk], orderData + runs[chunk + 1], lessThan);
+	});
+
+	QVector<int> buffer(count);
+	while (runs.size() > 2) {
+		const int *src = order.constData();
+		int *dst = buffer.data();
+		int pairs = (runs.size() - 1) / 2;
+		parallelChunks(pairs, [&](int pair) {
+			int begin = runs[2 * pair];
+			int mid = runs[2 * pair + 1];
+			int end = runs[2 * pair + 2];
+			std::merge(src + begin, src + mid, src + mid, src + end, dst + begin, lessThan);
+		});
+		// an odd last run is copied unchanged
+		if ((runs.size() - 1) % 2) {
+			int begin = runs[runs.size() - 2];
+			std::copy(src + begin, src + count, dst + begin);
+		}
+
+		QVector<int> merged;
+		for (int i = 0; i < runs.size(); i += 2)
+			merged.append(runs[i]);
+		if (merged.last() != count)
+			merged.append(count);
+		runs = merged;
+		order.swap(buffer);
+	}
+
+	QVector<int> sorted(count);
+	for (int pos = 0; pos < count; pos++)
+		sorted[pos] = rows[order[pos]];
+	return sorted;
+}
+
+AsyncQueryResult ResultOperations::select(const AsyncQueryResult &result,
+										  const QVector<int> &rows)
+{
+	AsyncQueryResult selected;
+	selected._record = result._record;
+	selected._columns = result._columns;
+	selected._queryString = result._queryString;
+	selected._data.reserve(rows.size());
+	for (int row : rows)
+		selected._data.append(result._data.value(row));
+	if (result.hasDisplayStrings()) {
+		selected._display.reserve(rows.size());
+		for (int row : rows)
+			selected._display.append(result._display.value(row));
+	}
+	return selected;
+}
+
+AsyncQueryResult ResultOperations::filter(const AsyncQueryResult &result,
+										  const ResultOperations::Predicate &predicate)
+{
+	return select(result, filterRows(result, predicate));
+}
+
+AsyncQueryResult ResultOperations::sort(const AsyncQueryResult &result,
+										const QVector<ResultOperations::SortColumn> &columns)
+{
+	return select(result, sortRows(result, columns));
+}
+
+AsyncQueryResult ResultOperations::groupBy(const AsyncQueryResult &result,
+										   const QVector<int> &keyColumns,
+										   const QVector<ResultOperations::Aggregate> &aggregates)
+{
+	const QVector<QVector<QVariant>> data = result.data();
+	int count = data.size();
+	int chunks = chunkCount(count);
+	int keyCount = keyColumns.size();
+
+	// group each chunk on its own, then combine the chunks in order
+	QVector<Groups> parts(chunks);
+	Groups *partData = parts.data();
+	parallelChunks(chunks, [&](int chunk) {
+		Groups &groups = partData[chunk];
+		int end = chunkBegin(count, chunks, chunk + 1);
+		for (int r = chunkBegin(count, chunks, chunk); r < end; r++) {
+			const QVector<QVariant> &row = data[r];
+			QByteArray key;
+			for (int col : keyColumns)
+				appendKey(key, row.value(col));
+
+			auto it = groups.index.constFind(key);
+			int group;
+			if (it == groups.index.constEnd()) {
+				group = groups.rows.size();
+				groups.index.insert(key, group);
+				groups.keys.append(key);
+				QVector<QVariant> acc(keyCount + aggregates.size());
+				for (int k = 0; k < keyCount; k++)
+					acc[k] = row.value(keyColumns[k]);
+				for (int a = 0; a < aggregates.size(); a++) {
+					if (aggregates[a].function == Count)
+						acc[keyCount + a] = QVariant(qlonglong(0));
+				}
+				groups.rows.append(acc);
+			} else {
+				group = it.value();
+			}
+
+			QVector<QVariant> &acc = groups.rows[group];
+			for (int a = 0; a < aggregates.size(); a++) {
+				acc[keyCount + a] = accumulate(aggregates[a].function, acc[keyCount + a],
+											   row.value(aggregates[a].column));
+			}
+		}
+	});
+
+	Groups total;
+	for (Groups &groups : parts) {
+		for (int g = 0; g < groups.rows.size(); g++) {
+			auto it = total.index.constFind(groups.keys[g]);
+			if (it == total.index.constEnd()) {
+				total.index.insert(groups.keys[g], total.rows.size());
+				total.rows.append(groups.rows[g]);
+				continue;
+			}
+			QVector<QVariant> &acc = total.rows[it.value()];
+			for (int a = 0; a < aggregates.size(); a++) {
+				acc[keyCount + a] = combine(aggregates[a].function, acc[keyCount + a],
+											groups.rows[g][keyCount + a]);
+			}
+		}
+	}
+
+	QSqlRecord record;
+	for (int col : keyColumns)
+		record.append(result._record.field(col));
+	static const char *names[] = { "count", "sum", "min", "max" };
+	for (const Aggregate &aggregate : aggregates) {
+		QSqlField source = result._record.field(aggregate.column);
+		record.append(QSqlField(
+			QString("%1(%2)").arg(QLatin1String(names[aggregate.function]), source.name()),
+			aggregate.function == Count ? QVariant::LongLong : source.type()));
+	}
+
+	AsyncQueryResult grouped;
+	grouped.setRecord(record);
+	grouped._data = total.rows;
+	return grouped;
+}
+
+AsyncQueryResult ResultOperations::hashJoin(const AsyncQueryResult &left, int leftColumn,
+											const AsyncQueryResult &right, int rightColumn)
+{
+	// build on the right side, rows per key keep their order
+	const QVector<QVector<QVariant>> rightData = right.data();
+	QHash<QByteArray, QVector<int>> table;
+	table.reserve(rightData.size());
+	for (int r = 0; r < rightData.size(); r++) {
+		const QVariant &val = rightData[r].value(rightColumn);
+		if (val.isNull())
+			continue;
+		QByteArray key;
+		appendKey(key, val);
+		table[key].append(r);
+	}
+
+	// probe with the left side in parallel
+	const QVector<QVector<QVariant>> leftData = left.data();
+	int count = leftData.size();
+	int chunks = chunkCount(count);
+	QVector<QVector<QVector<QVariant>>> parts(chunks);
+	QVector<QVector<QVariant>> *partData = parts.data();
+	parallelChunks(chunks, [&](int chunk) {
+		int end = chunkBegin(count, chunks, chunk + 1);
+		for (int l = chunkBegin(count, chunks, chunk); l < end; l++) {
+			const QVariant &val = leftData[l].value(leftColumn);
+			if (val.isNull())
+				continue;
+			QByteArray key;
+			appendKey(key, val);
+			auto it = table.constFind(key);
+			if (it == table.constEnd())
+				continue;
+			for (int r : it.value())
+				partData[chunk].append(leftData[l] + rightData[r]);
+		}
+	});
+
+	QSqlRecord record = left._record;
+	for (int i = 0; i < right._record.count(); i++)
+		record.append(right._record.field(i));
+
+	AsyncQueryResult joined;
+	joined.setRecord(record);
+	int total = 0;
+	for (const auto &part : parts)
+		total += part.size();
+	joined._data.reserve(total);
+	for (const auto &part : parts)
+		joined._data += part;
+	return joined;
+}
+
+void ResultOperations::run(const std::function<AsyncQueryResult()> &operation,
+						   const QObject *context,
+						   const std::function<void(const AsyncQueryResult &)> &handler)
+{
+	std::function<void(const AsyncQueryResult &)> callback = handler;
+	if (context) {
+		QPointer<QObject> guard(const_cast<QObject *>(context));
+		QThread *thread = context->thread();
+		callback = [guard, thread, handler](const AsyncQueryResult &result) {
+			DeliveryQueue::post(thread, guard, [handler, result]() {
+				handler(result);
+			});
+		};
+	}
+	ConnectionManager::instance()->startTask(new OperationTaskPrivate(operation, callback));
+}
+
+void ResultOperations::setMinChunkRows(int rows)
+{
+	minChunk.storeRelease(qMax(1, rows));
+}
+
+int ResultOperations::minChunkRows()
+{
+	return minChunk.loadAcquire();
+}
+
+}
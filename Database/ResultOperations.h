@@ -0,0 +1,132 @@
+#pragma once
+
+#include "AsyncQueryResult.h"
+
+#include <QObject>
+#include <QVector>
+
+#include <functional>
+
+namespace Database {
+
+/**
+ * @brief Parallel filter, sort, group-by and hash join on AsyncQueryResult.
+ *
+ * @details The functions split the rows into chunks which are processed by
+ * the calling thread together with tasks in the QThreadPool, and return a new
+ * result. Values are compared like SQLite: NULL < numbers (incl. date and
+ * time) < text, a NaN is equal to NaN and sorts after all numbers. The
+ * functions block the caller; run() executes an operation completely in the
+ * QThreadPool and delivers its result to a receiver thread.
+ * Helper tasks only start if ConnectionManager::setMaxTasksInFlight() admits
+ * them right away, the caller never waits for the admission control.
+ *
+ * Sample Usage:
+ * \code{.cpp}
+ * using Ops = Database::ResultOperations;
+ * Ops::run([tracks, albums]() {
+ *     Database::AsyncQueryResult joined = Ops::hashJoin(tracks, 1, albums, 0);
+ *     return Ops::groupBy(joined, {4}, {{2, Ops::Sum}, {0, Ops::Count}});
+ * }, this, [this](const Database::AsyncQueryResult &result) {
+ *     _model->setResult(result);
+ * });
+ * \endcode
+ *
+ * @note All functions are thread save and reentrant.
+ */
+class ResultOperations
+{
+public:
+	/**
+	 * @brief Is called concurrently from several pool threads, one chunk of
+	 * rows each. It must be thread save and must not depend on the order.
+	 */
+	typedef std::function<bool(const QVector<QVariant> &row)> Predicate;
+
+	struct SortColumn {
+		int column;
+		Qt::SortOrder order;
+	};
+
+	enum Function {
+		/** Number of non NULL values. */
+		Count,
+		Sum,
+		Min,
+		Max,
+	};
+
+	struct Aggregate {
+		int column;
+		Function function;
+	};
+
+	/**
+	 * @brief Rows of \p result accepted by \p predicate, in source order.
+	 */
+	static QVector<int> filterRows(const AsyncQueryResult &result, const Predicate &predicate);
+
+	/**
+	 * @brief All rows of \p result in the order of \p columns.
+	 * @details The sort is stable.
+	 */
+	static QVector<int> sortRows(const AsyncQueryResult &result,
+								 const QVector<SortColumn> &columns);
+
+	/**
+	 * @brief The row indexes \p rows of \p result in the order of \p columns.
+	 */
+	static QVector<int> sortRows(const AsyncQueryResult &result,
+								 const QVector<SortColumn> &columns,
+								 const QVector<int> &rows);
+
+	/**
+	 * @brief New result with the given \p rows of \p result.
+	 */
+	static AsyncQueryResult select(const AsyncQueryResult &result, const QVector<int> &rows);
+
+	static AsyncQueryResult filter(const AsyncQueryResult &result, const Predicate &predicate);
+	static AsyncQueryResult sort(const AsyncQueryResult &result,
+								 const QVector<SortColumn> &columns);
+
+	/**
+	 * @brief One row per distinct combination of \p keyColumns, followed by
+	 * one column per aggregate. Groups are in order of their first row.
+	 */
+	static AsyncQueryResult groupBy(const AsyncQueryResult &result,
+									const QVector<int> &keyColumns,
+									const QVector<Aggregate> &aggregates);
+
+	/**
+	 * @brief Inner join of \p left and \p right on equal values of
+	 * \p leftColumn and \p rightColumn (NULL never matches).
+	 * @details The rows have the columns of \p left followed by the columns of
+	 * \p right and are in order of \p left.
+	 */
+	static AsyncQueryResult hashJoin(const AsyncQueryResult &left, int leftColumn,
+									 const AsyncQueryResult &right, int rightColumn);
+
+	/**
+	 * @brief Run \p operation in the QThreadPool and call \p handler with its
+	 * result in the thread of \p context.
+	 * @details The handler is dropped if \p context is deleted before.
+	 * The operation is admitted like a query: with
+	 * AsyncQuery::Overflow_Block and a full queue of held back tasks (see
+	 * ConnectionManager::setMaxTasksPending()), run() blocks the calling
+	 * thread, also the GUI thread, until there is room.
+	 */
+	static void run(const std::function<AsyncQueryResult()> &operation,
+					const QObject *context,
+					const std::function<void(const AsyncQueryResult &)> &handler);
+
+	/**
+	 * @brief Rows per chunk below which work is not split, default 4096.
+	 */
+	static void setMinChunkRows(int rows);
+	static int minChunkRows();
+
+private:
+	ResultOperations() = delete;
+};
+
+}
@@ -0,0 +1,195 @@
+#include "ResultWriter.h"
+
+#include <QDataStream>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonValue>
+#include <QSqlField>
+
+namespace Database {
+
+namespace {
+
+/**
+ * RFC 4180 style CSV with a header line. NULL is written as an empty field.
+ */
+class CsvWriter : public ResultWriter
+{
+public:
+	explicit CsvWriter(QIODevice *device) : ResultWriter(device) {}
+
+	bool writeHeader(const QSqlRecord &record) override
+	{
+		QByteArray line;
+		for (int i = 0; i < record.count(); i++) {
+			if (i > 0)
+				line += ',';
+			appendField(line, record.fieldName(i));
+		}
+		line += "\r\n";
+		return write(line);
+	}
+
+	bool writeRow(const QVector<QVariant> &row) override
+	{
+		_line.clear();
+		for (int i = 0; i < row.size(); i++) {
+			if (i > 0)
+				_line += ',';
+			if (!row[i].isNull())
+				appendField(_line, row[i].toString());
+		}
+		_line += "\r\n";
+		return write(_line);
+	}
+
+	bool finish(qint64 rows) override
+	{
+		Q_UNUSED(rows);
+		return true;
+	}
+
+private:
+	static void appendField(QByteArray &line, const QString &value)
+	{
+		QByteArray utf8 = value.toUtf8();
+		bool quote = false;
+		for (char c : utf8) {
+			if (c == ',' || c == '"' || c == '\r' || c == '\n') {
+				quote = true;
+				break;
+			}
+		}
+		if (quote) {
+			line += '"';
+			line += utf8.replace('"', "\"\"");
+			line += '"';
+		} else {
+			line += utf8;
+		}
+	}
+
+	QByteArray _line;
+};
+
+/**
+ * One compact JSON object per line, keyed by column name.
+ */
+class JsonLinesWriter : public ResultWriter
+{
+public:
+	explicit JsonLinesWriter(QIODevice *device) : ResultWriter(device) {}
+
+	bool writeHeader(const QSqlRecord &record) override
+	{
+		_names.clear();
+		for (int i = 0; i < record.count(); i++)
+			_names << record.fieldName(i);
+		return true;
+	}
+
+	bool writeRow(const QVector<QVariant> &row) override
+	{
+		QJsonObject obj;
+		for (int i = 0; i < row.size() && i < _names.size(); i++) {
+			const QVariant &val = row[i];
+			if (val.isNull())
+				obj.insert(_names[i], QJsonValue(QJsonValue::Null));
+			else if (val.type() == QVariant::ByteArray)
+				obj.insert(_names[i], QString::fromLatin1(val.toByteArray().toBase64()));
+			else
+				obj.insert(_names[i], QJsonValue::fromVariant(val));
+		}
+		QByteArray line = QJsonDocument(obj).toJson(QJsonDocument::Compact);
+		line += '\n';
+		return write(line);
+	}
+
+	bool finish(qint64 rows) override
+	{
+		Q_UNUSED(rows);
+		return true;
+	}
+
+private:
+	QStringList _names;
+};
+
+/**
+ * QDataStream based row stream:
+ *
+ *  quint32 magic, quint32 version, qint32 columns,
+ *  per column: QString name, qint32 QVariant::Type
+ *  per row:    quint8 1, QVariant x columns
+ *  trailer:    quint8 0, qint64 row count
+ */
+class BinaryWriter : public ResultWriter
+{
+public:
+	static const quint32 Magic = 0x41515845; // "AQXE"
+	static const quint32 Version = 1;
+
+	explicit BinaryWriter(QIODevice *device)
+		: ResultWriter(device)
+		, _stream(device)
+	{
+		_stream.setVersion(QDataStream::Qt_5_5);
+	}
+
+	bool writeHeader(const QSqlRecord &record) override
+	{
+		_stream << Magic << Version << qint32(record.count());
+		for (int i = 0; i < record.count(); i++)
+			_stream << record.fieldName(i) << qint32(record.field(i).type());
+		return _stream.status() == QDataStream::Ok;
+	}
+
+	bool writeRow(const QVector<QVariant> &row) override
+	{
+		_stream << quint8(1);
+		for (const QVariant &val : row)
+			_stream << val;
+		return _stream.status() == QDataStream::Ok;
+	}
+
+	bool finish(qint64 rows) override
+	{
+		_stream << quint8(0) << rows;
+		return _stream.status() == QDataStream::Ok;
+	}
+
+private:
+	QDataStream _stream;
+};
+
+}
+
+ResultWriter::ResultWriter(QIODevice *device)
+	: _device(device)
+{
+}
+
+ResultWriter *ResultWriter::create(AsyncQuery::ExportFormat format, QIODevice *device)
+{
+	switch (format) {
+	case AsyncQuery::Export_Csv:
+		return new CsvWriter(device);
+	case AsyncQuery::Export_JsonLines:
+		return new JsonLinesWriter(device);
+	case AsyncQuery::Export_Binary:
+		return new BinaryWriter(device);
+	}
+	return nullptr;
+}
+
+QString ResultWriter::errorString() const
+{
+	return _device->errorString();
+}
+
+bool ResultWriter::write(const QByteArray &data)
+{
+	return _device->write(data) == data.size();
+}
+
+}
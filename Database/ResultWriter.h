@@ -0,0 +1,44 @@
+#pragma once
+
+#include "AsyncQuery.h"
+
+#include <QIODevice>
+#include <QSqlRecord>
+#include <QVector>
+#include <QVariant>
+
+namespace Database {
+
+/**
+ * @brief Serializes query rows to a QIODevice in one of the
+ * AsyncQuery::ExportFormat formats.
+ *
+ * @details Used by AsyncQuery::startExport() on the worker thread. Rows are
+ * written one by one as they are fetched from the cursor, so the memory
+ * footprint does not depend on the size of the result.
+ */
+class ResultWriter
+{
+public:
+	virtual ~ResultWriter() = default;
+
+	/**
+	 * @brief Create a writer for \p format writing to \p device.
+	 * @note The device must be open for writing and stays owned by the caller.
+	 */
+	static ResultWriter *create(AsyncQuery::ExportFormat format, QIODevice *device);
+
+	virtual bool writeHeader(const QSqlRecord &record) = 0;
+	virtual bool writeRow(const QVector<QVariant> &row) = 0;
+	virtual bool finish(qint64 rows) = 0;
+
+	QString errorString() const;
+
+protected:
+	explicit ResultWriter(QIODevice *device);
+	bool write(const QByteArray &data);
+
+	QIODevice *_device;
+};
+
+}
@@ -0,0 +1,354 @@
+#include "ShardedQuery.h"
+#include "AsyncQuery.h"
+
+#include <QDataStream>
+#include <QHash>
+#include <QSqlError>
+
+namespace Database {
+
+namespace {
+
+typedef QVector<QVector<QVariant>> Rows;
+
+bool isNumber(const QVariant &val)
+{
+	switch (val.type()) {
+	case QVariant::Bool:
+	case QVariant::Int:
+	case QVariant::UInt:
+	case QVariant::LongLong:
+	case QVariant::ULongLong:
+	case QVariant::Double:
+		return true;
+	default:
+		return false;
+	}
+}
+
+/** Compares like SQLite: NULL < numbers < text. */
+int compareValues(const QVariant &a, const QVariant &b)
+{
+	int kindA = !a.isValid() || a.isNull() ? 0 : (isNumber(a) ? 1 : 2);
+	int kindB = !b.isValid() || b.isNull() ? 0 : (isNumber(b) ? 1 : 2);
+	if (kindA != kindB)
+		return kindA < kindB ? -1 : 1;
+	if (kindA == 1) {
+		double da = a.toDouble(), db = b.toDouble();
+		return da < db ? -1 : (db < da ? 1 : 0);
+	}
+	if (kindA == 2)
+		return QString::compare(a.toString(), b.toString());
+	return 0;
+}
+
+Rows concatRows(const QVector<AsyncQueryResult> &results)
+{
+	int total = 0;
+	for (const AsyncQueryResult &res : results)
+		total += res.count();
+
+	Rows rows;
+	rows.reserve(total);
+	for (const AsyncQueryResult &res : results)
+		rows += res.data();
+	return rows;
+}
+
+Rows sortedRows(const QVector<AsyncQueryResult> &results, int column, Qt::SortOrder order)
+{
+	QVector<Rows> inputs;
+	int total = 0;
+	for (const AsyncQueryResult &res : results) {
+		inputs.append(res.data());
+		total += res.count();
+	}
+
+	// k-way merge, the first shard wins on equal keys
+	Rows rows;
+	rows.reserve(total);
+	QVector<int> pos(inputs.size(), 0);
+	while (rows.size() < total) {
+		int best = -1;
+		for (int i = 0; i < inputs.size(); i++) {
+			if (pos[i] >= inputs[i].size())
+				continue;
+			if (best < 0) {
+				best = i;
+				continue;
+			}
+			int cmp = compareValues(inputs[i][pos[i]].value(column),
+									inputs[best][pos[best]].value(column));
+			if (order == Qt::AscendingOrder ? cmp < 0 : cmp > 0)
+				best = i;
+		}
+		rows.append(inputs[best][pos[best]++]);
+	}
+	return rows;
+}
+
+QVariant aggregateValues(ShardedQuery::Aggregate aggregate, const QVariant &acc,
+						 const QVariant &val)
+{
+	if (!val.isValid() || val.isNull())
+		return acc;
+	if (!acc.isValid() || acc.isNull())
+		return val;
+
+	switch (aggregate) {
+	case ShardedQuery::Aggregate_Sum:
+		if (AsyncQueryResult::isIntegral(acc) && AsyncQueryResult::isIntegral(val))
+			return QVariant(acc.toLongLong() + val.toLongLong());
+		return QVariant(acc.toDouble() + val.toDouble());
+	case ShardedQuery::Aggregate_Min:
+		return compareValues(val, acc) < 0 ? val : acc;
+	case ShardedQuery::Aggregate_Max:
+		return compareValues(val, acc) > 0 ? val : acc;
+	default:
+		return acc;
+	}
+}
+
+Rows aggregateRows(const QVector<AsyncQueryResult> &results, int cols,
+				   const QMap<int, ShardedQuery::Aggregate> &aggregates)
+{
+	Rows rows;
+	QHash<QByteArray, int> groups;
+	for (const AsyncQueryResult &res : results) {
+		for (const QVector<QVariant> &row : res.data()) {
+			QByteArray key;
+			QDataStream out(&key, QIODevice::WriteOnly);
+			for (int col = 0; col < cols; col++) {
+				if (aggregates.value(col, ShardedQuery::Aggregate_None)
+						== ShardedQuery::Aggregate_None)
+					out << row.value(col);
+			}
+
+			auto it = groups.constFind(key);
+			if (it == groups.constEnd()) {
+				groups.insert(key, rows.size());
+				rows.append(row);
+				continue;
+			}
+
+			QVector<QVariant> &acc = rows[it.value()];
+			for (auto agg = aggregates.constBegin(); agg != aggregates.constEnd(); ++agg) {
+				int col = agg.key();
+				if (col >= 0 && col < acc.size())
+					acc[col] = aggregateValues(agg.value(), acc[col], row.value(col));
+			}
+		}
+	}
+	return rows;
+}
+
+}
+
+ShardedQuery::ShardedQuery(QObject *parent)
+	: QObject(parent), logger("Database.ShardedQuery")
+	, _running(false)
+	, _pending(0)
+	, _mergeMode(Merge_Concat)
+	, _sortColumn(0)
+	, _sortOrder(Qt::AscendingOrder)
+{
+}
+
+ShardedQuery::~ShardedQuery()
+{
+	waitDone();
+
+	// the last shard may still be inside its AsyncQuery::taskCallback()
+	for (AsyncQuery *shard : _shards) {
+		shard->setParent(nullptr);
+		shard->deleteLater();
+	}
+}
+
+void ShardedQuery::setProfiles(const QStringList &profiles)
+{
+	QMutexLocker locker(&_mutex);
+	if (_running) {
+		qCWarning(logger) << "ShardedQuery::setProfiles: query is running";
+		return;
+	}
+
+	for (AsyncQuery *shard : _shards)
+		shard->deleteLater();
+	_shards.clear();
+
+	_profiles = profiles;
+	for (int i = 0; i < _profiles.size(); i++) {
+		AsyncQuery *shard = new AsyncQuery(this);
+		shard->setConnectionProfile(_profiles[i]);
+		// merge on the worker thread of the shard
+		connect(shard, &AsyncQuery::execDone, this, [this, i](const AsyncQueryResult &result) {
+			shardDone(i, result);
+		}, Qt::DirectConnection);
+		_shards.append(shard);
+	}
+}
+
+QStringList ShardedQuery::profiles() const
+{
+	QMutexLocker locker(&_mutex);
+	return _profiles;
+}
+
+void ShardedQuery::setMergeMode(ShardedQuery::MergeMode mode)
+{
+	QMutexLocker locker(&_mutex);
+	_mergeMode = mode;
+}
+
+ShardedQuery::MergeMode ShardedQuery::mergeMode() const
+{
+	QMutexLocker locker(&_mutex);
+	return _mergeMode;
+}
+
+void ShardedQuery::setSortColumn(int column, Qt::SortOrder order)
+{
+	QMutexLocker locker(&_mutex);
+	_sortColumn = column;
+	_sortOrder = order;
+}
+
+int ShardedQuery::sortColumn() const
+{
+	QMutexLocker locker(&_mutex);
+	return _sortColumn;
+}
+
+Qt::SortOrder ShardedQuery::sortOrder() const
+{
+	QMutexLocker locker(&_mutex);
+	return _sortOrder;
+}
+
+void ShardedQuery::setAggregate(int column, ShardedQuery::Aggregate aggregate)
+{
+	QMutexLocker locker(&_mutex);
+	if (aggregate == Aggregate_None)
+		_aggregates.remove(column);
+	else
+		_aggregates.insert(column, aggregate);
+}
+
+ShardedQuery::Aggregate ShardedQuery::aggregate(int column) const
+{
+	QMutexLocker locker(&_mutex);
+	return _aggregates.value(column, Aggregate_None);
+}
+
+bool ShardedQuery::isRunning() const
+{
+	QMutexLocker locker(&_mutex);
+	return _running;
+}
+
+bool ShardedQuery::startExec(const QString &query, const QMap<QString, QVariant> &boundValues)
+{
+	QMutexLocker locker(&_mutex);
+	if (_running || _shards.isEmpty())
+		return false;
+
+	_results = QVector<AsyncQueryResult>(_shards.size());
+	_pending = _shards.size();
+	_running = true;
+	QVector<AsyncQuery*> shards = _shards;
+	locker.unlock();
+
+	for (int i = 0; i < shards.size(); i++) {
+		AsyncQuery *shard = shards[i];
+		bool started;
+		if (boundValues.isEmpty()) {
+			started = shard->startExec(query);
+		} else {
+			// values of the previous start would be bound again
+			shard->clearBoundValues();
+			shard->prepare(query);
+			for (auto it = boundValues.constBegin(); it != boundValues.constEnd(); ++it)
+				shard->bindValue(it.key(), it.value());
+			started = shard->startExec();
+		}
+		if (!started) {
+			// e.g. rejected by the queue depth limit, the shard is done with an error
+			AsyncQueryResult result;
+			result._queryString = query;
+			result._error = QSqlError(QString(), "Shard query was not started",
+									  QSqlError::StatementError);
+			shardDone(i, result);
+		}
+	}
+	return true;
+}
+
+bool ShardedQuery::waitDone(ulong msTimout)
+{
+	QMutexLocker lock(&_mutex);
+	if (_running)
+		return _waitcondition.wait(&_mutex, msTimout);
+	else
+		return true;
+}
+
+void ShardedQuery::shardDone(int shard, const AsyncQueryResult &result)
+{
+	_mutex.lock();
+	_results[shard] = result;
+	if (--_pending > 0) {
+		_mutex.unlock();
+		return;
+	}
+	QVector<AsyncQueryResult> results = _results;
+	_results.clear();
+	MergeMode mode = _mergeMode;
+	int sortColumn = _sortColumn;
+	Qt::SortOrder sortOrder = _sortOrder;
+	QMap<int, Aggregate> aggregates = _aggregates;
+	_mutex.unlock();
+
+	AsyncQueryResult merged;
+	merged._resultSets = results;
+	merged._record = results.first()._record;
+	merged._columns = results.first()._columns;
+	merged._queryString = results.first()._queryString;
+
+	int failed = -1;
+	int affected = 0;
+	for (int i = 0; i < results.size() && failed < 0; i++) {
+		if (!results[i].isValid())
+			failed = i;
+		affected += qMax(0, results[i].numRowsAffected());
+	}
+
+	if (failed >= 0) {
+		qCWarning(logger) << "ShardedQuery: shard" << failed << "failed:"
+						  << results[failed].error().text();
+		merged._error = results[failed]._error;
+	} else {
+		merged._numRowsAffected = affected;
+		switch (mode) {
+		case Merge_Concat:
+			merged._data = concatRows(results);
+			break;
+		case Merge_Sorted:
+			merged._data = sortedRows(results, sortColumn, sortOrder);
+			break;
+		case Merge_Aggregate:
+			merged._data = aggregateRows(results, merged._record.count(), aggregates);
+			break;
+		}
+	}
+
+	emit execDone(merged);
+
+	// wake waitDone() last, the destructor may delete the object then
+	_mutex.lock();
+	_running = false;
+	_waitcondition.wakeAll();
+	_mutex.unlock();
+}
+
+}
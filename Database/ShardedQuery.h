@@ -0,0 +1,144 @@
+#pragma once
+
+#include "AsyncQueryResult.h"
+
+#include <QLoggingCategory>
+#include <QMap>
+#include <QMutex>
+#include <QObject>
+#include <QStringList>
+#include <QVector>
+#include <QWaitCondition>
+
+namespace Database {
+
+// class forward decl's
+class AsyncQuery;
+
+/**
+ * @brief Runs the same query on several connection profiles in parallel and
+ * merges the results.
+ *
+ * @details Each profile (see ConnectionManager::addProfile()) is queried by its
+ * own AsyncQuery in the QThreadPool. The shard which finishes last merges all
+ * shard results on its worker thread and execDone() is emitted with the
+ * combined result.
+ *
+ * Sample Usage:
+ * \code{.cpp}
+ * Database::ShardedQuery *query = new Database::ShardedQuery(this);
+ * query->setProfiles(QStringList() << "2016-01" << "2016-02" << "2016-03");
+ * query->setMergeMode(Database::ShardedQuery::Merge_Aggregate);
+ * query->setAggregate(1, Database::ShardedQuery::Aggregate_Sum);
+ * connect(query, &Database::ShardedQuery::execDone, ...);
+ * query->startExec("SELECT Country, COUNT(*) FROM Customer GROUP BY Country");
+ * \endcode
+ */
+class ShardedQuery : public QObject
+{
+	Q_OBJECT
+
+public:
+	/**
+	 * @brief How the shard results are combined.
+	 */
+	enum MergeMode {
+		/** Rows of all shards in profile order. */
+		Merge_Concat,
+		/** Rows ordered by sortColumn(). Each shard has to deliver its rows
+		 * ordered by the same column (ORDER BY in the query). */
+		Merge_Sorted,
+		/** Rows with equal values in all columns without an aggregate are
+		 * combined into one row, see setAggregate(). */
+		Merge_Aggregate,
+	};
+	Q_ENUM(MergeMode)
+
+	/**
+	 * @brief How a column is combined in Merge_Aggregate mode.
+	 * @note Merge COUNT() columns with Aggregate_Sum. AVG() can not be merged,
+	 * select SUM() and COUNT() instead.
+	 */
+	enum Aggregate {
+		/** The column is part of the group key. */
+		Aggregate_None,
+		Aggregate_Sum,
+		Aggregate_Min,
+		Aggregate_Max,
+	};
+	Q_ENUM(Aggregate)
+
+	explicit ShardedQuery(QObject *parent = nullptr);
+	virtual ~ShardedQuery();
+
+	/**
+	 * @brief Connection profiles to query, one per shard.
+	 * @note Must not be changed while a query is running.
+	 */
+	void setProfiles(const QStringList &profiles);
+	QStringList profiles() const;
+
+	void setMergeMode(MergeMode mode);
+	MergeMode mergeMode() const;
+
+	/**
+	 * @brief Key column of Merge_Sorted.
+	 */
+	void setSortColumn(int column, Qt::SortOrder order = Qt::AscendingOrder);
+	int sortColumn() const;
+	Qt::SortOrder sortOrder() const;
+
+	/**
+	 * @brief Aggregate of \p column in Merge_Aggregate mode.
+	 */
+	void setAggregate(int column, Aggregate aggregate);
+	Aggregate aggregate(int column) const;
+
+	/**
+	 * @brief Is a query running.
+	 */
+	bool isRunning() const;
+
+	/**
+	 * @brief Start \p query with \p boundValues on all shards.
+	 * @returns \c false if no profiles are set or a query is already running.
+	 * A shard which can not start its query counts as failed, execDone() then
+	 * reports its error.
+	 */
+	bool startExec(const QString &query,
+				   const QMap<QString, QVariant> &boundValues = QMap<QString, QVariant>());
+
+	/**
+	 * @brief Wait for the running query to finish.
+	 */
+	bool waitDone(ulong msTimout = ULONG_MAX);
+
+signals:
+	/**
+	 * @brief Is emitted with the merged result when all shards are done.
+	 * @details AsyncQueryResult::resultSets() holds the shard results in
+	 * profile order. If a shard failed, the result carries its error and no
+	 * rows.
+	 */
+	void execDone(const Database::AsyncQueryResult &result);
+
+private:
+	// attention lives in the context of QRunable
+	void shardDone(int shard, const AsyncQueryResult &result);
+
+	QLoggingCategory logger;
+
+	mutable QMutex _mutex;
+	QWaitCondition _waitcondition;
+	QStringList _profiles;
+	QVector<AsyncQuery*> _shards;
+	QVector<AsyncQueryResult> _results;
+	bool _running;
+	int _pending;
+	MergeMode _mergeMode;
+	int _sortColumn;
+	Qt::SortOrder _sortOrder;
+	QMap<int, Aggregate> _aggregates;
+};
+
+}
@@ -0,0 +1,173 @@
+#include "SlowQueryLog.h"
+
+#include <QFile>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSqlQuery>
+#include <QSqlRecord>
+#include <QStringList>
+
+namespace Database {
+
+SlowQueryLog::SlowQueryLog()
+	: _mutex()
+	, _thresholdMs(0)
+	, _capacity(100)
+	, _capturePlan(true)
+	, _next(0)
+	, logger("Database.SlowQueryLog")
+{
+}
+
+void SlowQueryLog::setThresholdMs(qint64 ms)
+{
+	QMutexLocker locker(&_mutex);
+	_thresholdMs = qMax<qint64>(0, ms);
+}
+
+qint64 SlowQueryLog::thresholdMs() const
+{
+	QMutexLocker locker(&_mutex);
+	return _thresholdMs;
+}
+
+bool SlowQueryLog::isEnabled() const
+{
+	QMutexLocker locker(&_mutex);
+	return _thresholdMs > 0;
+}
+
+void SlowQueryLog::setCapacity(int entries)
+{
+	QMutexLocker locker(&_mutex);
+	QVector<Entry> ordered;
+	for (int i = 0; i < _entries.size(); i++)
+		ordered.append(_entries[(_next + i) % _entries.size()]);
+
+	_capacity = qMax(1, entries);
+	if (ordered.size() > _capacity)
+		ordered.remove(0, ordered.size() - _capacity);
+	_entries = ordered;
+	_next = 0;
+}
+
+int SlowQueryLog::capacity() const
+{
+	QMutexLocker locker(&_mutex);
+	return _capacity;
+}
+
+void SlowQueryLog::setFileName(const QString &fileName)
+{
+	QMutexLocker locker(&_mutex);
+	_fileName = fileName;
+}
+
+QString SlowQueryLog::fileName() const
+{
+	QMutexLocker locker(&_mutex);
+	return _fileName;
+}
+
+void SlowQueryLog::setCapturePlan(bool enabled)
+{
+	QMutexLocker locker(&_mutex);
+	_capturePlan = enabled;
+}
+
+bool SlowQueryLog::capturePlan() const
+{
+	QMutexLocker locker(&_mutex);
+	return _capturePlan;
+}
+
+QVector<SlowQueryLog::Entry> SlowQueryLog::entries() const
+{
+	QMutexLocker locker(&_mutex);
+	if (_entries.size() < _capacity)
+		return _entries;
+
+	QVector<Entry> ordered;
+	ordered.reserve(_entries.size());
+	for (int i = 0; i < _entries.size(); i++)
+		ordered.append(_entries[(_next + i) % _entries.size()]);
+	return ordered;
+}
+
+void SlowQueryLog::clear()
+{
+	QMutexLocker locker(&_mutex);
+	_entries.clear();
+	_next = 0;
+}
+
+void SlowQueryLog::record(const Entry &entry)
+{
+	qCWarning(logger) << "slow query:" << entry.execMs << "ms" << entry.query;
+
+	QMutexLocker locker(&_mutex);
+	if (_entries.size() < _capacity) {
+		_entries.append(entry);
+	} else {
+		_entries[_next] = entry;
+		_next = (_next + 1) % _capacity;
+	}
+
+	if (_fileName.isEmpty())
+		return;
+
+	QJsonObject bound;
+	for (auto it = entry.boundValues.constBegin(); it != entry.boundValues.constEnd(); ++it)
+		bound.insert(it.key(), QJsonValue::fromVariant(it.value()));
+
+	QJsonObject obj;
+	obj.insert("timestamp", entry.timestamp.toString("yyyy-MM-ddTHH:mm:ss.zzz"));
+	obj.insert("query", entry.query);
+	obj.insert("boundValues", bound);
+	obj.insert("queueMs", double(entry.queueMs));
+	obj.insert("execMs", double(entry.execMs));
+	obj.insert("rows", entry.rows);
+	obj.insert("connection", entry.connection);
+	obj.insert("plan", entry.plan);
+	obj.insert("error", entry.error);
+
+	QFile file(_fileName);
+	if (!file.open(QIODevice::WriteOnly | QIODevice::Append)) {
+		qCWarning(logger) << "SlowQueryLog: can not open" << _fileName << file.errorString();
+		return;
+	}
+	file.write(QJsonDocument(obj).toJson(QJsonDocument::Compact));
+	file.write("\n");
+}
+
+QString SlowQueryLog::explain(QSqlDatabase &db, const QString &query,
+							  const QMap<QString, QVariant> &boundValues, bool prepared)
+{
+	QString prefix = db.driverName().startsWith("QSQLITE") ?
+		QStringLiteral("EXPLAIN QUERY PLAN ") : QStringLiteral("EXPLAIN ");
+
+	QSqlQuery explainQuery(db);
+	bool succ;
+	if (prepared) {
+		succ = explainQuery.prepare(prefix + query);
+		for (auto it = boundValues.constBegin(); it != boundValues.constEnd(); ++it)
+			explainQuery.bindValue(it.key(), it.value());
+		succ = succ && explainQuery.exec();
+	} else {
+		succ = explainQuery.exec(prefix + query);
+	}
+	if (!succ)
+		return QString();
+
+	QStringList lines;
+	int cols = explainQuery.record().count();
+	while (explainQuery.next()) {
+		QStringList fields;
+		for (int i = 0; i < cols; i++)
+			fields << explainQuery.value(i).toString();
+		lines << fields.join(QLatin1Char('|'));
+	}
+	return lines.join(QLatin1Char('\n'));
+}
+
+}
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <QDateTime>
+#include <QMap>
+#include <QMutex>
+#include <QSqlDatabase>
+#include <QString>
+#include <QVariant>
+#include <QVector>
+
+#include <QLoggingCategory>
+
+namespace Database {
+
+/**
+ * @brief Records queries which run longer than a threshold.
+ *
+ * @details The log is owned by the ConnectionManager and disabled until a
+ * threshold is set. Slow queries are kept in an in-memory ring buffer of
+ * capacity() entries and, if a file name is set, appended to the file as JSON
+ * lines. For single statements the query plan (EXPLAIN QUERY PLAN for SQLite,
+ * EXPLAIN otherwise) is captured on the same connection right after the query.
+ *
+ * Sample Usage:
+ * \code{.cpp}
+ * Database::SlowQueryLog *log = Database::ConnectionManager::instance()->slowQueryLog();
+ * log->setThresholdMs(200);
+ * log->setFileName("slow-queries.jsonl");
+ * \endcode
+ *
+ * @note All functions are thread save.
+ */
+class SlowQueryLog
+{
+public:
+	/**
+	 * @brief One slow query.
+	 */
+	struct Entry {
+		QDateTime timestamp;
+		QString query;
+		QMap<QString, QVariant> boundValues;
+		/** Time in ms the query waited in queues before it was run. */
+		qint64 queueMs = 0;
+		/** Time in ms to execute the query and fetch its rows. */
+		qint64 execMs = 0;
+		/** Number of fetched rows, or of affected rows if nothing was fetched. */
+		int rows = 0;
+		QString connection;
+		QString plan;
+		QString error;
+	};
+
+	SlowQueryLog();
+
+	/**
+	 * @brief Queries with an execution time of at least \p ms are logged.
+	 * 0 (default) disables the log.
+	 */
+	void setThresholdMs(qint64 ms);
+	qint64 thresholdMs() const;
+
+	bool isEnabled() const;
+
+	/**
+	 * @brief Number of entries kept in memory, default 100.
+	 */
+	void setCapacity(int entries);
+	int capacity() const;
+
+	/**
+	 * @brief File the entries are appended to as JSON lines. Empty (default)
+	 * keeps them in memory only.
+	 */
+	void setFileName(const QString &fileName);
+	QString fileName() const;
+
+	/**
+	 * @brief Capture the query plan of slow queries, default \c true.
+	 */
+	void setCapturePlan(bool enabled);
+	bool capturePlan() const;
+
+	/**
+	 * @brief Returns the logged entries, oldest first.
+	 */
+	QVector<Entry> entries() const;
+
+	void clear();
+
+	/**
+	 * @brief Add \p entry to the log. Used by the query tasks.
+	 */
+	void record(const Entry &entry);
+
+	/**
+	 * @brief Returns the plan of \p query on \p db as text, one line per
+	 * plan row.
+	 * @param prepared Bind \p boundValues to the EXPLAIN statement.
+	 */
+	static QString explain(QSqlDatabase &db, const QString &query,
+						   const QMap<QString, QVariant> &boundValues, bool prepared);
+
+private:
+	mutable QMutex _mutex;
+	qint64 _thresholdMs;
+	int _capacity;
+	QString _fileName;
+	bool _capturePlan;
+	QVector<Entry> _entries;
+	int _next;
+
+	QLoggingCategory logger;
+};
+
+}
@@ -0,0 +1,244 @@
+#include "StatementStats.h"
+
+#include <QRegularExpression>
+
+#include <algorithm>
+
+namespace Database {
+
+namespace {
+
+/** Bound for the cache of sql text to fingerprint. */
+const int maxCachedFingerprints = 4096;
+
+/** Fingerprint of the entry collecting statements beyond the limit. */
+const char otherStatements[] = "(other statements)";
+
+double percentile(const QVector<float> &sorted, double p)
+{
+	if (sorted.isEmpty())
+		return 0;
+	int idx = qBound(0, int(p * (sorted.size() - 1) + 0.5), sorted.size() - 1);
+	return sorted[idx];
+}
+
+bool isIdentChar(QChar c)
+{
+	return c.isLetterOrNumber() || c == QLatin1Char('_') || c == QLatin1Char('$');
+}
+
+}
+
+StatementStats::StatementStats()
+	: _enabled(false)
+	, _maxStatements(1000)
+{
+}
+
+void StatementStats::setEnabled(bool enabled)
+{
+	QMutexLocker locker(&_mutex);
+	_enabled = enabled;
+}
+
+bool StatementStats::isEnabled() const
+{
+	QMutexLocker locker(&_mutex);
+	return _enabled;
+}
+
+void StatementStats::setMaxStatements(int count)
+{
+	QMutexLocker locker(&_mutex);
+	_maxStatements = qMax(1, count);
+}
+
+int StatementStats::maxStatements() const
+{
+	QMutexLocker locker(&_mutex);
+	return _maxStatements;
+}
+
+void StatementStats::record(const QString &sql, double ms, int rows, bool error)
+{
+	QMutexLocker locker(&_mutex);
+	if (!_enabled)
+		return;
+
+	Data &d = data(sql);
+	d.stats.calls++;
+	d.stats.totalMs += ms;
+	d.stats.maxMs = qMax(d.stats.maxMs, ms);
+	d.stats.rows += qMax(0, rows);
+	if (error)
+		d.stats.errors++;
+
+	if (d.samples.size() < sampleCount) {
+		d.samples.append(float(ms));
+	} else {
+		d.samples[d.nextSample] = float(ms);
+		d.nextSample = (d.nextSample + 1) % sampleCount;
+	}
+}
+
+void StatementStats::recordCacheHit(const QString &sql)
+{
+	QMutexLocker locker(&_mutex);
+	if (!_enabled)
+		return;
+
+	data(sql).stats.cacheHits++;
+}
+
+QVector<StatementStats::Statement> StatementStats::snapshot(SortKey key, int limit) const
+{
+	QVector<Statement> result;
+	{
+		QMutexLocker locker(&_mutex);
+		result.reserve(_statements.size());
+		for (const Data &d : _statements) {
+			Statement s = d.stats;
+			s.meanMs = s.calls > 0 ? s.totalMs / s.calls : 0;
+			QVector<float> sorted = d.samples;
+			std::sort(sorted.begin(), sorted.end());
+			s.p50Ms = percentile(sorted, 0.50);
+			s.p95Ms = percentile(sorted, 0.95);
+			s.p99Ms = percentile(sorted, 0.99);
+			result.append(s);
+		}
+	}
+
+	std::sort(result.begin(), result.end(), [key](const Statement &a, const Statement &b) {
+		switch (key) {
+		case Sort_MeanTime:
+			return a.meanMs > b.meanMs;
+		case Sort_Calls:
+			return a.calls > b.calls;
+		case Sort_Rows:
+			return a.rows > b.rows;
+		case Sort_Errors:
+			return a.errors > b.errors;
+		default:
+			return a.totalMs > b.totalMs;
+		}
+	});
+
+	if (limit >= 0 && result.size() > limit)
+		result.resize(limit);
+	return result;
+}
+
+void StatementStats::reset()
+{
+	QMutexLocker locker(&_mutex);
+	_statements.clear();
+	_fingerprints.clear();
+}
+
+StatementStats::Data &StatementStats::data(const QString &sql)
+{
+	// prepared statements repeat the same text, normalize each text once
+	auto it = _fingerprints.constFind(sql);
+	QString print;
+	if (it != _fingerprints.constEnd()) {
+		print = it.value();
+	} else {
+		print = fingerprint(sql);
+		if (_fingerprints.size() >= maxCachedFingerprints)
+			_fingerprints.clear();
+		_fingerprints.insert(sql, print);
+	}
+
+	// beyond the limit new fingerprints share one entry
+	if (!_statements.contains(print)) {
+		int distinct = _statements.size() - (_statements.contains(otherStatements) ? 1 : 0);
+		if (distinct >= _maxStatements)
+			print = QLatin1String(otherStatements);
+	}
+
+	Data &d = _statements[print];
+	if (d.stats.fingerprint.isEmpty()) {
+		d.stats.fingerprint = print;
+		d.stats.example = sql;
+	}
+	return d;
+}
+
+QString StatementStats::fingerprint(const QString &sql)
+{
+	QString out;
+	out.reserve(sql.size());
+	bool space = false;
+
+	for (int i = 0; i < sql.size(); i++) {
+		QChar c = sql.at(i);
+		QChar next = i + 1 < sql.size() ? sql.at(i + 1) : QChar();
+
+		if (c.isSpace()) {
+			space = true;
+			continue;
+		}
+		if (c == QLatin1Char('-') && next == QLatin1Char('-')) {
+			while (i < sql.size() && sql.at(i) != QLatin1Char('\n'))
+				i++;
+			space = true;
+			continue;
+		}
+		if (c == QLatin1Char('/') && next == QLatin1Char('*')) {
+			int end = sql.indexOf(QLatin1String("*/"), i + 2);
+			i = end < 0 ? sql.size() : end + 1;
+			space = true;
+			continue;
+		}
+
+		if (space && !out.isEmpty())
+			out += QLatin1Char(' ');
+		space = false;
+
+		if (c == QLatin1Char('\'')) {
+			// string literal, '' is an escaped quote
+			i++;
+			while (i < sql.size()) {
+				if (sql.at(i) == QLatin1Char('\'')) {
+					if (i + 1 < sql.size() && sql.at(i + 1) == QLatin1Char('\''))
+						i++;
+					else
+						break;
+				}
+				i++;
+			}
+			out += QLatin1Char('?');
+		} else if (c.isDigit() && (out.isEmpty() || !isIdentChar(out.at(out.size() - 1)))) {
+			// the sign of an exponent (1e-5) belongs to the literal, not of hex numbers
+			bool hex = c == QLatin1Char('0')
+				&& (next == QLatin1Char('x') || next == QLatin1Char('X'));
+			while (i + 1 < sql.size()) {
+				QChar d = sql.at(i + 1);
+				bool sign = !hex && (d == QLatin1Char('+') || d == QLatin1Char('-'))
+					&& (sql.at(i) == QLatin1Char('e') || sql.at(i) == QLatin1Char('E'))
+					&& i + 2 < sql.size() && sql.at(i + 2).isDigit();
+				if (!d.isLetterOrNumber() && d != QLatin1Char('.') && !sign)
+					break;
+				i++;
+			}
+			out += QLatin1Char('?');
+		} else if (c == QLatin1Char('"') || c == QLatin1Char('`')) {
+			// quoted identifier, kept as is
+			int end = sql.indexOf(c, i + 1);
+			if (end < 0)
+				end = sql.size() - 1;
+			out += sql.midRef(i, end - i + 1);
+			i = end;
+		} else {
+			out += c;
+		}
+	}
+
+	// value lists of any length share one fingerprint
+	static const QRegularExpression valueList(
+		QStringLiteral("\\(\\s*\\?(\\s*,\\s*\\?)*\\s*\\)"));
+	out.replace(valueList, QStringLiteral("(...)"));
+	return out;
+}
+
+}
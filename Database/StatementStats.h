@@ -0,0 +1,119 @@
+#pragma once
+
+#include <QHash>
+#include <QMutex>
+#include <QString>
+#include <QVector>
+
+namespace Database {
+
+/**
+ * @brief Aggregated execution statistics per normalized statement.
+ *
+ * @details Owned by the ConnectionManager and disabled by default. Every query
+ * run by AsyncQuery is reduced to a fingerprint(): literals are replaced by
+ * '?', lists of values by '...' and whitespace is collapsed, so the same
+ * statement with different values shares one entry. snapshot() returns the
+ * entries sorted e.g. by total time, which shows where the database time
+ * goes.
+ *
+ * @note All functions are thread save.
+ */
+class StatementStats
+{
+public:
+	/**
+	 * @brief Aggregates of one fingerprint.
+	 */
+	struct Statement {
+		QString fingerprint;
+		/** The first executed sql text with this fingerprint. */
+		QString example;
+		qint64 calls = 0;
+		qint64 errors = 0;
+		qint64 rows = 0;
+		/** Snapshots served by the persistent ResultCache. */
+		qint64 cacheHits = 0;
+		double totalMs = 0;
+		double meanMs = 0;
+		double maxMs = 0;
+		/** Percentiles of the most recent executions. */
+		double p50Ms = 0;
+		double p95Ms = 0;
+		double p99Ms = 0;
+	};
+
+	enum SortKey {
+		Sort_TotalTime,
+		Sort_MeanTime,
+		Sort_Calls,
+		Sort_Rows,
+		Sort_Errors,
+	};
+
+	StatementStats();
+
+	/**
+	 * @brief Collect statistics, default \c false.
+	 */
+	void setEnabled(bool enabled);
+	bool isEnabled() const;
+
+	/**
+	 * @brief Maximum number of fingerprints, default 1000.
+	 * @details Statements with further fingerprints are aggregated in one
+	 * entry with the fingerprint "(other statements)", so generated sql
+	 * (e.g. with varying table names) cannot grow the statistics unbounded.
+	 */
+	void setMaxStatements(int count);
+	int maxStatements() const;
+
+	/**
+	 * @brief Record one execution of \p sql.
+	 */
+	void record(const QString &sql, double ms, int rows, bool error);
+
+	/**
+	 * @brief Record a ResultCache hit for \p sql.
+	 */
+	void recordCacheHit(const QString &sql);
+
+	/**
+	 * @brief Returns the statements sorted descending by \p key.
+	 * @param limit Maximum number of statements, -1 returns all.
+	 */
+	QVector<Statement> snapshot(SortKey key = Sort_TotalTime, int limit = -1) const;
+
+	/**
+	 * @brief Remove all statistics.
+	 */
+	void reset();
+
+	/**
+	 * @brief Normalize \p sql: string and numeric literals become '?',
+	 * value lists "(?, ?, ...)" become "(...)", comments are removed and
+	 * whitespace is collapsed.
+	 */
+	static QString fingerprint(const QString &sql);
+
+private:
+	/** Number of latencies kept per statement for the percentiles. */
+	static const int sampleCount = 256;
+
+	struct Data {
+		Statement stats;
+		QVector<float> samples;
+		int nextSample = 0;
+	};
+
+	/* use only in locked area */
+	Data &data(const QString &sql);
+
+	mutable QMutex _mutex;
+	bool _enabled;
+	int _maxStatements;
+	QHash<QString, Data> _statements;
+	QHash<QString, QString> _fingerprints;
+};
+
+}
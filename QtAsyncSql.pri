@@ -2,16 +2,56 @@ QT 	*= sql
 CONFIG 	*= c++11
 INCLUDEPATH *= $$PWD/Database
 
+# Direct access to the SQLite C API (progress handler, hooks, backup).
+# Enable with "CONFIG += asyncsql_sqlite"; Qt has to be built with -system-sqlite
+# so the QSQLITE driver and the library share the same sqlite3 instance.
+asyncsql_sqlite {
+	DEFINES += ASYNCSQL_SQLITE_API
+	LIBS += -lsqlite3
+}
+
 SOURCES += \
         $$PWD/Database/AsyncQuery.cpp \
         $$PWD/Database/AsyncQueryResult.cpp \
         $$PWD/Database/ConnectionManager.cpp \
         $$PWD/Database/AsyncQueryModel.cpp \
-        $$PWD/Database/AsyncQueryQMLModel.cpp
+        $$PWD/Database/AsyncQueryQMLModel.cpp \
+        $$PWD/Database/ResultWriter.cpp \
+        $$PWD/Database/ResultCache.cpp \
+        $$PWD/Database/AsyncSortFilter.cpp \
+        $$PWD/Database/BulkImport.cpp \
+        $$PWD/Database/AsyncPipeline.cpp \
+        $$PWD/Database/ShardedQuery.cpp \
+        $$PWD/Database/AsyncSession.cpp \
+        $$PWD/Database/DeliveryQueue.cpp \
+        $$PWD/Database/LiveQuery.cpp \
+        $$PWD/Database/SlowQueryLog.cpp \
+        $$PWD/Database/StatementStats.cpp \
+        $$PWD/Database/PoolMetrics.cpp \
+        $$PWD/Database/MemoryReplica.cpp \
+        $$PWD/Database/ParallelScan.cpp \
+        $$PWD/Database/ResultOperations.cpp \
+        $$PWD/Database/ColumnHint.cpp
 
 HEADERS += \
         $$PWD/Database/AsyncQuery.h \
         $$PWD/Database/AsyncQueryResult.h \
         $$PWD/Database/ConnectionManager.h \
         $$PWD/Database/AsyncQueryModel.h \
-        $$PWD/Database/AsyncQueryQMLModel.h
+        $$PWD/Database/AsyncQueryQMLModel.h \
+        $$PWD/Database/ResultWriter.h \
+        $$PWD/Database/ResultCache.h \
+        $$PWD/Database/AsyncSortFilter.h \
+        $$PWD/Database/BulkImport.h \
+        $$PWD/Database/AsyncPipeline.h \
+        $$PWD/Database/ShardedQuery.h \
+        $$PWD/Database/AsyncSession.h \
+        $$PWD/Database/DeliveryQueue.h \
+        $$PWD/Database/LiveQuery.h \
+        $$PWD/Database/SlowQueryLog.h \
+        $$PWD/Database/StatementStats.h \
+        $$PWD/Database/PoolMetrics.h \
+        $$PWD/Database/MemoryReplica.h \
+        $$PWD/Database/ParallelScan.h \
+        $$PWD/Database/ResultOperations.h \
+        $$PWD/Database/ColumnHint.h
@@ -8,6 +8,14 @@ QT += core gui sql
 
 CONFIG += c++11
 
+# Direct access to the SQLite C API (progress handler, hooks, backup).
+# Enable with "CONFIG += asyncsql_sqlite"; Qt has to be built with -system-sqlite
+# so the QSQLITE driver and the library share the same sqlite3 instance.
+asyncsql_sqlite {
+	DEFINES += ASYNCSQL_SQLITE_API
+	LIBS += -lsqlite3
+}
+
 greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
 
 TARGET = QtThreadedAsyncSql
@@ -19,13 +27,45 @@ SOURCES += main.cpp\
 	Database/AsyncQuery.cpp \
 	Database/AsyncQueryResult.cpp \
 	Database/ConnectionManager.cpp \
-        Database/AsyncQueryModel.cpp
+        Database/AsyncQueryModel.cpp \
+	Database/ResultWriter.cpp \
+	Database/ResultCache.cpp \
+	Database/AsyncSortFilter.cpp \
+	Database/BulkImport.cpp \
+	Database/AsyncPipeline.cpp \
+	Database/ShardedQuery.cpp \
+	Database/AsyncSession.cpp \
+	Database/DeliveryQueue.cpp \
+	Database/LiveQuery.cpp \
+	Database/SlowQueryLog.cpp \
+	Database/StatementStats.cpp \
+	Database/PoolMetrics.cpp \
+	Database/MemoryReplica.cpp \
+	Database/ParallelScan.cpp \
+	Database/ResultOperations.cpp \
+	Database/ColumnHint.cpp
 
 HEADERS += mainwindow.h \
 	Database/AsyncQuery.h \
 	Database/AsyncQueryResult.h \
 	Database/ConnectionManager.h \
-        Database/AsyncQueryModel.h
+        Database/AsyncQueryModel.h \
+	Database/ResultWriter.h \
+	Database/ResultCache.h \
+	Database/AsyncSortFilter.h \
+	Database/BulkImport.h \
+	Database/AsyncPipeline.h \
+	Database/ShardedQuery.h \
+	Database/AsyncSession.h \
+	Database/DeliveryQueue.h \
+	Database/LiveQuery.h \
+	Database/SlowQueryLog.h \
+	Database/StatementStats.h \
+	Database/PoolMetrics.h \
+	Database/MemoryReplica.h \
+	Database/ParallelScan.h \
+	Database/ResultOperations.h \
+	Database/ColumnHint.h
 
 FORMS += mainwindow.ui
 
@@ -0,0 +1,30 @@
+#-------------------------------------------------
+#
+# Headless soak and stress test load generator,
+# run "asyncsql_soak --help" for the options.
+#
+#-------------------------------------------------
+
+QT      += core sql
+QT      -= gui
+
+CONFIG  += c++11 console
+CONFIG  -= app_bundle
+
+TEMPLATE = app
+TARGET 	 = asyncsql_soak
+
+include(QtAsyncSql.pri)
+
+# resident memory of the process on Windows
+win32: LIBS += -lpsapi
+
+SOURCES += \
+	soak/main.cpp \
+	soak/SoakProducer.cpp \
+	soak/SoakRunner.cpp
+
+HEADERS += \
+	soak/SoakOptions.h \
+	soak/SoakProducer.h \
+	soak/SoakRunner.h
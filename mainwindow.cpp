@@ -27,8 +27,10 @@ MainWindow::MainWindow(QWidget *parent)
 	Database::AsyncQuery::startExecOnce(
 				"SELECT name FROM sqlite_master WHERE type='table'",
 				[=](const Database::AsyncQueryResult& res) {
-		for (int i = 0; i < res.count(); i++) {
-			ui->cbTables->addItem(res.value(i, "name").toString());
+		Database::AsyncQueryResult::Column name = res.column("name");
+		Database::AsyncQueryRow row = res.rows();
+		while (row.next()) {
+			ui->cbTables->addItem(row.toString(name));
 		}
 		if (res.count() > 0) {
 			ui->cbTables->setCurrentIndex(0);
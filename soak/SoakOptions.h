@@ -0,0 +1,58 @@
+#pragma once
+
+#include "AsyncQuery.h"
+
+#include <QList>
+#include <QString>
+
+namespace Soak {
+
+/**
+ * @brief Load mix and database of a soak run, see main.cpp for the command
+ * line options.
+ */
+struct SoakOptions
+{
+	// database
+	QString driver = "QSQLITE";
+	QString databaseName;
+	QString hostName;
+	int port = -1;
+	QString userName;
+	QString password;
+
+	// load mix
+	int producers = 8;
+	/** Queries per second of each producer, 0 starts the next query when the
+	 * previous one is done (closed loop). */
+	double rate = 50;
+	/** Share of INSERTs, the rest are SELECTs. */
+	double writeRatio = 0.2;
+	/** Modes assigned round robin to the producers. */
+	QList<Database::AsyncQuery::Mode> modes = { Database::AsyncQuery::Mode_Parallel };
+	/** Rows returned by a SELECT. */
+	int resultRows = 100;
+	/** Rows of the table read by the SELECTs. */
+	int tableRows = 10000;
+	/** Size of the text column in bytes. */
+	int payloadSize = 64;
+	/** AsyncQuery::setMaxQueueDepth() of each producer, 0 for unlimited. */
+	int maxQueueDepth = 0;
+
+	// pool
+	/** QThreadPool::setExpiryTimeout() in ms, -1 keeps the default. Short
+	 * timeouts churn threads and with them thread connections. */
+	int expiryMs = -1;
+	/** QThreadPool::setMaxThreadCount(), 0 keeps the default. */
+	int maxThreads = 0;
+
+	// run
+	/** Run time in seconds, 0 runs until the process is killed. */
+	int durationSec = 3600;
+	/** Seconds between two reports. */
+	int reportSec = 10;
+	/** Write reports as JSON lines instead of text. */
+	bool json = false;
+};
+
+}
@@ -0,0 +1,179 @@
+#include "SoakProducer.h"
+
+namespace Soak {
+
+namespace {
+
+// the outer join returns the sequence number even if no data row matches
+const char *readQuery =
+	"SELECT :seq AS seq, s.id, s.payload FROM (SELECT 1 AS one) o LEFT JOIN "
+	"(SELECT id, payload FROM soak_data WHERE id > :from ORDER BY id LIMIT :rows) s "
+	"ON 1 = 1";
+
+const char *writeQuery =
+	"INSERT INTO soak_log (id, producer, payload) VALUES (:seq, :producer, :payload)";
+
+}
+
+qint64 SoakProducer::_nextSeq = 1;
+
+SoakProducer::SoakProducer(int id, const SoakOptions &options, Database::AsyncQuery::Mode mode,
+						   const QElapsedTimer &clock, QObject *parent)
+	: QObject(parent)
+	, _id(id)
+	, _options(options)
+	, _mode(mode)
+	, _clock(clock)
+	, _query(new Database::AsyncQuery(this))
+	, _running(false)
+	, _issued(0)
+	, _startedNs(0)
+	, _payload(options.payloadSize, QLatin1Char('x'))
+	, _random(id + 1)
+{
+	// named queries are reported by PoolMetrics
+	_query->setObjectName(QString("soak-%1").arg(id));
+	_query->setMode(mode);
+	if (options.maxQueueDepth > 0) {
+		_query->setMaxQueueDepth(options.maxQueueDepth);
+		_query->setOverflowPolicy(Database::AsyncQuery::Overflow_Reject);
+	}
+	connect(_query, &Database::AsyncQuery::execDone, this, &SoakProducer::onExecDone);
+
+	_timer.setTimerType(Qt::PreciseTimer);
+	_timer.setInterval(10);
+	connect(&_timer, &QTimer::timeout, this, &SoakProducer::onTick);
+}
+
+SoakProducer::~SoakProducer()
+{
+	// tasks in flight call back into the query
+	_query->waitDone();
+}
+
+void SoakProducer::start()
+{
+	_running = true;
+	_issued = 0;
+	_startedNs = _clock.nsecsElapsed();
+	if (_options.rate > 0)
+		_timer.start();
+	else
+		startQuery();
+}
+
+void SoakProducer::stop()
+{
+	_running = false;
+	_timer.stop();
+}
+
+SoakProducer::Stats SoakProducer::takeStats()
+{
+	dropLost();
+	_stats.maxQueueDepth = qMax(_stats.maxQueueDepth, _query->queueDepth());
+	Stats stats = _stats;
+	_stats = Stats();
+	return stats;
+}
+
+void SoakProducer::onTick()
+{
+	double elapsed = (_clock.nsecsElapsed() - _startedNs) / 1e9;
+	qint64 due = qint64(elapsed * _options.rate) - _issued;
+
+	// after a stall of the event loop catch up one second at most
+	qint64 maxBurst = qMax<qint64>(1, qint64(_options.rate));
+	if (due > maxBurst) {
+		_issued += due - maxBurst;
+		due = maxBurst;
+	}
+
+	for (qint64 i = 0; i < due; i++)
+		startQuery();
+}
+
+void SoakProducer::onExecDone(const Database::AsyncQueryResult &result)
+{
+	// SELECTs return the sequence number in their first column, INSERTs as key
+	QVariant tag = result.count() > 0 ? result.value(0, 0) : result.lastInsertId();
+	bool ok = false;
+	qint64 seq = tag.toLongLong(&ok);
+
+	if (ok && _pending.contains(seq)) {
+		complete(seq, result);
+	} else if (!_pending.isEmpty()) {
+		// failed query: exact in Mode_Fifo, the oldest query otherwise
+		if (_mode == Database::AsyncQuery::Mode_Fifo) {
+			complete(_pending.firstKey(), result);
+		} else {
+			_pending.erase(_pending.begin());
+			_stats.completed++;
+			_stats.errors += result.isValid() ? 0 : 1;
+		}
+	} else {
+		_stats.lost++;
+	}
+
+	if (_running && _options.rate <= 0)
+		startQuery();
+}
+
+void SoakProducer::startQuery()
+{
+	qint64 seq = _nextSeq++;
+	std::uniform_real_distribution<double> share(0.0, 1.0);
+
+	if (share(_random) < _options.writeRatio) {
+		_query->prepare(writeQuery);
+		_query->bindValue(":seq", seq);
+		_query->bindValue(":producer", _id);
+		_query->bindValue(":payload", _payload);
+	} else {
+		std::uniform_int_distribution<int> from(0, qMax(0, _options.tableRows - _options.resultRows));
+		_query->prepare(readQuery);
+		_query->bindValue(":seq", seq);
+		_query->bindValue(":from", from(_random));
+		_query->bindValue(":rows", _options.resultRows);
+	}
+
+	_issued++;
+	_stats.started++;
+	_pending.insert(seq, _clock.nsecsElapsed());
+	if (!_query->startExec()) {
+		_pending.remove(seq);
+		_stats.rejected++;
+		return;
+	}
+	_stats.maxQueueDepth = qMax(_stats.maxQueueDepth, _query->queueDepth());
+}
+
+void SoakProducer::complete(qint64 seq, const Database::AsyncQueryResult &result)
+{
+	auto it = _pending.find(seq);
+	if (_mode == Database::AsyncQuery::Mode_SkipPrevious) {
+		// results arrive in start order, older pending queries were overwritten
+		while (_pending.begin() != it) {
+			_pending.erase(_pending.begin());
+			_stats.skipped++;
+		}
+	}
+
+	_stats.latenciesMs.append((_clock.nsecsElapsed() - it.value()) / 1e6);
+	_pending.erase(it);
+	_stats.completed++;
+	if (!result.isValid())
+		_stats.errors++;
+}
+
+void SoakProducer::dropLost()
+{
+	// sequence numbers grow with the start time
+	qint64 limit = _clock.nsecsElapsed() - lostAfterMs * 1000000;
+	while (!_pending.isEmpty() && _pending.first() < limit) {
+		_pending.erase(_pending.begin());
+		_stats.lost++;
+	}
+}
+
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include "SoakOptions.h"
+
+#include <QElapsedTimer>
+#include <QMap>
+#include <QObject>
+#include <QTimer>
+#include <QVector>
+
+#include <random>
+
+namespace Soak {
+
+/**
+ * @brief Starts a mix of SELECTs and INSERTs on one AsyncQuery at a fixed rate.
+ *
+ * @details Each query gets a sequence number: SELECTs return it in their
+ * first column, INSERTs use it as primary key and return it as
+ * AsyncQueryResult::lastInsertId(). This matches every result to its start
+ * time, even with Mode_Parallel where results arrive out of order.
+ * Results of queries which were overwritten by Mode_SkipPrevious never arrive,
+ * they are counted as skipped.
+ *
+ * @note Lives in the main thread, results are delivered there.
+ */
+class SoakProducer : public QObject
+{
+	Q_OBJECT
+
+public:
+	/**
+	 * @brief Counters since the last takeStats().
+	 */
+	struct Stats {
+		qint64 started = 0;
+		qint64 completed = 0;
+		qint64 errors = 0;
+		/** Overwritten by Mode_SkipPrevious. */
+		qint64 skipped = 0;
+		/** Rejected by the queue depth limit. */
+		qint64 rejected = 0;
+		/** No result within lostAfterMs, or a result without sequence number. */
+		qint64 lost = 0;
+		/** Latency from startExec() to execDone() of every completed query. */
+		QVector<double> latenciesMs;
+		int maxQueueDepth = 0;
+	};
+
+	SoakProducer(int id, const SoakOptions &options, Database::AsyncQuery::Mode mode,
+				 const QElapsedTimer &clock, QObject *parent = nullptr);
+	virtual ~SoakProducer();
+
+	void start();
+
+	/**
+	 * @brief Stop starting queries, queries in flight still complete.
+	 */
+	void stop();
+
+	/**
+	 * @brief Queries started and not completed yet.
+	 */
+	int inFlight() const { return _pending.size(); }
+
+	Database::AsyncQuery::Mode mode() const { return _mode; }
+
+	/**
+	 * @brief Returns the counters and resets them.
+	 */
+	Stats takeStats();
+
+	/** Pending queries older than this are counted as lost. */
+	static const qint64 lostAfterMs = 60000;
+
+private slots:
+	void onTick();
+	void onExecDone(const Database::AsyncQueryResult &result);
+
+private:
+	void startQuery();
+	void complete(qint64 seq, const Database::AsyncQueryResult &result);
+	void dropLost();
+
+	static qint64 _nextSeq;
+
+	int _id;
+	SoakOptions _options;
+	Database::AsyncQuery::Mode _mode;
+	const QElapsedTimer &_clock;
+	Database::AsyncQuery *_query;
+	QTimer _timer;
+	bool _running;
+	qint64 _issued;
+	qint64 _startedNs;
+	QString _payload;
+	std::mt19937 _random;
+	/** sequence number -> start time in ns */
+	QMap<qint64, qint64> _pending;
+	Stats _stats;
+};
+
+}
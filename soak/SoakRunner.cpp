@@ -0,0 +1,399 @@
+#include "SoakRunner.h"
+#include "SoakProducer.h"
+#include "ConnectionManager.h"
+
+#include <QDir>
+#include <QFile>
+#include <QJsonDocument>
+#include <QSqlError>
+#include <QSqlQuery>
+#include <QTextStream>
+#include <QThread>
+#include <QThreadPool>
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(Q_OS_LINUX)
+#include <unistd.h>
+#elif defined(Q_OS_DARWIN)
+#include <mach/mach.h>
+#elif defined(Q_OS_WIN)
+#include <windows.h>
+#include <psapi.h>
+#endif
+
+namespace Soak {
+
+namespace {
+
+/** Seconds to wait for queries in flight after the run. */
+const int drainTimeoutSec = 30;
+
+/** Nearest rank percentile of the sorted \p values. */
+double percentile(const QVector<double> &values, double p)
+{
+	if (values.isEmpty())
+		return 0;
+	int rank = int(std::ceil(p * values.size()));
+	return values.at(qBound(0, rank - 1, values.size() - 1));
+}
+
+QString modeName(Database::AsyncQuery::Mode mode)
+{
+	switch (mode) {
+	case Database::AsyncQuery::Mode_Fifo:
+		return "fifo";
+	case Database::AsyncQuery::Mode_SkipPrevious:
+		return "skip";
+	default:
+		return "parallel";
+	}
+}
+
+QString megabytes(qint64 bytes)
+{
+	return bytes < 0 ? QString("n/a") : QString::number(bytes / 1048576.0, 'f', 1) + " MiB";
+}
+
+}
+
+SoakRunner::SoakRunner(const SoakOptions &options, QObject *parent)
+	: QObject(parent)
+	, _options(options)
+	, _lastReportNs(0)
+	, _stopNs(0)
+	, _completed(0)
+	, _errors(0)
+	, _skipped(0)
+	, _rejected(0)
+	, _lost(0)
+	, _connectionsOpened(0)
+	, _firstRss(-1)
+	, _lastRss(-1)
+	, _peakRss(-1)
+	, _reports(0)
+{
+	_reportTimer.setInterval(qMax(1, options.reportSec) * 1000);
+	connect(&_reportTimer, &QTimer::timeout, this, &SoakRunner::report);
+	_drainTimer.setInterval(100);
+	connect(&_drainTimer, &QTimer::timeout, this, &SoakRunner::drain);
+}
+
+SoakRunner::~SoakRunner()
+{
+	qDeleteAll(_producers);
+}
+
+bool SoakRunner::setup(QString *error)
+{
+	Database::ConnectionManager *mgr = Database::ConnectionManager::instance();
+	if (_options.driver == "QSQLITE") {
+		QString name = _options.databaseName.isEmpty()
+				? QDir::temp().filePath("asyncsql_soak.sl3") : _options.databaseName;
+		mgr->setDefaultProfile(Database::ConnectionProfile::sqlite(name,
+				_options.writeRatio > 0 ? Database::ConnectionProfile::Sqlite_WriteHeavy
+										: Database::ConnectionProfile::Sqlite_ReadHeavy));
+	} else {
+		Database::ConnectionProfile profile;
+		profile.type = _options.driver;
+		profile.hostName = _options.hostName;
+		profile.port = _options.port;
+		profile.databaseName = _options.databaseName;
+		profile.userName = _options.userName;
+		profile.password = _options.password;
+		mgr->setDefaultProfile(profile);
+	}
+
+	QThreadPool *pool = QThreadPool::globalInstance();
+	if (_options.expiryMs >= 0)
+		pool->setExpiryTimeout(_options.expiryMs);
+	if (_options.maxThreads > 0)
+		pool->setMaxThreadCount(_options.maxThreads);
+
+	// the tables are created on a connection of the main thread
+	QSqlError sqlError;
+	if (!mgr->open(&sqlError)) {
+		*error = sqlError.text();
+		return false;
+	}
+	bool succ = createTables(error);
+	mgr->closeOne(QThread::currentThread());
+	return succ;
+}
+
+bool SoakRunner::createTables(QString *error)
+{
+	QSqlDatabase db = Database::ConnectionManager::instance()->threadConnection();
+	QSqlQuery query(db);
+
+	const QStringList statements = {
+		"CREATE TABLE IF NOT EXISTS soak_data (id INTEGER PRIMARY KEY, payload TEXT)",
+		// written rows are keyed by sequence number, start empty
+		"DROP TABLE IF EXISTS soak_log",
+		"CREATE TABLE soak_log (id INTEGER PRIMARY KEY, producer INTEGER, payload TEXT)",
+	};
+	for (const QString &statement : statements) {
+		if (!query.exec(statement)) {
+			*error = query.lastError().text();
+			return false;
+		}
+	}
+
+	if (!query.exec("SELECT COALESCE(MAX(id), 0) FROM soak_data") || !query.next()) {
+		*error = query.lastError().text();
+		return false;
+	}
+	int rows = query.value(0).toInt();
+	if (rows >= _options.tableRows)
+		return true;
+
+	QString payload(_options.payloadSize, QLatin1Char('x'));
+	db.transaction();
+	query.prepare("INSERT INTO soak_data (id, payload) VALUES (?, ?)");
+	for (int id = rows + 1; id <= _options.tableRows; id++) {
+		query.addBindValue(id);
+		query.addBindValue(payload);
+		if (!query.exec()) {
+			*error = query.lastError().text();
+			db.rollback();
+			return false;
+		}
+	}
+	if (!db.commit()) {
+		*error = db.lastError().text();
+		return false;
+	}
+	return true;
+}
+
+void SoakRunner::start()
+{
+	_clock.start();
+	_lastReportNs = 0;
+	_connectionsOpened = Database::ConnectionManager::instance()->metrics()->snapshot().connectionsOpened;
+
+	QList<Database::AsyncQuery::Mode> modes = _options.modes;
+	if (modes.isEmpty())
+		modes << Database::AsyncQuery::Mode_Parallel;
+	for (int i = 0; i < _options.producers; i++) {
+		SoakProducer *producer = new SoakProducer(i, _options, modes.at(i % modes.size()), _clock);
+		_producers.append(producer);
+		producer->start();
+	}
+
+	_reportTimer.start();
+	if (_options.durationSec > 0)
+		QTimer::singleShot(_options.durationSec * 1000, this, &SoakRunner::stop);
+}
+
+void SoakRunner::report()
+{
+	SoakProducer::Stats total;
+	int inFlight = 0;
+	for (SoakProducer *producer : _producers) {
+		SoakProducer::Stats stats = producer->takeStats();
+		total.started += stats.started;
+		total.completed += stats.completed;
+		total.errors += stats.errors;
+		total.skipped += stats.skipped;
+		total.rejected += stats.rejected;
+		total.lost += stats.lost;
+		total.latenciesMs += stats.latenciesMs;
+		total.maxQueueDepth = qMax(total.maxQueueDepth, stats.maxQueueDepth);
+		inFlight += producer->inFlight();
+	}
+	std::sort(total.latenciesMs.begin(), total.latenciesMs.end());
+
+	_completed += total.completed;
+	_errors += total.errors;
+	_skipped += total.skipped;
+	_rejected += total.rejected;
+	_lost += total.lost;
+
+	Database::ConnectionManager *mgr = Database::ConnectionManager::instance();
+	Database::PoolMetrics::Snapshot snapshot = mgr->metrics()->snapshot();
+	qint64 opened = snapshot.connectionsOpened - _connectionsOpened;
+	_connectionsOpened = snapshot.connectionsOpened;
+
+	qint64 rss = residentBytes();
+	if (_reports++ == 0)
+		_firstRss = rss;
+	_lastRss = rss;
+	_peakRss = qMax(_peakRss, rss);
+
+	qint64 now = _clock.nsecsElapsed();
+	double seconds = qMax(1e-9, (now - _lastReportNs) / 1e9);
+	_lastReportNs = now;
+
+	QJsonObject report;
+	report["t"] = double(qRound64(now / 1e9));
+	report["qps"] = total.completed / seconds;
+	report["started"] = double(total.started);
+	report["completed"] = double(total.completed);
+	report["errors"] = double(total.errors);
+	report["skipped"] = double(total.skipped);
+	report["rejected"] = double(total.rejected);
+	report["lost"] = double(total.lost);
+	report["p50Ms"] = percentile(total.latenciesMs, 0.50);
+	report["p95Ms"] = percentile(total.latenciesMs, 0.95);
+	report["p99Ms"] = percentile(total.latenciesMs, 0.99);
+	report["maxMs"] = total.latenciesMs.isEmpty() ? 0.0 : total.latenciesMs.last();
+	report["inFlight"] = inFlight;
+	report["maxQueueDepth"] = total.maxQueueDepth;
+	report["queuedQueries"] = snapshot.queuedQueries;
+	report["tasksPending"] = snapshot.tasksPending;
+	report["connections"] = mgr->connectionCount();
+	report["connectionsOpened"] = double(opened);
+	report["connectionFailures"] = double(snapshot.connectionFailures);
+	report["poolActiveThreads"] = snapshot.poolActiveThreads;
+	report["poolMaxThreads"] = snapshot.poolMaxThreads;
+	report["rssBytes"] = double(rss);
+	print(report);
+}
+
+void SoakRunner::stop()
+{
+	for (SoakProducer *producer : _producers)
+		producer->stop();
+	_stopNs = _clock.nsecsElapsed();
+	_drainTimer.start();
+}
+
+void SoakRunner::drain()
+{
+	int inFlight = 0;
+	for (SoakProducer *producer : _producers)
+		inFlight += producer->inFlight();
+
+	if (inFlight > 0 && _clock.nsecsElapsed() - _stopNs < drainTimeoutSec * 1000000000LL)
+		return;
+
+	_drainTimer.stop();
+	_reportTimer.stop();
+	report();
+	printSummary();
+	emit finished();
+}
+
+void SoakRunner::print(const QJsonObject &report)
+{
+	QTextStream out(stdout);
+	if (_options.json) {
+		out << QJsonDocument(report).toJson(QJsonDocument::Compact) << '\n';
+		out.flush();
+		return;
+	}
+
+	out << QString("[%1s] qps %2 | latency ms p50 %3 p95 %4 p99 %5 max %6 | done %7 err %8 "
+				   "skip %9 rej %10 lost %11")
+			.arg(report["t"].toInt(), 6)
+			.arg(report["qps"].toDouble(), 0, 'f', 1)
+			.arg(report["p50Ms"].toDouble(), 0, 'f', 2)
+			.arg(report["p95Ms"].toDouble(), 0, 'f', 2)
+			.arg(report["p99Ms"].toDouble(), 0, 'f', 2)
+			.arg(report["maxMs"].toDouble(), 0, 'f', 2)
+			.arg(report["completed"].toDouble(), 0, 'f', 0)
+			.arg(report["errors"].toDouble(), 0, 'f', 0)
+			.arg(report["skipped"].toDouble(), 0, 'f', 0)
+			.arg(report["rejected"].toDouble(), 0, 'f', 0)
+			.arg(report["lost"].toDouble(), 0, 'f', 0)
+		<< QString(" | inflight %1 queue %2/%3 | conn %4 +%5 | threads %6/%7 | rss %8")
+			.arg(report["inFlight"].toInt())
+			.arg(report["queuedQueries"].toInt())
+			.arg(report["maxQueueDepth"].toInt())
+			.arg(report["connections"].toInt())
+			.arg(report["connectionsOpened"].toDouble(), 0, 'f', 0)
+			.arg(report["poolActiveThreads"].toInt())
+			.arg(report["poolMaxThreads"].toInt())
+			.arg(megabytes(qint64(report["rssBytes"].toDouble())))
+		<< '\n';
+	out.flush();
+}
+
+void SoakRunner::printSummary()
+{
+	double seconds = qMax(1e-9, _clock.nsecsElapsed() / 1e9);
+	qint64 growth = _firstRss >= 0 && _lastRss >= 0 ? _lastRss - _firstRss : -1;
+
+	QStringList modes;
+	for (Database::AsyncQuery::Mode mode : _options.modes)
+		modes << modeName(mode);
+
+	QJsonObject summary;
+	summary["summary"] = true;
+	summary["seconds"] = seconds;
+	summary["producers"] = _options.producers;
+	summary["modes"] = modes.join(',');
+	summary["completed"] = double(_completed);
+	summary["qps"] = _completed / seconds;
+	summary["errors"] = double(_errors);
+	summary["skipped"] = double(_skipped);
+	summary["rejected"] = double(_rejected);
+	summary["lost"] = double(_lost);
+	summary["connectionsOpened"] =
+		double(Database::ConnectionManager::instance()->metrics()->snapshot().connectionsOpened);
+	summary["rssFirstBytes"] = double(_firstRss);
+	summary["rssLastBytes"] = double(_lastRss);
+	summary["rssPeakBytes"] = double(_peakRss);
+	summary["rssGrowthBytes"] = double(growth);
+
+	QTextStream out(stdout);
+	if (_options.json) {
+		out << QJsonDocument(summary).toJson(QJsonDocument::Compact) << '\n';
+		out.flush();
+		return;
+	}
+
+	out << QString("summary: %1 s, %2 producers (%3), %4 queries, %5 qps, %6 errors, "
+				   "%7 skipped, %8 rejected, %9 lost")
+			.arg(seconds, 0, 'f', 0)
+			.arg(_options.producers)
+			.arg(modes.join(','))
+			.arg(_completed)
+			.arg(_completed / seconds, 0, 'f', 1)
+			.arg(_errors)
+			.arg(_skipped)
+			.arg(_rejected)
+			.arg(_lost)
+		<< '\n'
+		<< QString("connections opened %1, rss first %2 last %3 peak %4 growth %5")
+			.arg(summary["connectionsOpened"].toDouble(), 0, 'f', 0)
+			.arg(megabytes(_firstRss))
+			.arg(megabytes(_lastRss))
+			.arg(megabytes(_peakRss))
+			.arg(_firstRss < 0 || _lastRss < 0 ? QString("n/a")
+				 : QString::number(growth / 1048576.0, 'f', 1) + " MiB")
+		<< '\n';
+	out.flush();
+}
+
+qint64 SoakRunner::residentBytes()
+{
+#if defined(Q_OS_LINUX)
+	// statm: size resident shared ... in pages
+	QFile file("/proc/self/statm");
+	if (!file.open(QIODevice::ReadOnly))
+		return -1;
+	QList<QByteArray> fields = file.readAll().split(' ');
+	if (fields.size() < 2)
+		return -1;
+	return fields.at(1).toLongLong() * sysconf(_SC_PAGESIZE);
+#elif defined(Q_OS_DARWIN)
+	mach_task_basic_info_data_t info;
+	mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+	if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO,
+				  reinterpret_cast<task_info_t>(&info), &count) != KERN_SUCCESS)
+		return -1;
+	return qint64(info.resident_size);
+#elif defined(Q_OS_WIN)
+	PROCESS_MEMORY_COUNTERS counters;
+	if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+		return -1;
+	return qint64(counters.WorkingSetSize);
+#else
+	return -1;
+#endif
+}
+
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include "SoakOptions.h"
+
+#include <QElapsedTimer>
+#include <QJsonObject>
+#include <QList>
+#include <QObject>
+#include <QTimer>
+
+namespace Soak {
+
+// class forward decl's
+class SoakProducer;
+
+/**
+ * @brief Runs the producers of a soak test and reports at intervals.
+ *
+ * @details Every report covers the interval since the previous one:
+ * throughput, latency percentiles, skipped, rejected and lost queries,
+ * queue depths, connection count and churn, pool threads and the resident
+ * memory of the process. The summary at the end compares the memory with the
+ * first report, after the pool and the caches are warmed up.
+ */
+class SoakRunner : public QObject
+{
+	Q_OBJECT
+
+public:
+	explicit SoakRunner(const SoakOptions &options, QObject *parent = nullptr);
+	virtual ~SoakRunner();
+
+	/**
+	 * @brief Configure the ConnectionManager and the thread pool and create
+	 * the tables.
+	 * @returns \c false with \p error set if the database can not be set up.
+	 */
+	bool setup(QString *error);
+
+	/**
+	 * @brief Start the producers and the reports.
+	 */
+	void start();
+
+	/**
+	 * @brief Resident set size of the process in bytes, -1 if unknown.
+	 */
+	static qint64 residentBytes();
+
+signals:
+	/**
+	 * @brief Is emitted after the summary.
+	 */
+	void finished();
+
+private slots:
+	void report();
+	void stop();
+	void drain();
+
+private:
+	bool createTables(QString *error);
+	void print(const QJsonObject &report);
+	void printSummary();
+
+	SoakOptions _options;
+	QElapsedTimer _clock;
+	QList<SoakProducer*> _producers;
+	QTimer _reportTimer;
+	QTimer _drainTimer;
+	qint64 _lastReportNs;
+	qint64 _stopNs;
+
+	// totals
+	qint64 _completed;
+	qint64 _errors;
+	qint64 _skipped;
+	qint64 _rejected;
+	qint64 _lost;
+	qint64 _connectionsOpened;
+	qint64 _firstRss;
+	qint64 _lastRss;
+	qint64 _peakRss;
+	int _reports;
+};
+
+}
@@ -0,0 +1,118 @@
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QTextStream>
+
+#include "ConnectionManager.h"
+#include "SoakRunner.h"
+
+namespace {
+
+bool parseModes(const QString &text, QList<Database::AsyncQuery::Mode> *modes)
+{
+	modes->clear();
+	QStringList names = text.split(',');
+	names.removeAll(QString());
+	for (const QString &name : names) {
+		QString mode = name.trimmed().toLower();
+		if (mode == "parallel")
+			modes->append(Database::AsyncQuery::Mode_Parallel);
+		else if (mode == "fifo")
+			modes->append(Database::AsyncQuery::Mode_Fifo);
+		else if (mode == "skip")
+			modes->append(Database::AsyncQuery::Mode_SkipPrevious);
+		else
+			return false;
+	}
+	return !modes->isEmpty();
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+	QCoreApplication a(argc, argv);
+	QCoreApplication::setApplicationName("asyncsql_soak");
+
+	Soak::SoakOptions options;
+
+	QCommandLineParser parser;
+	parser.setApplicationDescription(
+		"Soak and stress test for QtAsyncSql. Runs concurrent AsyncQuery producers "
+		"against a database and reports throughput, latency, connections and memory.");
+	parser.addHelpOption();
+	parser.addOptions({
+		{ "driver", "Qt SQL driver.", "name", options.driver },
+		{ "database", "Database name, a temporary SQLite file by default.", "name" },
+		{ "host", "Database server host.", "host" },
+		{ "port", "Database server port.", "port" },
+		{ "user", "Database user.", "user" },
+		{ "password", "Database password.", "password" },
+		{ "producers", "Concurrent AsyncQuery producers.", "n", QString::number(options.producers) },
+		{ "rate", "Queries per second of each producer, 0 for closed loop.", "qps",
+		  QString::number(options.rate) },
+		{ "write-ratio", "Share of INSERTs, 0..1.", "ratio", QString::number(options.writeRatio) },
+		{ "modes", "Producer modes round robin: parallel, fifo, skip.", "list", "parallel" },
+		{ "rows", "Rows returned by a SELECT.", "n", QString::number(options.resultRows) },
+		{ "table-rows", "Rows of the table read by the SELECTs.", "n",
+		  QString::number(options.tableRows) },
+		{ "payload", "Size of the text column in bytes.", "bytes",
+		  QString::number(options.payloadSize) },
+		{ "max-queue", "Queue depth limit of fifo producers, 0 for unlimited.", "n", "0" },
+		{ "expiry", "QThreadPool expiry timeout in ms.", "ms" },
+		{ "max-threads", "QThreadPool max thread count.", "n" },
+		{ "duration", "Run time in seconds, 0 until killed.", "s",
+		  QString::number(options.durationSec) },
+		{ "interval", "Seconds between reports.", "s", QString::number(options.reportSec) },
+		{ "json", "Write reports as JSON lines." },
+	});
+	parser.process(a);
+
+	options.driver = parser.value("driver");
+	options.databaseName = parser.value("database");
+	options.hostName = parser.value("host");
+	if (parser.isSet("port"))
+		options.port = parser.value("port").toInt();
+	options.userName = parser.value("user");
+	options.password = parser.value("password");
+	options.producers = qMax(1, parser.value("producers").toInt());
+	options.rate = qMax(0.0, parser.value("rate").toDouble());
+	options.writeRatio = qBound(0.0, parser.value("write-ratio").toDouble(), 1.0);
+	options.resultRows = qMax(1, parser.value("rows").toInt());
+	options.tableRows = qMax(0, parser.value("table-rows").toInt());
+	options.payloadSize = qMax(0, parser.value("payload").toInt());
+	options.maxQueueDepth = qMax(0, parser.value("max-queue").toInt());
+	if (parser.isSet("expiry"))
+		options.expiryMs = parser.value("expiry").toInt();
+	if (parser.isSet("max-threads"))
+		options.maxThreads = parser.value("max-threads").toInt();
+	options.durationSec = qMax(0, parser.value("duration").toInt());
+	options.reportSec = qMax(1, parser.value("interval").toInt());
+	options.json = parser.isSet("json");
+
+	QTextStream err(stderr);
+	if (!parseModes(parser.value("modes"), &options.modes)) {
+		err << "invalid --modes: " << parser.value("modes") << '\n';
+		err.flush();
+		return 1;
+	}
+
+	Database::ConnectionManager::createInstance();
+
+	int ret = 1;
+	{
+		Soak::SoakRunner runner(options);
+		QString error;
+		if (runner.setup(&error)) {
+			QObject::connect(&runner, &Soak::SoakRunner::finished, &a, &QCoreApplication::quit);
+			runner.start();
+			ret = a.exec();
+		} else {
+			err << "setup failed: " << error << '\n';
+			err.flush();
+		}
+	}
+
+	Database::ConnectionManager::destroyInstance();
+
+	return ret;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <QSqlError>
+#include <QSqlQuery>
+#include <QStringList>
+#include <QTemporaryDir>
+
+#include "AsyncQuery.h"
+#include "ConnectionManager.h"
+
+namespace TestDatabase {
+
+/**
+ * @brief Point the default profile to a new SQLite file in \p dir and run
+ * \p statements on a connection of the calling thread.
+ * @returns \c false with \p error set if a statement fails.
+ */
+inline bool setup(const QTemporaryDir &dir, const QStringList &statements, QString *error)
+{
+	Database::ConnectionManager *conmgr = Database::ConnectionManager::createInstance();
+	conmgr->setDefaultProfile(Database::ConnectionProfile::sqlite(
+		dir.filePath("test.sl3"), Database::ConnectionProfile::Sqlite_WriteHeavy));
+
+	QSqlError sqlError;
+	if (!conmgr->open(&sqlError)) {
+		*error = sqlError.text();
+		return false;
+	}
+	QSqlQuery query(conmgr->threadConnection());
+	for (const QString &statement : statements) {
+		if (!query.exec(statement)) {
+			*error = statement + ": " + query.lastError().text();
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * @brief Run \p sql with \p query and wait for its result.
+ */
+inline Database::AsyncQueryResult exec(Database::AsyncQuery &query, const QString &sql)
+{
+	query.startExec(sql);
+	query.waitDone();
+	return query.result();
+}
+
+}
@@ -0,0 +1,15 @@
+# Common settings of the unit tests, each tst_*.pro sets TARGET and
+# SOURCES and includes this file.
+
+QT      += testlib sql
+QT      -= gui
+
+CONFIG  += c++11 console testcase
+CONFIG  -= app_bundle
+
+TEMPLATE = app
+
+include($$PWD/../QtAsyncSql.pri)
+INCLUDEPATH += $$PWD
+
+HEADERS += $$PWD/TestDatabase.h
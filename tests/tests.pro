@@ -0,0 +1,29 @@
+#-------------------------------------------------
+#
+# Unit tests, run with "qmake && make check".
+#
+#-------------------------------------------------
+
+TEMPLATE = subdirs
+
+SUBDIRS += \
+	tst_admissioncontrol \
+	tst_asyncpipeline \
+	tst_asyncquery \
+	tst_asyncqueryresult \
+	tst_asyncsession \
+	tst_asyncsortfilter \
+	tst_bulkimport \
+	tst_columnhint \
+	tst_connectionmanager \
+	tst_deliveryqueue \
+	tst_export \
+	tst_memoryreplica \
+	tst_parallelscan \
+	tst_poolmetrics \
+	tst_resultcache \
+	tst_resultoperations \
+	tst_shardedquery \
+	tst_slowquerylog \
+	tst_statementstats \
+	tst_tablenotifications
@@ -0,0 +1,260 @@
+#include <QtTest>
+
+#include "ResultOperations.h"
+#include "TestDatabase.h"
+
+using namespace Database;
+
+class tst_AdmissionControl : public QObject
+{
+	Q_OBJECT
+
+private slots:
+	void initTestCase();
+	void cleanupTestCase();
+	void cleanup();
+
+	void fifoReject();
+	void fifoDropOldest();
+	void fifoBlock();
+	void pendingReject();
+	void pendingDropOldest();
+	void pendingBlock();
+	void helpersNeverBlock();
+
+private:
+	/** Collects the first column of every result, called on the worker threads. */
+	struct Collector {
+		QMutex mutex;
+		QVector<int> values;
+		int rejected = 0;
+
+		void connectTo(AsyncQuery *query)
+		{
+			QObject::connect(query, &AsyncQuery::execDone, query,
+							 [this](const AsyncQueryResult &result) {
+				QMutexLocker locker(&mutex);
+				if (result.isRejected())
+					rejected++;
+				else
+					values.append(result.value(0, 0).toInt());
+			}, Qt::DirectConnection);
+		}
+	};
+
+	static bool waitIdle(AsyncQuery &query, int timeoutMs = 10000);
+
+	QTemporaryDir _dir;
+};
+
+static const ulong delayMs = 200;
+
+void tst_AdmissionControl::initTestCase()
+{
+	QVERIFY(_dir.isValid());
+	QString error;
+	QVERIFY2(TestDatabase::setup(_dir, {}, &error), qPrintable(error));
+}
+
+void tst_AdmissionControl::cleanupTestCase()
+{
+	ConnectionManager::destroyInstance();
+}
+
+void tst_AdmissionControl::cleanup()
+{
+	ConnectionManager *conmgr = ConnectionManager::instance();
+	conmgr->setMaxTasksInFlight(0);
+	conmgr->setMaxTasksPending(0);
+	conmgr->setTaskOverflowPolicy(AsyncQuery::Overflow_Reject);
+	QThreadPool::globalInstance()->waitForDone();
+}
+
+bool tst_AdmissionControl::waitIdle(AsyncQuery &query, int timeoutMs)
+{
+	QElapsedTimer timer;
+	timer.start();
+	while (query.isRunning()) {
+		if (timer.elapsed() > timeoutMs)
+			return false;
+		query.waitDone(50);
+	}
+	return true;
+}
+
+void tst_AdmissionControl::fifoReject()
+{
+	AsyncQuery query;
+	query.setMode(AsyncQuery::Mode_Fifo);
+	query.setDelayMs(delayMs);
+	query.setMaxQueueDepth(2);
+	query.setOverflowPolicy(AsyncQuery::Overflow_Reject);
+	QSignalSpy overflow(&query, &AsyncQuery::queueOverflow);
+	Collector collector;
+	collector.connectTo(&query);
+
+	QVERIFY(query.startExec("SELECT 1"));
+	QVERIFY(query.startExec("SELECT 2"));
+	QVERIFY(query.startExec("SELECT 3"));
+	QCOMPARE(query.queueDepth(), 2);
+	QVERIFY(!query.startExec("SELECT 4"));
+	QCOMPARE(overflow.count(), 1);
+
+	QVERIFY(waitIdle(query));
+	QCOMPARE(collector.values, QVector<int>({ 1, 2, 3 }));
+}
+
+void tst_AdmissionControl::fifoDropOldest()
+{
+	AsyncQuery query;
+	query.setMode(AsyncQuery::Mode_Fifo);
+	query.setDelayMs(delayMs);
+	query.setMaxQueueDepth(1);
+	query.setOverflowPolicy(AsyncQuery::Overflow_DropOldest);
+	Collector collector;
+	collector.connectTo(&query);
+
+	QVERIFY(query.startExec("SELECT 1"));
+	QVERIFY(query.startExec("SELECT 2"));
+	QVERIFY(query.startExec("SELECT 3"));
+	QCOMPARE(query.queueDepth(), 1);
+
+	QVERIFY(waitIdle(query));
+	QCOMPARE(collector.values, QVector<int>({ 1, 3 }));
+}
+
+void tst_AdmissionControl::fifoBlock()
+{
+	AsyncQuery query;
+	query.setMode(AsyncQuery::Mode_Fifo);
+	query.setDelayMs(delayMs);
+	query.setMaxQueueDepth(1);
+	query.setOverflowPolicy(AsyncQuery::Overflow_Block);
+	Collector collector;
+	collector.connectTo(&query);
+
+	QElapsedTimer timer;
+	timer.start();
+	QVERIFY(query.startExec("SELECT 1"));
+	QVERIFY(query.startExec("SELECT 2"));
+	// blocks until the first query finished and the second left the queue
+	QVERIFY(query.startExec("SELECT 3"));
+	QVERIFY(timer.elapsed() >= qint64(delayMs) / 2);
+
+	QVERIFY(waitIdle(query));
+	QCOMPARE(collector.values, QVector<int>({ 1, 2, 3 }));
+}
+
+void tst_AdmissionControl::pendingReject()
+{
+	ConnectionManager *conmgr = ConnectionManager::instance();
+	conmgr->setMaxTasksInFlight(1);
+	conmgr->setMaxTasksPending(1);
+	conmgr->setTaskOverflowPolicy(AsyncQuery::Overflow_Reject);
+
+	AsyncQuery running, pending, rejected;
+	for (AsyncQuery *query : { &running, &pending, &rejected })
+		query->setDelayMs(delayMs);
+
+	QVERIFY(running.startExec("SELECT 1"));
+	QVERIFY(pending.startExec("SELECT 2"));
+	QCOMPARE(conmgr->tasksPending(), 1);
+	QVERIFY(rejected.startExec("SELECT 3"));
+	QCOMPARE(conmgr->tasksPending(), 1);
+
+	QVERIFY(waitIdle(rejected));
+	QVERIFY(rejected.result().isRejected());
+	QVERIFY(waitIdle(running));
+	QVERIFY(waitIdle(pending));
+	QVERIFY(running.result().isValid());
+	QCOMPARE(pending.result().value(0, 0).toInt(), 2);
+}
+
+void tst_AdmissionControl::pendingDropOldest()
+{
+	ConnectionManager *conmgr = ConnectionManager::instance();
+	conmgr->setMaxTasksInFlight(1);
+	conmgr->setMaxTasksPending(1);
+	conmgr->setTaskOverflowPolicy(AsyncQuery::Overflow_DropOldest);
+
+	AsyncQuery running, dropped, newest;
+	for (AsyncQuery *query : { &running, &dropped, &newest })
+		query->setDelayMs(delayMs);
+
+	QVERIFY(running.startExec("SELECT 1"));
+	QVERIFY(dropped.startExec("SELECT 2"));
+	QVERIFY(newest.startExec("SELECT 3"));
+	QCOMPARE(conmgr->tasksPending(), 1);
+
+	QVERIFY(waitIdle(dropped));
+	QVERIFY(dropped.result().isRejected());
+	QVERIFY(waitIdle(running));
+	QVERIFY(waitIdle(newest));
+	QCOMPARE(newest.result().value(0, 0).toInt(), 3);
+}
+
+void tst_AdmissionControl::pendingBlock()
+{
+	ConnectionManager *conmgr = ConnectionManager::instance();
+	conmgr->setMaxTasksInFlight(1);
+	conmgr->setMaxTasksPending(1);
+	conmgr->setTaskOverflowPolicy(AsyncQuery::Overflow_Block);
+
+	AsyncQuery first, second, third;
+	for (AsyncQuery *query : { &first, &second, &third })
+		query->setDelayMs(delayMs);
+
+	QElapsedTimer timer;
+	timer.start();
+	QVERIFY(first.startExec("SELECT 1"));
+	QVERIFY(second.startExec("SELECT 2"));
+	// blocks until the first task finished and the second was admitted
+	QVERIFY(third.startExec("SELECT 3"));
+	QVERIFY(timer.elapsed() >= qint64(delayMs) / 2);
+	QVERIFY(conmgr->tasksPending() <= 1);
+
+	for (AsyncQuery *query : { &first, &second, &third }) {
+		QVERIFY(waitIdle(*query));
+		QVERIFY2(query->result().isValid(), qPrintable(query->result().error().text()));
+	}
+	QCOMPARE(third.result().value(0, 0).toInt(), 3);
+}
+
+void tst_AdmissionControl::helpersNeverBlock()
+{
+	AsyncQuery select;
+	QVERIFY(select.startExec("WITH RECURSIVE s(i) AS (SELECT 0 UNION ALL SELECT i + 1 "
+							 "FROM s WHERE i < 999) SELECT 999 - i FROM s"));
+	QVERIFY(waitIdle(select));
+	AsyncQueryResult result = select.result();
+	QCOMPARE(result.count(), 1000);
+
+	ConnectionManager *conmgr = ConnectionManager::instance();
+	conmgr->setMaxTasksInFlight(1);
+	conmgr->setMaxTasksPending(1);
+	conmgr->setTaskOverflowPolicy(AsyncQuery::Overflow_Block);
+
+	AsyncQuery first, second;
+	first.setDelayMs(delayMs);
+	second.setDelayMs(delayMs);
+	QVERIFY(first.startExec("SELECT 1"));
+	QVERIFY(second.startExec("SELECT 2"));
+
+	// the caller sorts alone instead of waiting for room
+	ResultOperations::setMinChunkRows(16);
+	QElapsedTimer timer;
+	timer.start();
+	QVector<int> rows = ResultOperations::sortRows(result, { { 0, Qt::AscendingOrder } });
+	QVERIFY(timer.elapsed() < qint64(delayMs) / 2);
+	ResultOperations::setMinChunkRows(4096);
+	QCOMPARE(rows.size(), 1000);
+	QCOMPARE(rows.first(), 999);
+	QCOMPARE(rows.last(), 0);
+
+	for (AsyncQuery *query : { &first, &second })
+		QVERIFY(waitIdle(*query));
+}
+
+QTEST_GUILESS_MAIN(tst_AdmissionControl)
+
+#include "tst_admissioncontrol.moc"
@@ -0,0 +1,5 @@
+TARGET 	 = tst_admissioncontrol
+
+include(../tests.pri)
+
+SOURCES += tst_admissioncontrol.cpp
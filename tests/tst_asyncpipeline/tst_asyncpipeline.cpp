@@ -0,0 +1,128 @@
+#include <QtTest>
+
+#include "AsyncPipeline.h"
+#include "TestDatabase.h"
+
+using namespace Database;
+
+class tst_AsyncPipeline : public QObject
+{
+	Q_OBJECT
+
+private slots:
+	void initTestCase();
+	void cleanupTestCase();
+	void init();
+
+	void transaction();
+	void stepAborts();
+	void commitFails();
+
+private:
+	static AsyncQueryResult run(AsyncPipeline &pipeline);
+	static QVariant scalar(const QString &sql);
+
+	QTemporaryDir _dir;
+};
+
+void tst_AsyncPipeline::initTestCase()
+{
+	QVERIFY(_dir.isValid());
+	QString error;
+	QVERIFY2(TestDatabase::setup(_dir, {
+		"CREATE TABLE parent (id INTEGER PRIMARY KEY)",
+		"CREATE TABLE child (id INTEGER PRIMARY KEY, parent INTEGER "
+			"REFERENCES parent(id) DEFERRABLE INITIALLY DEFERRED)",
+	}, &error), qPrintable(error));
+
+	// deferred foreign keys are checked by the commit of the worker connections
+	ConnectionManager::instance()->setInitStatements({ "PRAGMA foreign_keys = ON" });
+}
+
+void tst_AsyncPipeline::cleanupTestCase()
+{
+	ConnectionManager::destroyInstance();
+}
+
+void tst_AsyncPipeline::init()
+{
+	QSqlQuery query(ConnectionManager::instance()->threadConnection());
+	QVERIFY(query.exec("DELETE FROM child"));
+	QVERIFY(query.exec("DELETE FROM parent"));
+}
+
+AsyncQueryResult tst_AsyncPipeline::run(AsyncPipeline &pipeline)
+{
+	// execDone() is emitted on the worker thread, waitDone() orders the access
+	AsyncQueryResult result;
+	QObject::connect(&pipeline, &AsyncPipeline::execDone, &pipeline,
+					 [&result](const AsyncQueryResult &done) {
+		result = done;
+	}, Qt::DirectConnection);
+	if (pipeline.start())
+		pipeline.waitDone();
+	return result;
+}
+
+QVariant tst_AsyncPipeline::scalar(const QString &sql)
+{
+	QSqlQuery query(ConnectionManager::instance()->threadConnection());
+	if (!query.exec(sql) || !query.next())
+		return QVariant();
+	return query.value(0);
+}
+
+void tst_AsyncPipeline::transaction()
+{
+	AsyncPipeline pipeline;
+	pipeline.setTransaction(true);
+	pipeline.addQuery("INSERT INTO parent VALUES (1)");
+	pipeline.addStep([](QSqlQuery &query, const AsyncQueryResult &previous) {
+		query.prepare("INSERT INTO child VALUES (1, :parent)");
+		query.bindValue(":parent", previous.lastInsertId());
+		return query.exec();
+	});
+	pipeline.addQuery("SELECT parent FROM child");
+
+	AsyncQueryResult result = run(pipeline);
+	QVERIFY2(result.isValid(), qPrintable(result.error().text()));
+	QCOMPARE(result.resultSets().size(), 3);
+	QCOMPARE(result.value(0, 0).toInt(), 1);
+	QCOMPARE(scalar("SELECT COUNT(*) FROM child").toInt(), 1);
+}
+
+void tst_AsyncPipeline::stepAborts()
+{
+	AsyncPipeline pipeline;
+	pipeline.setTransaction(true);
+	pipeline.addQuery("INSERT INTO parent VALUES (1)");
+	pipeline.addQuery("INSERT INTO missing VALUES (1)");
+	pipeline.addQuery("INSERT INTO parent VALUES (2)");
+
+	AsyncQueryResult result = run(pipeline);
+	QVERIFY(!result.isValid());
+	QCOMPARE(result.resultSets().size(), 2);
+	QVERIFY(!result.resultSets().last().isValid());
+	QCOMPARE(scalar("SELECT COUNT(*) FROM parent").toInt(), 0);
+}
+
+void tst_AsyncPipeline::commitFails()
+{
+	// every step succeeds, the deferred foreign key fails the commit
+	AsyncPipeline pipeline;
+	pipeline.setTransaction(true);
+	pipeline.addQuery("INSERT INTO child VALUES (1, 42)");
+	pipeline.addQuery("SELECT COUNT(*) FROM child");
+
+	AsyncQueryResult result = run(pipeline);
+	QVERIFY(!result.isValid());
+	QCOMPARE(result.resultSets().size(), 2);
+	QVERIFY(result.resultSets().first().isValid());
+	QVERIFY(!result.resultSets().last().isValid());
+	QCOMPARE(result.resultSets().last().error().text(), result.error().text());
+	QCOMPARE(scalar("SELECT COUNT(*) FROM child").toInt(), 0);
+}
+
+QTEST_GUILESS_MAIN(tst_AsyncPipeline)
+
+#include "tst_asyncpipeline.moc"
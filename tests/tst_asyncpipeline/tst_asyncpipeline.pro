@@ -0,0 +1,5 @@
+TARGET 	 = tst_asyncpipeline
+
+include(../tests.pri)
+
+SOURCES += tst_asyncpipeline.cpp
@@ -0,0 +1,382 @@
+#include <QtTest>
+
+#include "TestDatabase.h"
+
+using namespace Database;
+
+class tst_AsyncQuery : public QObject
+{
+	Q_OBJECT
+
+private slots:
+	void initTestCase();
+	void cleanupTestCase();
+	void init();
+
+	void orderBySelect();
+	void orderByDml();
+	void batchChunks();
+	void batchChunkFails();
+	void batchMultiRowInsert();
+	void batchMultiRowUpsert();
+	void timeoutQueued();
+	void timeoutRunning();
+	void timeoutNotReached();
+	void scriptResultSets();
+	void scriptStopsAtError();
+	void execOnceContext();
+	void execOnceWorker();
+	void execOnceContextDeleted();
+
+private:
+	/** Collects batchProgress(), called on the worker thread. */
+	struct Progress {
+		QVector<QPair<int, int>> steps;
+
+		void connectTo(AsyncQuery *query)
+		{
+			QObject::connect(query, &AsyncQuery::batchProgress, query,
+							 [this](int done, int total) {
+				steps.append(qMakePair(done, total));
+			}, Qt::DirectConnection);
+		}
+	};
+
+	static QVariant scalar(const QString &sql);
+	static bool waitIdle(AsyncQuery &query, int timeoutMs = 10000);
+
+	QTemporaryDir _dir;
+};
+
+void tst_AsyncQuery::initTestCase()
+{
+	QVERIFY(_dir.isValid());
+	QString error;
+	QVERIFY2(TestDatabase::setup(_dir, {
+		"CREATE TABLE item (id INTEGER PRIMARY KEY, name TEXT)",
+	}, &error), qPrintable(error));
+}
+
+void tst_AsyncQuery::cleanupTestCase()
+{
+	ConnectionManager::destroyInstance();
+}
+
+void tst_AsyncQuery::init()
+{
+	QSqlQuery query(ConnectionManager::instance()->threadConnection());
+	QVERIFY(query.exec("DELETE FROM item"));
+}
+
+QVariant tst_AsyncQuery::scalar(const QString &sql)
+{
+	QSqlQuery query(ConnectionManager::instance()->threadConnection());
+	if (!query.exec(sql) || !query.next())
+		return QVariant();
+	return query.value(0);
+}
+
+bool tst_AsyncQuery::waitIdle(AsyncQuery &query, int timeoutMs)
+{
+	QElapsedTimer timer;
+	timer.start();
+	while (query.isRunning()) {
+		if (timer.elapsed() > timeoutMs)
+			return false;
+		query.waitDone(50);
+	}
+	return true;
+}
+
+void tst_AsyncQuery::orderBySelect()
+{
+	QSqlQuery insert(ConnectionManager::instance()->threadConnection());
+	QVERIFY(insert.exec("INSERT INTO item VALUES (1, 'b'), (2, 'c'), (3, 'a')"));
+
+	AsyncQuery query;
+	query.setOrderBy(1, Qt::DescendingOrder);
+	for (const QString &sql : { QString("SELECT id, name FROM item;"),
+			QString("WITH x AS (SELECT id, name FROM item) SELECT * FROM x") }) {
+		AsyncQueryResult result = TestDatabase::exec(query, sql);
+		QVERIFY2(result.isValid(), qPrintable(result.error().text()));
+		QCOMPARE(result.count(), 3);
+		QCOMPARE(result.value(0, 0).toInt(), 2);
+		QCOMPARE(result.value(1, 0).toInt(), 1);
+		QCOMPARE(result.value(2, 0).toInt(), 3);
+	}
+}
+
+void tst_AsyncQuery::orderByDml()
+{
+	// statements without rows are not wrapped into a sub-query
+	AsyncQuery query;
+	query.setOrderBy(0);
+	for (const QString &sql : { QString("INSERT INTO item VALUES (4, 'd')"),
+			QString("UPDATE item SET name = 'e' WHERE id = 4"),
+			QString("WITH x(id) AS (SELECT 4) DELETE FROM item WHERE id IN x") }) {
+		AsyncQueryResult result = TestDatabase::exec(query, sql);
+		QVERIFY2(result.isValid(), qPrintable(sql + ": " + result.error().text()));
+		QCOMPARE(result.numRowsAffected(), 1);
+	}
+	QCOMPARE(scalar("SELECT COUNT(*) FROM item").toInt(), 0);
+}
+
+void tst_AsyncQuery::batchChunks()
+{
+	QVariantList ids, names;
+	for (int i = 0; i < 10; i++) {
+		ids << i;
+		names << QString("name%1").arg(i);
+	}
+
+	AsyncQuery query;
+	Progress progress;
+	progress.connectTo(&query);
+	query.setBatchChunkSize(4);
+	query.prepare("INSERT INTO item VALUES (:id, :name)");
+	QVERIFY(query.bindBatchValue(":id", ids));
+	QVERIFY(query.bindBatchValue(":name", names));
+	QVERIFY(query.startExec());
+	QVERIFY(query.waitDone());
+
+	AsyncQueryResult result = query.result();
+	QVERIFY2(result.isValid(), qPrintable(result.error().text()));
+	QCOMPARE(result.numRowsAffected(), 10);
+	QCOMPARE(progress.steps, (QVector<QPair<int, int>>({ { 4, 10 }, { 8, 10 }, { 10, 10 } })));
+	QCOMPARE(scalar("SELECT COUNT(*) FROM item").toInt(), 10);
+}
+
+void tst_AsyncQuery::batchChunkFails()
+{
+	// the duplicate key in the second chunk rolls it back and stops the batch
+	QVariantList ids({ 1, 2, 3, 4, 5, 6, 5, 8, 9, 10 });
+	QVariantList names;
+	for (int i = 0; i < ids.size(); i++)
+		names << QString("name%1").arg(i);
+
+	AsyncQuery query;
+	Progress progress;
+	progress.connectTo(&query);
+	query.setBatchChunkSize(4);
+	query.prepare("INSERT INTO item VALUES (:id, :name)");
+	QVERIFY(query.bindBatchValue(":id", ids));
+	QVERIFY(query.bindBatchValue(":name", names));
+	QVERIFY(query.startExec());
+	QVERIFY(query.waitDone());
+
+	AsyncQueryResult result = query.result();
+	QVERIFY(!result.isValid());
+	QCOMPARE(result.numRowsAffected(), 4);
+	QCOMPARE(progress.steps, (QVector<QPair<int, int>>({ { 4, 10 } })));
+	QCOMPARE(scalar("SELECT COUNT(*) FROM item").toInt(), 4);
+	QCOMPARE(scalar("SELECT MAX(id) FROM item").toInt(), 4);
+}
+
+void tst_AsyncQuery::batchMultiRowInsert()
+{
+	const int rows = 1000;
+	QVariantList ids, names;
+	for (int i = 0; i < rows; i++) {
+		ids << i;
+		names << QString("name%1").arg(i);
+	}
+
+	AsyncQuery query;
+	Progress progress;
+	progress.connectTo(&query);
+	query.setBatchChunkSize(300);
+	query.setBatchMultiRowInsert(true);
+	query.prepare("INSERT INTO item (id, name) VALUES (:id, :name)");
+	QVERIFY(query.bindBatchValue(":id", ids));
+	QVERIFY(query.bindBatchValue(":name", names));
+	QVERIFY(query.startExec());
+	QVERIFY(query.waitDone());
+
+	AsyncQueryResult result = query.result();
+	QVERIFY2(result.isValid(), qPrintable(result.error().text()));
+	QCOMPARE(result.numRowsAffected(), rows);
+	QCOMPARE(progress.steps.size(), 4);
+	QCOMPARE(progress.steps.last(), qMakePair(rows, rows));
+	QCOMPARE(scalar("SELECT COUNT(*) FROM item").toInt(), rows);
+	QCOMPARE(scalar("SELECT name FROM item WHERE id = 999").toString(), QString("name999"));
+}
+
+void tst_AsyncQuery::batchMultiRowUpsert()
+{
+	QSqlQuery insert(ConnectionManager::instance()->threadConnection());
+	QVERIFY(insert.exec("INSERT INTO item VALUES (1, 'old'), (2, 'old')"));
+
+	// the clause after the tuple is not rewritten, the batch runs row by row
+	QVariantList ids({ 1, 2, 3 });
+	QVariantList names({ "one", "two", "three" });
+	AsyncQuery query;
+	query.setBatchChunkSize(2);
+	query.setBatchMultiRowInsert(true);
+	query.prepare("INSERT INTO item (id, name) VALUES (:id, (:name)) "
+				  "ON CONFLICT(id) DO UPDATE SET name = trim(excluded.name)");
+	QVERIFY(query.bindBatchValue(":id", ids));
+	QVERIFY(query.bindBatchValue(":name", names));
+	QVERIFY(query.startExec());
+	QVERIFY(query.waitDone());
+
+	AsyncQueryResult result = query.result();
+	QVERIFY2(result.isValid(), qPrintable(result.error().text()));
+	QCOMPARE(result.numRowsAffected(), 3);
+	QCOMPARE(scalar("SELECT COUNT(*) FROM item").toInt(), 3);
+	QCOMPARE(scalar("SELECT name FROM item WHERE id = 1").toString(), QString("one"));
+	QCOMPARE(scalar("SELECT name FROM item WHERE id = 3").toString(), QString("three"));
+}
+
+void tst_AsyncQuery::timeoutQueued()
+{
+	AsyncQuery query;
+	query.setMode(AsyncQuery::Mode_Fifo);
+	query.setDelayMs(300);
+	query.setTimeout(100);
+	QVector<AsyncQueryResult> results;
+	connect(&query, &AsyncQuery::execDone, &query, [&results](const AsyncQueryResult &result) {
+		results.append(result);
+	}, Qt::DirectConnection);
+
+	// the second query waits behind the delayed first one past its deadline
+	QVERIFY(query.startExec("SELECT 1"));
+	QVERIFY(query.startExec("SELECT 2"));
+	QVERIFY(waitIdle(query));
+
+	QCOMPARE(results.size(), 2);
+	QVERIFY(results.at(1).isTimeout());
+	QVERIFY(!results.at(1).isValid());
+	QCOMPARE(results.at(1).count(), 0);
+}
+
+void tst_AsyncQuery::timeoutRunning()
+{
+#ifdef ASYNCSQL_SQLITE_API
+	AsyncQuery query;
+	query.setTimeout(200);
+	QElapsedTimer timer;
+	timer.start();
+	QVERIFY(query.startExec("WITH RECURSIVE c(i) AS (SELECT 1 UNION ALL SELECT i + 1 FROM c "
+							"WHERE i < 1000000000) SELECT COUNT(*) FROM c"));
+	QVERIFY(query.waitDone(10000));
+
+	// interrupted by the progress handler instead of counting to the end
+	QVERIFY(query.result().isTimeout());
+	QVERIFY(timer.elapsed() < 5000);
+#else
+	QSKIP("requires CONFIG += asyncsql_sqlite");
+#endif
+}
+
+void tst_AsyncQuery::timeoutNotReached()
+{
+	AsyncQuery query;
+	query.setTimeout(5000);
+	AsyncQueryResult result = TestDatabase::exec(query, "SELECT 42");
+	QVERIFY2(result.isValid(), qPrintable(result.error().text()));
+	QVERIFY(!result.isTimeout());
+	QCOMPARE(result.value(0, 0).toInt(), 42);
+}
+
+void tst_AsyncQuery::scriptResultSets()
+{
+	AsyncQuery query;
+	// comments separate tokens, trigger bodies are not split
+	QVERIFY(query.startExecScript(
+		"INSERT INTO item VALUES (1, 'a;b');\n"
+		"SELECT/* not; a statement */name FROM item WHERE id = 1;\n"
+		"-- nor; this\n"
+		"SELECT COUNT(*)-- counted\n"
+		"FROM item;\n"
+		"CREATE TABLE log (name TEXT);\n"
+		"CREATE TRIGGER item_log AFTER INSERT ON item BEGIN\n"
+		"  INSERT INTO log VALUES (CASE WHEN new.name IS NULL THEN '-' ELSE new.name END);\n"
+		"  INSERT INTO log VALUES ('done');\n"
+		"END;\n"
+		"INSERT INTO item VALUES (2, NULL);\n"
+		"SELECT group_concat(name) FROM log;\n"
+		"DROP TRIGGER item_log;\n"
+		"DROP TABLE log"));
+	QVERIFY(query.waitDone());
+
+	AsyncQueryResult result = query.result();
+	QVERIFY2(result.isValid(), qPrintable(result.error().text()));
+	QCOMPARE(result.resultSets().size(), 9);
+	// the result itself is the first result set
+	QCOMPARE(result.numRowsAffected(), 1);
+	QCOMPARE(result.resultSets().at(0).numRowsAffected(), 1);
+	QCOMPARE(result.resultSets().at(1).value(0, 0).toString(), QString("a;b"));
+	QCOMPARE(result.resultSets().at(2).value(0, 0).toInt(), 1);
+	QCOMPARE(result.resultSets().at(6).value(0, 0).toString(), QString("-,done"));
+}
+
+void tst_AsyncQuery::scriptStopsAtError()
+{
+	AsyncQuery query;
+	QVERIFY(query.startExecScript(
+		"INSERT INTO item VALUES (2, 'x'); "
+		"INSERT INTO missing VALUES (1); "
+		"INSERT INTO item VALUES (3, 'y')"));
+	QVERIFY(query.waitDone());
+
+	// no implicit transaction, the statement before the error stays
+	AsyncQueryResult result = query.result();
+	QVERIFY(!result.isValid());
+	QCOMPARE(result.resultSets().size(), 2);
+	QVERIFY(result.resultSets().at(0).isValid());
+	QVERIFY(!result.resultSets().at(1).isValid());
+	QCOMPARE(scalar("SELECT COUNT(*) FROM item WHERE id = 2").toInt(), 1);
+	QCOMPARE(scalar("SELECT COUNT(*) FROM item WHERE id = 3").toInt(), 0);
+}
+
+void tst_AsyncQuery::execOnceContext()
+{
+	// delivered in the thread of the context by its event loop
+	QObject context;
+	QThread *handlerThread = nullptr;
+	int value = 0;
+	AsyncQuery::startExecOnce("SELECT 42", &context,
+							  [&handlerThread, &value](const AsyncQueryResult &result) {
+		handlerThread = QThread::currentThread();
+		value = result.value(0, 0).toInt();
+	});
+	QCOMPARE(value, 0);
+	QTRY_COMPARE(value, 42);
+	QCOMPARE(handlerThread, QThread::currentThread());
+}
+
+void tst_AsyncQuery::execOnceWorker()
+{
+	// without a context the handler runs on the worker thread
+	QMutex mutex;
+	QThread *handlerThread = nullptr;
+	int value = 0;
+	AsyncQuery::startExecOnce("SELECT 7", [&](const AsyncQueryResult &result) {
+		QMutexLocker locker(&mutex);
+		handlerThread = QThread::currentThread();
+		value = result.value(0, 0).toInt();
+	});
+	QThreadPool::globalInstance()->waitForDone();
+
+	QMutexLocker locker(&mutex);
+	QCOMPARE(value, 7);
+	QVERIFY(handlerThread != QThread::currentThread());
+}
+
+void tst_AsyncQuery::execOnceContextDeleted()
+{
+	int calls = 0;
+	QObject *context = new QObject;
+	AsyncQuery::startExecOnce("SELECT 1", context, [&calls](const AsyncQueryResult &) {
+		calls++;
+	});
+	// the delivery waits for this thread's event loop, the context is gone then
+	delete context;
+	QThreadPool::globalInstance()->waitForDone();
+	QTest::qWait(100);
+	QCOMPARE(calls, 0);
+}
+
+QTEST_GUILESS_MAIN(tst_AsyncQuery)
+
+#include "tst_asyncquery.moc"
@@ -0,0 +1,5 @@
+TARGET 	 = tst_asyncquery
+
+include(../tests.pri)
+
+SOURCES += tst_asyncquery.cpp
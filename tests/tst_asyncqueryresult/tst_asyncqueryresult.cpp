@@ -0,0 +1,317 @@
+#include <QtTest>
+
+#include "TestDatabase.h"
+
+using namespace Database;
+
+class tst_AsyncQueryResult : public QObject
+{
+	Q_OBJECT
+
+private slots:
+	void initTestCase();
+	void cleanupTestCase();
+
+	void binaryRoundTrip();
+	void binaryResultSets();
+	void binaryDisplayStrings();
+	void binaryTruncated();
+	void binaryOversizedCounts();
+	void binaryEmptyValues();
+	void binaryTypedNull();
+	void isIntegral();
+	void columnLookup();
+	void rowView();
+	void rowCursor();
+
+private:
+	static void compareResults(const AsyncQueryResult &actual, const AsyncQueryResult &expected);
+
+	QTemporaryDir _dir;
+};
+
+void tst_AsyncQueryResult::initTestCase()
+{
+	QVERIFY(_dir.isValid());
+	QString error;
+	QVERIFY2(TestDatabase::setup(_dir, {
+		"CREATE TABLE item (id INTEGER PRIMARY KEY, name TEXT, price REAL, data BLOB)",
+		"INSERT INTO item VALUES (1, 'one', 1.5, x'0102')",
+		"INSERT INTO item VALUES (2, NULL, 2.25, NULL)",
+		"INSERT INTO item VALUES (9007199254740993, 'big', NULL, x'')",
+	}, &error), qPrintable(error));
+}
+
+void tst_AsyncQueryResult::cleanupTestCase()
+{
+	ConnectionManager::destroyInstance();
+}
+
+void tst_AsyncQueryResult::compareResults(const AsyncQueryResult &actual,
+										  const AsyncQueryResult &expected)
+{
+	QCOMPARE(actual.isValid(), expected.isValid());
+	QCOMPARE(actual.count(), expected.count());
+	QCOMPARE(actual.headRecord().count(), expected.headRecord().count());
+	for (int col = 0; col < expected.headRecord().count(); col++)
+		QCOMPARE(actual.headRecord().fieldName(col), expected.headRecord().fieldName(col));
+	for (int row = 0; row < expected.count(); row++) {
+		for (int col = 0; col < expected.headRecord().count(); col++)
+			QCOMPARE(actual.value(row, col), expected.value(row, col));
+	}
+}
+
+void tst_AsyncQueryResult::binaryRoundTrip()
+{
+	AsyncQuery query;
+	AsyncQueryResult result = TestDatabase::exec(query,
+		"SELECT id, name, price, data FROM item ORDER BY id");
+	QVERIFY2(result.isValid(), qPrintable(result.error().text()));
+	QCOMPARE(result.count(), 3);
+
+	bool ok = false;
+	AsyncQueryResult copy = AsyncQueryResult::fromBinary(result.toBinary(), &ok);
+	QVERIFY(ok);
+	compareResults(copy, result);
+	QCOMPARE(copy.value(2, 0).toLongLong(), Q_INT64_C(9007199254740993));
+}
+
+void tst_AsyncQueryResult::binaryResultSets()
+{
+	AsyncQuery query;
+	QVERIFY(query.startExecScript("SELECT id FROM item ORDER BY id; SELECT name FROM item"));
+	QVERIFY(query.waitDone());
+	AsyncQueryResult result = query.result();
+	QVERIFY2(result.isValid(), qPrintable(result.error().text()));
+	QCOMPARE(result.resultSets().size(), 2);
+
+	bool ok = false;
+	AsyncQueryResult copy = AsyncQueryResult::fromBinary(result.toBinary(), &ok);
+	QVERIFY(ok);
+	QCOMPARE(copy.resultSets().size(), 2);
+	for (int i = 0; i < 2; i++)
+		compareResults(copy.resultSets().at(i), result.resultSets().at(i));
+}
+
+void tst_AsyncQueryResult::binaryDisplayStrings()
+{
+	AsyncQuery query;
+	query.setColumnHint("price", ColumnHint::decimal(2));
+	query.setDisplayStrings(true);
+	AsyncQueryResult result = TestDatabase::exec(query, "SELECT id, price FROM item ORDER BY id");
+	QVERIFY2(result.isValid(), qPrintable(result.error().text()));
+	QVERIFY(result.hasDisplayStrings());
+
+	bool ok = false;
+	AsyncQueryResult copy = AsyncQueryResult::fromBinary(result.toBinary(), &ok);
+	QVERIFY(ok);
+	QVERIFY(copy.hasDisplayStrings());
+	for (int row = 0; row < result.count(); row++) {
+		for (int col = 0; col < 2; col++)
+			QCOMPARE(copy.displayString(row, col), result.displayString(row, col));
+	}
+}
+
+void tst_AsyncQueryResult::binaryTruncated()
+{
+	AsyncQuery query;
+	AsyncQueryResult result = TestDatabase::exec(query, "SELECT id, name FROM item");
+	QByteArray data = result.toBinary();
+
+	for (int size : { 0, 4, 8, data.size() / 2, data.size() - 1 }) {
+		bool ok = true;
+		AsyncQueryResult::fromBinary(data.left(size), &ok);
+		QVERIFY2(!ok, qPrintable(QString("accepted %1 of %2 bytes").arg(size).arg(data.size())));
+	}
+}
+
+void tst_AsyncQueryResult::binaryOversizedCounts()
+{
+	const quint32 magic = 0x41515253;
+	const quint32 version = 2;
+
+	// column count larger than the data
+	{
+		QByteArray data;
+		QDataStream out(&data, QIODevice::WriteOnly);
+		out.setVersion(QDataStream::Qt_5_5);
+		out << magic << version << qint32(0x7fffffff);
+		bool ok = true;
+		AsyncQueryResult::fromBinary(data, &ok);
+		QVERIFY(!ok);
+	}
+
+	// row count larger than the data, must fail before allocating the rows
+	{
+		QByteArray data;
+		QDataStream out(&data, QIODevice::WriteOnly);
+		out.setVersion(QDataStream::Qt_5_5);
+		out << magic << version << qint32(0);
+		out << QString() << QString() << qint32(QSqlError::NoError) << QString();
+		out << QVariant() << QString() << qint32(0);
+		out << qint32(0x7fffffff);
+		bool ok = true;
+		AsyncQueryResult::fromBinary(data, &ok);
+		QVERIFY(!ok);
+	}
+
+	// negative column count
+	{
+		QByteArray data;
+		QDataStream out(&data, QIODevice::WriteOnly);
+		out.setVersion(QDataStream::Qt_5_5);
+		out << magic << version << qint32(-1);
+		bool ok = true;
+		AsyncQueryResult::fromBinary(data, &ok);
+		QVERIFY(!ok);
+	}
+}
+
+void tst_AsyncQueryResult::binaryEmptyValues()
+{
+	AsyncQuery query;
+	AsyncQueryResult result = TestDatabase::exec(query, "SELECT '', x'', NULL");
+	QVERIFY2(result.isValid(), qPrintable(result.error().text()));
+
+	// empty text and blob are not NULL, also after a round trip
+	bool ok = false;
+	AsyncQueryResult copy = AsyncQueryResult::fromBinary(result.toBinary(), &ok);
+	QVERIFY(ok);
+	for (const AsyncQueryResult &res : { result, copy }) {
+		QVERIFY(res.value(0, 0).isValid());
+		QVERIFY(!res.value(0, 0).isNull());
+		QCOMPARE(res.value(0, 0).toString(), QString());
+		QVERIFY(res.value(0, 1).isValid());
+		QVERIFY(!res.value(0, 1).isNull());
+		QVERIFY(res.value(0, 1).toByteArray().isEmpty());
+		QVERIFY(!res.value(0, 2).isValid());
+	}
+}
+
+void tst_AsyncQueryResult::binaryTypedNull()
+{
+	// one mixed column holding a typed null string and a text
+	QByteArray data;
+	QDataStream out(&data, QIODevice::WriteOnly);
+	out.setVersion(QDataStream::Qt_5_5);
+	out << quint32(0x41515253) << quint32(2) << qint32(1);
+	out << QString("v") << QString() << qint32(QVariant::String) << qint32(-1)
+		<< qint32(-1) << qint32(-1) << QVariant() << false << false << true;
+	out << QString() << QString() << qint32(QSqlError::NoError) << QString();
+	out << QVariant() << QString() << qint32(0);
+	out << qint32(2);
+	out << quint8(5) << qint32(QVariant::String) << QByteArray(1, '\0')
+		<< QVariant(QVariant::String) << QVariant(QString("x"));
+	out << qint32(0) << false;
+
+	bool ok = false;
+	AsyncQueryResult result = AsyncQueryResult::fromBinary(data, &ok);
+	QVERIFY(ok);
+	QVERIFY(result.value(0, 0).isValid());
+	QVERIFY(result.value(0, 0).isNull());
+
+	AsyncQueryResult copy = AsyncQueryResult::fromBinary(result.toBinary(), &ok);
+	QVERIFY(ok);
+	QVERIFY(!copy.value(0, 0).isValid());
+	QCOMPARE(copy.value(1, 0).toString(), QString("x"));
+}
+
+void tst_AsyncQueryResult::isIntegral()
+{
+	QVERIFY(AsyncQueryResult::isIntegral(QVariant(true)));
+	QVERIFY(AsyncQueryResult::isIntegral(QVariant(int(-1))));
+	QVERIFY(AsyncQueryResult::isIntegral(QVariant(uint(1))));
+	QVERIFY(AsyncQueryResult::isIntegral(QVariant(qlonglong(-1))));
+	QVERIFY(AsyncQueryResult::isIntegral(QVariant(qulonglong(1))));
+	QVERIFY(!AsyncQueryResult::isIntegral(QVariant(1.0)));
+	QVERIFY(!AsyncQueryResult::isIntegral(QVariant("1")));
+	QVERIFY(!AsyncQueryResult::isIntegral(QVariant()));
+}
+
+void tst_AsyncQueryResult::columnLookup()
+{
+	AsyncQuery query;
+	AsyncQueryResult result = TestDatabase::exec(query, "SELECT id, name AS Name, price, "
+														"name AS name FROM item ORDER BY id");
+	QVERIFY2(result.isValid(), qPrintable(result.error().text()));
+
+	// case insensitive, the first match wins
+	QCOMPARE(result.columnIndex("id"), 0);
+	QCOMPARE(result.columnIndex("Name"), 1);
+	QCOMPARE(result.columnIndex("name"), 1);
+	QCOMPARE(result.columnIndex("PRICE"), 2);
+	QCOMPARE(result.columnIndex("missing"), -1);
+	QCOMPARE(result.columnIndex("Name"), result.headRecord().indexOf("Name"));
+
+	AsyncQueryResult::Column price = result.column("Price");
+	QVERIFY(price.isValid());
+	QCOMPARE(price.index(), 2);
+	QCOMPARE(result.value(1, price).toDouble(), 2.25);
+	QCOMPARE(result.value(0, "NAME").toString(), QString("one"));
+	QVERIFY(!result.column("missing").isValid());
+	QVERIFY(!result.value(0, result.column("missing")).isValid());
+}
+
+void tst_AsyncQueryResult::rowView()
+{
+	AsyncQuery query;
+	AsyncQueryResult result = TestDatabase::exec(query, "SELECT id, name, price FROM item ORDER BY id");
+	QVERIFY2(result.isValid(), qPrintable(result.error().text()));
+
+	AsyncQueryRow row = result.row(0);
+	QVERIFY(row.isValid());
+	QCOMPARE(row.row(), 0);
+	QCOMPARE(row.count(), 3);
+	QCOMPARE(row.toInt(0), 1);
+	QCOMPARE(row.toString(result.column("name")), QString("one"));
+	QCOMPARE(row.toDouble(2), 1.5);
+	QCOMPARE(row.value("PRICE").toDouble(), 1.5);
+
+	// invalid columns read as NULL
+	QVERIFY(row.isNull(3));
+	QVERIFY(row.isNull(-1));
+	QVERIFY(row.isNull(result.column("missing")));
+	QVERIFY(!row.value("missing").isValid());
+
+	row = result.row(2);
+	QCOMPARE(row.toLongLong(0), Q_INT64_C(9007199254740993));
+	QVERIFY(row.isNull(2));
+#if QT_VERSION >= QT_VERSION_CHECK(5,10,0)
+	QCOMPARE(row.toStringView(1).toString(), QString("big"));
+	// no view of numbers
+	QVERIFY(row.toStringView(0).isEmpty());
+#endif
+
+	QVERIFY(!result.row(3).isValid());
+	QVERIFY(!result.row(-1).isValid());
+	QVERIFY(!AsyncQueryRow().isValid());
+	QVERIFY(AsyncQueryRow().isNull(0));
+}
+
+void tst_AsyncQueryResult::rowCursor()
+{
+	AsyncQuery query;
+	AsyncQueryResult result = TestDatabase::exec(query, "SELECT id, name FROM item ORDER BY id");
+	QVERIFY2(result.isValid(), qPrintable(result.error().text()));
+
+	AsyncQueryResult::Column name = result.column("name");
+	AsyncQueryRow row = result.rows();
+	QVERIFY(!row.isValid());
+	QStringList names;
+	while (row.next())
+		names << (row.isNull(name) ? QString("-") : row.toString(name));
+	QCOMPARE(names, QStringList({ "one", "-", "big" }));
+
+	// stays after the last row
+	QVERIFY(!row.isValid());
+	QVERIFY(!row.next());
+	QCOMPARE(row.row(), 3);
+
+	AsyncQueryResult empty = TestDatabase::exec(query, "SELECT id FROM item WHERE id < 0");
+	QVERIFY(!empty.rows().next());
+	QVERIFY(!AsyncQueryRow().next());
+}
+
+QTEST_GUILESS_MAIN(tst_AsyncQueryResult)
+
+#include "tst_asyncqueryresult.moc"
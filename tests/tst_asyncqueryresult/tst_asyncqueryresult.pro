@@ -0,0 +1,5 @@
+TARGET 	 = tst_asyncqueryresult
+
+include(../tests.pri)
+
+SOURCES += tst_asyncqueryresult.cpp
@@ -0,0 +1,79 @@
+#include <QtTest>
+
+#include "AsyncSession.h"
+#include "TestDatabase.h"
+
+using namespace Database;
+
+class tst_AsyncSession : public QObject
+{
+	Q_OBJECT
+
+private slots:
+	void initTestCase();
+	void cleanupTestCase();
+
+	void keepsState();
+	void closeNamedProfile();
+
+private:
+	QTemporaryDir _dir;
+};
+
+void tst_AsyncSession::initTestCase()
+{
+	QVERIFY(_dir.isValid());
+	QString error;
+	QVERIFY2(TestDatabase::setup(_dir, {
+		"CREATE TABLE item (id INTEGER PRIMARY KEY)",
+	}, &error), qPrintable(error));
+
+	ConnectionManager::instance()->addProfile("second", ConnectionProfile::sqlite(
+		_dir.filePath("second.sl3"), ConnectionProfile::Sqlite_WriteHeavy));
+}
+
+void tst_AsyncSession::cleanupTestCase()
+{
+	ConnectionManager::destroyInstance();
+}
+
+void tst_AsyncSession::keepsState()
+{
+	AsyncSession session;
+	AsyncQuery query;
+	query.setSession(&session);
+
+	AsyncQueryResult result = TestDatabase::exec(query, "CREATE TEMP TABLE scratch (x)");
+	QVERIFY2(result.isValid(), qPrintable(result.error().text()));
+	result = TestDatabase::exec(query, "SELECT COUNT(*) FROM temp.scratch");
+	QVERIFY2(result.isValid(), qPrintable(result.error().text()));
+
+	// close() discards the connection and its temporary table
+	session.close();
+	result = TestDatabase::exec(query, "SELECT COUNT(*) FROM temp.scratch");
+	QVERIFY(!result.isValid());
+}
+
+void tst_AsyncSession::closeNamedProfile()
+{
+	ConnectionManager *conmgr = ConnectionManager::instance();
+	AsyncSession session;
+	AsyncQuery query;
+	query.setSession(&session);
+	query.setConnectionProfile("second");
+
+	int before = conmgr->connectionCount();
+	AsyncQueryResult result = TestDatabase::exec(query, "CREATE TEMP TABLE scratch (x)");
+	QVERIFY2(result.isValid(), qPrintable(result.error().text()));
+	QCOMPARE(conmgr->connectionCount(), before + 1);
+
+	// the session thread has no connection of the default profile
+	session.close();
+	QCOMPARE(conmgr->connectionCount(), before);
+	result = TestDatabase::exec(query, "SELECT COUNT(*) FROM temp.scratch");
+	QVERIFY(!result.isValid());
+}
+
+QTEST_GUILESS_MAIN(tst_AsyncSession)
+
+#include "tst_asyncsession.moc"
@@ -0,0 +1,5 @@
+TARGET 	 = tst_asyncsession
+
+include(../tests.pri)
+
+SOURCES += tst_asyncsession.cpp
@@ -0,0 +1,148 @@
+#include <QtTest>
+
+#include "AsyncSortFilter.h"
+#include "ResultOperations.h"
+#include "TestDatabase.h"
+
+using namespace Database;
+
+class tst_AsyncSortFilter : public QObject
+{
+	Q_OBJECT
+
+private slots:
+	void initTestCase();
+	void cleanupTestCase();
+
+	void sortParallel();
+	void filterAndSort();
+	void newerStartWins();
+	void deleteWhileRunning();
+
+private:
+	/** Collects finished(), called on a worker thread. */
+	struct Collector {
+		QMutex mutex;
+		QVector<QVector<int>> rows;
+
+		void connectTo(AsyncSortFilter *sortFilter)
+		{
+			QObject::connect(sortFilter, &AsyncSortFilter::finished, sortFilter,
+							 [this](const AsyncQueryResult &, const QVector<int> &order) {
+				QMutexLocker locker(&mutex);
+				rows.append(order);
+			}, Qt::DirectConnection);
+		}
+
+		int count()
+		{
+			QMutexLocker locker(&mutex);
+			return rows.size();
+		}
+
+		QVector<int> last()
+		{
+			QMutexLocker locker(&mutex);
+			return rows.last();
+		}
+	};
+
+	QTemporaryDir _dir;
+	AsyncQueryResult _result;
+};
+
+static const int rowCount = 5000;
+
+void tst_AsyncSortFilter::initTestCase()
+{
+	QVERIFY(_dir.isValid());
+	QString error;
+	// names are a permutation of n00000..n04999
+	QVERIFY2(TestDatabase::setup(_dir, {
+		"CREATE TABLE item (id INTEGER PRIMARY KEY, name TEXT)",
+		"WITH RECURSIVE s(i) AS (SELECT 0 UNION ALL SELECT i + 1 FROM s WHERE i < 4999) "
+			"INSERT INTO item SELECT i, printf('n%05d', (i * 7919) % 5000) FROM s",
+	}, &error), qPrintable(error));
+
+	AsyncQuery query;
+	_result = TestDatabase::exec(query, "SELECT id, name FROM item ORDER BY id");
+	QVERIFY2(_result.isValid(), qPrintable(_result.error().text()));
+	QCOMPARE(_result.count(), rowCount);
+
+	// many chunks, sorted by several pool threads and merged
+	ResultOperations::setMinChunkRows(64);
+}
+
+void tst_AsyncSortFilter::cleanupTestCase()
+{
+	ResultOperations::setMinChunkRows(4096);
+	QThreadPool::globalInstance()->waitForDone();
+	ConnectionManager::destroyInstance();
+}
+
+void tst_AsyncSortFilter::sortParallel()
+{
+	AsyncSortFilter sortFilter;
+	Collector collector;
+	collector.connectTo(&sortFilter);
+	sortFilter.setSortColumn(1);
+	sortFilter.start(_result);
+	QTRY_COMPARE(collector.count(), 1);
+
+	QVector<int> rows = collector.last();
+	QCOMPARE(rows.size(), rowCount);
+	for (int i = 0; i < rows.size(); i++)
+		QCOMPARE(_result.value(rows[i], 1).toString(), QString().sprintf("n%05d", i));
+}
+
+void tst_AsyncSortFilter::filterAndSort()
+{
+	AsyncSortFilter sortFilter;
+	Collector collector;
+	collector.connectTo(&sortFilter);
+	sortFilter.setFilterFixedString("N001");
+	sortFilter.setFilterKeyColumn(1);
+	sortFilter.setSortColumn(1, Qt::DescendingOrder);
+	sortFilter.start(_result);
+	QTRY_COMPARE(collector.count(), 1);
+
+	// n00100..n00199, case insensitive
+	QVector<int> rows = collector.last();
+	QCOMPARE(rows.size(), 100);
+	for (int i = 0; i < rows.size(); i++)
+		QCOMPARE(_result.value(rows[i], 1).toString(), QString().sprintf("n%05d", 199 - i));
+}
+
+void tst_AsyncSortFilter::newerStartWins()
+{
+	AsyncSortFilter sortFilter;
+	Collector collector;
+	collector.connectTo(&sortFilter);
+	sortFilter.setSortColumn(1);
+	sortFilter.start(_result);
+	sortFilter.setSortColumn(1, Qt::DescendingOrder);
+	sortFilter.start(_result);
+	QThreadPool::globalInstance()->waitForDone();
+
+	// the first result may be dropped, the newest one is delivered last
+	QVERIFY(collector.count() >= 1);
+	QVector<int> rows = collector.last();
+	QCOMPARE(_result.value(rows.first(), 1).toString(), QString("n04999"));
+}
+
+void tst_AsyncSortFilter::deleteWhileRunning()
+{
+	Collector collector;
+	{
+		AsyncSortFilter sortFilter;
+		collector.connectTo(&sortFilter);
+		sortFilter.setSortColumn(1);
+		sortFilter.start(_result);
+	}
+	QThreadPool::globalInstance()->waitForDone();
+	QCOMPARE(collector.count(), 0);
+}
+
+QTEST_GUILESS_MAIN(tst_AsyncSortFilter)
+
+#include "tst_asyncsortfilter.moc"
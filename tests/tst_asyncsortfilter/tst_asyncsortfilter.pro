@@ -0,0 +1,5 @@
+TARGET 	 = tst_asyncsortfilter
+
+include(../tests.pri)
+
+SOURCES += tst_asyncsortfilter.cpp
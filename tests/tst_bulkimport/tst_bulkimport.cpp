@@ -0,0 +1,224 @@
+#include <QtTest>
+
+#include "BulkImport.h"
+#include "TestDatabase.h"
+
+using namespace Database;
+
+class tst_BulkImport : public QObject
+{
+	Q_OBJECT
+
+private slots:
+	void initTestCase();
+	void cleanupTestCase();
+	void init();
+
+	void importParallel();
+	void quotedFields();
+	void skipsMalformedRecords();
+	void numberDetection();
+	void singleColumn();
+	void missingFile();
+
+private:
+	struct Outcome {
+		qint64 rows = -1;
+		qint64 errors = -1;
+		QString errorText;
+	};
+
+	QString writeFile(const QString &name, const QByteArray &content);
+	Outcome import(BulkImport &import, const QString &fileName,
+				   const QString &table = "item");
+	QVariant scalar(const QString &sql);
+
+	QTemporaryDir _dir;
+};
+
+void tst_BulkImport::initTestCase()
+{
+	QVERIFY(_dir.isValid());
+	QString error;
+	QVERIFY2(TestDatabase::setup(_dir, {
+		"CREATE TABLE item (id INTEGER, name TEXT, price REAL)",
+		"CREATE TABLE raw (id INTEGER, value)",
+		"CREATE TABLE single (value)",
+	}, &error), qPrintable(error));
+}
+
+void tst_BulkImport::cleanupTestCase()
+{
+	ConnectionManager::destroyInstance();
+}
+
+void tst_BulkImport::init()
+{
+	QSqlQuery query(ConnectionManager::instance()->threadConnection());
+	QVERIFY(query.exec("DELETE FROM item"));
+	QVERIFY(query.exec("DELETE FROM raw"));
+	QVERIFY(query.exec("DELETE FROM single"));
+}
+
+QString tst_BulkImport::writeFile(const QString &name, const QByteArray &content)
+{
+	QString fileName = _dir.filePath(name);
+	QFile file(fileName);
+	if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+		return QString();
+	file.write(content);
+	return fileName;
+}
+
+tst_BulkImport::Outcome tst_BulkImport::import(BulkImport &import, const QString &fileName,
+												const QString &table)
+{
+	// importDone() is emitted on the writer thread, waitDone() orders the access
+	Outcome outcome;
+	connect(&import, &BulkImport::importDone, [&outcome](qint64 rows, qint64 errors,
+														  const QString &errorText) {
+		outcome.rows = rows;
+		outcome.errors = errors;
+		outcome.errorText = errorText;
+	});
+	if (import.startImport(fileName, table))
+		import.waitDone();
+	return outcome;
+}
+
+QVariant tst_BulkImport::scalar(const QString &sql)
+{
+	QSqlQuery query(ConnectionManager::instance()->threadConnection());
+	if (!query.exec(sql) || !query.next())
+		return QVariant();
+	return query.value(0);
+}
+
+void tst_BulkImport::importParallel()
+{
+	const int rows = 5000;
+	QByteArray csv = "id,name,price\n";
+	for (int i = 0; i < rows; i++)
+		csv += QByteArray::number(i) + ",name" + QByteArray::number(i) + "," +
+			QByteArray::number(i / 4.0) + "\n";
+	QString fileName = writeFile("parallel.csv", csv);
+	QVERIFY(!fileName.isEmpty());
+
+	BulkImport bulk;
+	bulk.setParserThreads(4);
+	bulk.setChunkRows(333);
+	Outcome outcome = import(bulk, fileName);
+
+	QVERIFY2(outcome.errorText.isEmpty(), qPrintable(outcome.errorText));
+	QCOMPARE(outcome.rows, qint64(rows));
+	QCOMPARE(outcome.errors, qint64(0));
+	QCOMPARE(scalar("SELECT COUNT(*) FROM item").toInt(), rows);
+	QCOMPARE(scalar("SELECT COUNT(DISTINCT id) FROM item").toInt(), rows);
+	QCOMPARE(scalar("SELECT SUM(id) FROM item").toLongLong(), qint64(rows) * (rows - 1) / 2);
+	QCOMPARE(scalar("SELECT typeof(id) FROM item LIMIT 1").toString(), QString("integer"));
+	QCOMPARE(scalar("SELECT name FROM item WHERE id = 4711").toString(), QString("name4711"));
+}
+
+void tst_BulkImport::quotedFields()
+{
+	QString fileName = writeFile("quoted.csv",
+		"id,name,price\n"
+		"1,\"a, b\",1.5\n"
+		"2,\"say \"\"hi\"\"\",\n"
+		"3,\"two\nlines\",3\n"
+		"4,\"\",4\n");
+	QVERIFY(!fileName.isEmpty());
+
+	BulkImport bulk;
+	bulk.setParserThreads(2);
+	Outcome outcome = import(bulk, fileName);
+
+	QVERIFY2(outcome.errorText.isEmpty(), qPrintable(outcome.errorText));
+	QCOMPARE(outcome.rows, qint64(4));
+	QCOMPARE(scalar("SELECT name FROM item WHERE id = 1").toString(), QString("a, b"));
+	QCOMPARE(scalar("SELECT name FROM item WHERE id = 2").toString(), QString("say \"hi\""));
+	QCOMPARE(scalar("SELECT name FROM item WHERE id = 3").toString(), QString("two\nlines"));
+	// quoted empty is an empty string, unquoted empty is NULL
+	QCOMPARE(scalar("SELECT name IS NULL FROM item WHERE id = 4").toInt(), 0);
+	QCOMPARE(scalar("SELECT price IS NULL FROM item WHERE id = 2").toInt(), 1);
+}
+
+void tst_BulkImport::skipsMalformedRecords()
+{
+	QString fileName = writeFile("malformed.csv",
+		"id,name,price\n"
+		"1,one,1\n"
+		"2,two\n"
+		"3,three,3,extra\n"
+		"4,four,4\n");
+	QVERIFY(!fileName.isEmpty());
+
+	BulkImport bulk;
+	Outcome outcome = import(bulk, fileName);
+
+	QVERIFY2(outcome.errorText.isEmpty(), qPrintable(outcome.errorText));
+	QCOMPARE(outcome.rows, qint64(2));
+	QCOMPARE(outcome.errors, qint64(2));
+	QCOMPARE(scalar("SELECT COUNT(*) FROM item").toInt(), 2);
+}
+
+void tst_BulkImport::numberDetection()
+{
+	// "value" has no type affinity and keeps the bound type
+	QString fileName = writeFile("numbers.csv",
+		"id,value\n"
+		"1,42\n"
+		"2,-1.5e3\n"
+		"3,007\n"
+		"4,+4930123\n"
+		"5,nan\n"
+		"6,inf\n"
+		"7,0.25\n"
+		"8,99999999999999999999\n");
+	QVERIFY(!fileName.isEmpty());
+
+	BulkImport bulk;
+	Outcome outcome = import(bulk, fileName, "raw");
+	QVERIFY2(outcome.errorText.isEmpty(), qPrintable(outcome.errorText));
+	QCOMPARE(outcome.rows, qint64(8));
+
+	QSqlQuery query(ConnectionManager::instance()->threadConnection());
+	QVERIFY(query.exec("SELECT typeof(value), value FROM raw ORDER BY id"));
+	QStringList types;
+	while (query.next())
+		types << query.value(0).toString();
+	QCOMPARE(types, QStringList({ "integer", "real", "text", "text", "text", "text", "real",
+								  "text" }));
+	QCOMPARE(scalar("SELECT value FROM raw WHERE id = 3").toString(), QString("007"));
+	QCOMPARE(scalar("SELECT value FROM raw WHERE id = 8").toString(),
+			 QString("99999999999999999999"));
+}
+
+void tst_BulkImport::singleColumn()
+{
+	// an empty line is a NULL field, not a line to skip
+	QString fileName = writeFile("single.csv", "value\none\n\nthree\n\"\"\n");
+	QVERIFY(!fileName.isEmpty());
+
+	BulkImport bulk;
+	Outcome outcome = import(bulk, fileName, "single");
+	QVERIFY2(outcome.errorText.isEmpty(), qPrintable(outcome.errorText));
+	QCOMPARE(outcome.rows, qint64(4));
+	QCOMPARE(outcome.errors, qint64(0));
+	QCOMPARE(scalar("SELECT COUNT(*) FROM single WHERE value IS NULL").toInt(), 1);
+	QCOMPARE(scalar("SELECT COUNT(*) FROM single WHERE value = ''").toInt(), 1);
+}
+
+void tst_BulkImport::missingFile()
+{
+	BulkImport bulk;
+	Outcome outcome = import(bulk, _dir.filePath("missing.csv"));
+
+	QVERIFY(!outcome.errorText.isEmpty());
+	QCOMPARE(outcome.rows, qint64(0));
+	QVERIFY(!bulk.isRunning());
+}
+
+QTEST_GUILESS_MAIN(tst_BulkImport)
+
+#include "tst_bulkimport.moc"
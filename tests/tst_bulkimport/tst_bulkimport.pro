@@ -0,0 +1,5 @@
+TARGET 	 = tst_bulkimport
+
+include(../tests.pri)
+
+SOURCES += tst_bulkimport.cpp
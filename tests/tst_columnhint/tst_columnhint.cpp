@@ -0,0 +1,119 @@
+#include <QtTest>
+
+#include "AsyncQueryQMLModel.h"
+#include "ColumnHint.h"
+#include "TestDatabase.h"
+
+using namespace Database;
+
+class tst_ColumnHint : public QObject
+{
+	Q_OBJECT
+
+private slots:
+	void initTestCase();
+	void cleanupTestCase();
+
+	void decimalDisplay_data();
+	void decimalDisplay();
+	void decimalGrouping();
+	void decimalQuery();
+	void qmlDisplayRoles();
+
+private:
+	QTemporaryDir _dir;
+};
+
+void tst_ColumnHint::initTestCase()
+{
+	QVERIFY(_dir.isValid());
+	QString error;
+	QVERIFY2(TestDatabase::setup(_dir, {
+		"CREATE TABLE amount (id INTEGER PRIMARY KEY, value TEXT)",
+		"INSERT INTO amount VALUES (1, '12345678901234567.885')",
+		"INSERT INTO amount VALUES (2, '-0.5')",
+	}, &error), qPrintable(error));
+
+	// the worker threads format with the default locale
+	QLocale::setDefault(QLocale::c());
+}
+
+void tst_ColumnHint::cleanupTestCase()
+{
+	ConnectionManager::destroyInstance();
+}
+
+void tst_ColumnHint::decimalDisplay_data()
+{
+	QTest::addColumn<QVariant>("fetched");
+	QTest::addColumn<int>("scale");
+	QTest::addColumn<QString>("display");
+
+	QTest::newRow("round half up") << QVariant("12.345") << 2 << "12.35";
+	QTest::newRow("carry") << QVariant("999.995") << 2 << "1000.00";
+	QTest::newRow("pad") << QVariant("3.1") << 3 << "3.100";
+	QTest::newRow("negative zero") << QVariant("-0.004") << 2 << "0.00";
+	QTest::newRow("negative") << QVariant("-2.5E-3") << 4 << "-0.0025";
+	QTest::newRow("exponent") << QVariant("1.5e3") << 1 << "1500.0";
+	QTest::newRow("leading zeros") << QVariant("007") << -1 << "7";
+	QTest::newRow("all digits") << QVariant("0.1000000000000000055") << -1
+								<< "0.1000000000000000055";
+	QTest::newRow("beyond double") << QVariant("12345678901234567.885") << 2
+								   << "12345678901234567.89";
+	QTest::newRow("integer") << QVariant(Q_INT64_C(9007199254740993)) << 2
+							 << "9007199254740993.00";
+	QTest::newRow("not a number") << QVariant("n/a") << 2 << "n/a";
+}
+
+void tst_ColumnHint::decimalDisplay()
+{
+	QFETCH(QVariant, fetched);
+	QFETCH(int, scale);
+	QFETCH(QString, display);
+
+	ColumnHint hint = ColumnHint::decimal(scale);
+	QCOMPARE(hint.display(hint.convert(fetched), QLocale::c(), fetched), display);
+}
+
+void tst_ColumnHint::decimalGrouping()
+{
+	ColumnHint hint = ColumnHint::decimal(2);
+	QVariant fetched("-1234567.891");
+	QCOMPARE(hint.display(hint.convert(fetched), QLocale(QLocale::German), fetched),
+			 QString("-1.234.567,89"));
+	// the converted value is a double for sorting
+	QCOMPARE(hint.convert(fetched).type(), QVariant::Double);
+}
+
+void tst_ColumnHint::decimalQuery()
+{
+	AsyncQuery query;
+	query.setColumnHint("value", ColumnHint::decimal(2));
+	query.setDisplayStrings(true);
+	AsyncQueryResult result = TestDatabase::exec(query, "SELECT value FROM amount ORDER BY id");
+	QVERIFY2(result.isValid(), qPrintable(result.error().text()));
+
+	QCOMPARE(result.displayString(0, 0), QString("12345678901234567.89"));
+	QCOMPARE(result.displayString(1, 0), QString("-0.50"));
+	QCOMPARE(result.value(1, 0).toDouble(), -0.5);
+}
+
+void tst_ColumnHint::qmlDisplayRoles()
+{
+	AsyncQueryQMLModel model;
+	model.startExec("SELECT 1 AS Total, 2 AS TotalDisplay");
+	QTRY_COMPARE(model.rowCount(), 1);
+
+	// the display role of Total must not hide the column TotalDisplay
+	QList<QByteArray> names = model.roleNames().values();
+	QCOMPARE(names.count("TotalDisplay"), 1);
+	QVERIFY(names.contains("TotalDisplay_"));
+	QVERIFY(names.contains("TotalDisplayDisplay"));
+	QCOMPARE(model.data(0, "TotalDisplay").toInt(), 2);
+	QCOMPARE(model.data(0, "TotalDisplay_").toInt(), 1);
+	QCOMPARE(model.data(0, "TotalDisplayDisplay").toInt(), 2);
+}
+
+QTEST_GUILESS_MAIN(tst_ColumnHint)
+
+#include "tst_columnhint.moc"
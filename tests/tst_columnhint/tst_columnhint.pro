@@ -0,0 +1,5 @@
+TARGET 	 = tst_columnhint
+
+include(../tests.pri)
+
+SOURCES += tst_columnhint.cpp
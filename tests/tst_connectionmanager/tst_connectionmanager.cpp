@@ -0,0 +1,157 @@
+#include <QtTest>
+
+#include "TestDatabase.h"
+
+using namespace Database;
+
+class tst_ConnectionManager : public QObject
+{
+	Q_OBJECT
+
+private slots:
+	void initTestCase();
+	void cleanupTestCase();
+
+	void initStatementsFail();
+	void initOutsideLock();
+	void inMemoryShared();
+	void reopenAll();
+
+private:
+	/** Opens a connection of a profile in its own thread. */
+	class OpenThread : public QThread
+	{
+	public:
+		explicit OpenThread(const QString &profile)
+			: profile(profile)
+		{
+		}
+
+		void run() override
+		{
+			ConnectionManager *conmgr = ConnectionManager::instance();
+			opened = conmgr->open(profile);
+			if (resume) {
+				// wait for reopenAll() from another thread
+				ready.release();
+				resume->tryAcquire(1, 10000);
+				existsAfter = conmgr->connectionExists(profile);
+				reopened = conmgr->open(profile) && conmgr->connectionExists(profile);
+			}
+			conmgr->closeOne(this);
+		}
+
+		QString profile;
+		QSemaphore ready;
+		QSemaphore *resume = nullptr;
+		bool opened = false;
+		bool existsAfter = true;
+		bool reopened = false;
+	};
+
+	QTemporaryDir _dir;
+};
+
+void tst_ConnectionManager::initTestCase()
+{
+	QVERIFY(_dir.isValid());
+	QString error;
+	QVERIFY2(TestDatabase::setup(_dir, {}, &error), qPrintable(error));
+}
+
+void tst_ConnectionManager::cleanupTestCase()
+{
+	ConnectionManager::destroyInstance();
+}
+
+void tst_ConnectionManager::initStatementsFail()
+{
+	ConnectionProfile profile = ConnectionProfile::sqlite(_dir.filePath("broken.sl3"),
+		ConnectionProfile::Sqlite_WriteHeavy);
+	profile.initStatements << "NOT A STATEMENT";
+	ConnectionManager *conmgr = ConnectionManager::instance();
+	conmgr->addProfile("broken", profile);
+
+	QSqlError error;
+	QVERIFY(!conmgr->open("broken", &error));
+	QVERIFY(error.isValid());
+	QVERIFY(!conmgr->connectionExists("broken"));
+	conmgr->removeProfile("broken");
+}
+
+void tst_ConnectionManager::initOutsideLock()
+{
+	// the init callback blocks, the manager stays usable meanwhile
+	QSemaphore started, proceed;
+	ConnectionProfile profile = ConnectionProfile::sqlite(_dir.filePath("slow.sl3"),
+		ConnectionProfile::Sqlite_WriteHeavy);
+	profile.initCallback = [&started, &proceed](QSqlDatabase &) {
+		started.release();
+		return proceed.tryAcquire(1, 10000);
+	};
+	ConnectionManager *conmgr = ConnectionManager::instance();
+	conmgr->addProfile("slow", profile);
+
+	OpenThread thread("slow");
+	thread.start();
+	QVERIFY(started.tryAcquire(1, 10000));
+
+	QElapsedTimer timer;
+	timer.start();
+	QVERIFY(conmgr->connectionCount() >= 1);
+	// not published before it is initialized
+	QVERIFY(!conmgr->connectionExists("slow", &thread));
+	QVERIFY(timer.elapsed() < 1000);
+
+	proceed.release();
+	QVERIFY(thread.wait(10000));
+	QVERIFY(thread.opened);
+	conmgr->removeProfile("slow");
+}
+
+void tst_ConnectionManager::inMemoryShared()
+{
+	ConnectionManager *conmgr = ConnectionManager::instance();
+	conmgr->addProfile("memory", ConnectionProfile::sqlite("asyncsql_test",
+		ConnectionProfile::Sqlite_InMemory));
+	QVERIFY(conmgr->open("memory"));
+
+	// a table created here is visible to the worker connections of the profile
+	QSqlQuery create(conmgr->threadConnection("memory"));
+	QVERIFY2(create.exec("CREATE TABLE shared (x)"), qPrintable(create.lastError().text()));
+	QVERIFY(create.exec("INSERT INTO shared VALUES (42)"));
+
+	AsyncQuery query;
+	query.setConnectionProfile("memory");
+	AsyncQueryResult result = TestDatabase::exec(query, "SELECT x FROM shared");
+	QVERIFY2(result.isValid(), qPrintable(result.error().text()));
+	QCOMPARE(result.value(0, 0).toInt(), 42);
+}
+
+void tst_ConnectionManager::reopenAll()
+{
+	ConnectionManager *conmgr = ConnectionManager::instance();
+	QVERIFY(conmgr->connectionExists() || conmgr->open());
+
+	QSemaphore resume;
+	OpenThread thread(QString());
+	thread.resume = &resume;
+	thread.start();
+	QVERIFY(thread.ready.tryAcquire(1, 10000));
+	QVERIFY(thread.opened);
+
+	// closed here, only marked for the other thread
+	conmgr->reopenAll();
+	QVERIFY(!conmgr->connectionExists());
+	QVERIFY(!conmgr->connectionExists(&thread));
+	QVERIFY(conmgr->connectionCount() >= 1);
+
+	resume.release();
+	QVERIFY(thread.wait(10000));
+	QVERIFY(!thread.existsAfter);
+	QVERIFY(thread.reopened);
+}
+
+QTEST_GUILESS_MAIN(tst_ConnectionManager)
+
+#include "tst_connectionmanager.moc"
@@ -0,0 +1,5 @@
+TARGET 	 = tst_connectionmanager
+
+include(../tests.pri)
+
+SOURCES += tst_connectionmanager.cpp
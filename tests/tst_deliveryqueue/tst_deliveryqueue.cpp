@@ -0,0 +1,137 @@
+#include <QtTest>
+
+#include "DeliveryQueue.h"
+#include "TestDatabase.h"
+
+using namespace Database;
+
+class tst_DeliveryQueue : public QObject
+{
+	Q_OBJECT
+
+private slots:
+	void initTestCase();
+	void cleanupTestCase();
+
+	void batched();
+	void latest();
+	void receiverThread();
+	void deletedReceiver();
+	void threadFinishes();
+
+private:
+	QTemporaryDir _dir;
+};
+
+void tst_DeliveryQueue::initTestCase()
+{
+	QVERIFY(_dir.isValid());
+	QString error;
+	QVERIFY2(TestDatabase::setup(_dir, {}, &error), qPrintable(error));
+}
+
+void tst_DeliveryQueue::cleanupTestCase()
+{
+	ConnectionManager::destroyInstance();
+}
+
+void tst_DeliveryQueue::batched()
+{
+	AsyncQuery query;
+	query.setDelivery(AsyncQuery::Delivery_Batched);
+	QVector<int> values;
+	connect(&query, &AsyncQuery::execDone, [&values](const AsyncQueryResult &result) {
+		values.append(result.value(0, 0).toInt());
+	});
+
+	// nothing is delivered before the event loop runs the batch
+	query.setMode(AsyncQuery::Mode_Fifo);
+	for (int i = 1; i <= 3; i++)
+		QVERIFY(query.startExec(QString("SELECT %1").arg(i)));
+	QThreadPool::globalInstance()->waitForDone();
+	QVERIFY(values.isEmpty());
+	QCOMPARE(DeliveryQueue::pending(QThread::currentThread()), 3);
+
+	QTRY_COMPARE(values, QVector<int>({ 1, 2, 3 }));
+}
+
+void tst_DeliveryQueue::latest()
+{
+	AsyncQuery query;
+	query.setDelivery(AsyncQuery::Delivery_Latest);
+	QVector<int> values;
+	connect(&query, &AsyncQuery::execDone, [&values](const AsyncQueryResult &result) {
+		values.append(result.value(0, 0).toInt());
+	});
+
+	query.setMode(AsyncQuery::Mode_Fifo);
+	for (int i = 1; i <= 3; i++)
+		QVERIFY(query.startExec(QString("SELECT %1").arg(i)));
+	QThreadPool::globalInstance()->waitForDone();
+
+	QTRY_COMPARE(values, QVector<int>({ 3 }));
+}
+
+void tst_DeliveryQueue::receiverThread()
+{
+	QThread thread;
+	QObject receiver;
+	receiver.moveToThread(&thread);
+	thread.start();
+
+	// the AsyncQuery lives in this thread, execDone is emitted in the receiver's
+	AsyncQuery query;
+	query.setDelivery(AsyncQuery::Delivery_Batched, &receiver);
+	QAtomicPointer<QThread> deliveredIn;
+	connect(&query, &AsyncQuery::execDone, &receiver, [&deliveredIn]() {
+		deliveredIn.storeRelease(QThread::currentThread());
+	}, Qt::DirectConnection);
+	QVERIFY(query.startExec("SELECT 1"));
+	QVERIFY(query.waitDone());
+
+	QTRY_COMPARE(deliveredIn.loadAcquire(), &thread);
+	thread.quit();
+	QVERIFY(thread.wait(5000));
+}
+
+void tst_DeliveryQueue::deletedReceiver()
+{
+	AsyncQuery query;
+	QObject *receiver = new QObject();
+	query.setDelivery(AsyncQuery::Delivery_Batched, receiver);
+	int delivered = 0;
+	connect(&query, &AsyncQuery::execDone, [&delivered]() {
+		delivered++;
+	});
+	QVERIFY(query.startExec("SELECT 1"));
+	QThreadPool::globalInstance()->waitForDone();
+
+	delete receiver;
+	QTest::qWait(50);
+	QCOMPARE(delivered, 0);
+}
+
+void tst_DeliveryQueue::threadFinishes()
+{
+	// callbacks still pending when the thread finishes run in that thread
+	QThread thread;
+	QObject receiver;
+	receiver.moveToThread(&thread);
+	thread.start();
+
+	QAtomicPointer<QThread> ranIn;
+	QTimer::singleShot(0, &receiver, [&receiver, &ranIn]() {
+		DeliveryQueue::post(QThread::currentThread(), &receiver, [&ranIn]() {
+			ranIn.storeRelease(QThread::currentThread());
+		});
+		QThread::currentThread()->quit();
+	});
+	QVERIFY(thread.wait(5000));
+
+	QCOMPARE(ranIn.loadAcquire(), &thread);
+	QCOMPARE(DeliveryQueue::pending(&thread), 0);
+}
+
+QTEST_GUILESS_MAIN(tst_DeliveryQueue)
+
+#include "tst_deliveryqueue.moc"
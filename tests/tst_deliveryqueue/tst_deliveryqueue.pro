@@ -0,0 +1,5 @@
+TARGET 	 = tst_deliveryqueue
+
+include(../tests.pri)
+
+SOURCES += tst_deliveryqueue.cpp
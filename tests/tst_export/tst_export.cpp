@@ -0,0 +1,191 @@
+#include <QtTest>
+#include <QBuffer>
+#include <QJsonDocument>
+#include <QJsonObject>
+
+#include "TestDatabase.h"
+
+using namespace Database;
+
+class tst_Export : public QObject
+{
+	Q_OBJECT
+
+private slots:
+	void initTestCase();
+	void cleanupTestCase();
+
+	void csv();
+	void jsonLines();
+	void binary();
+	void file();
+	void progress();
+	void failedQuery();
+
+private:
+	static AsyncQueryResult exportTo(QIODevice *device, const QString &sql,
+									 AsyncQuery::ExportFormat format);
+
+	QTemporaryDir _dir;
+};
+
+static const int manyRows = 2500;
+
+void tst_Export::initTestCase()
+{
+	QVERIFY(_dir.isValid());
+	QString error;
+	QVERIFY2(TestDatabase::setup(_dir, {
+		"CREATE TABLE item (id INTEGER PRIMARY KEY, name TEXT, data BLOB)",
+		"INSERT INTO item VALUES (1, 'plain', NULL)",
+		"INSERT INTO item VALUES (2, 'a, \"b\"', x'0102')",
+		"INSERT INTO item VALUES (3, NULL, NULL)",
+		"CREATE TABLE num (n INTEGER)",
+		"WITH RECURSIVE s(i) AS (SELECT 1 UNION ALL SELECT i + 1 FROM s WHERE i < 2500) "
+			"INSERT INTO num SELECT i FROM s",
+	}, &error), qPrintable(error));
+}
+
+void tst_Export::cleanupTestCase()
+{
+	ConnectionManager::destroyInstance();
+}
+
+AsyncQueryResult tst_Export::exportTo(QIODevice *device, const QString &sql,
+									  AsyncQuery::ExportFormat format)
+{
+	AsyncQuery query;
+	query.prepare(sql);
+	if (!query.startExport(device, format))
+		return AsyncQueryResult();
+	query.waitDone();
+	return query.result();
+}
+
+void tst_Export::csv()
+{
+	QBuffer buffer;
+	QVERIFY(buffer.open(QIODevice::WriteOnly));
+	AsyncQueryResult result = exportTo(&buffer, "SELECT id, name FROM item ORDER BY id",
+									   AsyncQuery::Export_Csv);
+	QVERIFY2(result.isValid(), qPrintable(result.error().text()));
+	QCOMPARE(result.count(), 0);
+	QCOMPARE(result.headRecord().count(), 2);
+
+	// quoted where needed, NULL is an empty field
+	QCOMPARE(buffer.data(), QByteArray("id,name\r\n"
+									   "1,plain\r\n"
+									   "2,\"a, \"\"b\"\"\"\r\n"
+									   "3,\r\n"));
+}
+
+void tst_Export::jsonLines()
+{
+	QBuffer buffer;
+	QVERIFY(buffer.open(QIODevice::WriteOnly));
+	AsyncQueryResult result = exportTo(&buffer, "SELECT id, name, data FROM item ORDER BY id",
+									   AsyncQuery::Export_JsonLines);
+	QVERIFY2(result.isValid(), qPrintable(result.error().text()));
+
+	QList<QByteArray> lines = buffer.data().split('\n');
+	QCOMPARE(lines.size(), 4);
+	QVERIFY(lines.last().isEmpty());
+
+	QJsonObject first = QJsonDocument::fromJson(lines.at(0)).object();
+	QCOMPARE(first.value("id").toInt(), 1);
+	QCOMPARE(first.value("name").toString(), QString("plain"));
+	QVERIFY(first.value("data").isNull());
+
+	// blobs are base64
+	QJsonObject second = QJsonDocument::fromJson(lines.at(1)).object();
+	QCOMPARE(second.value("data").toString(), QString("AQI="));
+
+	QJsonObject third = QJsonDocument::fromJson(lines.at(2)).object();
+	QVERIFY(third.value("name").isNull());
+}
+
+void tst_Export::binary()
+{
+	QBuffer buffer;
+	QVERIFY(buffer.open(QIODevice::WriteOnly));
+	AsyncQueryResult result = exportTo(&buffer, "SELECT id, name FROM item ORDER BY id",
+									   AsyncQuery::Export_Binary);
+	QVERIFY2(result.isValid(), qPrintable(result.error().text()));
+
+	QDataStream in(buffer.data());
+	in.setVersion(QDataStream::Qt_5_5);
+	quint32 magic, version;
+	qint32 cols;
+	in >> magic >> version >> cols;
+	QCOMPARE(magic, quint32(0x41515845));
+	QCOMPARE(version, quint32(1));
+	QCOMPARE(cols, qint32(2));
+	for (int i = 0; i < cols; i++) {
+		QString name;
+		qint32 type;
+		in >> name >> type;
+		QCOMPARE(name, QString(i == 0 ? "id" : "name"));
+	}
+
+	QVector<int> ids;
+	quint8 marker;
+	in >> marker;
+	while (marker == 1) {
+		QVariant id, name;
+		in >> id >> name;
+		ids.append(id.toInt());
+		in >> marker;
+	}
+	qint64 rows;
+	in >> rows;
+	QCOMPARE(in.status(), QDataStream::Ok);
+	QCOMPARE(rows, qint64(3));
+	QCOMPARE(ids, QVector<int>({ 1, 2, 3 }));
+}
+
+void tst_Export::file()
+{
+	QString fileName = _dir.filePath("export.csv");
+	AsyncQuery query;
+	query.prepare("SELECT n FROM num WHERE n <= 3 ORDER BY n");
+	QVERIFY(query.startExport(fileName, AsyncQuery::Export_Csv));
+	QVERIFY(query.waitDone());
+	QVERIFY2(query.result().isValid(), qPrintable(query.result().error().text()));
+
+	QFile file(fileName);
+	QVERIFY(file.open(QIODevice::ReadOnly));
+	QCOMPARE(file.readAll(), QByteArray("n\r\n1\r\n2\r\n3\r\n"));
+}
+
+void tst_Export::progress()
+{
+	QBuffer buffer;
+	QVERIFY(buffer.open(QIODevice::WriteOnly));
+
+	AsyncQuery query;
+	QVector<qint64> steps;
+	connect(&query, &AsyncQuery::exportProgress, &query, [&steps](qint64 rows) {
+		steps.append(rows);
+	}, Qt::DirectConnection);
+	query.prepare("SELECT n FROM num");
+	QVERIFY(query.startExport(&buffer, AsyncQuery::Export_Csv));
+	QVERIFY(query.waitDone());
+	QVERIFY2(query.result().isValid(), qPrintable(query.result().error().text()));
+
+	QCOMPARE(steps, QVector<qint64>({ 1000, 2000, manyRows }));
+	QCOMPARE(buffer.data().count('\n'), manyRows + 1);
+}
+
+void tst_Export::failedQuery()
+{
+	QBuffer buffer;
+	QVERIFY(buffer.open(QIODevice::WriteOnly));
+	AsyncQueryResult result = exportTo(&buffer, "SELECT nothing FROM missing",
+									   AsyncQuery::Export_Csv);
+	QVERIFY(!result.isValid());
+	QVERIFY(buffer.data().isEmpty());
+}
+
+QTEST_GUILESS_MAIN(tst_Export)
+
+#include "tst_export.moc"
@@ -0,0 +1,5 @@
+TARGET 	 = tst_export
+
+include(../tests.pri)
+
+SOURCES += tst_export.cpp
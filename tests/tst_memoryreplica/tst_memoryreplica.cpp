@@ -0,0 +1,328 @@
+#include <QtTest>
+
+#include "MemoryReplica.h"
+#include "TestDatabase.h"
+
+using namespace Database;
+
+class tst_MemoryReplica : public QObject
+{
+	Q_OBJECT
+
+private slots:
+	void initTestCase();
+	void cleanupTestCase();
+
+	void isWrite_data();
+	void isWrite();
+	void isDeterministic_data();
+	void isDeterministic();
+
+	void writeThrough();
+	void batchProgressOnce();
+	void nonDeterministicWrite();
+	void failedScript();
+	void generatedKeys();
+	void commitOrder();
+	void upsert();
+	void triggerReloads();
+
+private:
+	static QVariant readReplica(const QString &sql);
+	static QVariant readSource(const QString &sql);
+	static QString contents(const QString &table, const QString &column);
+	static void execConcurrently(const QString &sql, int count);
+
+	QTemporaryDir _dir;
+	bool _replica = false;
+};
+
+void tst_MemoryReplica::initTestCase()
+{
+	QVERIFY(_dir.isValid());
+	QString error;
+	QVERIFY2(TestDatabase::setup(_dir, {
+		"CREATE TABLE kv (id INTEGER PRIMARY KEY, val)",
+		"CREATE TABLE seq (id INTEGER PRIMARY KEY AUTOINCREMENT, val)",
+		"CREATE TABLE counter (id INTEGER PRIMARY KEY, n INTEGER)",
+		"INSERT INTO counter VALUES (1, 1)",
+		"CREATE TABLE audit (id INTEGER PRIMARY KEY, kv_id)",
+	}, &error), qPrintable(error));
+
+#ifdef ASYNCSQL_SQLITE_API
+	MemoryReplica *replica = ConnectionManager::instance()->memoryReplica();
+	replica->setSyncIntervalMs(50);
+	QSqlError sqlError;
+	QVERIFY2(replica->enable(&sqlError), qPrintable(sqlError.text()));
+	_replica = true;
+#endif
+}
+
+void tst_MemoryReplica::cleanupTestCase()
+{
+	QThreadPool::globalInstance()->waitForDone();
+	if (_replica)
+		ConnectionManager::instance()->memoryReplica()->disable();
+	ConnectionManager::destroyInstance();
+}
+
+QVariant tst_MemoryReplica::readReplica(const QString &sql)
+{
+	AsyncQuery query;
+	return TestDatabase::exec(query, sql).value(0, 0);
+}
+
+QVariant tst_MemoryReplica::readSource(const QString &sql)
+{
+	ConnectionManager *conmgr = ConnectionManager::instance();
+	QString profile = MemoryReplica::sourceProfile();
+	if (!conmgr->connectionExists(profile) && !conmgr->open(profile))
+		return QVariant();
+	QSqlQuery query(conmgr->threadConnection(profile));
+	if (!query.exec(sql) || !query.next())
+		return QVariant();
+	return query.value(0);
+}
+
+QString tst_MemoryReplica::contents(const QString &table, const QString &column)
+{
+	return QString("SELECT group_concat(r, ',') FROM "
+				   "(SELECT quote(id) || '=' || quote(%1) AS r FROM %2 ORDER BY id)")
+		.arg(column, table);
+}
+
+void tst_MemoryReplica::execConcurrently(const QString &sql, int count)
+{
+	// started together, the pool threads run them in any order
+	QList<AsyncQuery *> queries;
+	for (int i = 0; i < count; i++) {
+		AsyncQuery *query = new AsyncQuery;
+		query->prepare(sql);
+		query->bindValue(":k", i);
+		queries << query;
+	}
+	for (AsyncQuery *query : queries)
+		QVERIFY(query->startExec());
+	for (AsyncQuery *query : queries) {
+		QVERIFY(query->waitDone());
+		QVERIFY2(query->result().isValid(), qPrintable(query->result().error().text()));
+	}
+	qDeleteAll(queries);
+	QThreadPool::globalInstance()->waitForDone();
+}
+
+void tst_MemoryReplica::isWrite_data()
+{
+	QTest::addColumn<QString>("sql");
+	QTest::addColumn<bool>("write");
+
+	QTest::newRow("select") << "SELECT * FROM kv" << false;
+	QTest::newRow("comment") << "/* read */ -- only\n select 1" << false;
+	QTest::newRow("values") << "VALUES (1)" << false;
+	QTest::newRow("pragma query") << "PRAGMA user_version" << false;
+	QTest::newRow("pragma set") << "PRAGMA user_version = 2" << true;
+	QTest::newRow("with select") << "WITH x AS (SELECT 1) SELECT * FROM x" << false;
+	QTest::newRow("with insert") << "WITH x AS (SELECT 1) INSERT INTO kv SELECT 1, 2 FROM x" << true;
+	QTest::newRow("insert") << "INSERT INTO kv VALUES (1, 2)" << true;
+	QTest::newRow("commit") << "COMMIT" << true;
+}
+
+void tst_MemoryReplica::isWrite()
+{
+	QFETCH(QString, sql);
+	QFETCH(bool, write);
+	QCOMPARE(MemoryReplica::isWrite(sql), write);
+}
+
+void tst_MemoryReplica::isDeterministic_data()
+{
+	QTest::addColumn<QString>("sql");
+	QTest::addColumn<bool>("deterministic");
+
+	QTest::newRow("literal") << "INSERT INTO kv VALUES (1, 'a')" << true;
+	QTest::newRow("placeholder") << "UPDATE kv SET val = :val WHERE id = :id" << true;
+	QTest::newRow("identifier") << "INSERT INTO randomness VALUES (1)" << true;
+	QTest::newRow("random") << "INSERT INTO kv VALUES (1, random())" << false;
+	QTest::newRow("randomblob") << "INSERT INTO kv VALUES (1, RANDOMBLOB(8))" << false;
+	QTest::newRow("now") << "UPDATE kv SET val = datetime('now')" << false;
+	QTest::newRow("current_timestamp") << "INSERT INTO kv VALUES (1, CURRENT_TIMESTAMP)" << false;
+	QTest::newRow("last_insert_rowid") << "INSERT INTO kv VALUES (last_insert_rowid(), 1)" << false;
+	QTest::newRow("changes") << "UPDATE kv SET val = changes()" << false;
+}
+
+void tst_MemoryReplica::isDeterministic()
+{
+	QFETCH(QString, sql);
+	QFETCH(bool, deterministic);
+	QCOMPARE(MemoryReplica::isDeterministic(sql), deterministic);
+}
+
+void tst_MemoryReplica::writeThrough()
+{
+	if (!_replica)
+		QSKIP("requires CONFIG += asyncsql_sqlite");
+
+	MemoryReplica *replica = ConnectionManager::instance()->memoryReplica();
+	QSignalSpy synced(replica, &MemoryReplica::synced);
+
+	AsyncQuery query;
+	query.prepare("INSERT INTO kv VALUES (:id, :val)");
+	query.bindValue(":id", 1);
+	query.bindValue(":val", "one");
+	QVERIFY(query.startExec());
+	QVERIFY(query.waitDone());
+	QVERIFY2(query.result().isValid(), qPrintable(query.result().error().text()));
+
+	// repeated on the copy, no reload
+	QCOMPARE(readReplica("SELECT val FROM kv WHERE id = 1").toString(), QString("one"));
+	QTest::qWait(200);
+	QCOMPARE(synced.count(), 0);
+}
+
+void tst_MemoryReplica::batchProgressOnce()
+{
+	if (!_replica)
+		QSKIP("requires CONFIG += asyncsql_sqlite");
+
+	MemoryReplica *replica = ConnectionManager::instance()->memoryReplica();
+	QSignalSpy synced(replica, &MemoryReplica::synced);
+
+	QVariantList ids, vals;
+	for (int i = 100; i < 110; i++) {
+		ids << i;
+		vals << QString("v%1").arg(i);
+	}
+
+	AsyncQuery query;
+	QAtomicInt finalProgress;
+	connect(&query, &AsyncQuery::batchProgress, &query, [&finalProgress](int done, int total) {
+		if (done == total)
+			finalProgress.ref();
+	}, Qt::DirectConnection);
+	query.setBatchChunkSize(4);
+	query.prepare("INSERT INTO kv VALUES (:id, :val)");
+	query.bindBatchValue(":id", ids);
+	query.bindBatchValue(":val", vals);
+	QVERIFY(query.startExec());
+	QVERIFY(query.waitDone());
+	QVERIFY2(query.result().isValid(), qPrintable(query.result().error().text()));
+
+	// the batch is not executed again on the copy, it is reloaded
+	QCOMPARE(finalProgress.load(), 1);
+	QTRY_VERIFY(synced.count() > 0);
+	QCOMPARE(readReplica("SELECT COUNT(*) FROM kv WHERE id >= 100 AND id < 110").toInt(), 10);
+}
+
+void tst_MemoryReplica::nonDeterministicWrite()
+{
+	if (!_replica)
+		QSKIP("requires CONFIG += asyncsql_sqlite");
+
+	MemoryReplica *replica = ConnectionManager::instance()->memoryReplica();
+	QSignalSpy synced(replica, &MemoryReplica::synced);
+
+	AsyncQuery query;
+	AsyncQueryResult result = TestDatabase::exec(query, "INSERT INTO kv VALUES (200, random())");
+	QVERIFY2(result.isValid(), qPrintable(result.error().text()));
+
+	// a repeated random() would differ, the copy is reloaded from the file
+	QTRY_VERIFY(synced.count() > 0);
+	QVariant source = readSource("SELECT val FROM kv WHERE id = 200");
+	QVERIFY(source.isValid());
+	QCOMPARE(readReplica("SELECT val FROM kv WHERE id = 200"), source);
+}
+
+void tst_MemoryReplica::failedScript()
+{
+	if (!_replica)
+		QSKIP("requires CONFIG += asyncsql_sqlite");
+
+	MemoryReplica *replica = ConnectionManager::instance()->memoryReplica();
+	QSignalSpy synced(replica, &MemoryReplica::synced);
+
+	AsyncQuery query;
+	QVERIFY(query.startExecScript(
+		"INSERT INTO kv VALUES (300, 'kept'); INSERT INTO missing VALUES (1)"));
+	QVERIFY(query.waitDone());
+	QVERIFY(!query.result().isValid());
+
+	// whatever reached the file before the error also reaches the copy
+	QTRY_VERIFY(synced.count() > 0);
+	QCOMPARE(readReplica("SELECT COUNT(*) FROM kv WHERE id = 300"),
+			 readSource("SELECT COUNT(*) FROM kv WHERE id = 300"));
+}
+
+void tst_MemoryReplica::generatedKeys()
+{
+	if (!_replica)
+		QSKIP("requires CONFIG += asyncsql_sqlite");
+
+	MemoryReplica *replica = ConnectionManager::instance()->memoryReplica();
+	QSignalSpy synced(replica, &MemoryReplica::synced);
+
+	// AUTOINCREMENT keys are generated in the same order on the copy
+	execConcurrently("INSERT INTO seq (val) VALUES (:k)", 20);
+	QString sql = contents("seq", "val");
+	QCOMPARE(readReplica(sql).toString(), readSource(sql).toString());
+	QCOMPARE(readReplica("SELECT COUNT(*) FROM seq").toInt(), 20);
+	QTest::qWait(200);
+	QCOMPARE(synced.count(), 0);
+}
+
+void tst_MemoryReplica::commitOrder()
+{
+	if (!_replica)
+		QSKIP("requires CONFIG += asyncsql_sqlite");
+
+	MemoryReplica *replica = ConnectionManager::instance()->memoryReplica();
+	QSignalSpy synced(replica, &MemoryReplica::synced);
+
+	// the result depends on the order of the updates
+	execConcurrently("UPDATE counter SET n = (n * 3 + :k) % 1000003 WHERE id = 1", 20);
+	QString sql = contents("counter", "n");
+	QCOMPARE(readReplica(sql).toString(), readSource(sql).toString());
+	QTest::qWait(200);
+	QCOMPARE(synced.count(), 0);
+}
+
+void tst_MemoryReplica::upsert()
+{
+	if (!_replica)
+		QSKIP("requires CONFIG += asyncsql_sqlite");
+
+	execConcurrently("INSERT INTO kv VALUES (500, :k) "
+					 "ON CONFLICT(id) DO UPDATE SET val = val || '.' || excluded.val", 10);
+	QString sql = contents("kv", "val");
+	QTRY_COMPARE(readReplica(sql).toString(), readSource(sql).toString());
+}
+
+void tst_MemoryReplica::triggerReloads()
+{
+	if (!_replica)
+		QSKIP("requires CONFIG += asyncsql_sqlite");
+
+	MemoryReplica *replica = ConnectionManager::instance()->memoryReplica();
+	AsyncQuery query;
+	AsyncQueryResult result = TestDatabase::exec(query,
+		"CREATE TRIGGER kv_audit AFTER INSERT ON kv "
+		"BEGIN INSERT INTO audit (kv_id) VALUES (new.id); END");
+	QVERIFY2(result.isValid(), qPrintable(result.error().text()));
+	QThreadPool::globalInstance()->waitForDone();
+	QTest::qWait(200);
+
+	// the effects of a trigger are not compared, the copy is reloaded
+	QSignalSpy synced(replica, &MemoryReplica::synced);
+	result = TestDatabase::exec(query, "INSERT INTO kv VALUES (600, 'audited')");
+	QVERIFY2(result.isValid(), qPrintable(result.error().text()));
+	QTRY_VERIFY(synced.count() > 0);
+	QString sql = contents("audit", "kv_id");
+	QCOMPARE(readReplica(sql).toString(), readSource(sql).toString());
+	QCOMPARE(readReplica("SELECT COUNT(*) FROM audit WHERE kv_id = 600").toInt(), 1);
+
+	result = TestDatabase::exec(query, "DROP TRIGGER kv_audit");
+	QVERIFY2(result.isValid(), qPrintable(result.error().text()));
+}
+
+QTEST_GUILESS_MAIN(tst_MemoryReplica)
+
+#include "tst_memoryreplica.moc"
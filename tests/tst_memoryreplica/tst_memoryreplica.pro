@@ -0,0 +1,5 @@
+TARGET 	 = tst_memoryreplica
+
+include(../tests.pri)
+
+SOURCES += tst_memoryreplica.cpp
@@ -0,0 +1,208 @@
+#include <QtTest>
+
+#include "ParallelScan.h"
+#include "TestDatabase.h"
+
+using namespace Database;
+
+class tst_ParallelScan : public QObject
+{
+	Q_OBJECT
+
+private slots:
+	void initTestCase();
+	void cleanupTestCase();
+
+	void integerKey();
+	void boundValues();
+	void wideKeyRange();
+	void textKey();
+	void emptyRange();
+	void nullKeys();
+	void streaming();
+
+private:
+	static AsyncQueryResult scan(ParallelScan &scan);
+	static QVector<qint64> keys(const AsyncQueryResult &result);
+
+	QTemporaryDir _dir;
+};
+
+static const int rowCount = 1000;
+
+void tst_ParallelScan::initTestCase()
+{
+	QVERIFY(_dir.isValid());
+	QString error;
+	QVERIFY2(TestDatabase::setup(_dir, {
+		"CREATE TABLE item (id INTEGER PRIMARY KEY, code TEXT, price REAL)",
+		"WITH RECURSIVE n(i) AS (SELECT 1 UNION ALL SELECT i + 1 FROM n WHERE i < 1000) "
+			"INSERT INTO item SELECT i, printf('c%04d', i), i / 4.0 FROM n",
+		"CREATE TABLE wide (id INTEGER PRIMARY KEY)",
+		"INSERT INTO wide VALUES (-4611686018427387904)",
+		"INSERT INTO wide VALUES (-1)",
+		"INSERT INTO wide VALUES (0)",
+		"INSERT INTO wide VALUES (4611686018427387904)",
+		"INSERT INTO wide VALUES (9223372036854775807)",
+		"CREATE TABLE sparse (k INTEGER, v TEXT)",
+		"INSERT INTO sparse VALUES (3, 'c'), (NULL, 'x'), (1, 'a'), (NULL, 'y'), (2, 'b')",
+	}, &error), qPrintable(error));
+}
+
+void tst_ParallelScan::cleanupTestCase()
+{
+	ConnectionManager::destroyInstance();
+}
+
+AsyncQueryResult tst_ParallelScan::scan(ParallelScan &scan)
+{
+	// execDone() is emitted on a worker thread before waitDone() returns
+	AsyncQueryResult result;
+	connect(&scan, &ParallelScan::execDone, &scan, [&result](const AsyncQueryResult &res) {
+		result = res;
+	}, Qt::DirectConnection);
+	if (scan.startExec())
+		scan.waitDone();
+	return result;
+}
+
+QVector<qint64> tst_ParallelScan::keys(const AsyncQueryResult &result)
+{
+	QVector<qint64> keys;
+	for (int row = 0; row < result.count(); row++)
+		keys.append(result.value(row, 0).toLongLong());
+	return keys;
+}
+
+void tst_ParallelScan::integerKey()
+{
+	ParallelScan parallel;
+	parallel.setTable("item");
+	parallel.setKeyColumn("id");
+	parallel.setColumns("id, code");
+	parallel.setPartitions(4);
+	AsyncQueryResult result = scan(parallel);
+
+	QVERIFY2(result.isValid(), qPrintable(result.error().text()));
+	QCOMPARE(result.count(), rowCount);
+	QCOMPARE(result.numRowsAffected(), rowCount);
+	QVector<qint64> ids = keys(result);
+	for (int row = 0; row < rowCount; row++)
+		QCOMPARE(ids.at(row), qint64(row + 1));
+	QCOMPARE(result.value(41, "code").toString(), QString("c0042"));
+}
+
+void tst_ParallelScan::boundValues()
+{
+	ParallelScan parallel;
+	parallel.setTable("item");
+	parallel.setKeyColumn("id");
+	parallel.setColumns("id");
+	parallel.setWhere("price >= :min AND id % 2 = 0");
+	parallel.bindValue(":min", 100);
+	parallel.setPartitions(3);
+	AsyncQueryResult result = scan(parallel);
+
+	QVERIFY2(result.isValid(), qPrintable(result.error().text()));
+	QVector<qint64> expected;
+	for (qint64 id = 400; id <= rowCount; id += 2)
+		expected.append(id);
+	QCOMPARE(keys(result), expected);
+}
+
+void tst_ParallelScan::wideKeyRange()
+{
+	// MAX - MIN does not fit into a qint64
+	ParallelScan parallel;
+	parallel.setTable("wide");
+	parallel.setKeyColumn("id");
+	parallel.setColumns("id");
+	parallel.setPartitions(4);
+	AsyncQueryResult result = scan(parallel);
+
+	QVERIFY2(result.isValid(), qPrintable(result.error().text()));
+	QCOMPARE(keys(result), QVector<qint64>({ Q_INT64_C(-4611686018427387904), -1, 0,
+											 Q_INT64_C(4611686018427387904),
+											 Q_INT64_C(9223372036854775807) }));
+}
+
+void tst_ParallelScan::textKey()
+{
+	QTest::ignoreMessage(QtWarningMsg, "ParallelScan: key is not an integer, reading one partition");
+
+	ParallelScan parallel;
+	parallel.setTable("item");
+	parallel.setKeyColumn("code");
+	parallel.setColumns("code, id");
+	parallel.setPartitions(4);
+	AsyncQueryResult result = scan(parallel);
+
+	QVERIFY2(result.isValid(), qPrintable(result.error().text()));
+	QCOMPARE(result.count(), rowCount);
+	QCOMPARE(result.value(0, 0).toString(), QString("c0001"));
+	QCOMPARE(result.value(rowCount - 1, 0).toString(), QString("c1000"));
+}
+
+void tst_ParallelScan::emptyRange()
+{
+	ParallelScan parallel;
+	parallel.setTable("item");
+	parallel.setKeyColumn("id");
+	parallel.setWhere("id < 0");
+	parallel.setPartitions(4);
+	AsyncQueryResult result = scan(parallel);
+
+	QVERIFY2(result.isValid(), qPrintable(result.error().text()));
+	QCOMPARE(result.count(), 0);
+}
+
+void tst_ParallelScan::nullKeys()
+{
+	ParallelScan parallel;
+	parallel.setTable("sparse");
+	parallel.setKeyColumn("k");
+	parallel.setColumns("k, v");
+	parallel.setPartitions(3);
+	AsyncQueryResult result = scan(parallel);
+
+	// NULL keys are in no key range, they are read first
+	QVERIFY2(result.isValid(), qPrintable(result.error().text()));
+	QCOMPARE(result.count(), 5);
+	QVERIFY(result.value(0, 0).isNull());
+	QVERIFY(result.value(1, 0).isNull());
+	QCOMPARE(keys(result).mid(2), QVector<qint64>({ 1, 2, 3 }));
+	QCOMPARE(result.value(4, "v").toString(), QString("c"));
+}
+
+void tst_ParallelScan::streaming()
+{
+	ParallelScan parallel;
+	parallel.setTable("item");
+	parallel.setKeyColumn("id");
+	parallel.setColumns("id");
+	parallel.setPartitions(4);
+	parallel.setStreaming(true);
+
+	// partitionReady() is serialized and in key order
+	QVector<int> partitions;
+	QVector<qint64> ids;
+	connect(&parallel, &ParallelScan::partitionReady, &parallel,
+			[&partitions, &ids](int partition, const AsyncQueryResult &result) {
+		partitions.append(partition);
+		ids += keys(result);
+	}, Qt::DirectConnection);
+	AsyncQueryResult result = scan(parallel);
+
+	QVERIFY2(result.isValid(), qPrintable(result.error().text()));
+	QCOMPARE(result.count(), 0);
+	QCOMPARE(result.numRowsAffected(), rowCount);
+	// the first one holds the (here no) NULL keys
+	QCOMPARE(partitions, QVector<int>({ 0, 1, 2, 3, 4 }));
+	QCOMPARE(ids.size(), rowCount);
+	for (int row = 0; row < rowCount; row++)
+		QCOMPARE(ids.at(row), qint64(row + 1));
+}
+
+QTEST_GUILESS_MAIN(tst_ParallelScan)
+
+#include "tst_parallelscan.moc"
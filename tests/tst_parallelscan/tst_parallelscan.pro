@@ -0,0 +1,5 @@
+TARGET 	 = tst_parallelscan
+
+include(../tests.pri)
+
+SOURCES += tst_parallelscan.cpp
@@ -0,0 +1,162 @@
+#include <QtTest>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+
+#include "PoolMetrics.h"
+#include "TestDatabase.h"
+
+using namespace Database;
+
+class tst_PoolMetrics : public QObject
+{
+	Q_OBJECT
+
+private slots:
+	void initTestCase();
+	void cleanupTestCase();
+
+	void histogram();
+	void queueDepths();
+	void prometheus();
+	void json();
+	void queries();
+
+private:
+	QTemporaryDir _dir;
+};
+
+void tst_PoolMetrics::initTestCase()
+{
+	QVERIFY(_dir.isValid());
+	QString error;
+	QVERIFY2(TestDatabase::setup(_dir, {
+		"CREATE TABLE item (id INTEGER PRIMARY KEY)",
+	}, &error), qPrintable(error));
+}
+
+void tst_PoolMetrics::cleanupTestCase()
+{
+	ConnectionManager::destroyInstance();
+}
+
+void tst_PoolMetrics::histogram()
+{
+	PoolMetrics metrics(ConnectionManager::instance());
+	metrics.queryExecuted(0, 1, false, false);
+	metrics.queryExecuted(3, 1.5, true, false);
+	metrics.queryExecuted(20000, 20000, true, true);
+
+	PoolMetrics::Snapshot snap = metrics.snapshot();
+	QCOMPARE(snap.queriesExecuted, qint64(3));
+	QCOMPARE(snap.queryErrors, qint64(2));
+	QCOMPARE(snap.queryTimeouts, qint64(1));
+
+	// bounds are inclusive, the last bucket is +Inf
+	const PoolMetrics::Histogram &exec = snap.execMs;
+	QCOMPARE(exec.counts.size(), exec.bounds.size() + 1);
+	QCOMPARE(exec.counts.at(0), qint64(1));
+	QCOMPARE(exec.counts.at(1), qint64(1));
+	QCOMPARE(exec.counts.last(), qint64(1));
+	QCOMPARE(exec.count, qint64(3));
+	QCOMPARE(exec.sum, 20002.5);
+	QCOMPARE(snap.queueWaitMs.counts.at(0), qint64(1));
+	QCOMPARE(snap.queueWaitMs.counts.at(1), qint64(1));
+
+	metrics.queryDropped();
+	snap = metrics.snapshot();
+	QCOMPARE(snap.queryErrors, qint64(3));
+	QCOMPARE(snap.queryTimeouts, qint64(2));
+	QCOMPARE(snap.execMs.count, qint64(3));
+}
+
+void tst_PoolMetrics::queueDepths()
+{
+	PoolMetrics metrics(ConnectionManager::instance());
+	int a, b, c;
+	metrics.setQueueDepth(&a, "orders", 2);
+	metrics.setQueueDepth(&b, "orders", 3);
+	metrics.setQueueDepth(&c, QString(), 4);
+
+	// summed per name, unnamed queues only count in total
+	PoolMetrics::Snapshot snap = metrics.snapshot();
+	QCOMPARE(snap.queuedQueries, 9);
+	QCOMPARE(snap.queueDepths.size(), 1);
+	QCOMPARE(snap.queueDepths.value("orders"), 5);
+
+	metrics.setQueueDepth(&a, "orders", 0);
+	metrics.setQueueDepth(&c, QString(), 0);
+	snap = metrics.snapshot();
+	QCOMPARE(snap.queuedQueries, 3);
+	QCOMPARE(snap.queueDepths.value("orders"), 3);
+}
+
+void tst_PoolMetrics::prometheus()
+{
+	PoolMetrics metrics(ConnectionManager::instance());
+	metrics.taskStarted();
+	metrics.queryExecuted(0, 3, false, false);
+	metrics.queryExecuted(0, 7, false, false);
+	int a;
+	metrics.setQueueDepth(&a, "say \"hi\"", 1);
+
+	QString text = metrics.toPrometheus();
+	QVERIFY(text.contains("# TYPE asyncsql_tasks_started_total counter\n"
+						  "asyncsql_tasks_started_total 1\n"));
+	QVERIFY(text.contains("asyncsql_query_queue_depth{query=\"say \\\"hi\\\"\"} 1\n"));
+	// cumulative buckets
+	QVERIFY(text.contains("asyncsql_exec_ms_bucket{le=\"1\"} 0\n"));
+	QVERIFY(text.contains("asyncsql_exec_ms_bucket{le=\"5\"} 1\n"));
+	QVERIFY(text.contains("asyncsql_exec_ms_bucket{le=\"10\"} 2\n"));
+	QVERIFY(text.contains("asyncsql_exec_ms_bucket{le=\"+Inf\"} 2\n"));
+	QVERIFY(text.contains("asyncsql_exec_ms_sum 10.000\nasyncsql_exec_ms_count 2\n"));
+}
+
+void tst_PoolMetrics::json()
+{
+	PoolMetrics metrics(ConnectionManager::instance());
+	metrics.connectionOpened(true);
+	metrics.connectionOpened(false);
+	metrics.queueOverflow();
+	metrics.queryExecuted(2, 30000, false, false);
+	int a;
+	metrics.setQueueDepth(&a, "orders", 2);
+
+	QJsonObject obj = QJsonDocument::fromJson(metrics.toJson()).object();
+	QCOMPARE(obj.value("connectionsOpened").toInt(), 1);
+	QCOMPARE(obj.value("connectionFailures").toInt(), 1);
+	QCOMPARE(obj.value("queueOverflows").toInt(), 1);
+	QCOMPARE(obj.value("queuedQueries").toInt(), 2);
+	QCOMPARE(obj.value("queueDepths").toObject().value("orders").toInt(), 2);
+
+	QJsonArray buckets = obj.value("execMs").toObject().value("buckets").toArray();
+	QCOMPARE(buckets.last().toObject().value("le").toString(), QString("+Inf"));
+	QCOMPARE(buckets.last().toObject().value("count").toInt(), 1);
+	QCOMPARE(obj.value("execMs").toObject().value("count").toInt(), 1);
+}
+
+void tst_PoolMetrics::queries()
+{
+	PoolMetrics *metrics = ConnectionManager::instance()->metrics();
+	PoolMetrics::Snapshot before = metrics->snapshot();
+
+	AsyncQuery query;
+	AsyncQueryResult result = TestDatabase::exec(query, "SELECT id FROM item");
+	QVERIFY2(result.isValid(), qPrintable(result.error().text()));
+	result = TestDatabase::exec(query, "SELECT nothing FROM missing");
+	QVERIFY(!result.isValid());
+	QThreadPool::globalInstance()->waitForDone();
+
+	PoolMetrics::Snapshot after = metrics->snapshot();
+	QCOMPARE(after.queriesExecuted - before.queriesExecuted, qint64(2));
+	QCOMPARE(after.queryErrors - before.queryErrors, qint64(1));
+	QCOMPARE(after.execMs.count - before.execMs.count, qint64(2));
+	QVERIFY(after.tasksStarted - before.tasksStarted >= 2);
+	QVERIFY(after.connections >= 1);
+	QCOMPARE(after.tasksInFlight, 0);
+	QCOMPARE(after.queuedQueries, 0);
+}
+
+QTEST_GUILESS_MAIN(tst_PoolMetrics)
+
+#include "tst_poolmetrics.moc"
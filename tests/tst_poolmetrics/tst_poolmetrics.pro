@@ -0,0 +1,5 @@
+TARGET 	 = tst_poolmetrics
+
+include(../tests.pri)
+
+SOURCES += tst_poolmetrics.cpp
@@ -0,0 +1,214 @@
+#include <QtTest>
+
+#include "ResultCache.h"
+#include "TestDatabase.h"
+
+using namespace Database;
+
+class tst_ResultCache : public QObject
+{
+	Q_OBJECT
+
+private slots:
+	void initTestCase();
+	void cleanupTestCase();
+	void init();
+
+	void keys();
+	void storeAndLoad();
+	void disabled();
+	void staleWhileRevalidate();
+	void notCached();
+
+private:
+	/** Collects the delivered results, called on the calling and worker threads. */
+	struct Collector {
+		QMutex mutex;
+		QVector<AsyncQueryResult> results;
+
+		void connectTo(AsyncQuery *query)
+		{
+			QObject::connect(query, &AsyncQuery::execDone, query,
+							 [this](const AsyncQueryResult &result) {
+				QMutexLocker locker(&mutex);
+				results.append(result);
+			}, Qt::DirectConnection);
+		}
+
+		QVector<AsyncQueryResult> take()
+		{
+			QMutexLocker locker(&mutex);
+			QVector<AsyncQueryResult> taken = results;
+			results.clear();
+			return taken;
+		}
+	};
+
+	static void setName(int id, const QString &name);
+
+	QTemporaryDir _dir;
+};
+
+void tst_ResultCache::initTestCase()
+{
+	QVERIFY(_dir.isValid());
+	QString error;
+	QVERIFY2(TestDatabase::setup(_dir, {
+		"CREATE TABLE item (id INTEGER PRIMARY KEY, name TEXT)",
+		"INSERT INTO item VALUES (1, 'one')",
+		"INSERT INTO item VALUES (2, 'two')",
+	}, &error), qPrintable(error));
+}
+
+void tst_ResultCache::cleanupTestCase()
+{
+	ConnectionManager::destroyInstance();
+}
+
+void tst_ResultCache::init()
+{
+	ResultCache *cache = ConnectionManager::instance()->resultCache();
+	cache->setDirectory(_dir.filePath("cache"));
+	cache->setVersion(QString());
+	cache->clear();
+}
+
+void tst_ResultCache::setName(int id, const QString &name)
+{
+	QSqlQuery query(ConnectionManager::instance()->threadConnection());
+	query.prepare("UPDATE item SET name = :name WHERE id = :id");
+	query.bindValue(":name", name);
+	query.bindValue(":id", id);
+	QVERIFY2(query.exec(), qPrintable(query.lastError().text()));
+}
+
+void tst_ResultCache::keys()
+{
+	ResultCache *cache = ConnectionManager::instance()->resultCache();
+	QMap<QString, QVariant> bound;
+	bound[":id"] = 1;
+	QMap<QString, QVariant> other;
+	other[":id"] = 2;
+
+	QString key = cache->key("SELECT * FROM item WHERE id = :id", bound);
+	QCOMPARE(cache->key("SELECT * FROM item WHERE id = :id", bound), key);
+	QVERIFY(cache->key("SELECT * FROM item WHERE id = :id", other) != key);
+	QVERIFY(cache->key("SELECT * FROM item", bound) != key);
+	QVERIFY(cache->key("SELECT * FROM item WHERE id = :id", bound, "replica") != key);
+
+	cache->setVersion("2");
+	QVERIFY(cache->key("SELECT * FROM item WHERE id = :id", bound) != key);
+}
+
+void tst_ResultCache::storeAndLoad()
+{
+	AsyncQuery query;
+	AsyncQueryResult result = TestDatabase::exec(query, "SELECT id, name FROM item ORDER BY id");
+	QVERIFY2(result.isValid(), qPrintable(result.error().text()));
+	QVERIFY(!result.isCached());
+
+	ResultCache *cache = ConnectionManager::instance()->resultCache();
+	AsyncQueryResult loaded;
+	QVERIFY(!cache->load("snapshot", &loaded));
+	QVERIFY(cache->store("snapshot", result));
+	QVERIFY(cache->load("snapshot", &loaded));
+	QVERIFY(loaded.isCached());
+	QCOMPARE(loaded.count(), 2);
+	QCOMPARE(loaded.value(1, "name").toString(), QString("two"));
+
+	cache->clear();
+	QVERIFY(!cache->load("snapshot", &loaded));
+}
+
+void tst_ResultCache::disabled()
+{
+	ResultCache *cache = ConnectionManager::instance()->resultCache();
+	cache->setDirectory(QString());
+	QVERIFY(!cache->isEnabled());
+
+	AsyncQuery query;
+	AsyncQueryResult result = TestDatabase::exec(query, "SELECT id FROM item");
+	QVERIFY(!cache->store("snapshot", result));
+	AsyncQueryResult loaded;
+	QVERIFY(!cache->load("snapshot", &loaded));
+}
+
+void tst_ResultCache::staleWhileRevalidate()
+{
+	const QString sql = "SELECT name FROM item WHERE id = 1";
+
+	// cold: only the fresh result, which is stored
+	{
+		AsyncQuery query;
+		query.setPersistentCache(true);
+		Collector collector;
+		collector.connectTo(&query);
+		QVERIFY(query.startExec(sql));
+		QVERIFY(query.waitDone());
+		QVector<AsyncQueryResult> results = collector.take();
+		QCOMPARE(results.size(), 1);
+		QVERIFY(!results.at(0).isCached());
+		QCOMPARE(results.at(0).value(0, 0).toString(), QString("one"));
+	}
+
+	setName(1, "uno");
+
+	// warm: the snapshot is delivered before startExec() returns, then the fresh result
+	{
+		AsyncQuery query;
+		query.setPersistentCache(true);
+		query.setDelayMs(100);
+		Collector collector;
+		collector.connectTo(&query);
+		QVERIFY(query.startExec(sql));
+		{
+			QMutexLocker locker(&collector.mutex);
+			QCOMPARE(collector.results.size(), 1);
+		}
+		QVERIFY(query.waitDone());
+		QVector<AsyncQueryResult> results = collector.take();
+		QCOMPARE(results.size(), 2);
+		QVERIFY(results.at(0).isCached());
+		QCOMPARE(results.at(0).value(0, 0).toString(), QString("one"));
+		QVERIFY(!results.at(1).isCached());
+		QCOMPARE(results.at(1).value(0, 0).toString(), QString("uno"));
+	}
+
+	// the fresh result replaced the snapshot
+	{
+		AsyncQuery query;
+		query.setPersistentCache(true);
+		Collector collector;
+		collector.connectTo(&query);
+		QVERIFY(query.startExec(sql));
+		QVERIFY(query.waitDone());
+		QVector<AsyncQueryResult> results = collector.take();
+		QCOMPARE(results.size(), 2);
+		QCOMPARE(results.at(0).value(0, 0).toString(), QString("uno"));
+	}
+
+	setName(1, "one");
+}
+
+void tst_ResultCache::notCached()
+{
+	// scripts and batches always run against the database
+	for (int i = 0; i < 2; i++) {
+		AsyncQuery query;
+		query.setPersistentCache(true);
+		Collector collector;
+		collector.connectTo(&query);
+		QVERIFY(query.startExecScript("SELECT id FROM item; SELECT name FROM item"));
+		QVERIFY(query.waitDone());
+		QVector<AsyncQueryResult> results = collector.take();
+		QCOMPARE(results.size(), 1);
+		QVERIFY(!results.at(0).isCached());
+	}
+
+	QDir cacheDir(_dir.filePath("cache"));
+	QVERIFY(cacheDir.entryList(QDir::Files).isEmpty());
+}
+
+QTEST_GUILESS_MAIN(tst_ResultCache)
+
+#include "tst_resultcache.moc"
@@ -0,0 +1,5 @@
+TARGET 	 = tst_resultcache
+
+include(../tests.pri)
+
+SOURCES += tst_resultcache.cpp
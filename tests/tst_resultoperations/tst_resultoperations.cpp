@@ -0,0 +1,245 @@
+#include <QtTest>
+#include <cmath>
+
+#include "ResultOperations.h"
+#include "TestDatabase.h"
+
+using namespace Database;
+
+typedef ResultOperations Ops;
+
+class tst_ResultOperations : public QObject
+{
+	Q_OBJECT
+
+private slots:
+	void initTestCase();
+	void cleanupTestCase();
+
+	void sortLargeIntegers();
+	void sortMixedTypes();
+	void sortStable();
+	void groupByLargeIntegers();
+	void groupByMixedTypes();
+	void hashJoinMixedTypes();
+	void nanOrder();
+	void filterRows();
+	void run();
+
+private:
+	static AsyncQueryResult select(const QString &sql);
+	static QVector<int> positions(const AsyncQueryResult &result);
+
+	QTemporaryDir _dir;
+};
+
+static const qint64 big = Q_INT64_C(9007199254740993);	// 2^53 + 1, not exact as double
+
+void tst_ResultOperations::initTestCase()
+{
+	QVERIFY(_dir.isValid());
+	QString error;
+	QVERIFY2(TestDatabase::setup(_dir, {
+		// no type, SQLite keeps integer and real as given
+		"CREATE TABLE mixed (pos INTEGER, v)",
+		"INSERT INTO mixed VALUES (0, 3)",
+		"INSERT INTO mixed VALUES (1, 'a')",
+		"INSERT INTO mixed VALUES (2, 2.5)",
+		"INSERT INTO mixed VALUES (3, NULL)",
+		"INSERT INTO mixed VALUES (4, 9007199254740993)",
+		"INSERT INTO mixed VALUES (5, 3.0)",
+		"INSERT INTO mixed VALUES (6, 9007199254740992.0)",
+		"INSERT INTO mixed VALUES (7, 3.5)",
+		"CREATE TABLE big (pos INTEGER, v INTEGER)",
+		"INSERT INTO big VALUES (0, 9007199254740994)",
+		"INSERT INTO big VALUES (1, 9007199254740993)",
+		"INSERT INTO big VALUES (2, 9007199254740992)",
+		"INSERT INTO big VALUES (3, 9007199254740993)",
+		// SQLite stores no NaN, the sum of inf and -inf is one
+		"CREATE TABLE inf (pos INTEGER, g INTEGER, v)",
+		"INSERT INTO inf VALUES (0, 0, 9e999)",
+		"INSERT INTO inf VALUES (1, 1, 1.5)",
+		"INSERT INTO inf VALUES (2, 2, 9e999)",
+		"INSERT INTO inf VALUES (3, 0, -9e999)",
+		"INSERT INTO inf VALUES (4, 4, -9e999)",
+		"INSERT INTO inf VALUES (5, 5, 7)",
+		"INSERT INTO inf VALUES (6, 4, 9e999)",
+		"CREATE TABLE num (n INTEGER)",
+		"WITH RECURSIVE s(i) AS (SELECT 0 UNION ALL SELECT i + 1 FROM s WHERE i < 999) "
+			"INSERT INTO num SELECT i FROM s",
+	}, &error), qPrintable(error));
+
+	// split even the small results into chunks
+	Ops::setMinChunkRows(2);
+}
+
+void tst_ResultOperations::cleanupTestCase()
+{
+	Ops::setMinChunkRows(4096);
+	ConnectionManager::destroyInstance();
+}
+
+AsyncQueryResult tst_ResultOperations::select(const QString &sql)
+{
+	AsyncQuery query;
+	return TestDatabase::exec(query, sql);
+}
+
+QVector<int> tst_ResultOperations::positions(const AsyncQueryResult &result)
+{
+	QVector<int> values;
+	for (int row = 0; row < result.count(); row++)
+		values.append(result.value(row, 0).toInt());
+	return values;
+}
+
+void tst_ResultOperations::sortLargeIntegers()
+{
+	AsyncQueryResult result = select("SELECT pos, v FROM big ORDER BY pos");
+	QVERIFY2(result.isValid(), qPrintable(result.error().text()));
+
+	AsyncQueryResult sorted = Ops::sort(result, { { 1, Qt::AscendingOrder } });
+	QCOMPARE(positions(sorted), QVector<int>({ 2, 1, 3, 0 }));
+
+	sorted = Ops::sort(result, { { 1, Qt::DescendingOrder } });
+	QCOMPARE(positions(sorted), QVector<int>({ 0, 1, 3, 2 }));
+}
+
+void tst_ResultOperations::sortMixedTypes()
+{
+	AsyncQueryResult result = select("SELECT pos, v FROM mixed ORDER BY pos");
+	QVERIFY2(result.isValid(), qPrintable(result.error().text()));
+
+	// NULL < numbers, integer and real compared exactly < text
+	AsyncQueryResult sorted = Ops::sort(result, { { 1, Qt::AscendingOrder } });
+	QCOMPARE(positions(sorted), QVector<int>({ 3, 2, 0, 5, 7, 6, 4, 1 }));
+	QCOMPARE(sorted.value(6, 1).toLongLong(), big);
+}
+
+void tst_ResultOperations::sortStable()
+{
+	AsyncQueryResult result = select("SELECT n, n % 3 FROM num ORDER BY n");
+	QVERIFY2(result.isValid(), qPrintable(result.error().text()));
+
+	QVector<int> rows = Ops::sortRows(result, { { 1, Qt::DescendingOrder } });
+	QCOMPARE(rows.size(), result.count());
+	for (int i = 1; i < rows.size(); i++) {
+		int prev = rows[i - 1];
+		int cur = rows[i];
+		int prevKey = result.value(prev, 1).toInt();
+		int curKey = result.value(cur, 1).toInt();
+		QVERIFY(prevKey > curKey || (prevKey == curKey && prev < cur));
+	}
+}
+
+void tst_ResultOperations::groupByLargeIntegers()
+{
+	AsyncQueryResult result = select("SELECT pos, v FROM big ORDER BY pos");
+	QVERIFY2(result.isValid(), qPrintable(result.error().text()));
+
+	AsyncQueryResult grouped = Ops::groupBy(result, { 1 },
+		{ { 0, Ops::Count }, { 1, Ops::Sum } });
+	QCOMPARE(grouped.count(), 3);
+	QCOMPARE(grouped.value(0, 0).toLongLong(), big + 1);
+	QCOMPARE(grouped.value(1, 0).toLongLong(), big);
+	QCOMPARE(grouped.value(1, 1).toLongLong(), qint64(2));
+	QCOMPARE(grouped.value(1, 2).toLongLong(), 2 * big);
+	QCOMPARE(grouped.value(2, 0).toLongLong(), big - 1);
+}
+
+void tst_ResultOperations::groupByMixedTypes()
+{
+	AsyncQueryResult result = select("SELECT pos, v FROM mixed ORDER BY pos");
+	QVERIFY2(result.isValid(), qPrintable(result.error().text()));
+
+	// 3 and 3.0 are one group, 2^53 + 1 and 2^53 as real are not
+	AsyncQueryResult grouped = Ops::groupBy(result, { 1 }, { { 0, Ops::Count } });
+	QCOMPARE(grouped.count(), 7);
+	QCOMPARE(grouped.value(0, 0).toInt(), 3);
+	QCOMPARE(grouped.value(0, 1).toLongLong(), qint64(2));
+	for (int row = 1; row < grouped.count(); row++)
+		QCOMPARE(grouped.value(row, 1).toLongLong(), qint64(1));
+}
+
+void tst_ResultOperations::hashJoinMixedTypes()
+{
+	AsyncQueryResult left = select(
+		"SELECT pos, v FROM mixed WHERE pos IN (0, 1, 3, 4) ORDER BY pos");
+	AsyncQueryResult right = select("SELECT v, pos FROM mixed WHERE pos IN (1, 3, 5, 6)");
+	QVERIFY2(left.isValid(), qPrintable(left.error().text()));
+	QVERIFY2(right.isValid(), qPrintable(right.error().text()));
+
+	// 3 = 3.0 and 'a' = 'a', NULL never matches, 2^53 + 1 != 2^53
+	AsyncQueryResult joined = Ops::hashJoin(left, 1, right, 0);
+	QCOMPARE(joined.headRecord().count(), 4);
+	QCOMPARE(joined.count(), 2);
+	QCOMPARE(joined.value(0, 0).toInt(), 0);
+	QCOMPARE(joined.value(0, 3).toInt(), 5);
+	QCOMPARE(joined.value(1, 0).toInt(), 1);
+	QCOMPARE(joined.value(1, 3).toInt(), 1);
+}
+
+void tst_ResultOperations::nanOrder()
+{
+	AsyncQueryResult result = select("SELECT pos, g, v FROM inf ORDER BY pos");
+	QVERIFY2(result.isValid(), qPrintable(result.error().text()));
+
+	// groups 0, 1, 2, 4, 5 with the sums NaN, 1.5, inf, NaN, 7
+	AsyncQueryResult sums = Ops::groupBy(result, { 1 }, { { 2, Ops::Sum } });
+	QCOMPARE(sums.count(), 5);
+	QVERIFY(std::isnan(sums.value(0, 1).toDouble()));
+	QVERIFY(std::isnan(sums.value(3, 1).toDouble()));
+
+	// NaN after all numbers, equal NaNs keep their order
+	AsyncQueryResult sorted = Ops::sort(sums, { { 1, Qt::AscendingOrder } });
+	QCOMPARE(positions(sorted), QVector<int>({ 1, 5, 2, 0, 4 }));
+	sorted = Ops::sort(sums, { { 1, Qt::DescendingOrder } });
+	QCOMPARE(positions(sorted), QVector<int>({ 0, 4, 2, 5, 1 }));
+
+	// and are one group
+	AsyncQueryResult grouped = Ops::groupBy(sums, { 1 }, { { 0, Ops::Count } });
+	QCOMPARE(grouped.count(), 4);
+	QVERIFY(std::isnan(grouped.value(0, 0).toDouble()));
+	QCOMPARE(grouped.value(0, 1).toLongLong(), qint64(2));
+}
+
+void tst_ResultOperations::filterRows()
+{
+	AsyncQueryResult result = select("SELECT n FROM num ORDER BY n");
+	QVERIFY2(result.isValid(), qPrintable(result.error().text()));
+
+	QVector<int> rows = Ops::filterRows(result, [](const QVector<QVariant> &row) {
+		return row.value(0).toInt() % 7 == 0;
+	});
+	QCOMPARE(rows.size(), 143);
+	for (int i = 0; i < rows.size(); i++)
+		QCOMPARE(result.value(rows[i], 0).toInt(), i * 7);
+
+	AsyncQueryResult filtered = Ops::select(result, rows);
+	QCOMPARE(filtered.count(), 143);
+	QCOMPARE(filtered.value(142, 0).toInt(), 994);
+}
+
+void tst_ResultOperations::run()
+{
+	AsyncQueryResult result = select("SELECT n FROM num ORDER BY n");
+	QVERIFY2(result.isValid(), qPrintable(result.error().text()));
+
+	QThread *handlerThread = nullptr;
+	int count = -1;
+	Ops::run([result]() {
+		return Ops::filter(result, [](const QVector<QVariant> &row) {
+			return row.value(0).toInt() < 10;
+		});
+	}, this, [&handlerThread, &count](const AsyncQueryResult &res) {
+		handlerThread = QThread::currentThread();
+		count = res.count();
+	});
+
+	QTRY_COMPARE(count, 10);
+	QCOMPARE(handlerThread, thread());
+}
+
+QTEST_GUILESS_MAIN(tst_ResultOperations)
+
+#include "tst_resultoperations.moc"
@@ -0,0 +1,5 @@
+TARGET 	 = tst_resultoperations
+
+include(../tests.pri)
+
+SOURCES += tst_resultoperations.cpp
@@ -0,0 +1,176 @@
+#include <QtTest>
+
+#include "ShardedQuery.h"
+#include "TestDatabase.h"
+
+using namespace Database;
+
+class tst_ShardedQuery : public QObject
+{
+	Q_OBJECT
+
+private slots:
+	void initTestCase();
+	void cleanupTestCase();
+	void init();
+
+	void concat();
+	void sorted();
+	void aggregate();
+	void boundValues();
+	void failedShard();
+
+private:
+	static AsyncQueryResult exec(ShardedQuery &query, const QString &sql,
+								 const QMap<QString, QVariant> &boundValues = {});
+	static QVector<int> column(const AsyncQueryResult &result, int col);
+
+	QTemporaryDir _dir;
+	QStringList _profiles;
+};
+
+void tst_ShardedQuery::initTestCase()
+{
+	QVERIFY(_dir.isValid());
+	QString error;
+	QVERIFY2(TestDatabase::setup(_dir, {}, &error), qPrintable(error));
+
+	// shard s<i> holds the ids i, i + 3, i + 6, ... below 30
+	ConnectionManager *conmgr = ConnectionManager::instance();
+	for (int shard = 0; shard < 3; shard++) {
+		QString profile = QString("s%1").arg(shard);
+		conmgr->addProfile(profile, ConnectionProfile::sqlite(
+			_dir.filePath(profile + ".sl3"), ConnectionProfile::Sqlite_WriteHeavy));
+		QVERIFY(conmgr->open(profile));
+		QSqlQuery query(conmgr->threadConnection(profile));
+		QVERIFY(query.exec("CREATE TABLE sale (id INTEGER PRIMARY KEY, country TEXT, amount INTEGER)"));
+		for (int id = shard; id < 30; id += 3) {
+			query.prepare("INSERT INTO sale VALUES (:id, :country, :amount)");
+			query.bindValue(":id", id);
+			query.bindValue(":country", id % 2 ? "DE" : "FR");
+			query.bindValue(":amount", id * 10);
+			QVERIFY2(query.exec(), qPrintable(query.lastError().text()));
+		}
+		_profiles << profile;
+	}
+	conmgr->addProfile("broken", ConnectionProfile::sqlite(
+		_dir.filePath("broken.sl3"), ConnectionProfile::Sqlite_WriteHeavy));
+}
+
+void tst_ShardedQuery::cleanupTestCase()
+{
+	ConnectionManager::destroyInstance();
+}
+
+void tst_ShardedQuery::init()
+{
+	QThreadPool::globalInstance()->waitForDone();
+}
+
+AsyncQueryResult tst_ShardedQuery::exec(ShardedQuery &query, const QString &sql,
+										const QMap<QString, QVariant> &boundValues)
+{
+	// execDone() is emitted on a worker thread before waitDone() returns
+	AsyncQueryResult result;
+	connect(&query, &ShardedQuery::execDone, &query, [&result](const AsyncQueryResult &res) {
+		result = res;
+	}, Qt::DirectConnection);
+	if (query.startExec(sql, boundValues))
+		query.waitDone();
+	return result;
+}
+
+QVector<int> tst_ShardedQuery::column(const AsyncQueryResult &result, int col)
+{
+	QVector<int> values;
+	for (int row = 0; row < result.count(); row++)
+		values.append(result.value(row, col).toInt());
+	return values;
+}
+
+void tst_ShardedQuery::concat()
+{
+	ShardedQuery query;
+	query.setProfiles(_profiles);
+	AsyncQueryResult result = exec(query, "SELECT id FROM sale WHERE id < 6 ORDER BY id");
+
+	// shard by shard in profile order
+	QVERIFY2(result.isValid(), qPrintable(result.error().text()));
+	QCOMPARE(column(result, 0), QVector<int>({ 0, 3, 1, 4, 2, 5 }));
+	QCOMPARE(result.resultSets().size(), 3);
+	QCOMPARE(result.resultSets().at(1).count(), 2);
+}
+
+void tst_ShardedQuery::sorted()
+{
+	ShardedQuery query;
+	query.setProfiles(_profiles);
+	query.setMergeMode(ShardedQuery::Merge_Sorted);
+	query.setSortColumn(0, Qt::DescendingOrder);
+	AsyncQueryResult result = exec(query, "SELECT id FROM sale ORDER BY id DESC");
+
+	QVERIFY2(result.isValid(), qPrintable(result.error().text()));
+	QCOMPARE(result.count(), 30);
+	for (int row = 0; row < 30; row++)
+		QCOMPARE(result.value(row, 0).toInt(), 29 - row);
+}
+
+void tst_ShardedQuery::aggregate()
+{
+	ShardedQuery query;
+	query.setProfiles(_profiles);
+	query.setMergeMode(ShardedQuery::Merge_Aggregate);
+	query.setAggregate(1, ShardedQuery::Aggregate_Sum);
+	query.setAggregate(2, ShardedQuery::Aggregate_Max);
+	query.setAggregate(3, ShardedQuery::Aggregate_Min);
+	AsyncQueryResult result = exec(query, "SELECT country, COUNT(*), MAX(amount), MIN(amount) "
+										  "FROM sale GROUP BY country ORDER BY country");
+
+	// one row per country over all shards, in order of first appearance
+	QVERIFY2(result.isValid(), qPrintable(result.error().text()));
+	QCOMPARE(result.count(), 2);
+	QCOMPARE(result.value(0, 0).toString(), QString("DE"));
+	QCOMPARE(result.value(0, 1).toInt(), 15);
+	QCOMPARE(result.value(0, 2).toInt(), 290);
+	QCOMPARE(result.value(0, 3).toInt(), 10);
+	QCOMPARE(result.value(1, 0).toString(), QString("FR"));
+	QCOMPARE(result.value(1, 1).toInt(), 15);
+	QCOMPARE(result.value(1, 2).toInt(), 280);
+	QCOMPARE(result.value(1, 3).toInt(), 0);
+}
+
+void tst_ShardedQuery::boundValues()
+{
+	ShardedQuery query;
+	query.setProfiles(_profiles);
+	QMap<QString, QVariant> bound;
+	bound[":min"] = 27;
+	AsyncQueryResult result = exec(query, "SELECT id FROM sale WHERE id >= :min", bound);
+	QVERIFY2(result.isValid(), qPrintable(result.error().text()));
+	QCOMPARE(column(result, 0), QVector<int>({ 27, 28, 29 }));
+
+	// the previous values are not bound again
+	result = exec(query, "SELECT COUNT(*) FROM sale");
+	QVERIFY2(result.isValid(), qPrintable(result.error().text()));
+	QCOMPARE(column(result, 0), QVector<int>({ 10, 10, 10 }));
+}
+
+void tst_ShardedQuery::failedShard()
+{
+	QTest::ignoreMessage(QtWarningMsg, QRegularExpression("^ShardedQuery: shard 1 failed"));
+
+	ShardedQuery query;
+	query.setProfiles(QStringList() << "s0" << "broken" << "s2");
+	AsyncQueryResult result = exec(query, "SELECT id FROM sale");
+
+	// the error of the shard, no rows
+	QVERIFY(!result.isValid());
+	QCOMPARE(result.count(), 0);
+	QCOMPARE(result.resultSets().size(), 3);
+	QVERIFY(result.resultSets().at(0).isValid());
+	QVERIFY(!result.resultSets().at(1).isValid());
+}
+
+QTEST_GUILESS_MAIN(tst_ShardedQuery)
+
+#include "tst_shardedquery.moc"
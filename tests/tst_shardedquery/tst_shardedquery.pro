@@ -0,0 +1,5 @@
+TARGET 	 = tst_shardedquery
+
+include(../tests.pri)
+
+SOURCES += tst_shardedquery.cpp
@@ -0,0 +1,166 @@
+#include <QtTest>
+#include <QJsonDocument>
+#include <QJsonObject>
+
+#include "SlowQueryLog.h"
+#include "TestDatabase.h"
+
+using namespace Database;
+
+class tst_SlowQueryLog : public QObject
+{
+	Q_OBJECT
+
+private slots:
+	void initTestCase();
+	void cleanupTestCase();
+	void init();
+
+	void disabledByDefault();
+	void slowQuery();
+	void belowThreshold();
+	void ringBuffer();
+	void file();
+
+private:
+	static SlowQueryLog::Entry entry(const QString &query);
+
+	QTemporaryDir _dir;
+	SlowQueryLog *_log = nullptr;
+};
+
+// counting to this many takes well over a millisecond
+static const char *slowSql = "WITH RECURSIVE s(i) AS (SELECT 1 UNION ALL SELECT i + 1 FROM s "
+							 "WHERE i < :n) SELECT COUNT(*) FROM s";
+
+void tst_SlowQueryLog::initTestCase()
+{
+	QVERIFY(_dir.isValid());
+	QString error;
+	QVERIFY2(TestDatabase::setup(_dir, {}, &error), qPrintable(error));
+	_log = ConnectionManager::instance()->slowQueryLog();
+}
+
+void tst_SlowQueryLog::cleanupTestCase()
+{
+	ConnectionManager::destroyInstance();
+}
+
+void tst_SlowQueryLog::init()
+{
+	_log->setThresholdMs(0);
+	_log->setCapacity(100);
+	_log->setFileName(QString());
+	_log->setCapturePlan(true);
+	_log->clear();
+}
+
+SlowQueryLog::Entry tst_SlowQueryLog::entry(const QString &query)
+{
+	SlowQueryLog::Entry entry;
+	entry.timestamp = QDateTime::currentDateTime();
+	entry.query = query;
+	entry.execMs = 10;
+	return entry;
+}
+
+void tst_SlowQueryLog::disabledByDefault()
+{
+	SlowQueryLog log;
+	QVERIFY(!log.isEnabled());
+	QCOMPARE(log.capacity(), 100);
+	QVERIFY(log.capturePlan());
+
+	AsyncQuery query;
+	query.prepare(slowSql);
+	query.bindValue(":n", 1000000);
+	QVERIFY(query.startExec());
+	query.waitDone();
+	QVERIFY2(query.result().isValid(), qPrintable(query.result().error().text()));
+	QVERIFY(_log->entries().isEmpty());
+}
+
+void tst_SlowQueryLog::slowQuery()
+{
+	_log->setThresholdMs(1);
+	QVERIFY(_log->isEnabled());
+
+	AsyncQuery query;
+	query.prepare(slowSql);
+	query.bindValue(":n", 1000000);
+	QVERIFY(query.startExec());
+	query.waitDone();
+	QVERIFY2(query.result().isValid(), qPrintable(query.result().error().text()));
+
+	QVector<SlowQueryLog::Entry> entries = _log->entries();
+	QCOMPARE(entries.size(), 1);
+	const SlowQueryLog::Entry &slow = entries.first();
+	QCOMPARE(slow.query, QString(slowSql));
+	QCOMPARE(slow.boundValues.value(":n").toInt(), 1000000);
+	QVERIFY(slow.execMs >= 1);
+	QCOMPARE(slow.rows, 1);
+	QVERIFY(!slow.connection.isEmpty());
+	QVERIFY(slow.error.isEmpty());
+	// EXPLAIN QUERY PLAN of the prepared statement
+	QVERIFY2(slow.plan.contains("SCAN"), qPrintable(slow.plan));
+}
+
+void tst_SlowQueryLog::belowThreshold()
+{
+	_log->setThresholdMs(1000000);
+
+	AsyncQuery query;
+	AsyncQueryResult result = TestDatabase::exec(query, "SELECT 1");
+	QVERIFY2(result.isValid(), qPrintable(result.error().text()));
+	QVERIFY(_log->entries().isEmpty());
+}
+
+void tst_SlowQueryLog::ringBuffer()
+{
+	_log->setCapacity(3);
+	for (int i = 0; i < 5; i++)
+		_log->record(entry(QString::number(i)));
+
+	// the newest entries, oldest first
+	QVector<SlowQueryLog::Entry> entries = _log->entries();
+	QCOMPARE(entries.size(), 3);
+	QCOMPARE(entries.at(0).query, QString("2"));
+	QCOMPARE(entries.at(2).query, QString("4"));
+
+	// shrinking keeps the newest
+	_log->setCapacity(2);
+	entries = _log->entries();
+	QCOMPARE(entries.size(), 2);
+	QCOMPARE(entries.at(0).query, QString("3"));
+	QCOMPARE(entries.at(1).query, QString("4"));
+
+	_log->clear();
+	QVERIFY(_log->entries().isEmpty());
+}
+
+void tst_SlowQueryLog::file()
+{
+	QString fileName = _dir.filePath("slow.jsonl");
+	_log->setFileName(fileName);
+	SlowQueryLog::Entry first = entry("SELECT :a");
+	first.boundValues[":a"] = 7;
+	_log->record(first);
+	_log->record(entry("SELECT 2"));
+
+	QFile file(fileName);
+	QVERIFY(file.open(QIODevice::ReadOnly));
+	QList<QByteArray> lines = file.readAll().split('\n');
+	QCOMPARE(lines.size(), 3);
+	QVERIFY(lines.last().isEmpty());
+
+	QJsonObject obj = QJsonDocument::fromJson(lines.at(0)).object();
+	QCOMPARE(obj.value("query").toString(), QString("SELECT :a"));
+	QCOMPARE(obj.value("boundValues").toObject().value(":a").toInt(), 7);
+	QCOMPARE(obj.value("execMs").toInt(), 10);
+	QCOMPARE(QJsonDocument::fromJson(lines.at(1)).object().value("query").toString(),
+			 QString("SELECT 2"));
+}
+
+QTEST_GUILESS_MAIN(tst_SlowQueryLog)
+
+#include "tst_slowquerylog.moc"
@@ -0,0 +1,5 @@
+TARGET 	 = tst_slowquerylog
+
+include(../tests.pri)
+
+SOURCES += tst_slowquerylog.cpp
@@ -0,0 +1,177 @@
+#include <QtTest>
+#include <QBuffer>
+
+#include "StatementStats.h"
+#include "TestDatabase.h"
+
+using namespace Database;
+
+class tst_StatementStats : public QObject
+{
+	Q_OBJECT
+
+private slots:
+	void initTestCase();
+	void cleanupTestCase();
+	void init();
+
+	void fingerprint();
+	void aggregates();
+	void maxStatements();
+	void disabled();
+	void selectRows();
+	void affectedRows();
+	void failedStatement();
+	void exportRows();
+
+private:
+	static StatementStats::Statement find(const QString &sql);
+
+	QTemporaryDir _dir;
+};
+
+void tst_StatementStats::initTestCase()
+{
+	QVERIFY(_dir.isValid());
+	QString error;
+	QVERIFY2(TestDatabase::setup(_dir, {
+		"CREATE TABLE item (id INTEGER PRIMARY KEY, name TEXT)",
+		"INSERT INTO item VALUES (1, 'one')",
+		"INSERT INTO item VALUES (2, 'two')",
+		"INSERT INTO item VALUES (3, 'three')",
+	}, &error), qPrintable(error));
+}
+
+void tst_StatementStats::cleanupTestCase()
+{
+	ConnectionManager::destroyInstance();
+}
+
+void tst_StatementStats::init()
+{
+	StatementStats *stats = ConnectionManager::instance()->statementStats();
+	stats->reset();
+	stats->setEnabled(true);
+}
+
+StatementStats::Statement tst_StatementStats::find(const QString &sql)
+{
+	QString fingerprint = StatementStats::fingerprint(sql);
+	for (const auto &statement : ConnectionManager::instance()->statementStats()->snapshot()) {
+		if (statement.fingerprint == fingerprint)
+			return statement;
+	}
+	return StatementStats::Statement();
+}
+
+void tst_StatementStats::fingerprint()
+{
+	QCOMPARE(StatementStats::fingerprint("SELECT * FROM item WHERE id = 1 AND name = 'a'"),
+			 StatementStats::fingerprint("SELECT *  FROM item\n WHERE id = 42 AND name = 'it''s'"));
+	QCOMPARE(StatementStats::fingerprint("SELECT id FROM item -- comment\nWHERE id = 1"),
+			 StatementStats::fingerprint("SELECT id FROM item /* other */ WHERE id = 2"));
+	QCOMPARE(StatementStats::fingerprint("INSERT INTO item VALUES (1, 'a')"),
+			 StatementStats::fingerprint("INSERT INTO item VALUES (2, 'b', 3)"));
+	QVERIFY(StatementStats::fingerprint("SELECT id FROM item")
+			!= StatementStats::fingerprint("SELECT name FROM item"));
+
+	// exponents and hex numbers are one literal
+	QCOMPARE(StatementStats::fingerprint("SELECT 1e-5, 2.5E+10, 0x1F - 1"),
+			 QString("SELECT ?, ?, ? - ?"));
+	QCOMPARE(StatementStats::fingerprint("SELECT id-1 FROM item"),
+			 QString("SELECT id-? FROM item"));
+}
+
+void tst_StatementStats::aggregates()
+{
+	StatementStats *stats = ConnectionManager::instance()->statementStats();
+	stats->record("SELECT id FROM item WHERE id = 1", 10, 1, false);
+	stats->record("SELECT id FROM item WHERE id = 2", 30, 0, false);
+	stats->record("SELECT id FROM item WHERE id = 'x'", 20, -1, true);
+
+	StatementStats::Statement statement = find("SELECT id FROM item WHERE id = 3");
+	QCOMPARE(statement.calls, qint64(3));
+	QCOMPARE(statement.errors, qint64(1));
+	QCOMPARE(statement.rows, qint64(1));
+	QCOMPARE(statement.totalMs, 60.0);
+	QCOMPARE(statement.meanMs, 20.0);
+	QCOMPARE(statement.maxMs, 30.0);
+	QCOMPARE(statement.example, QString("SELECT id FROM item WHERE id = 1"));
+}
+
+void tst_StatementStats::maxStatements()
+{
+	StatementStats *stats = ConnectionManager::instance()->statementStats();
+	stats->setMaxStatements(3);
+	for (int i = 0; i < 10; i++)
+		stats->record(QString("SELECT id FROM item%1").arg(i), 1, 0, false);
+	stats->setMaxStatements(1000);
+
+	// three fingerprints and one entry for the rest
+	QVector<StatementStats::Statement> statements = stats->snapshot(StatementStats::Sort_Calls);
+	QCOMPARE(statements.size(), 4);
+	QCOMPARE(statements.first().fingerprint, QString("(other statements)"));
+	QCOMPARE(statements.first().calls, qint64(7));
+}
+
+void tst_StatementStats::disabled()
+{
+	StatementStats *stats = ConnectionManager::instance()->statementStats();
+	stats->setEnabled(false);
+	stats->record("SELECT 1", 1, 1, false);
+	QVERIFY(stats->snapshot().isEmpty());
+}
+
+void tst_StatementStats::selectRows()
+{
+	AsyncQuery query;
+	AsyncQueryResult result = TestDatabase::exec(query, "SELECT id, name FROM item");
+	QVERIFY2(result.isValid(), qPrintable(result.error().text()));
+
+	StatementStats::Statement statement = find("SELECT id, name FROM item");
+	QCOMPARE(statement.calls, qint64(1));
+	QCOMPARE(statement.rows, qint64(3));
+	QCOMPARE(statement.errors, qint64(0));
+}
+
+void tst_StatementStats::affectedRows()
+{
+	AsyncQuery query;
+	AsyncQueryResult result = TestDatabase::exec(query,
+		"UPDATE item SET name = name WHERE id <= 2");
+	QVERIFY2(result.isValid(), qPrintable(result.error().text()));
+
+	QCOMPARE(find("UPDATE item SET name = name WHERE id <= 2").rows, qint64(2));
+}
+
+void tst_StatementStats::failedStatement()
+{
+	AsyncQuery query;
+	AsyncQueryResult result = TestDatabase::exec(query, "SELECT nothing FROM missing");
+	QVERIFY(!result.isValid());
+
+	StatementStats::Statement statement = find("SELECT nothing FROM missing");
+	QCOMPARE(statement.calls, qint64(1));
+	QCOMPARE(statement.errors, qint64(1));
+	QCOMPARE(statement.rows, qint64(0));
+}
+
+void tst_StatementStats::exportRows()
+{
+	QBuffer buffer;
+	QVERIFY(buffer.open(QIODevice::WriteOnly));
+
+	AsyncQuery query;
+	query.prepare("SELECT id, name FROM item");
+	QVERIFY(query.startExport(&buffer, AsyncQuery::Export_Csv));
+	QVERIFY(query.waitDone());
+	QVERIFY2(query.result().isValid(), qPrintable(query.result().error().text()));
+	// the result holds no rows, the statistics count the streamed ones
+	QCOMPARE(query.result().count(), 0);
+
+	QCOMPARE(find("SELECT id, name FROM item").rows, qint64(3));
+}
+
+QTEST_GUILESS_MAIN(tst_StatementStats)
+
+#include "tst_statementstats.moc"
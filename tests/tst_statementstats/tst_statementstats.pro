@@ -0,0 +1,5 @@
+TARGET 	 = tst_statementstats
+
+include(../tests.pri)
+
+SOURCES += tst_statementstats.cpp
@@ -0,0 +1,144 @@
+#include <QtTest>
+
+#include "AsyncPipeline.h"
+#include "TestDatabase.h"
+
+using namespace Database;
+
+class tst_TableNotifications : public QObject
+{
+	Q_OBJECT
+
+private slots:
+	void initTestCase();
+	void cleanupTestCase();
+	void init();
+	void cleanup();
+
+	void autocommit();
+	void transaction();
+	void rollback();
+	void notSubscribed();
+	void ownThread();
+
+private:
+	/** Collects tablesChanged(), emitted on the worker threads. */
+	struct Collector {
+		QMutex mutex;
+		QVector<QStringList> changes;
+
+		QVector<QStringList> take()
+		{
+			QMutexLocker locker(&mutex);
+			QVector<QStringList> taken = changes;
+			changes.clear();
+			return taken;
+		}
+	};
+
+	static void runPipeline(const QStringList &statements);
+
+	QTemporaryDir _dir;
+	Collector _collector;
+};
+
+void tst_TableNotifications::initTestCase()
+{
+#ifndef ASYNCSQL_SQLITE_API
+	QSKIP("requires CONFIG += asyncsql_sqlite");
+#endif
+	QVERIFY(_dir.isValid());
+	QString error;
+	QVERIFY2(TestDatabase::setup(_dir, {
+		"CREATE TABLE item (id INTEGER PRIMARY KEY, name TEXT)",
+		"CREATE TABLE log (text TEXT)",
+	}, &error), qPrintable(error));
+
+	Collector *collector = &_collector;
+	connect(ConnectionManager::instance(), &ConnectionManager::tablesChanged, this,
+			[collector](const QStringList &tables) {
+		QMutexLocker locker(&collector->mutex);
+		QStringList sorted = tables;
+		sorted.sort();
+		collector->changes.append(sorted);
+	}, Qt::DirectConnection);
+}
+
+void tst_TableNotifications::cleanupTestCase()
+{
+	ConnectionManager::destroyInstance();
+}
+
+void tst_TableNotifications::init()
+{
+	ConnectionManager::instance()->subscribeTables({ "item" });
+}
+
+void tst_TableNotifications::cleanup()
+{
+	ConnectionManager::instance()->unsubscribeTables({ "item" });
+	QThreadPool::globalInstance()->waitForDone();
+	_collector.take();
+}
+
+void tst_TableNotifications::runPipeline(const QStringList &statements)
+{
+	AsyncPipeline pipeline;
+	pipeline.setTransaction(true);
+	for (const QString &statement : statements)
+		pipeline.addQuery(statement);
+	pipeline.start();
+	pipeline.waitDone();
+	QThreadPool::globalInstance()->waitForDone();
+}
+
+void tst_TableNotifications::autocommit()
+{
+	AsyncQuery query;
+	AsyncQueryResult result = TestDatabase::exec(query, "INSERT INTO item (name) VALUES ('a')");
+	QVERIFY2(result.isValid(), qPrintable(result.error().text()));
+	QThreadPool::globalInstance()->waitForDone();
+
+	QCOMPARE(_collector.take(), QVector<QStringList>() << QStringList({ "item" }));
+}
+
+void tst_TableNotifications::transaction()
+{
+	// one notification per task, with every table of the transaction
+	runPipeline({ "INSERT INTO item (name) VALUES ('a')",
+				  "INSERT INTO item (name) VALUES ('b')",
+				  "INSERT INTO log VALUES ('added')" });
+
+	QCOMPARE(_collector.take(), QVector<QStringList>() << QStringList({ "item", "log" }));
+}
+
+void tst_TableNotifications::rollback()
+{
+	runPipeline({ "INSERT INTO item (name) VALUES ('a')",
+				  "INSERT INTO missing VALUES (1)" });
+
+	QVERIFY(_collector.take().isEmpty());
+}
+
+void tst_TableNotifications::notSubscribed()
+{
+	ConnectionManager::instance()->unsubscribeTables({ "item" });
+	runPipeline({ "INSERT INTO item (name) VALUES ('a')" });
+	QVERIFY(_collector.take().isEmpty());
+	ConnectionManager::instance()->subscribeTables({ "item" });
+}
+
+void tst_TableNotifications::ownThread()
+{
+	// commits on an own thread are reported on request
+	QSqlQuery query(ConnectionManager::instance()->threadConnection());
+	QVERIFY(query.exec("INSERT INTO log VALUES ('direct')"));
+	QVERIFY(_collector.take().isEmpty());
+
+	ConnectionManager::instance()->sendTableNotifications();
+	QCOMPARE(_collector.take(), QVector<QStringList>() << QStringList({ "log" }));
+}
+
+QTEST_GUILESS_MAIN(tst_TableNotifications)
+
+#include "tst_tablenotifications.moc"
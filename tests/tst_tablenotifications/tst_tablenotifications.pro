@@ -0,0 +1,5 @@
+TARGET 	 = tst_tablenotifications
+
+include(../tests.pri)
+
+SOURCES += tst_tablenotifications.cpp